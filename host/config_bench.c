@@ -0,0 +1,269 @@
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <malloc.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+#include "io_config.h"
+#ifdef CONFIG_BENCH_CJSON
+#include "cJSON.h"
+#endif
+
+
+// IO configuration parser on the host: time and heap of building io_config_t from JSON documents
+// the streaming parser is fed the whole document and in chunks as received by the configuration server
+// with CONFIG_BENCH_CJSON (default), cJSON_Parse() of the same documents is measured as baseline: the former parser
+// built a cJSON DOM of the whole document before extracting the configuration from it
+// heap is counted in usable bytes of malloc, calloc and realloc; log output of the parser goes to /dev/null while timing
+#define BENCH_REPEAT 7
+#define BENCH_BATCH_NS 20000000
+#define BENCH_CHUNK 64
+
+// heap accounting; glibc allocator underneath
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* ptr, size_t size);
+extern void __libc_free(void* ptr);
+
+static int64_t heap_used;
+static int64_t heap_peak;
+static uint32_t heap_allocs;
+
+static inline void heap_count(void* ptr)
+{
+    if(!ptr) { return; }
+    heap_used += malloc_usable_size(ptr);
+    heap_allocs++;
+    if(heap_used > heap_peak) { heap_peak = heap_used; }
+}
+
+void* malloc(size_t size)
+{
+    void* ptr = __libc_malloc(size);
+    heap_count(ptr);
+    return ptr;
+}
+
+void* calloc(size_t count, size_t size)
+{
+    void* ptr = __libc_calloc(count, size);
+    heap_count(ptr);
+    return ptr;
+}
+
+void* realloc(void* ptr, size_t size)
+{
+    if(ptr) { heap_used -= malloc_usable_size(ptr); }
+    ptr = __libc_realloc(ptr, size);
+    heap_count(ptr);
+    return ptr;
+}
+
+void free(void* ptr)
+{
+    if(ptr) { heap_used -= malloc_usable_size(ptr); }
+    __libc_free(ptr);
+}
+
+static void heap_reset(void)
+{
+    heap_peak = heap_used;
+    heap_allocs = 0;
+}
+
+static inline uint64_t bench_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+// parser messages are printed to stdout; muted while timing
+static int stdout_saved = -1;
+static void stdout_mute(bool mute)
+{
+    fflush(stdout);
+    if(mute)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        stdout_saved = dup(STDOUT_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    else
+    {
+        dup2(stdout_saved, STDOUT_FILENO);
+        close(stdout_saved);
+    }
+}
+
+
+// documents; README example, and all features with pretty printing as a config grows in practice
+static const char* bench_doc_readme =
+    "{\n"
+    "    \"cycle_us\": 1000,\n"
+    "    \"pull\": \"down\",\n"
+    "    \"discrete_in\": [14, 12],\n"
+    "    \"coils\": [22, 23],\n"
+    "    \"input_reg\": [35, 34],\n"
+    "    \"holding_reg\": [25, 26]\n"
+    "}\n";
+
+static const char* bench_doc_full =
+    "{\n"
+    "    \"cycle_us\": 1000,\n"
+    "    \"latch_us\": 50,\n"
+    "    \"pull\": \"down\",\n"
+    "    \"discrete_in\": [\n"
+    "        0, 1, 2, 3, 4, 5, 12, 13,\n"
+    "        14, 15, 16, 17\n"
+    "    ],\n"
+    "    \"discrete_in_events\": true,\n"
+    "    \"coils\": [\n"
+    "        18, 19, 21, 22, 23, 27\n"
+    "    ],\n"
+    "    \"holding_reg\": [25, 26],\n"
+    "    \"holding_reg_mode\": [\n"
+    "        { \"mode\": \"ramp\", \"slew\": 50 },\n"
+    "        { \"mode\": \"table\", \"wave\": \"triangle\", \"freq_hz\": 100, \"amplitude\": 100 }\n"
+    "    ],\n"
+    "    \"dac_rate_hz\": 10000,\n"
+    "    \"input_reg\": [36, 37, 38, 39, 32, 33, 34, 35],\n"
+    "    \"input_reg_mode\": [\n"
+    "        \"mean\", \"mean\", \"iir:4\", \"iir:4\",\n"
+    "        \"min\", \"max\", \"rms\", \"last\"\n"
+    "    ],\n"
+    "    \"input_scale\": \"mV\",\n"
+    "    \"capture\": {\n"
+    "        \"pre\": 256,\n"
+    "        \"post\": 768,\n"
+    "        \"trigger\": \"rising\",\n"
+    "        \"input\": 34,\n"
+    "        \"level\": 2048\n"
+    "    },\n"
+    "    \"image_window\": true,\n"
+    "    \"publish\": {\n"
+    "        \"host\": \"239.0.0.1\",\n"
+    "        \"port\": 5020,\n"
+    "        \"deadband\": 8,\n"
+    "        \"keyframe_ms\": 1000,\n"
+    "        \"ttl\": 1\n"
+    "    }\n"
+    "}\n";
+
+typedef struct bench_doc_t {
+    const char* name;
+    const char* json;
+    size_t len;
+} bench_doc_t;
+
+typedef struct bench_result_t {
+    double ns;
+    int64_t heap;
+    uint32_t allocs;
+    esp_err_t err;
+} bench_result_t;
+
+typedef esp_err_t (*bench_fn_t)(const bench_doc_t* doc);
+
+static esp_err_t bench_parse(const bench_doc_t* doc)
+{
+    io_config_t io_config = IO_CONFIG_DEFAULT();
+    return io_config_generate(doc->json, doc->len, &io_config);
+}
+
+static esp_err_t bench_parse_chunked(const bench_doc_t* doc)
+{
+    io_config_t io_config = IO_CONFIG_DEFAULT();
+    io_config_parser_t parser;
+    io_config_parse_begin(&parser, &io_config);
+    for(size_t offset = 0; offset < doc->len; offset += BENCH_CHUNK)
+    {
+        io_config_parse_feed(&parser, doc->json + offset, doc->len - offset < BENCH_CHUNK ? doc->len - offset : BENCH_CHUNK);
+    }
+    return io_config_parse_end(&parser);
+}
+
+#ifdef CONFIG_BENCH_CJSON
+// DOM only; the extraction from the DOM came on top of this
+static esp_err_t bench_cjson(const bench_doc_t* doc)
+{
+    cJSON* root = cJSON_ParseWithLength(doc->json, doc->len);
+    if(!root) { return ESP_FAIL; }
+    cJSON_Delete(root);
+    return ESP_OK;
+}
+#endif
+
+// best time per call of several batches; heap of one call
+static bench_result_t bench_run(bench_fn_t fn, const bench_doc_t* doc)
+{
+    bench_result_t result = { .ns = 1e30 };
+
+    stdout_mute(true);
+    fn(doc); // warm up; stdio buffers
+
+    heap_reset();
+    const int64_t heap_start = heap_used;
+    result.err = fn(doc);
+    result.heap = heap_peak - heap_start;
+    result.allocs = heap_allocs;
+
+    uint32_t iterations = 1;
+    while(true)
+    {
+        const uint64_t start = bench_time_ns();
+        for(uint32_t i = 0; i < iterations; i++) { fn(doc); }
+        if(bench_time_ns() - start >= BENCH_BATCH_NS / 4) { break; }
+        iterations *= 2;
+    }
+    for(int r = 0; r < BENCH_REPEAT; r++)
+    {
+        const uint64_t start = bench_time_ns();
+        for(uint32_t i = 0; i < iterations; i++) { fn(doc); }
+        const double ns = (double)(bench_time_ns() - start) / iterations;
+        if(ns < result.ns) { result.ns = ns; }
+    }
+    stdout_mute(false);
+    return result;
+}
+
+static void bench_report(const bench_doc_t* doc, const char* variant, bench_result_t result)
+{
+    printf("%-6s %5u %-22s %10.0f %8.1f %10lli %7u %s\n", doc->name, (unsigned) doc->len, variant,
+        result.ns, doc->len * 1000.0 / result.ns, (long long) result.heap, result.allocs, result.err ? "FAIL" : "ok");
+}
+
+int main(int argc, char** argv)
+{
+    if(argc > 1)
+    {
+        printf("usage: %s\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    bench_doc_t docs[] = {
+        { .name = "readme", .json = bench_doc_readme },
+        { .name = "full", .json = bench_doc_full }
+    };
+
+#ifndef CONFIG_BENCH_CJSON
+    printf("cJSON baseline not built; configure with -DCONFIG_BENCH_CJSON=ON\n");
+#endif
+    printf("parser state: %u bytes of stack, io_config_t: %u bytes\n", (unsigned) sizeof(io_config_parser_t), (unsigned) sizeof(io_config_t));
+    printf("%-6s %5s %-22s %10s %8s %10s %7s\n", "doc", "bytes", "variant", "ns/parse", "MB/s", "heap peak", "allocs");
+    for(int i = 0; i < sizeof(docs) / sizeof(docs[0]); i++)
+    {
+        bench_doc_t* doc = &docs[i];
+        doc->len = strlen(doc->json);
+
+        bench_report(doc, "stream", bench_run(bench_parse, doc));
+        bench_report(doc, "stream, 64 byte chunks", bench_run(bench_parse_chunked, doc));
+#ifdef CONFIG_BENCH_CJSON
+        bench_report(doc, "cJSON_Parse", bench_run(bench_cjson, doc));
+#endif
+    }
+
+    return EXIT_SUCCESS;
+}
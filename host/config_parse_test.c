@@ -0,0 +1,158 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+#include "io_config.h"
+
+
+// IO configuration parser on network input: valid documents must be accepted and malformed or invalid ones
+// rejected by io_config_parse_end(), whether fed whole, split in two at every position or byte by byte
+// exits with failure on any document parsed the wrong way; parser messages go to /dev/null, failures are listed
+typedef struct parse_case_t {
+    const char* name;
+    const char* json;
+    bool valid;
+} parse_case_t;
+
+static const parse_case_t parse_cases[] = {
+    // valid
+    { "readme", "{\"cycle_us\": 1000, \"pull\": \"down\", \"discrete_in\": [14, 12], \"coils\": [22, 23], \"input_reg\": [35, 34], \"holding_reg\": [25, 26]}", true },
+    { "whitespace", " \n\t{ \"coils\" :\r\n[ 22 ,23 ] , \"discrete_in\":[]}\n ", true },
+    { "escapes", "{\"pull\": \"\\u0064own\", \"coils\": [22]}", true },
+    { "nested", "{\"input_reg\": [34], \"capture\": {\"pre\": 16, \"post\": 16, \"trigger\": \"rising\", \"input\": 34, \"level\": 2048}}", true },
+    { "publish", "{\"input_reg\": [34], \"publish\": {\"host\": \"239.0.0.1\", \"port\": 5020, \"deadband\": 8, \"keyframe_ms\": 1000, \"ttl\": 1}}", true },
+    // malformed JSON
+    { "empty", "", false },
+    { "whitespace only", "  \n ", false },
+    { "trailing comma in array", "{\"coils\": [22, 23,]}", false },
+    { "trailing comma in object", "{\"coils\": [22, 23],}", false },
+    { "leading comma", "{\"coils\": [, 22]}", false },
+    { "missing comma", "{\"coils\": [22 23]}", false },
+    { "missing colon", "{\"coils\" [22]}", false },
+    { "leading zero", "{\"coils\": [022]}", false },
+    { "leading plus", "{\"coils\": [+22]}", false },
+    { "bare minus", "{\"coils\": [-]}", false },
+    { "fraction without digits", "{\"cycle_us\": 1000.}", false },
+    { "exponent without digits", "{\"cycle_us\": 1e}", false },
+    { "hex number", "{\"coils\": [0x16]}", false },
+    { "truncated string", "{\"pull\": \"dow", false },
+    { "truncated key", "{\"pu", false },
+    { "truncated escape", "{\"pull\": \"down\\", false },
+    { "truncated unicode escape", "{\"pull\": \"\\u00", false },
+    { "invalid escape", "{\"pull\": \"\\x64own\"}", false },
+    { "invalid unicode escape", "{\"pull\": \"\\u00g4\"}", false },
+    { "control character in string", "{\"pull\": \"do\nwn\"}", false },
+    { "single quotes", "{'coils': [22]}", false },
+    { "unquoted key", "{coils: [22]}", false },
+    { "truncated object", "{\"coils\": [22]", false },
+    { "truncated array", "{\"coils\": [22", false },
+    { "truncated literal", "{\"image_window\": tru", false },
+    { "misspelled literal", "{\"image_window\": ture}", false },
+    { "unbalanced close", "{\"coils\": [22]]}", false },
+    { "trailing garbage", "{\"coils\": [22]} x", false },
+    { "second document", "{\"coils\": [22]} {}", false },
+    { "root array", "[22, 23]", false },
+    { "too deep", "{\"capture\": [[[[[[[[[[1]]]]]]]]]]}", false },
+    // valid JSON, invalid config
+    { "pin out of range", "{\"coils\": [40]}", false },
+    { "negative pin", "{\"discrete_in\": [-1]}", false },
+    { "pin not a GPIO", "{\"discrete_in\": [20]}", false },
+    { "pin on SPI flash", "{\"coils\": [6]}", false },
+    { "output on input only pin", "{\"coils\": [34]}", false },
+    { "pin used twice", "{\"coils\": [22], \"discrete_in\": [22]}", false },
+    { "pin not integer", "{\"coils\": [22.5]}", false },
+    { "pin wrapping int8", "{\"coils\": [278]}", false },
+    { "pin in exponent notation", "{\"coils\": [2.2e1]}", true },
+    { "pin as string", "{\"coils\": [\"22\"]}", false },
+    { "ADC2 pin", "{\"input_reg\": [4]}", false },
+    { "DAC on non DAC pin", "{\"holding_reg\": [22]}", false },
+    { "cycle too short", "{\"cycle_us\": 1}", false },
+    { "cycle not a number", "{\"cycle_us\": \"1000\"}", false },
+    { "unknown pull", "{\"pull\": \"sideways\"}", false },
+    { "too many coils", "{\"coils\": [0, 1, 2, 3, 4, 5, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33, 0]}", false },
+};
+
+static int stdout_saved = -1;
+static void stdout_mute(bool mute)
+{
+    fflush(stdout);
+    if(mute)
+    {
+        int null = open("/dev/null", O_WRONLY);
+        stdout_saved = dup(STDOUT_FILENO);
+        dup2(null, STDOUT_FILENO);
+        close(null);
+    }
+    else
+    {
+        dup2(stdout_saved, STDOUT_FILENO);
+        close(stdout_saved);
+    }
+}
+
+// feeds json in chunks of chunk bytes, the first one split bytes long; chunk 0: rest in one piece
+static esp_err_t parse_split(const char* json, size_t len, size_t split, size_t chunk)
+{
+    io_config_t io_config = IO_CONFIG_DEFAULT();
+    io_config_parser_t parser;
+    io_config_parse_begin(&parser, &io_config);
+
+    io_config_parse_feed(&parser, json, split);
+    for(size_t pos = split; pos < len; )
+    {
+        const size_t n = chunk && len - pos > chunk ? chunk : len - pos;
+        io_config_parse_feed(&parser, json + pos, n);
+        pos += n;
+    }
+    return io_config_parse_end(&parser);
+}
+
+// parser output stays muted; only failures are printed
+static void parse_report(const parse_case_t* c, const char* how)
+{
+    stdout_mute(false);
+    printf("%-28s %s, %s\n", c->name, c->valid ? "rejected" : "accepted", how);
+    stdout_mute(true);
+}
+
+// returns number of feeds parsed the wrong way; the first failing split is reported
+static uint32_t parse_check(const parse_case_t* c)
+{
+    const size_t len = strlen(c->json);
+    uint32_t failures = 0;
+    // whole (split at 0), split in two at every position
+    for(size_t split = 0; split <= len; split++)
+    {
+        if(!parse_split(c->json, len, split, 0) == c->valid) { continue; }
+        if(!failures)
+        {
+            char how[32];
+            snprintf(how, sizeof(how), "split at %zu", split);
+            parse_report(c, how);
+        }
+        failures++;
+    }
+    if(!parse_split(c->json, len, 0, 1) != c->valid)
+    {
+        parse_report(c, "byte by byte");
+        failures++;
+    }
+    return failures;
+}
+
+int main(int argc, char** argv)
+{
+    const size_t count = sizeof(parse_cases) / sizeof(parse_cases[0]);
+    uint32_t failed_cases = 0;
+
+    stdout_mute(true);
+    for(size_t i = 0; i < count; i++)
+    {
+        if(parse_check(&parse_cases[i])) { failed_cases++; }
+    }
+    stdout_mute(false);
+
+    printf("%zu documents, %u parsed the wrong way\n", count, failed_cases);
+    return failed_cases ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,295 @@
+#include <signal.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_system.h"
+#include "sim.h"
+
+#include "io_helpers.h"
+#include "io_config.h"
+#include "io_config_cache.h"
+#include "io_setup_handler.h"
+#include "io_handler.h"
+#include "process_image.h"
+#include "modbus_server.h"
+#include "io_publish.h"
+#include "io_reconfig.h"
+#include "boot_phase.h"
+
+
+// coupler core on the host: IO task, ADC DMA task and Modbus/TCP server of the firmware against the simulated HAL
+// (see shim/); boots like app_main() with the IO configuration from a JSON file instead of NVS and without WiFi
+static const char* default_io_json =
+    "{"
+    "\"cycle_us\": 1000,"
+    "\"pull\": \"down\","
+    "\"discrete_in_events\": true,"
+    "\"image_window\": true,"
+    "\"discrete_in\": [14, 12],"
+    "\"coils\": [22, 23],"
+    "\"input_reg\": [35, 34],"
+    "\"holding_reg\": [25, 26]"
+    "}";
+
+static volatile sig_atomic_t stop_requested = 0;
+static void on_signal(int signal)
+{
+    stop_requested = 1;
+}
+
+// drives discrete inputs with a binary counter; period_ms per count
+typedef struct toggle_params_t {
+    io_config_t* io_config;
+    uint32_t period_ms;
+} toggle_params_t;
+
+static void vToggleTask(void* params)
+{
+    toggle_params_t* toggle = (toggle_params_t*) params;
+    const uint8_t count = count_discrete_in(toggle->io_config);
+    uint64_t mask = 0;
+    for(int i = 0; i < count; i++) { mask |= (uint64_t)0x01 << toggle->io_config->discrete_in[i]; }
+
+    for(uint32_t counter = 0; true; counter++)
+    {
+        uint64_t levels = 0;
+        for(int i = 0; i < count; i++)
+        {
+            if((counter >> i) & 0x01) { levels |= (uint64_t)0x01 << toggle->io_config->discrete_in[i]; }
+        }
+        sim_gpio_set_inputs(levels, mask);
+        vTaskDelay(toggle->period_ms / portTICK_PERIOD_MS);
+    }
+}
+
+// IO config file is parsed in chunks as read, like the configuration server does while receiving
+static esp_err_t parse_file(FILE* file, io_config_t* io_config)
+{
+    io_config_parser_t parser;
+    io_config_parse_begin(&parser, io_config);
+
+    char chunk[256];
+    size_t len;
+    while((len = fread(chunk, 1, sizeof(chunk), file)) > 0)
+    {
+        io_config_parse_feed(&parser, chunk, len);
+    }
+    return io_config_parse_end(&parser);
+}
+
+// compiled config cache in a file, in place of the NVS blob of the firmware
+static esp_err_t load_cache(const char* path, io_compiled_t* compiled)
+{
+    static io_config_cache_t cache;
+    FILE* file = fopen(path, "rb");
+    if(!file) { return ESP_ERR_NOT_FOUND; }
+    const size_t size = fread(&cache, 1, sizeof(cache), file);
+    fclose(file);
+
+    esp_err_t err = io_config_cache_check(&cache, size);
+    if(err) { return err; }
+    memcpy((void*)compiled, (const void*)&(cache.compiled), sizeof(io_compiled_t));
+    return ESP_OK;
+}
+
+static esp_err_t store_cache(const char* path, const io_compiled_t* compiled)
+{
+    static io_config_cache_t cache;
+    io_config_cache_build(&cache, compiled);
+    FILE* file = fopen(path, "wb");
+    if(!file) { return ESP_FAIL; }
+    const size_t size = fwrite(&cache, 1, sizeof(cache), file);
+    fclose(file);
+    return size == sizeof(cache) ? ESP_OK : ESP_FAIL;
+}
+
+static void usage(const char* name)
+{
+    printf("usage: %s [io_config.json] [--cache <file>] [--duration <s>] [--toggle <ms>] [--reconfig <file> [--reconfig-after <s>]] [--shift-loopback] [--count-hz <hz>]\n", name);
+    printf("  io_config.json  IO configuration as sent to the coupler; default: README example with events and image window\n");
+    printf("  --cache         compiled config cache; used instead of the JSON if valid, written otherwise\n");
+    printf("  --duration      stop after <s> seconds and print statistics; default: run until SIGINT\n");
+    printf("  --toggle        count up discrete inputs every <ms> milliseconds\n");
+    printf("  --reconfig      switch the running IO task over to this IO configuration, like a POST to /config\n");
+    printf("  --reconfig-after  seconds after start to reconfigure; default: 1\n");
+    printf("  --shift-loopback  shift register inputs read the shift register outputs, chip by chip\n");
+    printf("  --count-hz      pulse rate of all counter inputs; negative counts down\n");
+    printf("Modbus/TCP server listens on port %i\n", MB_TCP_PORT_NUMBER);
+}
+
+int main(int argc, char** argv)
+{
+    const char* config_path = NULL;
+    const char* cache_path = NULL;
+    double duration_s = 0;
+    uint32_t toggle_ms = 0;
+    const char* reconfig_path = NULL;
+    double reconfig_s = 1;
+    bool shift_loopback = false;
+    int32_t count_hz = 0;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--duration") && i + 1 < argc) { duration_s = atof(argv[++i]); }
+        else if(!strcmp(argv[i], "--toggle") && i + 1 < argc) { toggle_ms = atoi(argv[++i]); }
+        else if(!strcmp(argv[i], "--cache") && i + 1 < argc) { cache_path = argv[++i]; }
+        else if(!strcmp(argv[i], "--reconfig") && i + 1 < argc) { reconfig_path = argv[++i]; }
+        else if(!strcmp(argv[i], "--reconfig-after") && i + 1 < argc) { reconfig_s = atof(argv[++i]); }
+        else if(!strcmp(argv[i], "--shift-loopback")) { shift_loopback = true; }
+        else if(!strcmp(argv[i], "--count-hz") && i + 1 < argc) { count_hz = atoi(argv[++i]); }
+        else if(argv[i][0] != '-' && !config_path) { config_path = argv[i]; }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("coupler host build booting...\n");
+    boot_phase("main");
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    signal(SIGPIPE, SIG_IGN);
+
+    // get and build io configuration; compiled config from cache if valid
+    static io_compiled_t io_compiled;
+    io_config_t* io_config = &(io_compiled.config);
+    const int64_t config_start_us = esp_timer_get_time();
+    if(cache_path && !load_cache(cache_path, &io_compiled))
+    {
+        printf("using cached IO config; loaded in %uus\n", (uint32_t)(esp_timer_get_time() - config_start_us));
+    }
+    else
+    {
+        static io_config_t io_config_json = IO_CONFIG_DEFAULT();
+        esp_err_t err;
+        if(config_path)
+        {
+            FILE* file = fopen(config_path, "rb");
+            if(!file)
+            {
+                printf("Could not read IO config '%s'!\n", config_path);
+                return EXIT_FAILURE;
+            }
+            err = parse_file(file, &io_config_json);
+            fclose(file);
+        }
+        else
+        {
+            err = io_config_generate(default_io_json, strlen(default_io_json), &io_config_json);
+        }
+        if(err)
+        {
+            printf("Invalid IO configuration!\n");
+            return EXIT_FAILURE;
+        }
+        io_config_compile(&io_config_json, &io_compiled);
+        printf("built IO config from JSON in %uus\n", (uint32_t)(esp_timer_get_time() - config_start_us));
+        if(cache_path && store_cache(cache_path, &io_compiled))
+        {
+            printf("writing IO config cache '%s' failed!\n", cache_path);
+        }
+    }
+    io_config_print(io_config);
+    sim_spi_set_chain(io_config->shift_outputs, io_config->shift_inputs, shift_loopback);
+    for(int i = 0; i < IO_COUNTERS_MAX; i++) { sim_pcnt_set_rate(i, count_hz); }
+
+    // init process image shared by IO task and modbus slave
+    static process_image_t process_image;
+    process_image_init(&process_image);
+
+    // IO first; network services start next to the running IO task, like the fast boot path of the firmware
+    ESP_ERROR_CHECK(setup_gpio_in(&io_compiled));
+    ESP_ERROR_CHECK(setup_io_events(io_config));
+    ESP_ERROR_CHECK(setup_gpio_out(&io_compiled));
+    ESP_ERROR_CHECK(setup_adc(&io_compiled));
+    ESP_ERROR_CHECK(setup_dac(io_config));
+    ESP_ERROR_CHECK(setup_shift(io_config));
+    ESP_ERROR_CHECK(setup_counters(io_config));
+
+    // start IO acquisition task
+    static io_task_params_t io_task_params = {
+        .compiled = &io_compiled,
+        .image = &process_image
+    };
+    start_io_task(&io_task_params);
+    boot_phase("IO task started");
+
+    // start modbus server
+    ESP_ERROR_CHECK(start_modbus_slave(io_config, &process_image));
+
+    // start report-by-exception publisher; subscribes to input images of the IO task
+    ESP_ERROR_CHECK(start_io_publish(io_config, &process_image));
+    boot_phase("modbus server started");
+
+    static toggle_params_t toggle_params;
+    if(toggle_ms)
+    {
+        toggle_params.io_config = io_config;
+        toggle_params.period_ms = toggle_ms;
+        xTaskCreate(vToggleTask, "toggle", 2048, (void*) &toggle_params, tskIDLE_PRIORITY, NULL);
+    }
+
+    printf("up and running!\n");
+    fflush(stdout);
+
+    const int64_t end_us = duration_s > 0 ? esp_timer_get_time() + (int64_t)(duration_s * 1000000) : INT64_MAX;
+    int64_t reconfig_us = reconfig_path ? esp_timer_get_time() + (int64_t)(reconfig_s * 1000000) : INT64_MAX;
+    while(!stop_requested && esp_timer_get_time() < end_us)
+    {
+        usleep(100000);
+        if(esp_timer_get_time() < reconfig_us) { continue; }
+        reconfig_us = INT64_MAX;
+
+        // compiled off the hot path, swapped in at a cycle boundary
+        static io_config_t io_config_next = IO_CONFIG_DEFAULT();
+        static io_compiled_t io_compiled_next;
+        FILE* file = fopen(reconfig_path, "rb");
+        if(!file || parse_file(file, &io_config_next))
+        {
+            printf("Invalid IO configuration '%s'; not reconfiguring!\n", reconfig_path);
+            if(file) { fclose(file); }
+            continue;
+        }
+        fclose(file);
+        io_config_compile(&io_config_next, &io_compiled_next);
+        io_reconfig_stats_t reconfig_stats;
+        const esp_err_t err = io_reconfig_apply(&io_task_params, &io_compiled_next, &reconfig_stats);
+        if(!err)
+        {
+            io_config = &(io_task_params.runtime->compiled.config);
+        }
+        else if(err != ESP_ERR_NOT_SUPPORTED)
+        {
+            // like the coupler; peripherals may be half way
+            esp_restart();
+        }
+    }
+
+    // statistics are read racy while tasks keep running; good enough for a summary
+    const io_cycle_stats_t* cycle_stats = &(io_task_params.cycle_stats);
+    printf("\nIO cycles: %u, missed: %u, late latches: %u, first at %lluus after boot, config swaps: %u\n", cycle_stats->cycles, cycle_stats->missed_cycles, cycle_stats->late_latches, (unsigned long long) cycle_stats->first_cycle_us, cycle_stats->swaps);
+    printf("ADC DMA overruns: %u\n", sim_adc_overruns());
+    printf("DAC output: %u %u\n", sim_dac_get(DAC_CHANNEL_1), sim_dac_get(DAC_CHANNEL_2));
+    printf("GPIO output: 0x%010llx\n", (unsigned long long) sim_gpio_get_outputs());
+    if(io_shift.len)
+    {
+        uint8_t shift_out[IO_SHIFT_CHIPS_MAX];
+        sim_spi_get_outputs(shift_out, io_shift.outputs);
+        printf("shift transactions: %u, errors: %u, outputs:", sim_spi_transactions(), cycle_stats->shift_errors);
+        for(int i = 0; i < io_shift.outputs; i++) { printf(" %02x", shift_out[i]); }
+        printf("\n");
+    }
+    for(int i = 0; i < io_counters.count; i++)
+    {
+        const io_counter_t* counter = &(io_counters.counters[i]);
+        printf("counter %i: %i, %u.%03uHz, period %uus\n", i, counter->count, counter->freq_mhz / 1000, counter->freq_mhz % 1000, counter->period_us);
+    }
+    printf("modbus accepts: %u, closes: %u, evictions: %u, framing errors: %u\n", mb_stats.accepts, mb_stats.closes, mb_stats.evictions, mb_stats.framing_errors);
+    printf("modbus requests: %u, exceptions: %u, busy: %u, bytes in: %u, bytes out: %u\n", mb_stats.requests, mb_stats.exceptions, mb_stats.busy, mb_stats.bytes_in, mb_stats.bytes_out);
+    if(io_config->publish)
+    {
+        printf("publish cycles: %u, datagrams: %u, keyframes: %u, send errors: %u\n", io_publish.cycles, io_publish.datagrams, io_publish.keyframes, io_publish.send_errors);
+    }
+    fflush(stdout);
+    return EXIT_SUCCESS;
+}
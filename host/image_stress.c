@@ -0,0 +1,137 @@
+#include <pthread.h>
+#include <unistd.h>
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+#include "process_image.h"
+
+
+// stress test of the process image seqlocks: one writer and one reader thread per direction, for a fixed time
+// the writer fills every word of the image with its sequence number; a reader seeing two different numbers in one
+// image, or a number older than the last one it saw, read a torn image
+// exits with failure on any torn read, or if the reader could not read at all
+#define STRESS_DEFAULT_S 2
+#define STRESS_OUT_RETRIES 2 // like the IO task
+
+static process_image_t image;
+static volatile bool stress_stop = false;
+
+typedef struct stress_side_t {
+    uint64_t writes;
+    uint64_t reads;
+    uint64_t failed_reads; // bounded reads giving up; expected under contention
+    uint64_t torn;
+} stress_side_t;
+static stress_side_t stress_in, stress_out;
+
+static void stress_fill(void* data, size_t size, uint32_t n)
+{
+    uint32_t* words = (uint32_t*) data;
+    for(size_t i = 0; i < size / sizeof(uint32_t); i++) { words[i] = n; }
+}
+
+// returns the sequence number of the image; UINT32_MAX if torn
+static uint32_t stress_check(const void* data, size_t size)
+{
+    const uint32_t* words = (const uint32_t*) data;
+    for(size_t i = 1; i < size / sizeof(uint32_t); i++)
+    {
+        if(words[i] != words[0]) { return UINT32_MAX; }
+    }
+    return words[0];
+}
+
+static void* stress_write_in(void* arg)
+{
+    static process_image_in_t in;
+    for(uint32_t n = 1; !stress_stop; n++)
+    {
+        stress_fill((void*)&in, sizeof(in), n);
+        process_image_publish_in(&image, &in);
+        stress_in.writes++;
+    }
+    return NULL;
+}
+
+static void* stress_read_in(void* arg)
+{
+    static process_image_in_t in;
+    uint32_t last = 0;
+    while(!stress_stop)
+    {
+        process_image_read_in(&image, &in);
+        const uint32_t n = stress_check((const void*)&in, sizeof(in));
+        if(n == UINT32_MAX || n < last) { stress_in.torn++; }
+        else { last = n; }
+        stress_in.reads++;
+    }
+    return NULL;
+}
+
+static void* stress_write_out(void* arg)
+{
+    for(uint32_t n = 1; !stress_stop; n++)
+    {
+        // in place like the Modbus server
+        process_image_out_t* out = process_image_write_out_begin(&image);
+        stress_fill((void*)out, sizeof(process_image_out_t), n);
+        process_image_write_out_end(&image);
+        stress_out.writes++;
+    }
+    return NULL;
+}
+
+static void* stress_read_out(void* arg)
+{
+    static process_image_out_t out;
+    uint32_t last = 0;
+    while(!stress_stop)
+    {
+        if(!process_image_read_out(&image, &out, STRESS_OUT_RETRIES))
+        {
+            stress_out.failed_reads++;
+            continue;
+        }
+        const uint32_t n = stress_check((const void*)&out, sizeof(out));
+        if(n == UINT32_MAX || n < last) { stress_out.torn++; }
+        else { last = n; }
+        stress_out.reads++;
+    }
+    return NULL;
+}
+
+static void stress_print(const char* name, const stress_side_t* side)
+{
+    printf("%-4s %12llu writes %12llu reads %10llu failed reads %6llu torn\n", name,
+        (unsigned long long)side->writes, (unsigned long long)side->reads, (unsigned long long)side->failed_reads, (unsigned long long)side->torn);
+}
+
+int main(int argc, char** argv)
+{
+    double duration_s = STRESS_DEFAULT_S;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--duration") && i + 1 < argc) { duration_s = atof(argv[++i]); }
+        else
+        {
+            printf("usage: %s [--duration <s>]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    process_image_init(&image);
+    pthread_t threads[4];
+    pthread_create(&threads[0], NULL, stress_write_in, NULL);
+    pthread_create(&threads[1], NULL, stress_read_in, NULL);
+    pthread_create(&threads[2], NULL, stress_write_out, NULL);
+    pthread_create(&threads[3], NULL, stress_read_out, NULL);
+    usleep((useconds_t)(duration_s * 1000000));
+    stress_stop = true;
+    for(int i = 0; i < 4; i++) { pthread_join(threads[i], NULL); }
+
+    stress_print("in", &stress_in);
+    stress_print("out", &stress_out);
+    const bool ok = !stress_in.torn && !stress_out.torn && stress_in.reads && stress_out.reads;
+    printf("%s\n", ok ? "no torn images" : "FAILED");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,495 @@
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC 1
+#endif
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+
+#include "io_config.h"
+#include "io_setup_handler.h"
+#include "io_handler.h"
+#include "io_gpio_map.h"
+#include "adc_reduce.h"
+#include "dac_engine.h"
+
+
+// microbenchmarks of the IO task hot path on the host; kernels are compiled from main/ against the simulated
+// register access macros of shim/, so absolute numbers differ from the ESP32, but changes in the kernels show up
+// each case is swept over its point count (pins, input registers or DAC channels) and reported per call and per point
+// best batch of several repetitions is reported, to suppress scheduling noise
+#define BENCH_REPEAT 7
+#define BENCH_BATCH_NS 2000000
+
+static volatile uint64_t bench_sink;
+
+typedef void (*bench_fn_t)(void* ctx, uint32_t iterations);
+
+typedef struct bench_result_t {
+    double ns;
+    double cycles;
+} bench_result_t;
+
+typedef struct bench_options_t {
+    const char* kernel; // NULL for all
+    bool full; // every point count instead of powers of two
+    bool csv;
+    double cpu_mhz; // cycles from time on hosts without TSC
+} bench_options_t;
+static bench_options_t bench_options = { .kernel = NULL, .full = false, .csv = false, .cpu_mhz = 1000 };
+
+static inline uint64_t bench_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static inline uint64_t bench_cycles(void)
+{
+#ifdef BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// per call time and cycles of fn
+static bench_result_t bench_run(bench_fn_t fn, void* ctx)
+{
+    // size batches to BENCH_BATCH_NS
+    uint32_t iterations = 16;
+    while(true)
+    {
+        const uint64_t start = bench_time_ns();
+        fn(ctx, iterations);
+        if(bench_time_ns() - start >= BENCH_BATCH_NS / 4 || iterations >= (1u << 28)) { break; }
+        iterations *= 2;
+    }
+    iterations *= 4;
+
+    bench_result_t best = { .ns = 1e30, .cycles = 0 };
+    for(int r = 0; r < BENCH_REPEAT; r++)
+    {
+        const uint64_t start_cycles = bench_cycles();
+        const uint64_t start = bench_time_ns();
+        fn(ctx, iterations);
+        const uint64_t ns = bench_time_ns() - start;
+        const uint64_t cycles = bench_cycles() - start_cycles;
+        if((double)ns / iterations < best.ns)
+        {
+            best.ns = (double)ns / iterations;
+            best.cycles = (double)cycles / iterations;
+        }
+    }
+#ifndef BENCH_TSC
+    best.cycles = best.ns * bench_options.cpu_mhz / 1000;
+#endif
+    return best;
+}
+
+static void bench_report(const char* kernel, const char* variant, int points, bench_result_t result)
+{
+    if(bench_options.csv)
+    {
+        printf("%s,%s,%i,%.2f,%.1f,%.2f\n", kernel, variant, points, result.ns, result.cycles, result.cycles / points);
+    }
+    else
+    {
+        printf("%-16s %-16s %6i %10.2f %12.1f %14.2f\n", kernel, variant, points, result.ns, result.cycles, result.cycles / points);
+    }
+}
+
+static bool bench_selected(const char* kernel)
+{
+    return !bench_options.kernel || !strcmp(bench_options.kernel, kernel);
+}
+
+// point counts of a sweep: 1, 2, 4, ... max, or all with --full
+static int bench_next_points(int points, int max)
+{
+    if(bench_options.full || points == max) { return points + 1; }
+    return points * 2 > max ? max : points * 2;
+}
+
+
+// pin layouts; point i of a sweep is mapped to layout[i]
+// contiguous: GPIO 0..n-1, one run; reversed: n-1..0, no runs; board: all ESP32 GPIOs in ascending order, runs broken
+// at gaps; scattered: fixed permutation of all ESP32 GPIOs, mostly single bits
+#define BENCH_PINS_MAX 34
+static const int8_t bench_esp32_pins[BENCH_PINS_MAX] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17, 18, 19, 21, 22, 23, 25, 26, 27, 32, 33, 34, 35, 36, 37, 38, 39
+};
+
+typedef enum {
+    BENCH_LAYOUT_CONTIGUOUS = 0,
+    BENCH_LAYOUT_REVERSED,
+    BENCH_LAYOUT_BOARD,
+    BENCH_LAYOUT_SCATTERED,
+    BENCH_LAYOUT_MAX
+} bench_layout_t;
+static const char* bench_layout_names[BENCH_LAYOUT_MAX] = { "contiguous", "reversed", "board", "scattered" };
+
+static void bench_layout(bench_layout_t layout, int8_t* pins, int count)
+{
+    switch(layout)
+    {
+        case BENCH_LAYOUT_CONTIGUOUS:
+            for(int i = 0; i < count; i++) { pins[i] = i; }
+            break;
+        case BENCH_LAYOUT_REVERSED:
+            for(int i = 0; i < count; i++) { pins[i] = count - 1 - i; }
+            break;
+        case BENCH_LAYOUT_BOARD:
+            for(int i = 0; i < count; i++) { pins[i] = bench_esp32_pins[i]; }
+            break;
+        case BENCH_LAYOUT_SCATTERED:
+        {
+            // fixed shuffle; same layout on every run
+            int8_t shuffled[BENCH_PINS_MAX];
+            memcpy((void*)shuffled, (const void*)bench_esp32_pins, sizeof(shuffled));
+            uint32_t state = 0x2545f491;
+            for(int i = BENCH_PINS_MAX - 1; i > 0; i--)
+            {
+                state = state * 1664525 + 1013904223;
+                const int j = (state >> 8) % (i + 1);
+                const int8_t pin = shuffled[i];
+                shuffled[i] = shuffled[j];
+                shuffled[j] = pin;
+            }
+            memcpy((void*)pins, (const void*)shuffled, count);
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+typedef struct bench_gpio_t {
+    gpio_map_t map;
+    uint64_t mask;
+    int8_t pins[BENCH_PINS_MAX];
+    size_t count;
+} bench_gpio_t;
+
+static __attribute__((noinline)) void bench_read_gpio_in(void* ctx, uint32_t iterations)
+{
+    const bench_gpio_t* gpio = (const bench_gpio_t*) ctx;
+    uint64_t acc = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t data;
+        read_gpio_in(&data, &(gpio->map));
+        acc += data;
+    }
+    bench_sink = acc;
+}
+
+static __attribute__((noinline)) void bench_gpio_out_build(void* ctx, uint32_t iterations)
+{
+    const bench_gpio_t* gpio = (const bench_gpio_t*) ctx;
+    uint64_t acc = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t mask_set, mask_clear;
+        gpio_out_build((uint64_t)i * 0x9e3779b97f4a7c15, &(gpio->map), gpio->mask, &mask_set, &mask_clear);
+        acc += mask_set ^ mask_clear;
+    }
+    bench_sink = acc;
+}
+
+// baseline: per bit loops over the pin list, as used before the pin mapping was compiled into a plan
+static __attribute__((noinline)) void bench_read_gpio_in_loop(void* ctx, uint32_t iterations)
+{
+    const bench_gpio_t* gpio = (const bench_gpio_t*) ctx;
+    uint64_t acc = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t data = 0x00;
+        uint64_t gpio_in = 0x00;
+        gpio_in |= ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);
+        gpio_in |= REG_READ(GPIO_IN_REG);
+        for(int p = 0; p < gpio->count; p++)
+        {
+            data |= ((gpio_in >> gpio->pins[p]) & 0x01) << p;
+        }
+        acc += data;
+    }
+    bench_sink = acc;
+}
+
+static __attribute__((noinline)) void bench_gpio_out_build_loop(void* ctx, uint32_t iterations)
+{
+    const bench_gpio_t* gpio = (const bench_gpio_t*) ctx;
+    uint64_t acc = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        uint64_t data = (uint64_t)i * 0x9e3779b97f4a7c15;
+        uint64_t mask_set = 0x00;
+        for(int p = 0; p < gpio->count; p++)
+        {
+            mask_set |= (data & (uint64_t)0x01) << gpio->pins[p];
+            data >>= 1;
+        }
+        const uint64_t mask_clear = gpio->mask & ~mask_set;
+        acc += mask_set ^ mask_clear;
+    }
+    bench_sink = acc;
+}
+
+static __attribute__((noinline)) void bench_gpio_out_latch(void* ctx, uint32_t iterations)
+{
+    const bench_gpio_t* gpio = (const bench_gpio_t*) ctx;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        const uint64_t mask_set = ((uint64_t)i * 0x9e3779b97f4a7c15) & gpio->mask;
+        gpio_out_latch(mask_set, gpio->mask & ~mask_set);
+    }
+}
+
+static void bench_gpio(void)
+{
+    static const struct {
+        const char* name;
+        bench_fn_t fn;
+        bench_fn_t loop; // baseline; NULL if the kernel did not change
+        bool out;
+        int max;
+    } kernels[] = {
+        { "read_gpio_in", bench_read_gpio_in, bench_read_gpio_in_loop, false, DISCRETE_IN_MAX },
+        { "gpio_out_build", bench_gpio_out_build, bench_gpio_out_build_loop, true, COILS_MAX },
+        { "gpio_out_latch", bench_gpio_out_latch, NULL, true, COILS_MAX }
+    };
+
+    // inputs read as alternating levels
+    REG_WRITE(GPIO_IN_REG, 0x55555555);
+    REG_WRITE(GPIO_IN1_REG, 0x55);
+
+    for(int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+    {
+        if(!bench_selected(kernels[k].name)) { continue; }
+        for(int layout = 0; layout < BENCH_LAYOUT_MAX; layout++)
+        {
+            for(int points = 1; points <= kernels[k].max; points = bench_next_points(points, kernels[k].max))
+            {
+                bench_gpio_t gpio = { .map = GPIO_MAP_DEFAULT(), .mask = 0, .count = points };
+                bench_layout(layout, gpio.pins, points);
+                for(int i = 0; i < points; i++) { gpio.mask |= (uint64_t)0x01 << gpio.pins[i]; }
+                ESP_ERROR_CHECK(kernels[k].out ? gpio_map_compile_out(&(gpio.map), gpio.pins, points) : gpio_map_compile_in(&(gpio.map), gpio.pins, points));
+
+                bench_report(kernels[k].name, bench_layout_names[layout], points, bench_run(kernels[k].fn, (void*) &gpio));
+                if(kernels[k].loop)
+                {
+                    char variant[32];
+                    snprintf(variant, sizeof(variant), "%s loop", bench_layout_names[layout]);
+                    bench_report(kernels[k].name, variant, points, bench_run(kernels[k].loop, (void*) &gpio));
+                }
+                gpio_map_free(&(gpio.map));
+            }
+        }
+    }
+}
+
+
+// ADC; one DMA buffer of ADC_DMA_BUF_LEN samples per call, reduced per input register
+// stream: consecutive buffers of the pattern; buffers start at every phase of the pattern like the DMA stream does
+// unordered: every channel sampled twice in a row; breaks the pattern order from two inputs on, taking the per sample fallback
+#define BENCH_ADC_BUFFERS ADC_REDUCE_SLOTS_MAX
+typedef struct bench_adc_t {
+    adc_reduce_t reduce;
+    adc_digi_output_data_t samples[BENCH_ADC_BUFFERS][ADC_DMA_BUF_LEN];
+} bench_adc_t;
+
+static __attribute__((noinline)) void bench_adc_reduce_buffer(void* ctx, uint32_t iterations)
+{
+    bench_adc_t* adc = (bench_adc_t*) ctx;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        adc_reduce_buffer(&(adc->reduce), adc->samples[i % BENCH_ADC_BUFFERS], ADC_DMA_BUF_LEN);
+    }
+    bench_sink = adc->reduce.slots[0].value;
+}
+
+static __attribute__((noinline)) void bench_read_adc(void* ctx, uint32_t iterations)
+{
+    const size_t count = *(const size_t*) ctx;
+    uint16_t data[ADC_REDUCE_SLOTS_MAX];
+    uint64_t acc = 0;
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        acc += read_adc(data, count, 0);
+        acc += data[count - 1];
+    }
+    bench_sink = acc;
+}
+
+static void bench_adc(void)
+{
+    static const struct {
+        const char* name;
+        const char* mode;
+        bool mv;
+        bool unordered;
+    } variants[] = {
+        { "last", "last", false, false },
+        { "mean", "mean", false, false },
+        { "min", "min", false, false },
+        { "max", "max", false, false },
+        { "rms", "rms", false, false },
+        { "iir", "iir:4", false, false },
+        { "mean mV", "mean", true, false },
+        { "last unordered", "last", false, true },
+        { "mean unordered", "mean", false, true }
+    };
+
+    // windows of one IO cycle at 1ms
+    const uint32_t window_buffers = (uint64_t)ADC_SAMPLE_RATE * 1000 / 1000000 / ADC_DMA_BUF_LEN;
+    uint16_t* scale = malloc(sizeof(uint16_t) * ADC_SCALE_TABLE_LEN);
+    for(int i = 0; i < ADC_SCALE_TABLE_LEN; i++) { scale[i] = (uint32_t)i * 3100 / 4095; }
+
+    static bench_adc_t adc;
+    if(bench_selected("adc_reduce"))
+    {
+        for(int v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+        {
+            for(int points = 1; points <= ADC_REDUCE_SLOTS_MAX; points = bench_next_points(points, ADC_REDUCE_SLOTS_MAX))
+            {
+                // pattern of ADC1 channels in board pin order (GPIO 32 and up)
+                adc1_channel_t channels[ADC_REDUCE_SLOTS_MAX];
+                adc_reduce_mode_t modes[ADC_REDUCE_SLOTS_MAX];
+                uint8_t iir_shifts[ADC_REDUCE_SLOTS_MAX];
+                for(int i = 0; i < points; i++)
+                {
+                    channels[i] = (ADC1_CHANNEL_4 + i) % ADC1_CHANNEL_MAX;
+                    ESP_ERROR_CHECK(adc_reduce_mode_parse(variants[v].mode, &(modes[i]), &(iir_shifts[i])));
+                }
+                adc_reduce_init(&(adc.reduce), points, channels, modes, iir_shifts, window_buffers, variants[v].mv ? scale : NULL);
+
+                for(int b = 0; b < BENCH_ADC_BUFFERS; b++)
+                {
+                    for(int i = 0; i < ADC_DMA_BUF_LEN; i++)
+                    {
+                        const int n = b * ADC_DMA_BUF_LEN + i;
+                        const int slot = variants[v].unordered ? (n / 2) % points : n % points;
+                        adc.samples[b][i].type1.channel = channels[slot];
+                        adc.samples[b][i].type1.data = (n * 997) & 0x0fff;
+                    }
+                }
+
+                bench_report("adc_reduce", variants[v].name, points, bench_run(bench_adc_reduce_buffer, (void*) &adc));
+            }
+        }
+    }
+
+    if(bench_selected("read_adc"))
+    {
+        // mailbox holds valid readings of all input registers
+        for(int buf = 0; buf < 3; buf++) { adc_mailbox.valid_mask[buf] = 0xff; }
+        triple_buffer_publish(&(adc_mailbox.exchange));
+        for(size_t points = 1; points <= ADC_REDUCE_SLOTS_MAX; points = bench_next_points(points, ADC_REDUCE_SLOTS_MAX))
+        {
+            bench_report("read_adc", "mailbox", points, bench_run(bench_read_adc, (void*) &points));
+        }
+    }
+    free(scale);
+}
+
+
+// DAC; engine set up without timer, only the write path of the IO task is timed
+// cosine outputs are written with unchanged offsets, so the generator is not reconfigured
+static __attribute__((noinline)) void bench_write_dac(void* ctx, uint32_t iterations)
+{
+    dac_engine_t* engine = (dac_engine_t*) ctx;
+    const bool cosine = engine->channels[0].mode == DAC_MODE_COSINE;
+    uint16_t data[DAC_CHANNEL_MAX];
+    for(uint32_t i = 0; i < iterations; i++)
+    {
+        for(int ch = 0; ch < DAC_CHANNEL_MAX; ch++) { data[ch] = cosine ? 128 : (uint8_t)(i + ch); }
+        write_dac(data, engine);
+    }
+}
+
+static void bench_dac(void)
+{
+    static const struct {
+        const char* name;
+        dac_mode_t mode;
+    } variants[] = {
+        { "setpoint", DAC_MODE_SETPOINT },
+        { "ramp", DAC_MODE_RAMP },
+        { "table", DAC_MODE_TABLE },
+        { "cosine", DAC_MODE_COSINE }
+    };
+
+    if(!bench_selected("write_dac")) { return; }
+    static dac_engine_t engine;
+    for(int v = 0; v < sizeof(variants) / sizeof(variants[0]); v++)
+    {
+        for(int points = 1; points <= DAC_CHANNEL_MAX; points++)
+        {
+            memset((void*)&engine, 0, sizeof(engine));
+            engine.channel_count = points;
+            for(int i = 0; i < points; i++)
+            {
+                engine.channels[i].mode = variants[v].mode;
+                engine.channels[i].channel = DAC_CHANNEL_1 + i;
+                engine.channels[i].target = 128;
+            }
+            bench_report("write_dac", variants[v].name, points, bench_run(bench_write_dac, (void*) &engine));
+        }
+    }
+}
+
+
+static void usage(const char* name)
+{
+    printf("usage: %s [--kernel <name>] [--full] [--csv] [--cpu-mhz <f>]\n", name);
+    printf("  --kernel   read_gpio_in, gpio_out_build, gpio_out_latch, adc_reduce, read_adc or write_dac; default: all\n");
+    printf("  --full     every point count; default: powers of two and maximum\n");
+    printf("  --csv      kernel,variant,points,ns_per_call,cycles_per_call,cycles_per_point\n");
+    printf("  --cpu-mhz  clock to convert time to cycles on hosts without time stamp counter (default 1000)\n");
+}
+
+int main(int argc, char** argv)
+{
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "--kernel") && i + 1 < argc) { bench_options.kernel = argv[++i]; }
+        else if(!strcmp(argv[i], "--full")) { bench_options.full = true; }
+        else if(!strcmp(argv[i], "--csv")) { bench_options.csv = true; }
+        else if(!strcmp(argv[i], "--cpu-mhz") && i + 1 < argc) { bench_options.cpu_mhz = atof(argv[++i]); }
+        else
+        {
+            usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    static const char* kernels[] = { "read_gpio_in", "gpio_out_build", "gpio_out_latch", "adc_reduce", "read_adc", "write_dac" };
+    bool known = !bench_options.kernel;
+    for(int i = 0; i < sizeof(kernels) / sizeof(kernels[0]); i++) { known |= bench_selected(kernels[i]); }
+    if(!known)
+    {
+        usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    if(bench_options.csv)
+    {
+        printf("kernel,variant,points,ns_per_call,cycles_per_call,cycles_per_point\n");
+    }
+    else
+    {
+#ifdef BENCH_TSC
+        printf("cycles: time stamp counter\n");
+#else
+        printf("cycles: time at %.0fMHz\n", bench_options.cpu_mhz);
+#endif
+        printf("%-16s %-16s %6s %10s %12s %14s\n", "kernel", "variant", "points", "ns/call", "cycles/call", "cycles/point");
+    }
+
+    bench_gpio();
+    bench_adc();
+    bench_dac();
+    return EXIT_SUCCESS;
+}
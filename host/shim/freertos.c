@@ -0,0 +1,253 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+
+// FreeRTOS task, queue and critical section API over pthreads
+// scheduling is left to the host; priorities and core affinity are ignored
+struct sim_task_t {
+    pthread_t thread;
+    TaskFunction_t function;
+    void* params;
+    pthread_mutex_t lock;
+    pthread_cond_t notified;
+    uint32_t notify_count;
+};
+
+struct sim_queue_t {
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t head;
+    UBaseType_t count;
+    uint8_t* items;
+};
+
+static __thread struct sim_task_t* sim_current_task = NULL;
+static pthread_mutex_t sim_critical = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static struct timespec sim_deadline(TickType_t ticks)
+{
+    struct timespec deadline;
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    const uint64_t ms = (uint64_t)ticks * portTICK_PERIOD_MS;
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if(deadline.tv_nsec >= 1000000000)
+    {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    return deadline;
+}
+
+// wait on condition with FreeRTOS timeout semantics; returns false on timeout
+static bool sim_cond_wait(pthread_cond_t* cond, pthread_mutex_t* lock, TickType_t ticks, const struct timespec* deadline)
+{
+    if(ticks == 0) { return false; }
+    if(ticks == portMAX_DELAY) { return pthread_cond_wait(cond, lock) == 0; }
+    return pthread_cond_timedwait(cond, lock, deadline) != ETIMEDOUT;
+}
+
+static void sim_cond_init(pthread_cond_t* cond)
+{
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+static struct sim_task_t* sim_task_new(void)
+{
+    struct sim_task_t* task = calloc(1, sizeof(struct sim_task_t));
+    pthread_mutex_init(&(task->lock), NULL);
+    sim_cond_init(&(task->notified));
+    return task;
+}
+
+static void* sim_task_entry(void* arg)
+{
+    struct sim_task_t* task = (struct sim_task_t*) arg;
+    sim_current_task = task;
+    task->function(task->params);
+    return NULL;
+}
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* params, UBaseType_t priority, TaskHandle_t* handle)
+{
+    struct sim_task_t* task = sim_task_new();
+    task->function = function;
+    task->params = params;
+
+    // stack depth is sized for the ESP32; host stacks are larger anyways
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    const int err = pthread_create(&(task->thread), &attr, sim_task_entry, (void*) task);
+    pthread_attr_destroy(&attr);
+    if(err)
+    {
+        free(task);
+        if(handle) { *handle = NULL; }
+        return pdFAIL;
+    }
+    pthread_setname_np(task->thread, name);
+
+    if(handle) { *handle = task; }
+    return pdPASS;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t function, const char* name, uint32_t stack_depth, void* params, UBaseType_t priority, TaskHandle_t* handle, BaseType_t core)
+{
+    return xTaskCreate(function, name, stack_depth, params, priority, handle);
+}
+
+// only deleting the calling task is supported
+void vTaskDelete(TaskHandle_t task)
+{
+    if(task == NULL || task == sim_current_task) { pthread_exit(NULL); }
+    fprintf(stderr, "vTaskDelete of other tasks is not supported on the host\n");
+    abort();
+}
+
+// threads not created by xTaskCreate (e.g. main) get a handle on first use
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    if(!sim_current_task)
+    {
+        sim_current_task = sim_task_new();
+        sim_current_task->thread = pthread_self();
+    }
+    return sim_current_task;
+}
+
+void vTaskDelay(TickType_t ticks)
+{
+    const struct timespec deadline = sim_deadline(ticks);
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (TickType_t)((uint64_t)now.tv_sec * configTICK_RATE_HZ + (uint64_t)now.tv_nsec * configTICK_RATE_HZ / 1000000000);
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+    pthread_mutex_lock(&(task->lock));
+    task->notify_count++;
+    pthread_cond_signal(&(task->notified));
+    pthread_mutex_unlock(&(task->lock));
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t task, BaseType_t* higher_priority_task_woken)
+{
+    xTaskNotifyGive(task);
+    if(higher_priority_task_woken) { *higher_priority_task_woken = pdFALSE; }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t ticks)
+{
+    struct sim_task_t* task = xTaskGetCurrentTaskHandle();
+    const struct timespec deadline = sim_deadline(ticks);
+
+    pthread_mutex_lock(&(task->lock));
+    while(!task->notify_count && sim_cond_wait(&(task->notified), &(task->lock), ticks, &deadline)) {}
+    const uint32_t count = task->notify_count;
+    if(count) { task->notify_count = clear_on_exit ? 0 : count - 1; }
+    pthread_mutex_unlock(&(task->lock));
+    return count;
+}
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size)
+{
+    struct sim_queue_t* queue = calloc(1, sizeof(struct sim_queue_t));
+    queue->items = malloc(length * item_size);
+    if(!queue->items)
+    {
+        free(queue);
+        return NULL;
+    }
+    queue->length = length;
+    queue->item_size = item_size;
+    pthread_mutex_init(&(queue->lock), NULL);
+    sim_cond_init(&(queue->changed));
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t queue)
+{
+    pthread_mutex_destroy(&(queue->lock));
+    pthread_cond_destroy(&(queue->changed));
+    free(queue->items);
+    free(queue);
+}
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t ticks)
+{
+    const struct timespec deadline = sim_deadline(ticks);
+
+    pthread_mutex_lock(&(queue->lock));
+    while(queue->count == queue->length && sim_cond_wait(&(queue->changed), &(queue->lock), ticks, &deadline)) {}
+    const bool space = queue->count < queue->length;
+    if(space)
+    {
+        const UBaseType_t tail = (queue->head + queue->count) % queue->length;
+        memcpy((void*)(queue->items + tail * queue->item_size), item, queue->item_size);
+        queue->count++;
+        pthread_cond_broadcast(&(queue->changed));
+    }
+    pthread_mutex_unlock(&(queue->lock));
+    return space ? pdPASS : pdFAIL;
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t queue, const void* item, BaseType_t* higher_priority_task_woken)
+{
+    if(higher_priority_task_woken) { *higher_priority_task_woken = pdFALSE; }
+    return xQueueSend(queue, item, 0);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t ticks)
+{
+    const struct timespec deadline = sim_deadline(ticks);
+
+    pthread_mutex_lock(&(queue->lock));
+    while(!queue->count && sim_cond_wait(&(queue->changed), &(queue->lock), ticks, &deadline)) {}
+    const bool available = queue->count > 0;
+    if(available)
+    {
+        memcpy(item, (const void*)(queue->items + queue->head * queue->item_size), queue->item_size);
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_broadcast(&(queue->changed));
+    }
+    pthread_mutex_unlock(&(queue->lock));
+    return available ? pdTRUE : pdFALSE;
+}
+
+UBaseType_t uxQueueMessagesWaiting(QueueHandle_t queue)
+{
+    pthread_mutex_lock(&(queue->lock));
+    const UBaseType_t count = queue->count;
+    pthread_mutex_unlock(&(queue->lock));
+    return count;
+}
+
+void vPortEnterCritical(portMUX_TYPE* mux)
+{
+    pthread_mutex_lock(&sim_critical);
+}
+
+void vPortExitCritical(portMUX_TYPE* mux)
+{
+    pthread_mutex_unlock(&sim_critical);
+}
@@ -0,0 +1,918 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_ota_ops.h"
+#include "xtensa/hal.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "driver/gpio.h"
+#include "driver/adc.h"
+#include "driver/dac.h"
+#include "driver/i2s.h"
+#include "driver/timer.h"
+#include "driver/spi_master.h"
+#include "driver/pcnt.h"
+#include "esp_adc_cal.h"
+#include "hal/adc_ll.h"
+#include "soc/adc_channel.h"
+#include "soc/dac_channel.h"
+#include "sim.h"
+
+
+// simulated ESP32 peripherals for the host build
+static int64_t sim_time_ns(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void sim_sleep_until(int64_t deadline_ns)
+{
+    const struct timespec deadline = { .tv_sec = deadline_ns / 1000000000, .tv_nsec = deadline_ns % 1000000000 };
+    while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {}
+}
+
+static int64_t sim_boot_ns = 0;
+__attribute__((constructor)) static void sim_boot(void)
+{
+    sim_boot_ns = sim_time_ns();
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return (sim_time_ns() - sim_boot_ns) / 1000;
+}
+
+uint32_t xthal_get_ccount(void)
+{
+    return (uint32_t)((sim_time_ns() - sim_boot_ns) * CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ / 1000);
+}
+
+const esp_app_desc_t* esp_ota_get_app_description(void)
+{
+    static esp_app_desc_t desc = { .version = "host", .project_name = "coupler_host" };
+    static const char build[] = __DATE__ " " __TIME__;
+    if(!desc.app_elf_sha256[0]) { memcpy((void*)desc.app_elf_sha256, (const void*)build, sizeof(build) < 32 ? sizeof(build) : 32); }
+    return &desc;
+}
+
+void esp_restart(void)
+{
+    printf("esp_restart(); exiting\n");
+    fflush(stdout);
+    exit(EXIT_FAILURE);
+}
+
+const char* esp_err_to_name(esp_err_t err)
+{
+    switch(err)
+    {
+        case ESP_OK: return "ESP_OK";
+        case ESP_FAIL: return "ESP_FAIL";
+        case ESP_ERR_NO_MEM: return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG: return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE: return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND: return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT: return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC: return "ESP_ERR_INVALID_CRC";
+        case ESP_ERR_INVALID_VERSION: return "ESP_ERR_INVALID_VERSION";
+        default: return "UNKNOWN ERROR";
+    }
+}
+
+
+// GPIO
+// input levels are set by sim_gpio_set_input(); edge interrupts are dispatched from the calling thread,
+// serialized like the single ISR service on the ESP32
+volatile uint32_t sim_gpio_reg[SIM_GPIO_REG_COUNT];
+
+typedef struct sim_gpio_pin_t {
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    gpio_isr_t isr;
+    void* arg;
+} sim_gpio_pin_t;
+static sim_gpio_pin_t sim_gpio_pins[GPIO_NUM_MAX];
+static bool sim_gpio_isr_service = false;
+static pthread_mutex_t sim_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool sim_gpio_valid(gpio_num_t pin)
+{
+    return pin >= 0 && pin < GPIO_NUM_MAX;
+}
+
+esp_err_t gpio_config(const gpio_config_t* config)
+{
+    if(config->pin_bit_mask >> GPIO_NUM_MAX) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&sim_gpio_lock);
+    for(int pin = 0; pin < GPIO_NUM_MAX; pin++)
+    {
+        if(!((config->pin_bit_mask >> pin) & 0x01)) { continue; }
+        sim_gpio_pins[pin].mode = config->mode;
+        sim_gpio_pins[pin].intr_type = config->intr_type;
+    }
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_reset_pin(gpio_num_t pin)
+{
+    if(!sim_gpio_valid(pin)) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&sim_gpio_lock);
+    memset((void*)&(sim_gpio_pins[pin]), 0, sizeof(sim_gpio_pin_t));
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level)
+{
+    if(!sim_gpio_valid(pin)) { return ESP_ERR_INVALID_ARG; }
+    const uint32_t reg = pin < 32 ? (level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG) : (level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG);
+    REG_WRITE(reg, (uint32_t)0x01 << (pin & 31));
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t pin)
+{
+    if(!sim_gpio_valid(pin)) { return 0; }
+    return (REG_READ(pin < 32 ? GPIO_IN_REG : GPIO_IN1_REG) >> (pin & 31)) & 0x01;
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t intr_type)
+{
+    if(!sim_gpio_valid(pin)) { return ESP_ERR_INVALID_ARG; }
+    sim_gpio_pins[pin].intr_type = intr_type;
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    if(sim_gpio_isr_service) { return ESP_ERR_INVALID_STATE; }
+    sim_gpio_isr_service = true;
+    return ESP_OK;
+}
+
+void gpio_uninstall_isr_service(void)
+{
+    sim_gpio_isr_service = false;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void* arg)
+{
+    if(!sim_gpio_valid(pin)) { return ESP_ERR_INVALID_ARG; }
+    if(!sim_gpio_isr_service) { return ESP_ERR_INVALID_STATE; }
+    pthread_mutex_lock(&sim_gpio_lock);
+    sim_gpio_pins[pin].isr = isr;
+    sim_gpio_pins[pin].arg = arg;
+    pthread_mutex_unlock(&sim_gpio_lock);
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin)
+{
+    return gpio_isr_handler_add(pin, NULL, NULL);
+}
+
+static bool sim_gpio_edge_fires(gpio_int_type_t intr_type, int level)
+{
+    switch(intr_type)
+    {
+        case GPIO_INTR_POSEDGE: return level;
+        case GPIO_INTR_NEGEDGE: return !level;
+        case GPIO_INTR_ANYEDGE: return true;
+        // level interrupts are approximated by one call per change to the active level
+        case GPIO_INTR_HIGH_LEVEL: return level;
+        case GPIO_INTR_LOW_LEVEL: return !level;
+        default: return false;
+    }
+}
+
+void sim_gpio_set_inputs(uint64_t levels, uint64_t mask)
+{
+    pthread_mutex_lock(&sim_gpio_lock);
+    const uint64_t previous = ((uint64_t)sim_gpio_reg[GPIO_IN1_REG] << 32) | sim_gpio_reg[GPIO_IN_REG];
+    const uint64_t next = (previous & ~mask) | (levels & mask);
+    REG_WRITE(GPIO_IN_REG, (uint32_t)next);
+    REG_WRITE(GPIO_IN1_REG, (uint32_t)(next >> 32));
+
+    uint64_t changed = (previous ^ next) & (((uint64_t)1 << GPIO_NUM_MAX) - 1);
+    while(sim_gpio_isr_service && changed)
+    {
+        const int pin = __builtin_ctzll(changed);
+        changed &= changed - 1;
+        const sim_gpio_pin_t* gpio = &(sim_gpio_pins[pin]);
+        if(gpio->isr && sim_gpio_edge_fires(gpio->intr_type, (next >> pin) & 0x01))
+        {
+            gpio->isr(gpio->arg);
+        }
+    }
+    pthread_mutex_unlock(&sim_gpio_lock);
+}
+
+void sim_gpio_set_input(int pin, int level)
+{
+    if(!sim_gpio_valid(pin)) { return; }
+    sim_gpio_set_inputs(level ? (uint64_t)1 << pin : 0, (uint64_t)1 << pin);
+}
+
+uint64_t sim_gpio_get_outputs(void)
+{
+    return ((uint64_t)REG_READ(GPIO_OUT1_REG) << 32) | REG_READ(GPIO_OUT_REG);
+}
+
+
+// DAC
+rtc_io_dev_t RTCIO;
+
+esp_err_t dac_pad_get_io_num(dac_channel_t channel, gpio_num_t* pin)
+{
+    switch(channel)
+    {
+        case DAC_CHANNEL_1: *pin = DAC_CHANNEL_1_GPIO_NUM; return ESP_OK;
+        case DAC_CHANNEL_2: *pin = DAC_CHANNEL_2_GPIO_NUM; return ESP_OK;
+        default: return ESP_ERR_INVALID_ARG;
+    }
+}
+
+esp_err_t dac_output_enable(dac_channel_t channel)
+{
+    if(channel < 0 || channel >= DAC_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    RTCIO.pad_dac[channel].xpd_dac = 1;
+    return ESP_OK;
+}
+
+esp_err_t dac_output_disable(dac_channel_t channel)
+{
+    if(channel < 0 || channel >= DAC_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    RTCIO.pad_dac[channel].xpd_dac = 0;
+    return ESP_OK;
+}
+
+esp_err_t dac_output_voltage(dac_channel_t channel, uint8_t value)
+{
+    if(channel < 0 || channel >= DAC_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    RTCIO.pad_dac[channel].dac = value;
+    return ESP_OK;
+}
+
+// the cosine generator is not simulated; its output is not visible in the latch
+esp_err_t dac_cw_generator_enable(void) { return ESP_OK; }
+esp_err_t dac_cw_generator_disable(void) { return ESP_OK; }
+esp_err_t dac_cw_generator_config(dac_cw_config_t* config) { return ESP_OK; }
+
+uint8_t sim_dac_get(dac_channel_t channel)
+{
+    if(channel < 0 || channel >= DAC_CHANNEL_MAX) { return 0; }
+    return RTCIO.pad_dac[channel].dac;
+}
+
+
+// ADC1 through I2S0
+syscon_dev_t SYSCON;
+
+esp_err_t adc1_pad_get_io_num(adc1_channel_t channel, gpio_num_t* pin)
+{
+    static const int8_t pins[ADC1_CHANNEL_MAX] = {
+        ADC1_CHANNEL_0_GPIO_NUM, ADC1_CHANNEL_1_GPIO_NUM, ADC1_CHANNEL_2_GPIO_NUM, ADC1_CHANNEL_3_GPIO_NUM,
+        ADC1_CHANNEL_4_GPIO_NUM, ADC1_CHANNEL_5_GPIO_NUM, ADC1_CHANNEL_6_GPIO_NUM, ADC1_CHANNEL_7_GPIO_NUM
+    };
+    if(channel < 0 || channel >= ADC1_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    *pin = pins[channel];
+    return ESP_OK;
+}
+
+esp_err_t adc_gpio_init(adc_unit_t unit, int channel)
+{
+    return unit == ADC_UNIT_1 && channel >= 0 && channel < ADC1_CHANNEL_MAX ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+void adc_power_acquire(void) {}
+esp_err_t adc_digi_init(void) { return ESP_OK; }
+
+esp_adc_cal_value_t esp_adc_cal_characterize(adc_unit_t unit, adc_atten_t atten, adc_bits_width_t bit_width, uint32_t default_vref, esp_adc_cal_characteristics_t* chars)
+{
+    static const uint32_t full_scale_mv[] = { 950, 1250, 1750, 3100 };
+    chars->adc_num = unit;
+    chars->atten = atten;
+    chars->bit_width = bit_width;
+    chars->vref = default_vref;
+    chars->coeff_a = (uint64_t)full_scale_mv[atten & 0x03] * 65536 / ((1 << (9 + bit_width)) - 1);
+    chars->coeff_b = 0;
+    return ESP_ADC_CAL_VAL_DEFAULT_VREF;
+}
+
+uint32_t esp_adc_cal_raw_to_voltage(uint32_t raw, const esp_adc_cal_characteristics_t* chars)
+{
+    return ((uint64_t)raw * chars->coeff_a + 32768) / 65536 + chars->coeff_b;
+}
+
+// DMA buffers form a ring; the generator overwrites the oldest unread buffer when the ring is full, like the
+// I2S driver does when its reader falls behind
+typedef struct sim_i2s_t {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    bool installed;
+    bool running;
+    QueueHandle_t queue;
+    uint32_t sample_rate;
+    int buf_count;
+    int buf_len; // samples
+    adc_digi_output_data_t* bufs;
+    int head; // oldest completed buffer
+    int count; // completed buffers
+    int read_pos; // samples already read from oldest buffer
+    uint32_t overruns;
+    uint8_t pattern[ADC1_CHANNEL_MAX];
+    uint8_t pattern_len;
+    uint64_t sample_index;
+    sim_adc_source_t source;
+    void* source_arg;
+} sim_i2s_t;
+static sim_i2s_t sim_i2s = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
+static uint16_t sim_adc_sine(adc1_channel_t channel, int64_t t_us, void* arg)
+{
+    const double hz = (channel + 1) * 10.0;
+    return 2048 + (int)(1500.0 * sin(2.0 * M_PI * hz * t_us / 1000000.0));
+}
+
+void sim_adc_set_source(sim_adc_source_t source, void* arg)
+{
+    pthread_mutex_lock(&(sim_i2s.lock));
+    sim_i2s.source = source;
+    sim_i2s.source_arg = arg;
+    pthread_mutex_unlock(&(sim_i2s.lock));
+}
+
+uint32_t sim_adc_overruns(void)
+{
+    pthread_mutex_lock(&(sim_i2s.lock));
+    const uint32_t overruns = sim_i2s.overruns;
+    pthread_mutex_unlock(&(sim_i2s.lock));
+    return overruns;
+}
+
+esp_err_t adc_digi_controller_config(const adc_digi_config_t* config)
+{
+    if(config->adc1_pattern_len < 1 || config->adc1_pattern_len > ADC1_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&(sim_i2s.lock));
+    for(int i = 0; i < config->adc1_pattern_len; i++)
+    {
+        sim_i2s.pattern[i] = config->adc1_pattern[i].channel;
+    }
+    sim_i2s.pattern_len = config->adc1_pattern_len;
+    pthread_mutex_unlock(&(sim_i2s.lock));
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_install(i2s_port_t port, const i2s_config_t* config, int queue_size, void* queue)
+{
+    if(port != I2S_NUM_0 || config->dma_buf_count < 2 || config->dma_buf_len < 1 || !config->sample_rate) { return ESP_ERR_INVALID_ARG; }
+    if(sim_i2s.installed) { return ESP_ERR_INVALID_STATE; }
+
+    sim_i2s.bufs = calloc(config->dma_buf_count * config->dma_buf_len, sizeof(adc_digi_output_data_t));
+    if(!sim_i2s.bufs) { return ESP_ERR_NO_MEM; }
+    sim_i2s.sample_rate = config->sample_rate;
+    sim_i2s.buf_count = config->dma_buf_count;
+    sim_i2s.buf_len = config->dma_buf_len;
+    if(!sim_i2s.source) { sim_i2s.source = sim_adc_sine; }
+    if(queue)
+    {
+        sim_i2s.queue = xQueueCreate(queue_size, sizeof(i2s_event_t));
+        *(QueueHandle_t*)queue = sim_i2s.queue;
+    }
+    sim_i2s.installed = true;
+    return ESP_OK;
+}
+
+esp_err_t i2s_driver_uninstall(i2s_port_t port)
+{
+    if(port != I2S_NUM_0 || !sim_i2s.installed) { return ESP_ERR_INVALID_STATE; }
+    i2s_stop(port);
+    if(sim_i2s.queue) { vQueueDelete(sim_i2s.queue); }
+    free(sim_i2s.bufs);
+    sim_i2s.queue = NULL;
+    sim_i2s.bufs = NULL;
+    sim_i2s.installed = false;
+    return ESP_OK;
+}
+
+// fill next DMA buffer from source following the pattern table; called with lock held
+static void sim_i2s_fill(sim_i2s_t* i2s)
+{
+    if(i2s->count == i2s->buf_count)
+    {
+        i2s->head = (i2s->head + 1) % i2s->buf_count;
+        i2s->count--;
+        i2s->read_pos = 0;
+        i2s->overruns++;
+    }
+
+    adc_digi_output_data_t* buf = i2s->bufs + ((i2s->head + i2s->count) % i2s->buf_count) * i2s->buf_len;
+    for(int i = 0; i < i2s->buf_len; i++, i2s->sample_index++)
+    {
+        const uint8_t channel = i2s->pattern_len ? i2s->pattern[i2s->sample_index % i2s->pattern_len] : 0;
+        const int64_t t_us = i2s->sample_index * 1000000 / i2s->sample_rate;
+        buf[i].type1.channel = channel;
+        buf[i].type1.data = i2s->source(channel, t_us, i2s->source_arg) & 0x0fff;
+    }
+    i2s->count++;
+}
+
+// buffers are completed at the sample rate; after scheduling delays, all buffers due are produced at once
+static void* sim_i2s_thread(void* arg)
+{
+    sim_i2s_t* i2s = (sim_i2s_t*) arg;
+    const int64_t period_ns = (int64_t)i2s->buf_len * 1000000000 / i2s->sample_rate;
+    const int64_t start_ns = sim_time_ns();
+    uint64_t produced = 0;
+
+    while(true)
+    {
+        sim_sleep_until(start_ns + (produced + 1) * period_ns);
+
+        pthread_mutex_lock(&(i2s->lock));
+        if(!i2s->running)
+        {
+            pthread_mutex_unlock(&(i2s->lock));
+            break;
+        }
+        const uint64_t due = (sim_time_ns() - start_ns) / period_ns;
+        if(due - produced > i2s->buf_count)
+        {
+            // buffers beyond the ring are lost entirely; sample time keeps running
+            const uint64_t lost = due - produced - i2s->buf_count;
+            i2s->overruns += lost;
+            i2s->sample_index += lost * i2s->buf_len;
+            produced += lost;
+        }
+        while(produced < due)
+        {
+            sim_i2s_fill(i2s);
+            produced++;
+        }
+        pthread_mutex_unlock(&(i2s->lock));
+
+        if(i2s->queue)
+        {
+            const i2s_event_t event = { .type = I2S_EVENT_RX_DONE, .size = i2s->buf_len * sizeof(adc_digi_output_data_t) };
+            xQueueSendFromISR(i2s->queue, &event, NULL);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t i2s_start(i2s_port_t port)
+{
+    if(port != I2S_NUM_0 || !sim_i2s.installed) { return ESP_ERR_INVALID_STATE; }
+    pthread_mutex_lock(&(sim_i2s.lock));
+    const bool start = !sim_i2s.running;
+    sim_i2s.running = true;
+    pthread_mutex_unlock(&(sim_i2s.lock));
+
+    if(start && pthread_create(&(sim_i2s.thread), NULL, sim_i2s_thread, (void*) &sim_i2s))
+    {
+        sim_i2s.running = false;
+        return ESP_FAIL;
+    }
+    if(start) { pthread_setname_np(sim_i2s.thread, "sim_i2s"); }
+    return ESP_OK;
+}
+
+esp_err_t i2s_stop(i2s_port_t port)
+{
+    if(port != I2S_NUM_0 || !sim_i2s.installed) { return ESP_ERR_INVALID_STATE; }
+    pthread_mutex_lock(&(sim_i2s.lock));
+    const bool stop = sim_i2s.running;
+    sim_i2s.running = false;
+    pthread_mutex_unlock(&(sim_i2s.lock));
+
+    if(stop) { pthread_join(sim_i2s.thread, NULL); }
+    return ESP_OK;
+}
+
+// completed buffers are consumed in order; waiting for data polls at tick resolution
+esp_err_t i2s_read(i2s_port_t port, void* dest, size_t size, size_t* bytes_read, TickType_t ticks)
+{
+    if(port != I2S_NUM_0 || !sim_i2s.installed) { return ESP_ERR_INVALID_STATE; }
+    *bytes_read = 0;
+    const size_t sample_size = sizeof(adc_digi_output_data_t);
+    const TickType_t start = xTaskGetTickCount();
+
+    while(*bytes_read + sample_size <= size)
+    {
+        pthread_mutex_lock(&(sim_i2s.lock));
+        while(sim_i2s.count && *bytes_read + sample_size <= size)
+        {
+            const adc_digi_output_data_t* buf = sim_i2s.bufs + sim_i2s.head * sim_i2s.buf_len;
+            size_t samples = sim_i2s.buf_len - sim_i2s.read_pos;
+            if(samples > (size - *bytes_read) / sample_size) { samples = (size - *bytes_read) / sample_size; }
+
+            memcpy((uint8_t*)dest + *bytes_read, (const void*)(buf + sim_i2s.read_pos), samples * sample_size);
+            *bytes_read += samples * sample_size;
+            sim_i2s.read_pos += samples;
+            if(sim_i2s.read_pos == sim_i2s.buf_len)
+            {
+                sim_i2s.head = (sim_i2s.head + 1) % sim_i2s.buf_count;
+                sim_i2s.count--;
+                sim_i2s.read_pos = 0;
+            }
+        }
+        pthread_mutex_unlock(&(sim_i2s.lock));
+
+        if(*bytes_read + sample_size > size) { break; }
+        if(ticks != portMAX_DELAY && xTaskGetTickCount() - start >= ticks)
+        {
+            return *bytes_read ? ESP_OK : ESP_ERR_TIMEOUT;
+        }
+        vTaskDelay(1);
+    }
+    return ESP_OK;
+}
+
+
+// timer groups; one thread per running timer calls the ISR callback at the alarm period
+typedef struct sim_timer_t {
+    pthread_mutex_t lock;
+    pthread_t thread;
+    bool initialized;
+    bool running;
+    uint64_t alarm_us;
+    timer_isr_t isr;
+    void* arg;
+} sim_timer_t;
+static sim_timer_t sim_timers[TIMER_GROUP_MAX][TIMER_MAX] = {
+    { { .lock = PTHREAD_MUTEX_INITIALIZER }, { .lock = PTHREAD_MUTEX_INITIALIZER } },
+    { { .lock = PTHREAD_MUTEX_INITIALIZER }, { .lock = PTHREAD_MUTEX_INITIALIZER } }
+};
+
+static sim_timer_t* sim_timer_get(timer_group_t group, timer_idx_t idx)
+{
+    if(group < 0 || group >= TIMER_GROUP_MAX || idx < 0 || idx >= TIMER_MAX) { return NULL; }
+    return &(sim_timers[group][idx]);
+}
+
+static void* sim_timer_thread(void* arg)
+{
+    sim_timer_t* timer = (sim_timer_t*) arg;
+    int64_t deadline_ns = sim_time_ns();
+
+    while(true)
+    {
+        pthread_mutex_lock(&(timer->lock));
+        const bool running = timer->running;
+        const int64_t period_ns = timer->alarm_us * 1000;
+        const timer_isr_t isr = timer->isr;
+        void* isr_arg = timer->arg;
+        pthread_mutex_unlock(&(timer->lock));
+        if(!running) { break; }
+
+        // alarms missed while the thread was not scheduled coalesce into one, as pending interrupts do
+        deadline_ns += period_ns;
+        const int64_t now_ns = sim_time_ns();
+        if(now_ns - deadline_ns > period_ns) { deadline_ns = now_ns; }
+        sim_sleep_until(deadline_ns);
+        if(isr) { isr(isr_arg); }
+    }
+    return NULL;
+}
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t idx, const timer_config_t* config)
+{
+    sim_timer_t* timer = sim_timer_get(group, idx);
+    if(!timer) { return ESP_ERR_INVALID_ARG; }
+    if(config->divider != 80)
+    {
+        printf("sim: timer divider %u not supported; counting microseconds\n", config->divider);
+    }
+    timer->initialized = true;
+    return config->counter_en == TIMER_START ? timer_start(group, idx) : ESP_OK;
+}
+
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t idx)
+{
+    esp_err_t err = timer_pause(group, idx);
+    if(err) { return err; }
+    sim_timer_get(group, idx)->initialized = false;
+    return ESP_OK;
+}
+
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t idx, uint64_t value)
+{
+    return sim_timer_get(group, idx) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t idx, uint64_t value)
+{
+    sim_timer_t* timer = sim_timer_get(group, idx);
+    if(!timer || !value) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&(timer->lock));
+    timer->alarm_us = value;
+    pthread_mutex_unlock(&(timer->lock));
+    return ESP_OK;
+}
+
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t idx)
+{
+    return sim_timer_get(group, idx) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t idx, timer_isr_t isr, void* arg, int intr_alloc_flags)
+{
+    sim_timer_t* timer = sim_timer_get(group, idx);
+    if(!timer) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&(timer->lock));
+    timer->isr = isr;
+    timer->arg = arg;
+    pthread_mutex_unlock(&(timer->lock));
+    return ESP_OK;
+}
+
+esp_err_t timer_isr_callback_remove(timer_group_t group, timer_idx_t idx)
+{
+    return timer_isr_callback_add(group, idx, NULL, NULL, 0);
+}
+
+esp_err_t timer_start(timer_group_t group, timer_idx_t idx)
+{
+    sim_timer_t* timer = sim_timer_get(group, idx);
+    if(!timer) { return ESP_ERR_INVALID_ARG; }
+    if(!timer->initialized || !timer->alarm_us) { return ESP_ERR_INVALID_STATE; }
+
+    pthread_mutex_lock(&(timer->lock));
+    const bool start = !timer->running;
+    timer->running = true;
+    pthread_mutex_unlock(&(timer->lock));
+
+    if(start && pthread_create(&(timer->thread), NULL, sim_timer_thread, (void*) timer))
+    {
+        timer->running = false;
+        return ESP_FAIL;
+    }
+    if(start) { pthread_setname_np(timer->thread, "sim_timer"); }
+    return ESP_OK;
+}
+
+esp_err_t timer_pause(timer_group_t group, timer_idx_t idx)
+{
+    sim_timer_t* timer = sim_timer_get(group, idx);
+    if(!timer) { return ESP_ERR_INVALID_ARG; }
+
+    pthread_mutex_lock(&(timer->lock));
+    const bool stop = timer->running;
+    timer->running = false;
+    pthread_mutex_unlock(&(timer->lock));
+
+    if(stop) { pthread_join(timer->thread, NULL); }
+    return ESP_OK;
+}
+
+
+// SPI master; the device on a bus is a chain of 74HC595 outputs followed by 74HC165 inputs, set by
+// sim_spi_set_chain(); the latch pulse is not observed, sim_spi_get_outputs() reads the shift stages
+// a transaction takes its bit time at the device clock; polling_end() sleeps until it would be complete
+#define SIM_SPI_CHIPS_MAX 64
+
+typedef struct sim_spi_device_t {
+    spi_host_device_t host;
+    int clock_hz;
+    bool acquired;
+    spi_transaction_t* trans;
+    int64_t done_ns;
+} sim_spi_device_t;
+
+typedef struct sim_spi_chain_t {
+    pthread_mutex_t lock;
+    uint8_t outputs;
+    uint8_t inputs;
+    bool loopback; // inputs read the 595 outputs
+    uint8_t out[SIM_SPI_CHIPS_MAX];
+    uint8_t in[SIM_SPI_CHIPS_MAX];
+    uint32_t transactions;
+} sim_spi_chain_t;
+static sim_spi_chain_t sim_spi_chain = { .lock = PTHREAD_MUTEX_INITIALIZER };
+static bool sim_spi_bus[SPI_HOST_MAX];
+static sim_spi_device_t sim_spi_devices[SPI_HOST_MAX];
+
+esp_err_t spi_bus_initialize(spi_host_device_t host, const spi_bus_config_t* bus_config, spi_dma_chan_t dma_chan)
+{
+    if(host <= SPI1_HOST || host >= SPI_HOST_MAX) { return ESP_ERR_INVALID_ARG; }
+    if(sim_spi_bus[host]) { return ESP_ERR_INVALID_STATE; }
+    sim_spi_bus[host] = true;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_free(spi_host_device_t host)
+{
+    if(host <= SPI1_HOST || host >= SPI_HOST_MAX || !sim_spi_bus[host]) { return ESP_ERR_INVALID_STATE; }
+    sim_spi_bus[host] = false;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_add_device(spi_host_device_t host, const spi_device_interface_config_t* dev_config, spi_device_handle_t* handle)
+{
+    if(host <= SPI1_HOST || host >= SPI_HOST_MAX || !sim_spi_bus[host]) { return ESP_ERR_INVALID_STATE; }
+    if(dev_config->clock_speed_hz <= 0) { return ESP_ERR_INVALID_ARG; }
+    sim_spi_device_t* device = &(sim_spi_devices[host]);
+    memset((void*)device, 0, sizeof(sim_spi_device_t));
+    device->host = host;
+    device->clock_hz = dev_config->clock_speed_hz;
+    *handle = device;
+    return ESP_OK;
+}
+
+esp_err_t spi_bus_remove_device(spi_device_handle_t handle)
+{
+    if(handle->trans) { return ESP_ERR_INVALID_STATE; }
+    handle->clock_hz = 0;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_acquire_bus(spi_device_handle_t device, TickType_t wait)
+{
+    device->acquired = true;
+    return ESP_OK;
+}
+
+void spi_device_release_bus(spi_device_handle_t device)
+{
+    device->acquired = false;
+}
+
+// shifts the whole transaction at once; bytes are sent first to last, the last one ends up in chip 0
+esp_err_t spi_device_polling_start(spi_device_handle_t handle, spi_transaction_t* trans, TickType_t ticks_to_wait)
+{
+    if(!handle->clock_hz || handle->trans) { return ESP_ERR_INVALID_STATE; }
+    if(trans->length % 8 || trans->length / 8 > SIM_SPI_CHIPS_MAX) { return ESP_ERR_INVALID_ARG; }
+    const size_t len = trans->length / 8;
+    const uint8_t* tx = (const uint8_t*) trans->tx_buffer;
+    uint8_t* rx = (uint8_t*) trans->rx_buffer;
+
+    sim_spi_chain_t* chain = &sim_spi_chain;
+    pthread_mutex_lock(&(chain->lock));
+    // 165 chain was loaded before; chip 0 is shifted in first, bytes past the chain read 0
+    for(size_t i = 0; rx && i < len; i++)
+    {
+        if(chain->loopback) { rx[i] = i < chain->outputs ? chain->out[i] : 0x00; }
+        else { rx[i] = i < chain->inputs ? chain->in[i] : 0x00; }
+    }
+    for(size_t c = 0; tx && c < chain->outputs && c < len; c++)
+    {
+        chain->out[c] = tx[len - 1 - c];
+    }
+    chain->transactions++;
+    pthread_mutex_unlock(&(chain->lock));
+
+    handle->trans = trans;
+    handle->done_ns = sim_time_ns() + (int64_t)trans->length * 1000000000 / handle->clock_hz;
+    return ESP_OK;
+}
+
+esp_err_t spi_device_polling_end(spi_device_handle_t handle, TickType_t ticks_to_wait)
+{
+    if(!handle->trans) { return ESP_ERR_INVALID_STATE; }
+    sim_sleep_until(handle->done_ns);
+    handle->trans = NULL;
+    return ESP_OK;
+}
+
+void sim_spi_set_chain(uint8_t outputs, uint8_t inputs, bool loopback)
+{
+    sim_spi_chain_t* chain = &sim_spi_chain;
+    pthread_mutex_lock(&(chain->lock));
+    chain->outputs = outputs < SIM_SPI_CHIPS_MAX ? outputs : SIM_SPI_CHIPS_MAX;
+    chain->inputs = inputs < SIM_SPI_CHIPS_MAX ? inputs : SIM_SPI_CHIPS_MAX;
+    chain->loopback = loopback;
+    pthread_mutex_unlock(&(chain->lock));
+}
+
+void sim_spi_set_inputs(const uint8_t* in, size_t count)
+{
+    sim_spi_chain_t* chain = &sim_spi_chain;
+    pthread_mutex_lock(&(chain->lock));
+    memcpy((void*)chain->in, (const void*)in, count < SIM_SPI_CHIPS_MAX ? count : SIM_SPI_CHIPS_MAX);
+    pthread_mutex_unlock(&(chain->lock));
+}
+
+void sim_spi_get_outputs(uint8_t* out, size_t count)
+{
+    sim_spi_chain_t* chain = &sim_spi_chain;
+    pthread_mutex_lock(&(chain->lock));
+    memcpy((void*)out, (const void*)chain->out, count < SIM_SPI_CHIPS_MAX ? count : SIM_SPI_CHIPS_MAX);
+    pthread_mutex_unlock(&(chain->lock));
+}
+
+uint32_t sim_spi_transactions(void)
+{
+    return __atomic_load_n(&(sim_spi_chain.transactions), __ATOMIC_RELAXED);
+}
+
+
+// pulse counters; a running unit counts at the rate set by sim_pcnt_set_rate(), evaluated when the counter is read
+// the 16 bit counter resets to 0 when it reaches a limit, like the PCNT does
+typedef struct sim_pcnt_t {
+    bool configured;
+    bool running;
+    int16_t h_lim;
+    int16_t l_lim;
+    int16_t counter;
+    int32_t rate_hz; // negative counts down
+    int64_t last_ns;
+    int64_t rest; // pulses * 1e9 not yet counted
+} sim_pcnt_t;
+static sim_pcnt_t sim_pcnt[PCNT_UNIT_MAX];
+static pthread_mutex_t sim_pcnt_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static inline bool sim_pcnt_valid(pcnt_unit_t unit)
+{
+    return unit >= PCNT_UNIT_0 && unit < PCNT_UNIT_MAX;
+}
+
+// called with lock held
+static void sim_pcnt_advance(sim_pcnt_t* pcnt)
+{
+    const int64_t now_ns = sim_time_ns();
+    if(pcnt->running)
+    {
+        const int64_t scaled = pcnt->rest + (int64_t)pcnt->rate_hz * (now_ns - pcnt->last_ns);
+        int64_t pulses = scaled / 1000000000;
+        pcnt->rest = scaled - pulses * 1000000000;
+        int32_t counter = pcnt->counter;
+        if(pcnt->h_lim > 0) { pulses %= pcnt->h_lim; }
+        counter += pulses;
+        if(pcnt->h_lim > 0 && counter >= pcnt->h_lim) { counter -= pcnt->h_lim; }
+        if(pcnt->l_lim < 0 && counter <= pcnt->l_lim) { counter -= pcnt->l_lim; }
+        pcnt->counter = counter;
+    }
+    pcnt->last_ns = now_ns;
+}
+
+esp_err_t pcnt_unit_config(const pcnt_config_t* pcnt_config)
+{
+    if(!sim_pcnt_valid(pcnt_config->unit) || pcnt_config->channel >= PCNT_CHANNEL_MAX) { return ESP_ERR_INVALID_ARG; }
+    if(pcnt_config->counter_h_lim < 0 || pcnt_config->counter_l_lim > 0) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&sim_pcnt_lock);
+    sim_pcnt_t* pcnt = &(sim_pcnt[pcnt_config->unit]);
+    pcnt->configured = true;
+    pcnt->h_lim = pcnt_config->counter_h_lim;
+    pcnt->l_lim = pcnt_config->counter_l_lim;
+    pthread_mutex_unlock(&sim_pcnt_lock);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_get_counter_value(pcnt_unit_t unit, int16_t* count)
+{
+    if(!sim_pcnt_valid(unit)) { return ESP_ERR_INVALID_ARG; }
+    pthread_mutex_lock(&sim_pcnt_lock);
+    sim_pcnt_advance(&(sim_pcnt[unit]));
+    *count = sim_pcnt[unit].counter;
+    pthread_mutex_unlock(&sim_pcnt_lock);
+    return ESP_OK;
+}
+
+static esp_err_t sim_pcnt_control(pcnt_unit_t unit, int running, bool clear)
+{
+    if(!sim_pcnt_valid(unit) || !sim_pcnt[unit].configured) { return ESP_ERR_INVALID_STATE; }
+    pthread_mutex_lock(&sim_pcnt_lock);
+    sim_pcnt_t* pcnt = &(sim_pcnt[unit]);
+    sim_pcnt_advance(pcnt);
+    if(running >= 0) { pcnt->running = running; }
+    if(clear)
+    {
+        pcnt->counter = 0;
+        pcnt->rest = 0;
+    }
+    pthread_mutex_unlock(&sim_pcnt_lock);
+    return ESP_OK;
+}
+
+esp_err_t pcnt_counter_pause(pcnt_unit_t unit) { return sim_pcnt_control(unit, false, false); }
+esp_err_t pcnt_counter_resume(pcnt_unit_t unit) { return sim_pcnt_control(unit, true, false); }
+esp_err_t pcnt_counter_clear(pcnt_unit_t unit) { return sim_pcnt_control(unit, -1, true); }
+
+// limits always reset the simulated counter; filters are not simulated
+esp_err_t pcnt_event_enable(pcnt_unit_t unit, pcnt_evt_type_t evt_type) { return sim_pcnt_valid(unit) ? ESP_OK : ESP_ERR_INVALID_ARG; }
+esp_err_t pcnt_set_filter_value(pcnt_unit_t unit, uint16_t filter_val)
+{
+    return sim_pcnt_valid(unit) && filter_val < 1024 ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+esp_err_t pcnt_filter_enable(pcnt_unit_t unit) { return sim_pcnt_valid(unit) ? ESP_OK : ESP_ERR_INVALID_ARG; }
+esp_err_t pcnt_filter_disable(pcnt_unit_t unit) { return sim_pcnt_valid(unit) ? ESP_OK : ESP_ERR_INVALID_ARG; }
+
+void sim_pcnt_set_rate(int unit, int32_t rate_hz)
+{
+    if(!sim_pcnt_valid(unit)) { return; }
+    pthread_mutex_lock(&sim_pcnt_lock);
+    sim_pcnt_advance(&(sim_pcnt[unit]));
+    sim_pcnt[unit].rate_hz = rate_hz;
+    pthread_mutex_unlock(&sim_pcnt_lock);
+}
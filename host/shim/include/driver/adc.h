@@ -0,0 +1,81 @@
+#pragma once
+#include "hal/gpio_types.h"
+
+
+typedef enum {
+    ADC1_CHANNEL_0 = 0,
+    ADC1_CHANNEL_1,
+    ADC1_CHANNEL_2,
+    ADC1_CHANNEL_3,
+    ADC1_CHANNEL_4,
+    ADC1_CHANNEL_5,
+    ADC1_CHANNEL_6,
+    ADC1_CHANNEL_7,
+    ADC1_CHANNEL_MAX
+} adc1_channel_t;
+
+typedef enum {
+    ADC_UNIT_1 = 1,
+    ADC_UNIT_2 = 2
+} adc_unit_t;
+
+typedef enum {
+    ADC_ATTEN_DB_0 = 0,
+    ADC_ATTEN_DB_2_5,
+    ADC_ATTEN_DB_6,
+    ADC_ATTEN_DB_11
+} adc_atten_t;
+
+typedef enum {
+    ADC_WIDTH_BIT_9 = 0,
+    ADC_WIDTH_BIT_10,
+    ADC_WIDTH_BIT_11,
+    ADC_WIDTH_BIT_12
+} adc_bits_width_t;
+
+typedef enum {
+    ADC_DIGI_FORMAT_12BIT
+} adc_digi_output_format_t;
+
+typedef enum {
+    ADC_CONV_SINGLE_UNIT_1 = 1
+} adc_digi_convert_mode_t;
+
+// DMA sample format of the built-in ADC through I2S0
+typedef struct {
+    union {
+        struct {
+            uint16_t data: 12;
+            uint16_t channel: 4;
+        } type1;
+        uint16_t val;
+    };
+} adc_digi_output_data_t;
+
+typedef struct {
+    union {
+        struct {
+            uint8_t atten: 2;
+            uint8_t bit_width: 2;
+            uint8_t channel: 4;
+        };
+        uint8_t val;
+    };
+} adc_digi_pattern_table_t;
+
+typedef struct {
+    bool conv_limit_en;
+    uint32_t conv_limit_num;
+    uint32_t adc1_pattern_len;
+    uint32_t adc2_pattern_len;
+    adc_digi_pattern_table_t* adc1_pattern;
+    adc_digi_pattern_table_t* adc2_pattern;
+    adc_digi_convert_mode_t conv_mode;
+    adc_digi_output_format_t format;
+} adc_digi_config_t;
+
+esp_err_t adc1_pad_get_io_num(adc1_channel_t channel, gpio_num_t* pin);
+esp_err_t adc_gpio_init(adc_unit_t unit, int channel);
+void adc_power_acquire(void);
+esp_err_t adc_digi_init(void);
+esp_err_t adc_digi_controller_config(const adc_digi_config_t* config);
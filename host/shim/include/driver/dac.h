@@ -0,0 +1,47 @@
+#pragma once
+#include "hal/gpio_types.h"
+
+
+typedef enum {
+    DAC_CHANNEL_1 = 0,
+    DAC_CHANNEL_2,
+    DAC_CHANNEL_MAX
+} dac_channel_t;
+
+typedef enum {
+    DAC_CW_SCALE_1 = 0,
+    DAC_CW_SCALE_2,
+    DAC_CW_SCALE_4,
+    DAC_CW_SCALE_8
+} dac_cw_scale_t;
+
+typedef enum {
+    DAC_CW_PHASE_0 = 0x02,
+    DAC_CW_PHASE_180 = 0x03
+} dac_cw_phase_t;
+
+typedef struct {
+    dac_channel_t en_ch;
+    dac_cw_scale_t scale;
+    dac_cw_phase_t phase;
+    uint32_t freq;
+    int8_t offset;
+} dac_cw_config_t;
+
+// DAC output latch; the DAC sink of the simulation (see sim_dac_get() in sim.h)
+typedef struct {
+    struct {
+        volatile uint32_t dac: 8;
+        volatile uint32_t xpd_dac: 1;
+        volatile uint32_t dac_xpd_force: 1;
+    } pad_dac[DAC_CHANNEL_MAX];
+} rtc_io_dev_t;
+extern rtc_io_dev_t RTCIO;
+
+esp_err_t dac_pad_get_io_num(dac_channel_t channel, gpio_num_t* pin);
+esp_err_t dac_output_enable(dac_channel_t channel);
+esp_err_t dac_output_disable(dac_channel_t channel);
+esp_err_t dac_output_voltage(dac_channel_t channel, uint8_t value);
+esp_err_t dac_cw_generator_enable(void);
+esp_err_t dac_cw_generator_disable(void);
+esp_err_t dac_cw_generator_config(dac_cw_config_t* config);
@@ -0,0 +1,61 @@
+#pragma once
+#include "hal/gpio_types.h"
+
+
+// simulated GPIO matrix registers; pin levels are driven by sim_gpio_set_input() (see sim.h)
+// writes to the W1TS/W1TC registers set/clear bits of the output registers like on the ESP32
+#define GPIO_OUT_REG 0
+#define GPIO_OUT_W1TS_REG 1
+#define GPIO_OUT_W1TC_REG 2
+#define GPIO_OUT1_REG 3
+#define GPIO_OUT1_W1TS_REG 4
+#define GPIO_OUT1_W1TC_REG 5
+#define GPIO_IN_REG 6
+#define GPIO_IN1_REG 7
+#define SIM_GPIO_REG_COUNT 8
+
+extern volatile uint32_t sim_gpio_reg[SIM_GPIO_REG_COUNT];
+
+static inline uint32_t sim_reg_read(uint32_t reg)
+{
+    return __atomic_load_n(&(sim_gpio_reg[reg]), __ATOMIC_RELAXED);
+}
+
+static inline void sim_reg_write(uint32_t reg, uint32_t value)
+{
+    switch(reg)
+    {
+        case GPIO_OUT_W1TS_REG:
+        case GPIO_OUT1_W1TS_REG:
+            __atomic_fetch_or(&(sim_gpio_reg[reg - 1]), value, __ATOMIC_RELAXED);
+            break;
+        case GPIO_OUT_W1TC_REG:
+        case GPIO_OUT1_W1TC_REG:
+            __atomic_fetch_and(&(sim_gpio_reg[reg - 2]), ~value, __ATOMIC_RELAXED);
+            break;
+        default:
+            __atomic_store_n(&(sim_gpio_reg[reg]), value, __ATOMIC_RELAXED);
+            break;
+    }
+}
+
+// pin capabilities of the ESP32 as in soc_caps.h: no GPIO 20, 24, 28 - 31; GPIO 34 - 39 input only
+#define SOC_GPIO_VALID_GPIO_MASK (0xFFFFFFFFFFULL & ~(0ULL | (1ULL << 20) | (1ULL << 24) | (0xfULL << 28)))
+#define SOC_GPIO_VALID_OUTPUT_GPIO_MASK (SOC_GPIO_VALID_GPIO_MASK & ~(0x3fULL << 34))
+#define GPIO_IS_VALID_GPIO(gpio_num) (((1ULL << (gpio_num)) & SOC_GPIO_VALID_GPIO_MASK) != 0)
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) (((1ULL << (gpio_num)) & SOC_GPIO_VALID_OUTPUT_GPIO_MASK) != 0)
+
+#define REG_READ(reg) sim_reg_read(reg)
+#define REG_WRITE(reg, value) sim_reg_write((reg), (value))
+
+typedef void (*gpio_isr_t)(void* arg);
+
+esp_err_t gpio_config(const gpio_config_t* config);
+esp_err_t gpio_reset_pin(gpio_num_t pin);
+esp_err_t gpio_set_level(gpio_num_t pin, uint32_t level);
+int gpio_get_level(gpio_num_t pin);
+esp_err_t gpio_set_intr_type(gpio_num_t pin, gpio_int_type_t intr_type);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+void gpio_uninstall_isr_service(void);
+esp_err_t gpio_isr_handler_add(gpio_num_t pin, gpio_isr_t isr, void* arg);
+esp_err_t gpio_isr_handler_remove(gpio_num_t pin);
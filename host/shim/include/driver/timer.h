@@ -0,0 +1,62 @@
+#pragma once
+#include "esp_system.h"
+
+
+// general purpose timer groups; an alarm with auto reload calls the ISR callback from a timer thread
+// counting is assumed at 1MHz (divider 80 from APB), like all users in this project
+typedef enum {
+    TIMER_GROUP_0 = 0,
+    TIMER_GROUP_1,
+    TIMER_GROUP_MAX
+} timer_group_t;
+
+typedef enum {
+    TIMER_0 = 0,
+    TIMER_1,
+    TIMER_MAX
+} timer_idx_t;
+
+typedef enum {
+    TIMER_COUNT_DOWN = 0,
+    TIMER_COUNT_UP
+} timer_count_dir_t;
+
+typedef enum {
+    TIMER_PAUSE = 0,
+    TIMER_START
+} timer_start_t;
+
+typedef enum {
+    TIMER_ALARM_DIS = 0,
+    TIMER_ALARM_EN
+} timer_alarm_t;
+
+typedef enum {
+    TIMER_AUTORELOAD_DIS = 0,
+    TIMER_AUTORELOAD_EN
+} timer_autoreload_t;
+
+typedef enum {
+    TIMER_INTR_LEVEL = 0
+} timer_intr_mode_t;
+
+typedef struct {
+    timer_alarm_t alarm_en;
+    timer_start_t counter_en;
+    timer_intr_mode_t intr_type;
+    timer_count_dir_t counter_dir;
+    timer_autoreload_t auto_reload;
+    uint32_t divider;
+} timer_config_t;
+
+typedef bool (*timer_isr_t)(void* arg);
+
+esp_err_t timer_init(timer_group_t group, timer_idx_t idx, const timer_config_t* config);
+esp_err_t timer_deinit(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_set_counter_value(timer_group_t group, timer_idx_t idx, uint64_t value);
+esp_err_t timer_set_alarm_value(timer_group_t group, timer_idx_t idx, uint64_t value);
+esp_err_t timer_enable_intr(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_isr_callback_add(timer_group_t group, timer_idx_t idx, timer_isr_t isr, void* arg, int intr_alloc_flags);
+esp_err_t timer_isr_callback_remove(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_start(timer_group_t group, timer_idx_t idx);
+esp_err_t timer_pause(timer_group_t group, timer_idx_t idx);
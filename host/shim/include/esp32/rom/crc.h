@@ -0,0 +1,18 @@
+#pragma once
+#include <stdint.h>
+
+
+// ROM CRC32 (IEEE 802.3, reflected); crc is the result of a previous call or 0, inverted in and out like the ROM
+static inline uint32_t crc32_le(uint32_t crc, uint8_t const* buf, uint32_t len)
+{
+    crc = ~crc;
+    for(uint32_t i = 0; i < len; i++)
+    {
+        crc ^= buf[i];
+        for(int bit = 0; bit < 8; bit++)
+        {
+            crc = (crc >> 1) ^ (0xedb88320 & -(crc & 0x01));
+        }
+    }
+    return ~crc;
+}
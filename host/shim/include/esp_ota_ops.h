@@ -0,0 +1,13 @@
+#pragma once
+#include <stdint.h>
+
+
+// application description; only the fields the coupler uses
+typedef struct esp_app_desc_t {
+    char version[32];
+    char project_name[32];
+    uint8_t app_elf_sha256[32];
+} esp_app_desc_t;
+
+// host build: the ELF SHA is derived from the build time of the shim, so a rebuilt shim invalidates caches
+const esp_app_desc_t* esp_ota_get_app_description(void);
@@ -0,0 +1,6 @@
+#pragma once
+#include "esp_system.h"
+
+
+// microseconds since start of the process (CLOCK_MONOTONIC)
+int64_t esp_timer_get_time(void);
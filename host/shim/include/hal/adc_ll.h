@@ -0,0 +1,11 @@
+#pragma once
+#include <stdint.h>
+
+
+// digital controller register written by setup_adc(); no effect in the simulation
+typedef struct {
+    struct {
+        volatile uint32_t meas_num_limit;
+    } saradc_ctrl2;
+} syscon_dev_t;
+extern syscon_dev_t SYSCON;
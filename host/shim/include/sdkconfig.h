@@ -0,0 +1,6 @@
+#pragma once
+
+
+// configuration of sdkconfig.defaults relevant to the host build
+#define CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ 240
+#define CONFIG_FREERTOS_HZ 1000
@@ -0,0 +1,30 @@
+#pragma once
+#include "esp_system.h"
+#include "driver/adc.h"
+#include "driver/dac.h"
+
+
+// control of the simulated hardware; may be called from any thread
+// pin levels: inputs change GPIO_IN_REG/GPIO_IN1_REG and fire edge interrupts of pins configured for them
+void sim_gpio_set_input(int pin, int level);
+void sim_gpio_set_inputs(uint64_t levels, uint64_t mask);
+uint64_t sim_gpio_get_outputs(void);
+
+// current DAC output latch value
+uint8_t sim_dac_get(dac_channel_t channel);
+
+// ADC source: 12 bit reading of channel at time t_us; default: sine of (channel + 1) * 10Hz around mid scale
+typedef uint16_t (*sim_adc_source_t)(adc1_channel_t channel, int64_t t_us, void* arg);
+void sim_adc_set_source(sim_adc_source_t source, void* arg);
+// DMA buffers overwritten before they were read
+uint32_t sim_adc_overruns(void);
+
+// shift register chain on the SPI bus: outputs 74HC595 and inputs 74HC165, byte per chip, chip 0 next to the ESP32
+// loopback: the 165 inputs read the 595 outputs, chip by chip
+void sim_spi_set_chain(uint8_t outputs, uint8_t inputs, bool loopback);
+void sim_spi_set_inputs(const uint8_t* in, size_t count);
+void sim_spi_get_outputs(uint8_t* out, size_t count);
+uint32_t sim_spi_transactions(void);
+
+// pulse counter input of a PCNT unit in counts per second; negative counts down (updown and quadrature units)
+void sim_pcnt_set_rate(int unit, int32_t rate_hz);
@@ -0,0 +1,11 @@
+#pragma once
+
+
+#define ADC1_CHANNEL_0_GPIO_NUM 36
+#define ADC1_CHANNEL_1_GPIO_NUM 37
+#define ADC1_CHANNEL_2_GPIO_NUM 38
+#define ADC1_CHANNEL_3_GPIO_NUM 39
+#define ADC1_CHANNEL_4_GPIO_NUM 32
+#define ADC1_CHANNEL_5_GPIO_NUM 33
+#define ADC1_CHANNEL_6_GPIO_NUM 34
+#define ADC1_CHANNEL_7_GPIO_NUM 35
@@ -0,0 +1,5 @@
+#pragma once
+
+
+#define DAC_CHANNEL_1_GPIO_NUM 25
+#define DAC_CHANNEL_2_GPIO_NUM 26
@@ -0,0 +1,6 @@
+#pragma once
+#include <stdint.h>
+
+
+// simulated CPU cycle counter; CLOCK_MONOTONIC scaled to CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ, wraps like CCOUNT
+uint32_t xthal_get_ccount(void);
@@ -0,0 +1,240 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include "esp_system.h"
+#include "driver/adc.h"
+#include "adc_reduce.h" // ADC_REDUCE_SLOTS_MAX
+
+
+// triggered waveform capture of all ADC pattern slots (input registers) at full sample rate
+// the pattern table is sampled round robin, so each channel is recorded at ADC_SAMPLE_RATE / channels
+// samples are recorded by the ADC task into a preallocated ring per slot; once armed, the ring holds the
+// newest pre-trigger samples; after the trigger, post-trigger samples are recorded and the capture is frozen
+// arm/trigger requests come from the IO task (coils); the finished capture is read from the modbus side
+#define ADC_CAPTURE_SAMPLES_MAX 4096 // per slot; pre + post
+
+typedef enum {
+    ADC_CAPTURE_IDLE = 0,   // not armed
+    ADC_CAPTURE_ARMED,      // recording pre-trigger samples, waiting for trigger
+    ADC_CAPTURE_TRIGGERED,  // recording post-trigger samples
+    ADC_CAPTURE_DONE        // capture complete and frozen until re-armed
+} adc_capture_state_t;
+
+typedef enum {
+    ADC_CAPTURE_TRIGGER_COIL = 0,   // trigger coil only
+    ADC_CAPTURE_TRIGGER_RISING,     // trigger input crossing level upwards
+    ADC_CAPTURE_TRIGGER_FALLING     // trigger input crossing level downwards
+} adc_capture_trigger_t;
+
+// requests; set by IO task, consumed by ADC task
+#define ADC_CAPTURE_REQ_ARM 0x01
+#define ADC_CAPTURE_REQ_TRIGGER 0x02
+
+typedef struct adc_capture_t {
+    // configuration
+    uint16_t pre;
+    uint16_t post;
+    uint16_t len; // pre + post; 0 if capture is disabled
+    adc_capture_trigger_t trigger;
+    int8_t trigger_slot;
+    uint16_t level;
+    uint8_t slot_count;
+    int8_t channel_slot[ADC1_CHANNEL_MAX];
+    uint16_t* data; // slot_count rings of len samples
+    // ADC task state
+    volatile uint32_t state;
+    volatile uint32_t sequence; // incremented with every completed capture
+    bool trigger_pending;
+    bool has_last;
+    uint16_t last;
+    uint16_t pos[ADC_REDUCE_SLOTS_MAX];
+    uint16_t filled[ADC_REDUCE_SLOTS_MAX];
+    uint8_t pre_slots; // slots holding at least pre samples; the trigger is accepted once all do
+    uint16_t remaining[ADC_REDUCE_SLOTS_MAX];
+    uint16_t start[ADC_REDUCE_SLOTS_MAX]; // ring index of first sample of a completed capture
+    volatile uint32_t requests;
+} adc_capture_t;
+static adc_capture_t adc_capture;
+
+void print_adc_capture_trigger(adc_capture_trigger_t trigger)
+{
+    switch(trigger) {
+        case ADC_CAPTURE_TRIGGER_COIL:
+            printf("coil");
+            break;
+        case ADC_CAPTURE_TRIGGER_RISING:
+            printf("rising");
+            break;
+        case ADC_CAPTURE_TRIGGER_FALLING:
+            printf("falling");
+            break;
+        default:
+            printf("UNKNOWN");
+    }
+}
+
+// trigger_slot: slot of threshold trigger input; ignored for coil trigger
+esp_err_t adc_capture_init(adc_capture_t* capture, uint8_t slot_count, const adc1_channel_t* channels, uint16_t pre, uint16_t post, adc_capture_trigger_t trigger, int8_t trigger_slot, uint16_t level)
+{
+    free(capture->data);
+    memset((void*)capture, 0, sizeof(adc_capture_t));
+    memset((void*)capture->channel_slot, -1, sizeof(capture->channel_slot));
+
+    if(!slot_count || !(pre + post)) { return ESP_OK; }
+
+    capture->data = malloc(sizeof(uint16_t) * slot_count * (pre + post));
+    if(!capture->data)
+    {
+        printf("allocating ADC capture buffer failed!\n");
+        return ESP_ERR_NO_MEM;
+    }
+
+    capture->pre = pre;
+    capture->post = post;
+    capture->len = pre + post;
+    capture->trigger = trigger;
+    capture->trigger_slot = trigger_slot;
+    capture->level = level;
+    capture->slot_count = slot_count;
+    for(int i = 0; i < slot_count; i++)
+    {
+        if(capture->channel_slot[channels[i]] < 0)
+        {
+            capture->channel_slot[channels[i]] = i;
+        }
+    }
+
+    printf("ADC capture of %i + %i samples on %i channels\n", pre, post, slot_count);
+    return ESP_OK;
+}
+
+// IO task
+static inline void adc_capture_request(adc_capture_t* capture, uint32_t requests)
+{
+    __atomic_fetch_or(&(capture->requests), requests, __ATOMIC_RELAXED);
+}
+
+static void adc_capture_arm(adc_capture_t* capture)
+{
+    memset((void*)capture->pos, 0, sizeof(capture->pos));
+    memset((void*)capture->filled, 0, sizeof(capture->filled));
+    capture->pre_slots = capture->pre ? 0 : capture->slot_count;
+    capture->trigger_pending = false;
+    capture->has_last = false;
+    __atomic_store_n(&(capture->state), ADC_CAPTURE_ARMED, __ATOMIC_RELEASE);
+}
+
+static inline void adc_capture_complete(adc_capture_t* capture)
+{
+    capture->sequence++;
+    __atomic_store_n(&(capture->state), ADC_CAPTURE_DONE, __ATOMIC_RELEASE);
+}
+
+static void adc_capture_trigger(adc_capture_t* capture)
+{
+    for(int i = 0; i < capture->slot_count; i++)
+    {
+        capture->remaining[i] = capture->post;
+        // first post-trigger sample goes to current position
+        capture->start[i] = (capture->pos[i] + capture->len - capture->pre) % capture->len;
+    }
+    capture->trigger_pending = false;
+    if(capture->post) { capture->state = ADC_CAPTURE_TRIGGERED; }
+    else { adc_capture_complete(capture); }
+}
+
+static inline void adc_capture_finish(adc_capture_t* capture)
+{
+    for(int i = 0; i < capture->slot_count; i++)
+    {
+        if(capture->remaining[i]) { return; }
+    }
+    adc_capture_complete(capture);
+}
+
+// ADC task; record one DMA buffer
+void adc_capture_buffer(adc_capture_t* capture, const adc_digi_output_data_t* samples, size_t len)
+{
+    if(!capture->len) { return; }
+
+    const uint32_t requests = __atomic_exchange_n(&(capture->requests), 0, __ATOMIC_RELAXED);
+    if(requests & ADC_CAPTURE_REQ_ARM) { adc_capture_arm(capture); }
+    if((requests & ADC_CAPTURE_REQ_TRIGGER) && capture->state == ADC_CAPTURE_ARMED) { capture->trigger_pending = true; }
+
+    if(capture->state != ADC_CAPTURE_ARMED && capture->state != ADC_CAPTURE_TRIGGERED) { return; }
+
+    for(size_t i = 0; i < len; i++)
+    {
+        const uint8_t channel = samples[i].type1.channel;
+        const int8_t slot = channel < ADC1_CHANNEL_MAX ? capture->channel_slot[channel] : -1;
+        if(slot < 0) { continue; }
+        const uint16_t value = samples[i].type1.data;
+
+        if(capture->state == ADC_CAPTURE_ARMED && capture->pre_slots == capture->slot_count)
+        {
+            // trigger is accepted once the pre-trigger part of the rings of all slots is filled
+            if(slot == capture->trigger_slot && capture->has_last)
+            {
+                if((capture->trigger == ADC_CAPTURE_TRIGGER_RISING && capture->last < capture->level && value >= capture->level)
+                    || (capture->trigger == ADC_CAPTURE_TRIGGER_FALLING && capture->last > capture->level && value <= capture->level))
+                {
+                    capture->trigger_pending = true;
+                }
+            }
+            if(capture->trigger_pending)
+            {
+                adc_capture_trigger(capture);
+            }
+        }
+        if(slot == capture->trigger_slot)
+        {
+            capture->last = value;
+            capture->has_last = true;
+        }
+
+        if(capture->state == ADC_CAPTURE_DONE) { break; }
+
+        // record
+        capture->data[slot * capture->len + capture->pos[slot]] = value;
+        capture->pos[slot] = (capture->pos[slot] + 1) % capture->len;
+        if(capture->filled[slot] < capture->len && ++(capture->filled[slot]) == capture->pre) { capture->pre_slots++; }
+
+        if(capture->state == ADC_CAPTURE_TRIGGERED && capture->remaining[slot])
+        {
+            if(!--(capture->remaining[slot]))
+            {
+                adc_capture_finish(capture);
+                if(capture->state == ADC_CAPTURE_DONE) { break; }
+            }
+        }
+    }
+}
+
+// status registers: state, capture sequence, samples per channel, pre-trigger samples, channels
+#define ADC_CAPTURE_STATUS_REGS 5
+
+// IO task; sequence changes with every completed capture and guards downloads against re-arming
+static inline void adc_capture_status(const adc_capture_t* capture, uint16_t* regs)
+{
+    regs[0] = __atomic_load_n(&(capture->state), __ATOMIC_ACQUIRE);
+    regs[1] = capture->sequence;
+    regs[2] = capture->len;
+    regs[3] = capture->pre;
+    regs[4] = capture->slot_count;
+}
+
+// modbus side; copy samples [first, first + count) of a completed capture in chronological order
+// returns ESP_ERR_INVALID_STATE if no completed capture is available
+esp_err_t adc_capture_read(const adc_capture_t* capture, uint8_t slot, uint16_t first, uint16_t count, uint16_t* data)
+{
+    if(__atomic_load_n(&(capture->state), __ATOMIC_ACQUIRE) != ADC_CAPTURE_DONE) { return ESP_ERR_INVALID_STATE; }
+    if(slot >= capture->slot_count || (uint32_t)first + count > capture->len) { return ESP_ERR_INVALID_ARG; }
+
+    const uint16_t* ring = capture->data + slot * capture->len;
+    for(uint16_t i = 0; i < count; i++)
+    {
+        data[i] = ring[(capture->start[slot] + first + i) % capture->len];
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,318 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "esp_system.h"
+#include "driver/adc.h"
+
+
+// per-channel reduction of the full ADC sample stream, in fixed point
+// samples arrive interleaved in pattern table order; each pattern slot (input register) is reduced
+// with a strided loop specialized per mode, instead of dispatching on every sample
+typedef enum {
+    ADC_REDUCE_LAST = 0, // newest sample
+    ADC_REDUCE_MEAN,     // mean over window
+    ADC_REDUCE_MIN,      // minimum over window
+    ADC_REDUCE_MAX,      // maximum over window
+    ADC_REDUCE_RMS,      // root mean square over window
+    ADC_REDUCE_IIR,      // first order low pass, y += (x - y) >> shift; continuous
+    ADC_REDUCE_MAX_MODE
+} adc_reduce_mode_t;
+
+// scale of reduced values; samples are converted before reduction
+typedef enum {
+    ADC_SCALE_RAW = 0,  // raw 12 bit readings
+    ADC_SCALE_MV        // calibrated millivolts from lookup table
+} adc_scale_t;
+#define ADC_SCALE_TABLE_LEN 4096 // one entry per 12 bit reading
+
+#define ADC_REDUCE_IIR_SHIFT_MAX 15
+#define ADC_REDUCE_IIR_FRAC_BITS 16 // fractional bits of IIR state
+#define ADC_REDUCE_SLOTS_MAX 8
+
+void print_adc_reduce_mode(adc_reduce_mode_t mode, uint8_t iir_shift)
+{
+    switch(mode) {
+        case ADC_REDUCE_LAST:
+            printf("last");
+            break;
+        case ADC_REDUCE_MEAN:
+            printf("mean");
+            break;
+        case ADC_REDUCE_MIN:
+            printf("min");
+            break;
+        case ADC_REDUCE_MAX:
+            printf("max");
+            break;
+        case ADC_REDUCE_RMS:
+            printf("rms");
+            break;
+        case ADC_REDUCE_IIR:
+            printf("iir:%i", iir_shift);
+            break;
+        default:
+            printf("UNKNOWN");
+    }
+}
+
+// parse "last", "mean", "min", "max", "rms" or "iir:<shift>"
+esp_err_t adc_reduce_mode_parse(const char* str, adc_reduce_mode_t* mode, uint8_t* iir_shift)
+{
+    *iir_shift = 0;
+    if(strcmp("last", str) == 0) { *mode = ADC_REDUCE_LAST; }
+    else if(strcmp("mean", str) == 0) { *mode = ADC_REDUCE_MEAN; }
+    else if(strcmp("min", str) == 0) { *mode = ADC_REDUCE_MIN; }
+    else if(strcmp("max", str) == 0) { *mode = ADC_REDUCE_MAX; }
+    else if(strcmp("rms", str) == 0) { *mode = ADC_REDUCE_RMS; }
+    else if(strncmp("iir:", str, 4) == 0)
+    {
+        int shift = atoi(str + 4);
+        if(shift < 1 || shift > ADC_REDUCE_IIR_SHIFT_MAX) { return ESP_ERR_INVALID_ARG; }
+        *mode = ADC_REDUCE_IIR;
+        *iir_shift = shift;
+    }
+    else
+    {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+// reduction state of one pattern slot
+typedef struct adc_reduce_slot_t {
+    adc_reduce_mode_t mode;
+    uint8_t iir_shift;
+    uint8_t channel;
+    bool valid; // value holds at least one reduced result
+    uint16_t value; // latest result
+    // window accumulators
+    uint32_t count;
+    uint32_t sum;
+    uint64_t sum_sq;
+    uint16_t min;
+    uint16_t max;
+    // continuous state
+    uint32_t iir; // ADC_REDUCE_IIR_FRAC_BITS fractional bits
+} adc_reduce_slot_t;
+
+// all slots of the ADC pattern table
+// window_buffers: DMA buffers per reduction window; windows are sized to one IO cycle
+// scale: ADC_SCALE_TABLE_LEN entries converting raw readings; NULL for raw values
+typedef struct adc_reduce_t {
+    const uint16_t* scale;
+    uint8_t slot_count;
+    int8_t channel_slot[ADC1_CHANNEL_MAX]; // pattern slot of channel; -1 for unused channels
+    adc_reduce_slot_t slots[ADC_REDUCE_SLOTS_MAX];
+    uint32_t window_buffers;
+    uint32_t buffers; // DMA buffers in current window
+} adc_reduce_t;
+
+static inline void adc_reduce_window_reset(adc_reduce_slot_t* slot)
+{
+    slot->count = 0;
+    slot->sum = 0;
+    slot->sum_sq = 0;
+    slot->min = UINT16_MAX;
+    slot->max = 0;
+}
+
+void adc_reduce_init(adc_reduce_t* reduce, uint8_t slot_count, const adc1_channel_t* channels, const adc_reduce_mode_t* modes, const uint8_t* iir_shifts, uint32_t window_buffers, const uint16_t* scale)
+{
+    memset((void*)reduce, 0, sizeof(adc_reduce_t));
+    memset((void*)reduce->channel_slot, -1, sizeof(reduce->channel_slot));
+    reduce->scale = scale;
+    reduce->slot_count = slot_count;
+    reduce->window_buffers = window_buffers ? window_buffers : 1;
+
+    for(int i = 0; i < slot_count; i++)
+    {
+        adc_reduce_slot_t* slot = &(reduce->slots[i]);
+        slot->mode = modes[i];
+        slot->iir_shift = iir_shifts[i];
+        slot->channel = channels[i];
+        adc_reduce_window_reset(slot);
+        if(reduce->channel_slot[channels[i]] < 0)
+        {
+            reduce->channel_slot[channels[i]] = i;
+        }
+    }
+}
+
+static inline uint16_t adc_reduce_isqrt(uint32_t x)
+{
+    uint32_t root = 0;
+    uint32_t bit = (uint32_t)1 << 30;
+    while(bit > x) { bit >>= 2; }
+    while(bit)
+    {
+        if(x >= root + bit)
+        {
+            x -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+        {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return root;
+}
+
+// raw or scaled reading; with a constant NULL scale the table load is compiled out
+#define ADC_REDUCE_SAMPLE(samples, i, scale) ((scale) ? (scale)[(samples)[i].type1.data] : (samples)[i].type1.data)
+
+// reduce samples at start, start + stride, ... < len of one slot
+static inline void adc_reduce_slot_run(adc_reduce_slot_t* slot, const adc_digi_output_data_t* samples, size_t start, size_t len, size_t stride, const uint16_t* scale)
+{
+    if(start >= len) { return; }
+
+    switch(slot->mode)
+    {
+        case ADC_REDUCE_LAST:
+            slot->value = ADC_REDUCE_SAMPLE(samples, start + (len - 1 - start) / stride * stride, scale);
+            slot->valid = true;
+            break;
+        case ADC_REDUCE_MEAN:
+        {
+            uint32_t sum = 0;
+            uint32_t count = 0;
+            for(size_t i = start; i < len; i += stride) { sum += ADC_REDUCE_SAMPLE(samples, i, scale); count++; }
+            slot->sum += sum;
+            slot->count += count;
+            break;
+        }
+        case ADC_REDUCE_MIN:
+        {
+            uint16_t min = slot->min;
+            for(size_t i = start; i < len; i += stride) { const uint16_t x = ADC_REDUCE_SAMPLE(samples, i, scale); if(x < min) { min = x; } }
+            slot->min = min;
+            slot->count++;
+            break;
+        }
+        case ADC_REDUCE_MAX:
+        {
+            uint16_t max = slot->max;
+            for(size_t i = start; i < len; i += stride) { const uint16_t x = ADC_REDUCE_SAMPLE(samples, i, scale); if(x > max) { max = x; } }
+            slot->max = max;
+            slot->count++;
+            break;
+        }
+        case ADC_REDUCE_RMS:
+        {
+            uint32_t sum_sq = 0; // max 16 samples of 12 bits (or < 4096mV) per DMA buffer
+            uint32_t count = 0;
+            for(size_t i = start; i < len; i += stride) { const uint32_t x = ADC_REDUCE_SAMPLE(samples, i, scale); sum_sq += x * x; count++; }
+            slot->sum_sq += sum_sq;
+            slot->count += count;
+            break;
+        }
+        case ADC_REDUCE_IIR:
+        {
+            int32_t y = slot->iir;
+            const uint8_t shift = slot->iir_shift;
+            if(!slot->valid)
+            {
+                // start from first sample instead of settling from zero
+                y = (int32_t)ADC_REDUCE_SAMPLE(samples, start, scale) << ADC_REDUCE_IIR_FRAC_BITS;
+            }
+            for(size_t i = start; i < len; i += stride) { y += (((int32_t)ADC_REDUCE_SAMPLE(samples, i, scale) << ADC_REDUCE_IIR_FRAC_BITS) - y) >> shift; }
+            slot->iir = y;
+            slot->value = (y + ((int32_t)1 << (ADC_REDUCE_IIR_FRAC_BITS - 1))) >> ADC_REDUCE_IIR_FRAC_BITS;
+            slot->valid = true;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// close window of slot and update value
+static inline void adc_reduce_slot_window(adc_reduce_slot_t* slot)
+{
+    if(!slot->count) { return; }
+
+    switch(slot->mode)
+    {
+        case ADC_REDUCE_MEAN:
+            slot->value = (slot->sum + slot->count / 2) / slot->count;
+            break;
+        case ADC_REDUCE_MIN:
+            slot->value = slot->min;
+            break;
+        case ADC_REDUCE_MAX:
+            slot->value = slot->max;
+            break;
+        case ADC_REDUCE_RMS:
+            slot->value = adc_reduce_isqrt(slot->sum_sq / slot->count);
+            break;
+        default:
+            return;
+    }
+    slot->valid = true;
+    adc_reduce_window_reset(slot);
+}
+
+// per sample fallback if samples are not in pattern order
+static void adc_reduce_samples(adc_reduce_t* reduce, const adc_digi_output_data_t* samples, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        const uint8_t channel = samples[i].type1.channel;
+        if(channel < ADC1_CHANNEL_MAX && reduce->channel_slot[channel] >= 0)
+        {
+            adc_reduce_slot_run(&(reduce->slots[reduce->channel_slot[channel]]), samples, i, i + 1, 1, reduce->scale);
+        }
+    }
+}
+
+// reduce one DMA buffer; returns true if samples followed the pattern table order
+bool adc_reduce_buffer(adc_reduce_t* reduce, const adc_digi_output_data_t* samples, size_t len)
+{
+    const size_t n = reduce->slot_count;
+    bool in_order = n && len;
+
+    // phase of pattern at first sample; check order of all samples
+    int phase = 0;
+    if(in_order)
+    {
+        const uint8_t channel = samples[0].type1.channel;
+        phase = channel < ADC1_CHANNEL_MAX ? reduce->channel_slot[channel] : -1;
+        in_order = phase >= 0;
+        for(size_t i = 0; in_order && i < len; i++)
+        {
+            in_order = samples[i].type1.channel == reduce->slots[(phase + i) % n].channel;
+        }
+    }
+
+    if(in_order)
+    {
+        for(size_t slot = 0; slot < n; slot++)
+        {
+            const size_t start = (slot + n - phase) % n;
+            if(reduce->scale)
+            {
+                adc_reduce_slot_run(&(reduce->slots[slot]), samples, start, len, n, reduce->scale);
+            }
+            else
+            {
+                adc_reduce_slot_run(&(reduce->slots[slot]), samples, start, len, n, NULL);
+            }
+        }
+    }
+    else
+    {
+        adc_reduce_samples(reduce, samples, len);
+    }
+
+    if(++(reduce->buffers) >= reduce->window_buffers)
+    {
+        for(size_t slot = 0; slot < n; slot++)
+        {
+            adc_reduce_slot_window(&(reduce->slots[slot]));
+        }
+        reduce->buffers = 0;
+    }
+
+    return in_order;
+}
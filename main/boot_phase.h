@@ -0,0 +1,16 @@
+#pragma once
+#include <stdio.h>
+#include "esp_timer.h"
+
+
+// boot phase timestamps; time since boot and since the previous phase
+// tracks time to first IO cycle and how long network bring-up runs next to it
+static int64_t boot_phase_last_us;
+
+void boot_phase(const char* phase)
+{
+    const int64_t now_us = esp_timer_get_time();
+    printf("boot: %-24s at %8lluus (+%lluus)\n", phase, (unsigned long long) now_us, (unsigned long long) (now_us - boot_phase_last_us));
+    fflush(stdout);
+    boot_phase_last_us = now_us;
+}
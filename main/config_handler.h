@@ -4,9 +4,82 @@
 #include "wifi_handler.h"
 #include "config_server.h"
 #include "io_config.h"
+#include "io_config_cache.h"
+#include "io_reconfig.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
 
 #define NVS_STORAGE_NAMESPACE "storage"
-#define CONFIG_KEY_TIMEOUT_SEC 1
+
+// configuration is entered on boot by holding the strap pin low, or by a key press within one window;
+// stored configuration is used otherwise and nothing waits for the console
+// strap pin is pulled up internally and released after sampling; -1 disables it
+// a window of 0 boots without waiting, leaving the strap pin as the only way into configuration
+#define CONFIG_STRAP_GPIO -1
+#define CONFIG_WINDOW_MS 1000
+#define CONFIG_WINDOW_POLL_MS 100
+
+// configuration requested on boot
+typedef struct config_req_t {
+    bool clear;
+    bool wifi;
+} config_req_t;
+
+bool config_strap_requested()
+{
+#if CONFIG_STRAP_GPIO >= 0
+    gpio_config_t strap_config = {
+        .pin_bit_mask = (uint64_t)0x01 << CONFIG_STRAP_GPIO,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .mode = GPIO_MODE_INPUT,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    gpio_config(&strap_config);
+    const bool requested = gpio_get_level(CONFIG_STRAP_GPIO) == 0;
+    gpio_reset_pin(CONFIG_STRAP_GPIO);
+
+    if(requested) { printf("configuration requested by strap pin GPIO %i\n", CONFIG_STRAP_GPIO); }
+    return requested;
+#else
+    return false;
+#endif
+}
+
+// single window for all configuration; strap pin skips the window and opens the menu directly
+config_req_t config_user_request(bool strap)
+{
+    config_req_t req = { .clear = false, .wifi = false };
+
+    bool menu = strap;
+    if(!menu && CONFIG_WINDOW_MS > 0)
+    {
+        printf("Press any key to configure...\n");
+        fflush(stdout);
+
+        // wait for config request
+        for(int waited_ms = 0; waited_ms <= CONFIG_WINDOW_MS; waited_ms += CONFIG_WINDOW_POLL_MS)
+        {
+            if(fgetc(stdin) != EOF) {
+                menu = true;
+                break;
+            }
+            vTaskDelay(CONFIG_WINDOW_POLL_MS / portTICK_PERIOD_MS);
+        }
+    }
+    if(!menu) { return req; }
+
+    char choice[8] = "";
+    // IO config is POSTed to /config at any time
+    printf("Configure [w]iFi, [c]lear all config; enter to continue: ");
+    fgets_async_blocking(choice, 8, stdin, true, false);
+    printf("\n");
+    clear_stdin();
+
+    req.clear = strchr(choice, 'c') != NULL;
+    req.wifi = strchr(choice, 'w') != NULL;
+    return req;
+}
 
 static void print_auth_mode(int authmode)
 {
@@ -41,10 +114,9 @@ static void print_auth_mode(int authmode)
     }
 }
 
-int wifi_user_config_handler(char* ssid, size_t ssid_len, char* passwd, size_t passwd_len)
+// config_req: configure even if credentials are present
+int wifi_user_config_handler(char* ssid, size_t ssid_len, char* passwd, size_t passwd_len, bool config_req)
 {
-    bool config_req = false;
-
     memset(ssid, 0, ssid_len*sizeof(char));
     memset(passwd, 0, passwd_len*sizeof(char));
 
@@ -68,22 +140,6 @@ int wifi_user_config_handler(char* ssid, size_t ssid_len, char* passwd, size_t p
         }
     }
 
-    // allow user to request configuration (if credentials present)
-    if(!config_req)
-    {
-        printf("Press any key to configure WiFi...\n");
-        fflush(stdout);
-
-        // wait for config request
-        for (int wait_config_reps = 10; wait_config_reps >= 0; wait_config_reps--) {
-            if(fgetc(stdin) != EOF) {
-                config_req = true;
-                break;
-            }
-            vTaskDelay(CONFIG_KEY_TIMEOUT_SEC * 100 / portTICK_PERIOD_MS);
-        }
-    }
-
     if(config_req) {
         // let user configure wifi
         clear_stdin();
@@ -125,32 +181,66 @@ int wifi_user_config_handler(char* ssid, size_t ssid_len, char* passwd, size_t p
         clear_stdin();
 
         // persist values
-        if(nvs_set_str(NVS, "ssid", ssid) != ESP_OK) { return EXIT_FAILURE; }
-        if(nvs_set_str(NVS, "passwd", passwd) != ESP_OK) { return EXIT_FAILURE; }
-        nvs_commit(NVS);
+        esp_err_t err = nvs_set_str(NVS, "ssid", ssid);
+        if(!err) { err = nvs_set_str(NVS, "passwd", passwd); }
+        if(!err) { nvs_commit(NVS); }
+        nvs_close(NVS);
+        if(err) { return EXIT_FAILURE; }
     }
     else
     {
         // use persisted values
-        if(nvs_get_str(NVS, "ssid", ssid, &ssid_len) != ESP_OK) { return EXIT_FAILURE; }
-        if(nvs_get_str(NVS, "passwd", passwd, &passwd_len) != ESP_OK) { return EXIT_FAILURE; }
+        esp_err_t err = nvs_get_str(NVS, "ssid", ssid, &ssid_len);
+        if(!err) { err = nvs_get_str(NVS, "passwd", passwd, &passwd_len); }
+        nvs_close(NVS);
+        if(err) { return EXIT_FAILURE; }
     }
     return EXIT_SUCCESS;
 }
 
-#define IO_JSON_BUFF_SIZE 500
-int io_user_config_handler(io_config_t* io_config)
+// IO config JSON is persisted as received; statically allocated, the parser itself needs no buffer
+// shared by loading on boot and the configuration server, which starts after loading
+#define IO_JSON_BUFF_SIZE 4096
+static char io_json[IO_JSON_BUFF_SIZE];
+
+// compiled config is cached in NVS as "io_bin" next to "io_json"; see io_config_cache.h
+static io_config_cache_t io_config_cache;
+
+esp_err_t io_config_cache_store(nvs_handle_t NVS, const io_compiled_t* compiled)
 {
-    bool config_req = false;
+    io_config_cache_build(&io_config_cache, compiled);
+    return nvs_set_blob(NVS, "io_bin", &io_config_cache, sizeof(io_config_cache_t));
+}
 
-    char io_json[IO_JSON_BUFF_SIZE];
+esp_err_t io_config_cache_load(nvs_handle_t NVS, io_compiled_t* compiled)
+{
+    size_t size = sizeof(io_config_cache_t);
+    esp_err_t err = nvs_get_blob(NVS, "io_bin", &io_config_cache, &size);
+    if(err)
+    {
+        printf("no IO config cache present\n");
+        return err;
+    }
+    err = io_config_cache_check(&io_config_cache, size);
+    if(err) { return err; }
+
+    memcpy((void*)compiled, (const void*)&(io_config_cache.compiled), sizeof(io_compiled_t));
+    return ESP_OK;
+}
+
+// IO config from NVS; compiled config from cache if valid, built from JSON otherwise
+// fails if no valid config is stored, to be received with io_user_config_receive()
+int io_user_config_load(io_compiled_t* compiled)
+{
+    size_t io_json_size = IO_JSON_BUFF_SIZE;
+    static io_config_t io_config = IO_CONFIG_DEFAULT();
 
     nvs_handle_t NVS;
     if (nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &NVS) != ESP_OK) {
         printf("Error opening NVS handle!\n");
         return EXIT_FAILURE;
     }
-    // check for persistent io config -> if none: req=true
+    // check for persistent io config
     {
         size_t io_json_nvm_size;
         esp_err_t err = nvs_get_blob(NVS, "io_json", NULL, &io_json_nvm_size);
@@ -160,86 +250,159 @@ int io_user_config_handler(io_config_t* io_config)
             printf("No valid persistent IO configuration present. Requiring config!");
             if(io_json_nvm_size == 0) { printf(" [size is 0]"); }
             if(io_json_nvm_size > IO_JSON_BUFF_SIZE) { printf(" [too large]"); }
-            config_req = true;
             printf("\n");
+            nvs_close(NVS);
+            return EXIT_FAILURE;
         }
     }
 
-    // allow user to request configuration (if credentials present)
-    if(!config_req)
+    const int64_t start_us = esp_timer_get_time();
+    if(!io_config_cache_load(NVS, compiled))
     {
-        printf("Press any key to configure IO...\n");
-        fflush(stdout);
-
-        // wait for config request
-        for (int wait_config_reps = 10; wait_config_reps >= 0; wait_config_reps--) {
-            if(fgetc(stdin) != EOF) {
-                config_req = true;
-                break;
-            }
-            vTaskDelay(CONFIG_KEY_TIMEOUT_SEC * 100 / portTICK_PERIOD_MS);
-        }
+        printf("using cached IO config; loaded in %uus\n", (uint32_t)(esp_timer_get_time() - start_us));
+        nvs_close(NVS);
+        return EXIT_SUCCESS;
     }
 
-    if(config_req) {
-        size_t io_json_size = IO_JSON_BUFF_SIZE;
-        get_io_json_http(io_json, &io_json_size);
+    // use persisted values
+    nvs_get_blob(NVS, "io_json", NULL, &io_json_size);
+    // size has been tested to fit in allocated buffer before
+    if(nvs_get_blob(NVS, "io_json", io_json, &io_json_size) != ESP_OK)
+    {
+        printf("fetching IO config from nvs failed!\n");
+        nvs_close(NVS);
+        return EXIT_FAILURE;
+    }
 
-        printf("got valid config!");
+    // build config; cache it for next boot
+    printf("using config:\n%.*s\n", io_json_size, io_json);
+    if(io_config_generate(io_json, io_json_size, &io_config))
+    {
+        // stored with an earlier firmware; do not start IO on a partial config
+        printf("stored IO config is invalid. Requiring config!\n");
+        nvs_close(NVS);
+        return EXIT_FAILURE;
+    }
+    io_config_compile(&io_config, compiled);
+    printf("built IO config from JSON in %uus\n", (uint32_t)(esp_timer_get_time() - start_us));
 
-        // persist values
-        if(nvs_set_blob(NVS, "io_json", io_json, io_json_size) != ESP_OK)
-        {
-            printf("storing IO config in nvs failed!\n");
-            return EXIT_FAILURE;
-        }
+    if(io_config_cache_store(NVS, compiled) == ESP_OK)
+    {
         nvs_commit(NVS);
     }
-    else
+    nvs_close(NVS);
+
+    return EXIT_SUCCESS;
+}
+
+// IO configs received over HTTP are persisted; the first one is handed to app_main if none was stored,
+// later ones switch the running IO task over at a cycle boundary (see io_reconfig.h)
+static io_compiled_t io_received;
+static EventGroupHandle_t io_received_event = NULL;
+static io_task_params_t* io_reconfig_task = NULL;
+
+// a failed switch-over leaves peripherals half way; restart into the stored config once the response is sent
+#define IO_CONFIG_RESTART_DELAY_MS 500
+#define IO_CONFIG_RESTART_TASK_STACK_SIZE 2048
+#define IO_CONFIG_RESTART_TASK_PRIORITY 1
+
+static void vIoConfigRestartTask(void* params)
+{
+    vTaskDelay(IO_CONFIG_RESTART_DELAY_MS / portTICK_PERIOD_MS);
+    printf("Rebooting!\n");
+    esp_restart();
+}
+
+static esp_err_t io_user_config_received(const char* data, size_t size, io_config_t* io_config, char* resp, size_t resp_size)
+{
+    io_config_compile(io_config, &io_received);
+
+    nvs_handle_t NVS;
+    if (nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &NVS) != ESP_OK) {
+        printf("Error opening NVS handle!\n");
+        return ESP_FAIL;
+    }
+    // persist values
+    if(nvs_set_blob(NVS, "io_json", data, size) != ESP_OK)
     {
-        // use persisted values
-        size_t io_json_nvm_size;
-        nvs_get_blob(NVS, "io_json", NULL, &io_json_nvm_size);
-        // size has been tested to fit in allocated buffer before
-        // char* io_json = malloc(io_json_nvm_size);
-        if(nvs_get_blob(NVS, "io_json", io_json, &io_json_nvm_size) != ESP_OK)
-        {
-            printf("fetching IO config from nvs failed!\n");
-            return EXIT_FAILURE;
-        }
+        printf("storing IO config in nvs failed!\n");
+        nvs_close(NVS);
+        return ESP_FAIL;
+    }
+    if(io_config_cache_store(NVS, &io_received) != ESP_OK)
+    {
+        // cache of the previous config would be loaded first; without it, JSON is used on next boot
+        printf("storing IO config cache in nvs failed!\n");
+        nvs_erase_key(NVS, "io_bin");
+    }
+    nvs_commit(NVS);
+    nvs_close(NVS);
+
+    io_task_params_t* params = __atomic_load_n(&io_reconfig_task, __ATOMIC_ACQUIRE);
+    if(!params)
+    {
+        printf("got valid config!\n");
+        xEventGroupSetBits(io_received_event, BIT0);
+        return ESP_OK;
     }
-    
 
-    // build config
-    printf("using config:\n%s\n", io_json);
-    io_config_generate(io_json, io_config);
+    io_reconfig_stats_t stats;
+    esp_err_t err = io_reconfig_apply(params, &io_received, &stats);
+    if(err == ESP_ERR_NOT_SUPPORTED)
+    {
+        snprintf(resp, resp_size, "{\"stored\": true, \"reboot_required\": true}");
+        return ESP_OK;
+    }
+    if(err)
+    {
+        printf("switching over failed; restarting into the stored config\n");
+        snprintf(resp, resp_size, "{\"stored\": true, \"error\": \"could not switch over\", \"restarting\": true}");
+        xTaskCreate(vIoConfigRestartTask, "io_config_restart", IO_CONFIG_RESTART_TASK_STACK_SIZE, NULL, IO_CONFIG_RESTART_TASK_PRIORITY, NULL);
+        return err;
+    }
+    snprintf(resp, resp_size, "{\"switchover_us\": %u, \"prepare_us\": %u, \"wait_us\": %u, \"swap_ns\": %u, \"release_us\": %u}",
+        stats.total_us, stats.prepare_us, stats.wait_us, stats.swap_ns, stats.release_us);
+    return ESP_OK;
+}
 
+// start configuration server; runs for as long as the coupler does, requires network
+int io_user_config_server()
+{
+    if(io_received_event) { return EXIT_SUCCESS; }
+    io_received_event = xEventGroupCreate();
+    if(start_config_server(io_json, IO_JSON_BUFF_SIZE, io_user_config_received))
+    {
+        return EXIT_FAILURE;
+    }
     return EXIT_SUCCESS;
 }
 
-void clear_user_config_handler()
+// wait for the first IO config; if none is stored
+int io_user_config_receive(io_compiled_t* compiled)
 {
-        printf("Press any key to clear config...\n");
-        fflush(stdout);
-        bool clear_req = false;
-        // wait for config request
-        for (int wait_config_reps = 10; wait_config_reps >= 0; wait_config_reps--) {
-            if(fgetc(stdin) != EOF) {
-                clear_req = true;
-                break;
-            }
-            vTaskDelay(CONFIG_KEY_TIMEOUT_SEC * 100 / portTICK_PERIOD_MS);
-        }
+    if(io_user_config_server()) { return EXIT_FAILURE; }
 
-        if(clear_req)
-        {
-            printf("Erasing user config!\n");
-            nvs_handle_t NVS;
-            if (nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &NVS) != ESP_OK) {
-                printf("Error opening NVS handle!\n");
-                return;
-            }
-            nvs_erase_all(NVS);
-            nvs_commit(NVS);
-        }
-}
\ No newline at end of file
+    printf("waiting for IO config...\n");
+    xEventGroupWaitBits(io_received_event, BIT0, pdTRUE, pdFALSE, portMAX_DELAY);
+    memcpy((void*)compiled, (const void*)&io_received, sizeof(io_compiled_t));
+    return EXIT_SUCCESS;
+}
+
+// IO configs received from now on switch the running IO task over; call once the IO task runs
+void io_user_config_attach(io_task_params_t* params)
+{
+    __atomic_store_n(&io_reconfig_task, params, __ATOMIC_RELEASE);
+}
+
+void clear_user_config()
+{
+    printf("Erasing user config!\n");
+    nvs_handle_t NVS;
+    if (nvs_open(NVS_STORAGE_NAMESPACE, NVS_READWRITE, &NVS) != ESP_OK) {
+        printf("Error opening NVS handle!\n");
+        return;
+    }
+    nvs_erase_all(NVS);
+    nvs_commit(NVS);
+    nvs_close(NVS);
+}
@@ -5,40 +5,54 @@
 #include "esp_http_server.h"
 
 #include "io_config.h"
+#include "io_stream.h"
 
 
+// called from the server task for each valid config; data: document as received, for persistence
+// resp: response body, JSON; left empty for an empty response
+typedef esp_err_t (*config_received_t)(const char* data, size_t size, io_config_t* io_config, char* resp, size_t resp_size);
+
 typedef struct handler_ctx_t {
     char* data;
     size_t size;
-    EventGroupHandle_t evtgrp;
+    config_received_t on_config;
 } handler_ctx_t;
 
+#define CONFIG_RESP_LEN 192
+// the POST handler keeps config, parser and response on the server task stack and runs the whole reconfiguration
+// on it: NVS writes, ADC/DAC driver setup, gpio_config() and console output; HTTPD_DEFAULT_CONFIG() gives 4096
+#define CONFIG_SERVER_STACK_SIZE 8192
+
+// received chunks are stored for persistence and parsed as they arrive; no intermediate copy or DOM
 static esp_err_t config_post_handler(httpd_req_t *req)
 {
-    char* buffJSON = ((handler_ctx_t*) req->user_ctx)->data;
-    size_t buffJSON_size = ((handler_ctx_t*) req->user_ctx)->size;
+    handler_ctx_t* ctx = (handler_ctx_t*) req->user_ctx;
+    char* buffJSON = ctx->data;
+    size_t buffJSON_size = ctx->size;
     // printf("Returning JSON to %p[%u]\n", buffJSON, buffJSON_size);
 
-    char buf[100];
     int transferred = 0;
     int ret, remaining = req->content_len;
     // printf("content-length: %i\n", remaining);
 
+    char resp[CONFIG_RESP_LEN] = "";
     if(remaining > buffJSON_size)
     {
         printf("too much data!\n");
-        char err_resp[128];
-        sprintf(err_resp, "{\"error:\": \"buffer exhausted; use less than %i bytes\"}", buffJSON_size);
-        printf("err resp: %s\n", err_resp);
-        httpd_resp_send_chunk(req, err_resp, strlen(err_resp));
+        sprintf(resp, "{\"error\": \"buffer exhausted; use less than %i bytes\"}", buffJSON_size);
+        printf("err resp: %s\n", resp);
+        httpd_resp_send_chunk(req, resp, strlen(resp));
         httpd_resp_send_chunk(req, NULL, 0);
         return ESP_OK;
     }
 
+    io_config_t io_config = IO_CONFIG_DEFAULT();
+    io_config_parser_t parser;
+    io_config_parse_begin(&parser, &io_config);
+
     while (remaining > 0) {
         /* Read the data for the request */
-        if ((ret = httpd_req_recv(req, buf,
-                        (remaining < sizeof(buf) ? remaining : sizeof(buf)))) <= 0) {
+        if ((ret = httpd_req_recv(req, buffJSON + transferred, remaining)) <= 0) {
             if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
                 /* Retry receiving if timeout occurred */
                 continue;
@@ -46,58 +60,60 @@ static esp_err_t config_post_handler(httpd_req_t *req)
             return ESP_FAIL;
         }
 
-        // transfer to accumulation buffer
-        memcpy(buffJSON + transferred, buf, (remaining < sizeof(buf) ? remaining : sizeof(buf)));
+        io_config_parse_feed(&parser, buffJSON + transferred, ret);
         transferred += ret;
         remaining -= ret;
     }
-    ((handler_ctx_t*) req->user_ctx)->size = strlen(buffJSON);
-    // send response
-    httpd_resp_send_chunk(req, NULL, 0);
-
-    printf("=========== RECEIVED DATA ==========\n%s\n====================================\n", buffJSON);
 
+    printf("=========== RECEIVED DATA ==========\n%.*s\n====================================\n", transferred, buffJSON);
 
-    io_config_t io_config = IO_CONFIG_DEFAULT();
-    if(!io_config_generate(buffJSON, &io_config))
+    if(!io_config_parse_end(&parser))
     {
         io_config_print(&io_config);
-        printf("receive OK; sending signal...\n");
-        xEventGroupSetBits(((handler_ctx_t*) req->user_ctx)->evtgrp, BIT0);
+        printf("receive OK; applying...\n");
+        if(ctx->on_config(buffJSON, transferred, &io_config, resp, sizeof(resp)) && !resp[0])
+        {
+            sprintf(resp, "{\"error\": \"could not apply config\"}");
+        }
     }
     else
     {
         printf("could not read config\n");
+        sprintf(resp, "{\"error\": \"invalid config\"}");
     }
 
+    // send response
+    if(resp[0]) { httpd_resp_send_chunk(req, resp, strlen(resp)); }
+    httpd_resp_send_chunk(req, NULL, 0);
     fflush(stdout);
     
     return ESP_OK;
 }
 
 
-esp_err_t get_io_json_http(char* io_json, size_t* io_json_size)
+// receives IO config JSON by POST to /config for as long as the coupler runs; requests are handled one at a time
+// serves the live process image stream on /stream next to it, see io_stream.h
+// io_json: receive buffer of io_json_size bytes; on_config: called for each valid config
+esp_err_t start_config_server(char* io_json, size_t io_json_size, config_received_t on_config)
 {
-    httpd_handle_t server = NULL;
+    static httpd_handle_t server = NULL;
+    static handler_ctx_t json_ctx;
+    if(server) { return ESP_ERR_INVALID_STATE; }
+
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.lru_purge_enable = true;
+    config.stack_size = CONFIG_SERVER_STACK_SIZE;
 
-    EventGroupHandle_t io_json_event_group = xEventGroupCreate();
-
-    handler_ctx_t json_ctx = {
-        .data = io_json,
-        .size = *io_json_size,
-        .evtgrp = io_json_event_group
-    };
+    json_ctx.data = io_json;
+    json_ctx.size = io_json_size;
+    json_ctx.on_config = on_config;
 
     httpd_uri_t config_uri = {
         .uri       = "/config",
         .method    = HTTP_POST,
-        .handler   = config_post_handler
-        // .user_ctx  = (void*)&json_ctx
+        .handler   = config_post_handler,
+        .user_ctx  = (void*)&json_ctx
     };
-    config_uri.user_ctx  = (void*)&json_ctx;
-
 
     // Start the httpd server
     printf("Starting server on port: '%d'\n", config.server_port);
@@ -106,27 +122,14 @@ esp_err_t get_io_json_http(char* io_json, size_t* io_json_size)
         // Set URI handlers
         // printf("Registering URI handlers\n");
         httpd_register_uri_handler(server, &config_uri);
+        if(io_stream_register(server)) { printf("registering process image stream failed!\n"); }
     }
     else
     {
         printf("Configuration server creation failed!\n");
+        server = NULL;
         return ESP_FAIL;
     }
 
-    // wait async blocking for config data
-    EventBits_t bits;
-    do
-    {
-        printf("waiting for IO config...\n");
-        bits = xEventGroupWaitBits(io_json_event_group, BIT0, pdFALSE, pdFALSE, portMAX_DELAY);
-    } while(!(bits & BIT0));
-    vEventGroupDelete(io_json_event_group);
-
-    // copy size from handler to result
-    *io_json_size = json_ctx.size;
-
-    printf("stopping server...\n");
-    httpd_stop(server);
-
     return ESP_OK;
-}
\ No newline at end of file
+}
@@ -0,0 +1,304 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include "esp_system.h"
+#include "driver/dac.h"
+#include "driver/timer.h"
+
+
+// DAC output engine; holding registers are applied per channel depending on mode:
+//   setpoint: written directly at the output latch of the IO cycle
+//   ramp: target approached with limited slew rate by a timer at dac_rate_hz
+//   table: waveform from a 256 entry table, replayed by the timer with phase accumulator; register is the offset
+//   cosine: hardware cosine generator; register is the offset (128: centered)
+// the timer ISR only runs if a ramp or table channel is configured; it is allocated on the core calling dac_engine_init()
+// I2S DMA streaming is not used, since I2S0 (the only I2S unit connected to the DAC) streams the ADC
+typedef enum {
+    DAC_MODE_SETPOINT = 0,
+    DAC_MODE_RAMP,
+    DAC_MODE_TABLE,
+    DAC_MODE_COSINE
+} dac_mode_t;
+
+typedef enum {
+    DAC_WAVE_SINE = 0,
+    DAC_WAVE_TRIANGLE,
+    DAC_WAVE_SAW,
+    DAC_WAVE_SQUARE
+} dac_wave_t;
+
+#define DAC_RATE_HZ_MIN 1000
+#define DAC_RATE_HZ_MAX 50000
+#define DAC_RATE_HZ_DEFAULT 10000
+// cosine generator frequency range
+#define DAC_CW_FREQ_HZ_MIN 130
+#define DAC_CW_FREQ_HZ_MAX 55000
+
+// slew: ramp counts per ms
+// wave, amplitude: table waveform and its peak deviation from offset in counts
+// freq_hz: table or cosine frequency
+// cw_scale: cosine amplitude divisor (1, 2, 4, 8); cw_phase: cosine phase (0, 180)
+typedef struct dac_output_config_t {
+    dac_mode_t mode;
+    uint16_t slew;
+    dac_wave_t wave;
+    uint8_t amplitude;
+    uint32_t freq_hz;
+    uint8_t cw_scale;
+    uint16_t cw_phase;
+} dac_output_config_t;
+
+#define DAC_OUTPUT_CONFIG_DEFAULT() { .mode = DAC_MODE_SETPOINT, .slew = 0, .wave = DAC_WAVE_SINE, .amplitude = 127, .freq_hz = 0, .cw_scale = 1, .cw_phase = 0 }
+
+void print_dac_output_config(const dac_output_config_t* config)
+{
+    static const char* waves[] = { "sine", "triangle", "saw", "square" };
+    switch(config->mode) {
+        case DAC_MODE_SETPOINT:
+            printf("setpoint");
+            break;
+        case DAC_MODE_RAMP:
+            printf("ramp %u/ms", config->slew);
+            break;
+        case DAC_MODE_TABLE:
+            printf("%s %uHz +-%u", waves[config->wave], config->freq_hz, config->amplitude);
+            break;
+        case DAC_MODE_COSINE:
+            printf("cosine %uHz 1/%u %u deg", config->freq_hz, config->cw_scale, config->cw_phase);
+            break;
+        default:
+            printf("UNKNOWN");
+    }
+}
+
+// parse "setpoint", "ramp", "table" or "cosine"
+esp_err_t dac_mode_parse(const char* str, dac_mode_t* mode)
+{
+    if(strcmp("setpoint", str) == 0) { *mode = DAC_MODE_SETPOINT; }
+    else if(strcmp("ramp", str) == 0) { *mode = DAC_MODE_RAMP; }
+    else if(strcmp("table", str) == 0) { *mode = DAC_MODE_TABLE; }
+    else if(strcmp("cosine", str) == 0) { *mode = DAC_MODE_COSINE; }
+    else { return ESP_ERR_INVALID_ARG; }
+    return ESP_OK;
+}
+
+// parse "sine", "triangle", "saw" or "square"
+esp_err_t dac_wave_parse(const char* str, dac_wave_t* wave)
+{
+    if(strcmp("sine", str) == 0) { *wave = DAC_WAVE_SINE; }
+    else if(strcmp("triangle", str) == 0) { *wave = DAC_WAVE_TRIANGLE; }
+    else if(strcmp("saw", str) == 0) { *wave = DAC_WAVE_SAW; }
+    else if(strcmp("square", str) == 0) { *wave = DAC_WAVE_SQUARE; }
+    else { return ESP_ERR_INVALID_ARG; }
+    return ESP_OK;
+}
+
+#define DAC_TIMER_GROUP TIMER_GROUP_0
+#define DAC_TIMER_IDX TIMER_1
+#define DAC_TIMER_DIVIDER 80 // 80MHz APB clock -> 1MHz
+#define DAC_TABLE_BITS 8
+#define DAC_TABLE_LEN (1 << DAC_TABLE_BITS)
+#define DAC_RAMP_FRAC_BITS 16
+
+// target: setpoint/ramp target or waveform offset; written by IO task, read by timer ISR
+typedef struct dac_engine_channel_t {
+    dac_mode_t mode;
+    dac_channel_t channel;
+    volatile uint8_t target;
+    // ramp
+    int32_t value; // DAC_RAMP_FRAC_BITS fractional bits
+    int32_t step;
+    // table
+    uint32_t phase;
+    uint32_t phase_step;
+    int16_t table[DAC_TABLE_LEN];
+    // cosine
+    dac_cw_config_t cw;
+} dac_engine_channel_t;
+
+typedef struct dac_engine_t {
+    uint8_t channel_count;
+    bool timer; // timer driven channels present
+    uint32_t rate_hz;
+    dac_engine_channel_t channels[DAC_CHANNEL_MAX];
+} dac_engine_t;
+static dac_engine_t dac_engine;
+
+static void dac_engine_build_table(int16_t* table, dac_wave_t wave, uint8_t amplitude)
+{
+    for(int i = 0; i < DAC_TABLE_LEN; i++)
+    {
+        const float x = (float)i / DAC_TABLE_LEN; // [0, 1)
+        float y;
+        switch(wave)
+        {
+            case DAC_WAVE_TRIANGLE:
+                y = x < 0.25f ? 4 * x : (x < 0.75f ? 2 - 4 * x : 4 * x - 4);
+                break;
+            case DAC_WAVE_SAW:
+                y = 2 * x - 1;
+                break;
+            case DAC_WAVE_SQUARE:
+                y = x < 0.5f ? 1 : -1;
+                break;
+            case DAC_WAVE_SINE:
+            default:
+                y = sinf(2 * (float)M_PI * x);
+                break;
+        }
+        table[i] = lroundf(y * amplitude);
+    }
+}
+
+static inline uint8_t dac_engine_clamp(int32_t value)
+{
+    return value < 0 ? 0 : (value > 255 ? 255 : value);
+}
+
+static bool IRAM_ATTR dac_engine_isr(void* arg)
+{
+    dac_engine_t* engine = (dac_engine_t*) arg;
+
+    for(int i = 0; i < engine->channel_count; i++)
+    {
+        dac_engine_channel_t* ch = &(engine->channels[i]);
+        switch(ch->mode)
+        {
+            case DAC_MODE_RAMP:
+            {
+                const int32_t target = (int32_t)ch->target << DAC_RAMP_FRAC_BITS;
+                int32_t value = ch->value;
+                if(value < target) { value = value + ch->step > target ? target : value + ch->step; }
+                else if(value > target) { value = value - ch->step < target ? target : value - ch->step; }
+                ch->value = value;
+                RTCIO.pad_dac[ch->channel].dac = value >> DAC_RAMP_FRAC_BITS;
+                break;
+            }
+            case DAC_MODE_TABLE:
+                ch->phase += ch->phase_step;
+                RTCIO.pad_dac[ch->channel].dac = dac_engine_clamp((int32_t)ch->target + ch->table[ch->phase >> (32 - DAC_TABLE_BITS)]);
+                break;
+            default:
+                break;
+        }
+    }
+
+    return false;
+}
+
+// channels: DAC channel per holding register; configs: output config per holding register
+// DAC outputs must be enabled by setup_dac() before
+esp_err_t dac_engine_init(dac_engine_t* engine, uint8_t count, const dac_channel_t* channels, const dac_output_config_t* configs, uint32_t rate_hz)
+{
+    memset((void*)engine, 0, sizeof(dac_engine_t));
+    engine->channel_count = count;
+    engine->rate_hz = rate_hz;
+
+    bool cosine = false;
+    for(int i = 0; i < count; i++)
+    {
+        dac_engine_channel_t* ch = &(engine->channels[i]);
+        const dac_output_config_t* config = &(configs[i]);
+        ch->mode = config->mode;
+        ch->channel = channels[i];
+
+        switch(config->mode)
+        {
+            case DAC_MODE_RAMP:
+                ch->step = ((uint64_t)config->slew * 1000 << DAC_RAMP_FRAC_BITS) / rate_hz;
+                if(!ch->step) { ch->step = 1; }
+                // continue from the current output level; holds outputs across reconfiguration
+                ch->target = RTCIO.pad_dac[channels[i]].dac;
+                ch->value = (int32_t)ch->target << DAC_RAMP_FRAC_BITS;
+                engine->timer = true;
+                break;
+            case DAC_MODE_TABLE:
+                ch->phase_step = ((uint64_t)config->freq_hz << 32) / rate_hz;
+                dac_engine_build_table(ch->table, config->wave, config->amplitude);
+                engine->timer = true;
+                break;
+            case DAC_MODE_COSINE:
+            {
+                ch->cw.en_ch = channels[i];
+                ch->cw.scale = config->cw_scale == 8 ? DAC_CW_SCALE_8 : (config->cw_scale == 4 ? DAC_CW_SCALE_4 : (config->cw_scale == 2 ? DAC_CW_SCALE_2 : DAC_CW_SCALE_1));
+                ch->cw.phase = config->cw_phase == 180 ? DAC_CW_PHASE_180 : DAC_CW_PHASE_0;
+                ch->cw.freq = config->freq_hz;
+                ch->cw.offset = 0;
+                ch->target = 128;
+                esp_err_t err = dac_cw_generator_config(&(ch->cw));
+                if(err) { return err; }
+                cosine = true;
+                break;
+            }
+            default:
+                break;
+        }
+    }
+
+    if(cosine)
+    {
+        esp_err_t err = dac_cw_generator_enable();
+        if(err) { return err; }
+    }
+
+    if(!engine->timer) { return ESP_OK; }
+
+    timer_config_t timer_config = {
+        .divider = DAC_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_EN,
+        .auto_reload = TIMER_AUTORELOAD_EN,
+        .intr_type = TIMER_INTR_LEVEL
+    };
+
+    esp_err_t err = timer_init(DAC_TIMER_GROUP, DAC_TIMER_IDX, &timer_config);
+    if(err) { return err; }
+    timer_set_counter_value(DAC_TIMER_GROUP, DAC_TIMER_IDX, 0);
+    timer_set_alarm_value(DAC_TIMER_GROUP, DAC_TIMER_IDX, 1000000 / rate_hz);
+    timer_enable_intr(DAC_TIMER_GROUP, DAC_TIMER_IDX);
+    err = timer_isr_callback_add(DAC_TIMER_GROUP, DAC_TIMER_IDX, dac_engine_isr, (void*) engine, ESP_INTR_FLAG_IRAM);
+    if(err) { return err; }
+
+    printf("starting DAC timer at %uHz\n", rate_hz);
+    return timer_start(DAC_TIMER_GROUP, DAC_TIMER_IDX);
+}
+
+// stop timer driven channels, e.g. before dac_engine_init() of another engine; outputs hold their last value
+void dac_engine_stop(dac_engine_t* engine)
+{
+    if(!engine->timer) { return; }
+    timer_pause(DAC_TIMER_GROUP, DAC_TIMER_IDX);
+    timer_isr_callback_remove(DAC_TIMER_GROUP, DAC_TIMER_IDX);
+    timer_deinit(DAC_TIMER_GROUP, DAC_TIMER_IDX);
+    engine->timer = false;
+}
+
+// IO task; apply holding registers at output latch
+static inline void dac_engine_write(dac_engine_t* engine, const uint16_t* data)
+{
+    for(int i = 0; i < engine->channel_count; i++)
+    {
+        dac_engine_channel_t* ch = &(engine->channels[i]);
+        const uint8_t value = data[i];
+        switch(ch->mode)
+        {
+            case DAC_MODE_SETPOINT:
+                RTCIO.pad_dac[ch->channel].dac = value;
+                break;
+            case DAC_MODE_COSINE:
+                // reconfigure generator on change only
+                if(value != ch->target)
+                {
+                    ch->target = value;
+                    ch->cw.offset = (int32_t)value - 128;
+                    dac_cw_generator_config(&(ch->cw));
+                }
+                break;
+            default:
+                ch->target = value;
+                break;
+        }
+    }
+}
@@ -5,7 +5,11 @@
 #include "soc/adc_channel.h"
 #include "driver/dac.h"
 #include "soc/dac_channel.h"
-#include "cJSON.h"
+#include "json_stream.h"
+#include "adc_reduce.h"
+#include "adc_capture.h"
+#include "dac_engine.h"
+#include "io_counter.h"
 
 
 typedef enum {
@@ -31,43 +35,162 @@ void print_pull_resistor(pull_resistor_t pull)
     }
 }
 
-#define COILS_MAX 32
-#define DISCRETE_IN_MAX 32
+// one point per GPIO: 28 output capable GPIOs as coils, all 34 GPIOs (incl. input only 34 - 39) as discrete inputs
+#define COILS_MAX 28
+#define DISCRETE_IN_MAX 34
 #define HOLDING_REG_MAX 16
 #define INPUT_REG_MAX 16
-#define DISCRETE_GPIO_PIN_NUM_MAX 31
 
-// max 32 coil/discrete and 16 register IO (registers physically limited to 2/8)
+// IO cycle period and output latch phase in microseconds
+#define IO_CYCLE_US_MIN 100
+#define IO_CYCLE_US_MAX 100000
+#define IO_CYCLE_US_DEFAULT 10000
+#define IO_LATCH_US_DEFAULT 50
+
+// report-by-exception publisher
+#define IO_PUBLISH_PORT_DEFAULT 5020
+#define IO_PUBLISH_KEYFRAME_MS_MIN 10
+#define IO_PUBLISH_KEYFRAME_MS_MAX 60000
+#define IO_PUBLISH_KEYFRAME_MS_DEFAULT 1000
+
+// shift register IO expansion; chips of 8 points per chain
+#define IO_SHIFT_CHIPS_MAX 32
+#define IO_SHIFT_CLOCK_HZ_MIN 100000
+#define IO_SHIFT_CLOCK_HZ_MAX 20000000
+#define IO_SHIFT_CLOCK_HZ_DEFAULT 4000000
+
+// max 28 coil/34 discrete and 16 register IO (registers physically limited to 2/8)
 // pin arrays are initialized to PIN_NUM_NC (-1)
 // register channels initialized to DAC_CHANNEL_MAX and ADC1_CHANNEL_MAX; input registers from ADC1 only!
+// cycle_us: IO cycle period; latch_us: offset of output latch (DAC and coils) from start of cycle
+// discrete_in_events: capture edges of discrete inputs by interrupt
+// image_window: mirror all IO in one block of holding registers (see modbus_pdu.h)
+// input_reg_mode/input_reg_iir_shift: reduction of ADC samples per input register
+// input_scale: raw readings or calibrated millivolts for all input registers
+// holding_reg_output: DAC output mode per holding register; dac_rate_hz: update rate of ramp and table outputs
+// capture_*: triggered waveform capture of all input registers; disabled if capture_pre + capture_post is 0
+//   capture_input: input register GPIO for threshold triggers; capture_level: raw threshold
+// publish_*: report-by-exception UDP publisher of inputs (see io_publish.h); publish_ip: unicast or multicast target
+//   publish_deadband: input register change to report; publish_keyframe_ms: period of complete images
+//   publish_ttl: multicast time to live
+// shift_*: 74HC595 output and 74HC165 input chains on one SPI bus (see io_shift.h); shift_outputs/shift_inputs: chips
+//   per chain; shift_load: 165 SH/LD; shift_latch: 595 RCLK; pins GPIO_NUM_NC if unused
+// counters: PCNT pulse counters and encoders (see io_counter.h), one per unit; terminated by pulse GPIO_NUM_NC
 typedef struct io_config_t {
+    uint32_t cycle_us;
+    uint32_t latch_us;
     pull_resistor_t pull;
+    bool discrete_in_events;
+    bool image_window;
     int8_t coils[COILS_MAX];
     int8_t discrete_in[DISCRETE_IN_MAX];
     int8_t holding_reg[HOLDING_REG_MAX];
     dac_channel_t holding_reg_dac_channel[HOLDING_REG_MAX];
+    dac_output_config_t holding_reg_output[HOLDING_REG_MAX];
+    uint32_t dac_rate_hz;
     int8_t input_reg[INPUT_REG_MAX];
     adc1_channel_t input_reg_adc_channel[INPUT_REG_MAX];
+    adc_reduce_mode_t input_reg_mode[INPUT_REG_MAX];
+    uint8_t input_reg_iir_shift[INPUT_REG_MAX];
+    adc_scale_t input_scale;
+    uint16_t capture_pre;
+    uint16_t capture_post;
+    adc_capture_trigger_t capture_trigger;
+    int8_t capture_input;
+    uint16_t capture_level;
+    bool publish;
+    uint8_t publish_ip[4];
+    uint16_t publish_port;
+    uint16_t publish_deadband;
+    uint16_t publish_keyframe_ms;
+    uint8_t publish_ttl;
+    uint8_t shift_outputs;
+    uint8_t shift_inputs;
+    int8_t shift_sclk;
+    int8_t shift_mosi;
+    int8_t shift_miso;
+    int8_t shift_load;
+    int8_t shift_latch;
+    uint32_t shift_clock_hz;
+    io_counter_config_t counters[IO_COUNTERS_MAX];
 } io_config_t;
 
 // #define IO_CONFIG_DEFAULT() { .pull = OFF, .coils = {GPIO_NUM_NC}, .discrete_in = {GPIO_NUM_NC}, .holding_reg = {GPIO_NUM_NC}, .input_reg = {GPIO_NUM_NC} }
 #define IO_CONFIG_DEFAULT() \
     { \
+        .cycle_us = IO_CYCLE_US_DEFAULT, \
+        .latch_us = IO_LATCH_US_DEFAULT, \
         .pull = OFF, \
+        .discrete_in_events = false, \
+        .image_window = false, \
         .coils = {GPIO_NUM_NC}, \
         .discrete_in = {GPIO_NUM_NC}, \
         .holding_reg = {GPIO_NUM_NC}, \
         .holding_reg_dac_channel = {DAC_CHANNEL_MAX}, \
+        .holding_reg_output = {DAC_OUTPUT_CONFIG_DEFAULT(), DAC_OUTPUT_CONFIG_DEFAULT()}, \
+        .dac_rate_hz = DAC_RATE_HZ_DEFAULT, \
         .input_reg = {GPIO_NUM_NC}, \
-        .input_reg_adc_channel = {ADC1_CHANNEL_MAX} \
+        .input_reg_adc_channel = {ADC1_CHANNEL_MAX}, \
+        .input_reg_mode = {ADC_REDUCE_LAST}, \
+        .input_reg_iir_shift = {0}, \
+        .input_scale = ADC_SCALE_RAW, \
+        .capture_pre = 0, \
+        .capture_post = 0, \
+        .capture_trigger = ADC_CAPTURE_TRIGGER_COIL, \
+        .capture_input = GPIO_NUM_NC, \
+        .capture_level = 0, \
+        .publish = false, \
+        .publish_ip = {0}, \
+        .publish_port = IO_PUBLISH_PORT_DEFAULT, \
+        .publish_deadband = 0, \
+        .publish_keyframe_ms = IO_PUBLISH_KEYFRAME_MS_DEFAULT, \
+        .publish_ttl = 1, \
+        .shift_outputs = 0, \
+        .shift_inputs = 0, \
+        .shift_sclk = GPIO_NUM_NC, \
+        .shift_mosi = GPIO_NUM_NC, \
+        .shift_miso = GPIO_NUM_NC, \
+        .shift_load = GPIO_NUM_NC, \
+        .shift_latch = GPIO_NUM_NC, \
+        .shift_clock_hz = IO_SHIFT_CLOCK_HZ_DEFAULT, \
+        .counters = {IO_COUNTER_CONFIG_DEFAULT()} \
     }
 #define IO_CONFIG_INIT(io_config) \
+    (io_config).cycle_us = IO_CYCLE_US_DEFAULT; \
+    (io_config).latch_us = IO_LATCH_US_DEFAULT; \
+    (io_config).discrete_in_events = false; \
+    (io_config).image_window = false; \
     memset((io_config).coils, GPIO_NUM_NC, COILS_MAX); \
     memset((io_config).discrete_in, GPIO_NUM_NC, DISCRETE_IN_MAX); \
     memset((io_config).holding_reg, GPIO_NUM_NC, HOLDING_REG_MAX); \
     memset((io_config).holding_reg_dac_channel, DAC_CHANNEL_MAX, sizeof(dac_channel_t) * HOLDING_REG_MAX); \
+    for(int i = 0; i < HOLDING_REG_MAX; i++) { (io_config).holding_reg_output[i] = (dac_output_config_t)DAC_OUTPUT_CONFIG_DEFAULT(); } \
+    (io_config).dac_rate_hz = DAC_RATE_HZ_DEFAULT; \
     memset((io_config).input_reg, GPIO_NUM_NC, INPUT_REG_MAX) ; \
-    memset((io_config).input_reg_adc_channel, ADC1_CHANNEL_MAX, sizeof(adc1_channel_t) * INPUT_REG_MAX)
+    memset((io_config).input_reg_adc_channel, ADC1_CHANNEL_MAX, sizeof(adc1_channel_t) * INPUT_REG_MAX); \
+    memset((io_config).input_reg_mode, ADC_REDUCE_LAST, sizeof(adc_reduce_mode_t) * INPUT_REG_MAX); \
+    memset((io_config).input_reg_iir_shift, 0, INPUT_REG_MAX); \
+    (io_config).input_scale = ADC_SCALE_RAW; \
+    (io_config).capture_pre = 0; \
+    (io_config).capture_post = 0; \
+    (io_config).capture_trigger = ADC_CAPTURE_TRIGGER_COIL; \
+    (io_config).capture_input = GPIO_NUM_NC; \
+    (io_config).capture_level = 0; \
+    (io_config).publish = false; \
+    memset((io_config).publish_ip, 0, 4); \
+    (io_config).publish_port = IO_PUBLISH_PORT_DEFAULT; \
+    (io_config).publish_deadband = 0; \
+    (io_config).publish_keyframe_ms = IO_PUBLISH_KEYFRAME_MS_DEFAULT; \
+    (io_config).publish_ttl = 1; \
+    (io_config).shift_outputs = 0; \
+    (io_config).shift_inputs = 0; \
+    (io_config).shift_sclk = GPIO_NUM_NC; \
+    (io_config).shift_mosi = GPIO_NUM_NC; \
+    (io_config).shift_miso = GPIO_NUM_NC; \
+    (io_config).shift_load = GPIO_NUM_NC; \
+    (io_config).shift_latch = GPIO_NUM_NC; \
+    (io_config).shift_clock_hz = IO_SHIFT_CLOCK_HZ_DEFAULT; \
+    for(int i = 0; i < IO_COUNTERS_MAX; i++) { (io_config).counters[i] = (io_counter_config_t)IO_COUNTER_CONFIG_DEFAULT(); }
 
 uint8_t count_assigned_functions(int8_t* pin_config, size_t max_len)
 {
@@ -99,6 +222,16 @@ uint8_t count_input_reg(io_config_t* io_config)
     return count_assigned_functions(io_config->input_reg, INPUT_REG_MAX);
 }
 
+uint8_t count_counters(io_config_t* io_config)
+{
+    size_t count = 0;
+    while(count < IO_COUNTERS_MAX && io_config->counters[count].pulse != GPIO_NUM_NC)
+    {
+        count++;
+    }
+    return count;
+}
+
 void print_gpio_arr(int8_t* arr, size_t max)
 {
     if(arr[0] != GPIO_NUM_NC)
@@ -113,6 +246,8 @@ void print_gpio_arr(int8_t* arr, size_t max)
 
 void io_config_print(io_config_t* io_config)
 {
+    printf("cycle: %uus, latch at %uus\n", io_config->cycle_us, io_config->latch_us);
+
     printf("pull: ");
     print_pull_resistor(io_config->pull);
     printf("\n");
@@ -123,15 +258,101 @@ void io_config_print(io_config_t* io_config)
 
     printf("discrete inputs: ");
     print_gpio_arr(io_config->discrete_in, DISCRETE_IN_MAX);
-    printf("\n");
+    printf("%s\n", io_config->discrete_in_events ? " (events)" : "");
 
     printf("holding registers: ");
     print_gpio_arr(io_config->holding_reg, HOLDING_REG_MAX);
     printf("\n");
 
+    printf("holding register outputs: ");
+    for(int i = 0; i < count_holding_reg(io_config); i++)
+    {
+        printf("%s", i ? ", " : "");
+        print_dac_output_config(&(io_config->holding_reg_output[i]));
+    }
+    printf(" (%uHz)\n", io_config->dac_rate_hz);
+
     printf("input registers: ");
     print_gpio_arr(io_config->input_reg, INPUT_REG_MAX);
     printf("\n");
+
+    printf("input register modes: ");
+    for(int i = 0; i < count_input_reg(io_config); i++)
+    {
+        printf("%s", i ? ", " : "");
+        print_adc_reduce_mode(io_config->input_reg_mode[i], io_config->input_reg_iir_shift[i]);
+    }
+    printf("\n");
+
+    printf("input register scale: %s\n", io_config->input_scale == ADC_SCALE_MV ? "mV" : "raw");
+
+    if(io_config->image_window)
+    {
+        printf("process image window: enabled\n");
+    }
+
+    if(io_config->capture_pre + io_config->capture_post)
+    {
+        printf("capture: %u + %u samples, trigger ", io_config->capture_pre, io_config->capture_post);
+        print_adc_capture_trigger(io_config->capture_trigger);
+        if(io_config->capture_trigger != ADC_CAPTURE_TRIGGER_COIL)
+        {
+            printf(" on GPIO %i at %u", io_config->capture_input, io_config->capture_level);
+        }
+        printf("\n");
+    }
+
+    if(io_config->publish)
+    {
+        printf("publish: %u.%u.%u.%u:%u, deadband %u, keyframe every %ums\n",
+            io_config->publish_ip[0], io_config->publish_ip[1], io_config->publish_ip[2], io_config->publish_ip[3],
+            io_config->publish_port, io_config->publish_deadband, io_config->publish_keyframe_ms);
+    }
+
+    if(io_config->shift_outputs || io_config->shift_inputs)
+    {
+        printf("shift registers: %u outputs (74HC595), %u inputs (74HC165) at %uHz; sclk %i, mosi %i, miso %i, load %i, latch %i\n",
+            io_config->shift_outputs * 8, io_config->shift_inputs * 8, io_config->shift_clock_hz,
+            io_config->shift_sclk, io_config->shift_mosi, io_config->shift_miso, io_config->shift_load, io_config->shift_latch);
+    }
+
+    for(int i = 0; i < count_counters(io_config); i++)
+    {
+        printf("counter %i: ", i);
+        print_io_counter_config(&(io_config->counters[i]));
+        printf("\n");
+    }
+}
+
+// GPIO 6 - 11 connect the SPI flash on most modules; configuring them as IO halts code execution from flash
+#define IO_CONFIG_FLASH_GPIO_MASK ((uint64_t)0x3f << 6)
+
+// adds pin to mask of one function; false if the pin is not a GPIO of the ESP32, connects the SPI flash or is used
+// twice in the function
+static bool io_config_add_pin(uint64_t* mask, int8_t pin, bool output, const char* name)
+{
+    if(pin < 0 || pin >= GPIO_NUM_MAX || !GPIO_IS_VALID_GPIO(pin))
+    {
+        printf("%s on GPIO %i: no such GPIO\n", name, pin);
+        return false;
+    }
+    if(IO_CONFIG_FLASH_GPIO_MASK & ((uint64_t)0x01 << pin))
+    {
+        printf("%s on GPIO %i: GPIO connects the SPI flash\n", name, pin);
+        return false;
+    }
+    if(output && !GPIO_IS_VALID_OUTPUT_GPIO(pin))
+    {
+        printf("%s on GPIO %i: GPIO is input only\n", name, pin);
+        return false;
+    }
+    if(*mask & ((uint64_t)0x01 << pin))
+    {
+        printf("%s on GPIO %i: GPIO used twice\n", name, pin);
+        return false;
+    }
+    *mask |= (uint64_t)0x01 << pin;
+    return true;
 }
 
 // check for multiple pin use, GPIO out of bounds, and ADC/DAC pin/channel assignment
@@ -144,13 +365,25 @@ esp_err_t io_config_validate(io_config_t* io_config)
     uint64_t holding_reg_gpio = 0x00;
     uint64_t input_reg_gpio = 0x00;
 
+    // check cycle timing
+    if(io_config->cycle_us < IO_CYCLE_US_MIN || io_config->cycle_us > IO_CYCLE_US_MAX)
+    {
+        printf("cycle of %uus out of bounds; use %i to %ius", io_config->cycle_us, IO_CYCLE_US_MIN, IO_CYCLE_US_MAX);
+        has_err = true;
+    }
+    if(io_config->latch_us >= io_config->cycle_us)
+    {
+        printf("latch offset of %uus exceeds cycle of %uus", io_config->latch_us, io_config->cycle_us);
+        has_err = true;
+    }
+
     // check DAC channels
     {
         int8_t* holding_reg = io_config->holding_reg;
         dac_channel_t* holding_reg_dac_channel = io_config->holding_reg_dac_channel;
         while(*holding_reg != GPIO_NUM_NC && holding_reg != (&(io_config->holding_reg[HOLDING_REG_MAX - 1]) + 1))
         {
-            holding_reg_gpio |= (1 << *holding_reg);
+            has_err |= !io_config_add_pin(&holding_reg_gpio, *holding_reg, true, "holding register");
 
             gpio_num_t pin;
             esp_err_t err = dac_pad_get_io_num(*holding_reg_dac_channel, &pin);
@@ -164,13 +397,69 @@ esp_err_t io_config_validate(io_config_t* io_config)
         }
     }    
 
+    // check DAC output modes
+    if(io_config->dac_rate_hz < DAC_RATE_HZ_MIN || io_config->dac_rate_hz > DAC_RATE_HZ_MAX)
+    {
+        printf("DAC rate of %uHz out of bounds; use %i to %iHz", io_config->dac_rate_hz, DAC_RATE_HZ_MIN, DAC_RATE_HZ_MAX);
+        has_err = true;
+    }
+    {
+        uint32_t cw_freq_hz = 0;
+        for(int i = 0; i < count_holding_reg(io_config); i++)
+        {
+            const dac_output_config_t* output = &(io_config->holding_reg_output[i]);
+            switch(output->mode)
+            {
+                case DAC_MODE_RAMP:
+                    if(!output->slew)
+                    {
+                        printf("ramp on GPIO %i requires a slew rate", io_config->holding_reg[i]);
+                        has_err = true;
+                    }
+                    break;
+                case DAC_MODE_TABLE:
+                    if(!output->freq_hz || output->freq_hz > io_config->dac_rate_hz / 2)
+                    {
+                        printf("waveform on GPIO %i: frequency must be 1Hz to half the DAC rate", io_config->holding_reg[i]);
+                        has_err = true;
+                    }
+                    break;
+                case DAC_MODE_COSINE:
+                    if(output->freq_hz < DAC_CW_FREQ_HZ_MIN || output->freq_hz > DAC_CW_FREQ_HZ_MAX)
+                    {
+                        printf("cosine on GPIO %i: frequency out of bounds; use %i to %iHz", io_config->holding_reg[i], DAC_CW_FREQ_HZ_MIN, DAC_CW_FREQ_HZ_MAX);
+                        has_err = true;
+                    }
+                    if(cw_freq_hz && cw_freq_hz != output->freq_hz)
+                    {
+                        printf("cosine generator is shared; frequencies of both channels must match");
+                        has_err = true;
+                    }
+                    cw_freq_hz = output->freq_hz;
+                    if(output->cw_scale != 1 && output->cw_scale != 2 && output->cw_scale != 4 && output->cw_scale != 8)
+                    {
+                        printf("cosine on GPIO %i: scale must be 1, 2, 4 or 8", io_config->holding_reg[i]);
+                        has_err = true;
+                    }
+                    if(output->cw_phase != 0 && output->cw_phase != 180)
+                    {
+                        printf("cosine on GPIO %i: phase must be 0 or 180", io_config->holding_reg[i]);
+                        has_err = true;
+                    }
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
     // check ADC channels
     {
         int8_t* input_reg = io_config->input_reg;
         adc1_channel_t* input_reg_adc_channel = io_config->input_reg_adc_channel;
         while(*input_reg != GPIO_NUM_NC && input_reg != (&(io_config->input_reg[INPUT_REG_MAX - 1]) + 1))
         {
-            input_reg_gpio |= (1 << *input_reg);
+            has_err |= !io_config_add_pin(&input_reg_gpio, *input_reg, false, "input register");
 
             gpio_num_t pin;
             esp_err_t err = adc1_pad_get_io_num(*input_reg_adc_channel, &pin);
@@ -184,19 +473,50 @@ esp_err_t io_config_validate(io_config_t* io_config)
         }
     }
 
+    // ADC pattern table holds one slot per input register
+    if(count_input_reg(io_config) > ADC_REDUCE_SLOTS_MAX)
+    {
+        printf("too many input registers; ADC1 provides %i channels", ADC_REDUCE_SLOTS_MAX);
+        has_err = true;
+    }
+
+    // waveform capture
+    if(io_config->capture_pre + io_config->capture_post > ADC_CAPTURE_SAMPLES_MAX)
+    {
+        printf("capture of %u samples exceeds %i samples per channel", io_config->capture_pre + io_config->capture_post, ADC_CAPTURE_SAMPLES_MAX);
+        has_err = true;
+    }
+    if(io_config->capture_pre + io_config->capture_post && !count_input_reg(io_config))
+    {
+        printf("capture requires input registers");
+        has_err = true;
+    }
+    if(io_config->capture_trigger != ADC_CAPTURE_TRIGGER_COIL)
+    {
+        bool found = false;
+        for(int i = 0; i < count_input_reg(io_config); i++)
+        {
+            found |= io_config->input_reg[i] == io_config->capture_input;
+        }
+        if(!found)
+        {
+            printf("capture trigger input on GPIO %i is not an input register", io_config->capture_input);
+            has_err = true;
+        }
+        if(io_config->capture_level > 4095)
+        {
+            printf("capture trigger level %u exceeds 12 bit ADC range", io_config->capture_level);
+            has_err = true;
+        }
+    }
+
     // get coils GPIOs and check out of GPIO bounds
     {
         // int8_t* coil = &(io_config->coils[0]);
         // while(*coil != GPIO_NUM_NC && coil != (&(io_config->coils[COILS_MAX - 1]) + 1))
         for(int8_t* coil = io_config->coils; *coil != GPIO_NUM_NC && coil != (&(io_config->coils[COILS_MAX - 1]) + 1); coil++)
         {
-            coil_gpio |= (1 << *coil);
-
-            if(*coil > DISCRETE_GPIO_PIN_NUM_MAX)
-            {
-                printf("coil on GPIO %i out of bounds; max GPIO number is %i", *coil, DISCRETE_GPIO_PIN_NUM_MAX);
-                has_err = true;
-            }
+            has_err |= !io_config_add_pin(&coil_gpio, *coil, true, "coil");
         }
     }
 
@@ -206,20 +526,83 @@ esp_err_t io_config_validate(io_config_t* io_config)
         // while(*discrete_in != GPIO_NUM_NC && discrete_in != (&(io_config->discrete_in[DISCRETE_IN_MAX - 1]) + 1))
         for(int8_t* discrete_in = io_config->discrete_in; *discrete_in != GPIO_NUM_NC && discrete_in != (&(io_config->discrete_in[DISCRETE_IN_MAX - 1]) + 1); discrete_in++)
         {
-            discrete_in_gpio |= (1 << *discrete_in);
+            has_err |= !io_config_add_pin(&discrete_in_gpio, *discrete_in, false, "discrete in");
 
-            if(*discrete_in > DISCRETE_GPIO_PIN_NUM_MAX)
+            // GPIO 34 - 39 have no pull resistors
+            if(io_config->pull != OFF && GPIO_IS_VALID_GPIO(*discrete_in) && !GPIO_IS_VALID_OUTPUT_GPIO(*discrete_in))
             {
-                printf("discrete in on GPIO %i out of bounds; max GPIO number is %i", *discrete_in, DISCRETE_GPIO_PIN_NUM_MAX);
-                has_err = true;
+                printf("discrete in on GPIO %i has no internal pull resistor; use an external one\n", *discrete_in);
             }
         }
     }
 
-    // check GPIO overlap
-    if(coil_gpio & discrete_in_gpio & holding_reg_gpio & input_reg_gpio)
+    // shift register chains; clock and outputs chain need output capable pins, inputs chain a data in pin
+    uint64_t shift_gpio = 0x00;
+    if(io_config->shift_outputs || io_config->shift_inputs)
+    {
+        has_err |= !io_config_add_pin(&shift_gpio, io_config->shift_sclk, true, "shift register sclk");
+    }
+    if(io_config->shift_outputs)
+    {
+        has_err |= !io_config_add_pin(&shift_gpio, io_config->shift_mosi, true, "shift register mosi");
+        has_err |= !io_config_add_pin(&shift_gpio, io_config->shift_latch, true, "shift register latch");
+    }
+    if(io_config->shift_inputs)
+    {
+        has_err |= !io_config_add_pin(&shift_gpio, io_config->shift_miso, false, "shift register miso");
+        has_err |= !io_config_add_pin(&shift_gpio, io_config->shift_load, true, "shift register load");
+    }
+    if(io_config->shift_clock_hz < IO_SHIFT_CLOCK_HZ_MIN || io_config->shift_clock_hz > IO_SHIFT_CLOCK_HZ_MAX)
+    {
+        printf("shift register clock of %uHz out of bounds; use %i to %iHz\n", io_config->shift_clock_hz, IO_SHIFT_CLOCK_HZ_MIN, IO_SHIFT_CLOCK_HZ_MAX);
+        has_err = true;
+    }
+    else if(io_config->shift_outputs || io_config->shift_inputs)
+    {
+        // transaction is padded to whole words and completes before the latch
+        const uint32_t chips = io_config->shift_outputs > io_config->shift_inputs ? io_config->shift_outputs : io_config->shift_inputs;
+        const uint32_t shift_us = ((chips + 3) & ~0x03) * 8 * 1000000 / io_config->shift_clock_hz + 1;
+        if(shift_us >= io_config->latch_us)
+        {
+            printf("warning: shifting %u chips takes %uus at %uHz; latch at %uus will be late\n", chips, shift_us, io_config->shift_clock_hz, io_config->latch_us);
+        }
+    }
+
+    // counters; quadrature encoders and up/down counters need the ctrl input
+    uint64_t counter_gpio = 0x00;
+    for(int i = 0; i < count_counters(io_config); i++)
+    {
+        const io_counter_config_t* counter = &(io_config->counters[i]);
+        has_err |= !io_config_add_pin(&counter_gpio, counter->pulse, false, "counter pulse");
+        if(counter->mode != IO_COUNTER_UP && counter->ctrl == GPIO_NUM_NC)
+        {
+            printf("counter %i needs a ctrl input for up/down counting\n", i);
+            has_err = true;
+        }
+        else if(counter->mode != IO_COUNTER_UP)
+        {
+            has_err |= !io_config_add_pin(&counter_gpio, counter->ctrl, false, "counter ctrl");
+        }
+        else if(counter->ctrl != GPIO_NUM_NC)
+        {
+            printf("counter %i counts up; ctrl on GPIO %i is not used\n", i, counter->ctrl);
+            has_err = true;
+        }
+        if(counter->filter_ns > IO_COUNTER_FILTER_NS_MAX)
+        {
+            printf("counter %i filter of %uns out of bounds; use 0 to %ins\n", i, counter->filter_ns, IO_COUNTER_FILTER_NS_MAX);
+            has_err = true;
+        }
+    }
+
+    // check GPIO overlap; each GPIO serves one function
+    if((coil_gpio & (discrete_in_gpio | holding_reg_gpio | input_reg_gpio | shift_gpio | counter_gpio))
+        | (discrete_in_gpio & (holding_reg_gpio | input_reg_gpio | shift_gpio | counter_gpio))
+        | (holding_reg_gpio & (input_reg_gpio | shift_gpio | counter_gpio))
+        | (input_reg_gpio & (shift_gpio | counter_gpio))
+        | (shift_gpio & counter_gpio))
     {
-        printf("requested GPIO pins are overlapping!");
+        printf("requested GPIO pins are overlapping!\n");
         has_err = true;
     }
 
@@ -228,218 +611,949 @@ esp_err_t io_config_validate(io_config_t* io_config)
 
 // CONFIG JSON:
 // {
+//     "cycle_us": 10000,
+//     "latch_us": 50,
 //     "pull": "up/down",
 //     "discrete_in": [1, 2],
+//     "discrete_in_events": true,
 //     "coils": [11, 12],
 //     "holding_reg": [25, 26],
-//     "input_reg": [34, 35]
+//     "holding_reg_mode": ["setpoint", { "mode": "ramp", "slew": 50 }] or "setpoint",
+//     "dac_rate_hz": 10000,
+//     "input_reg": [34, 35],
+//     "input_reg_mode": ["mean", "iir:4"] or "mean",
+//     "input_scale": "raw/mV",
+//     "capture": { "pre": 256, "post": 768, "trigger": "coil/rising/falling", "input": 34, "level": 2048 },
+//     "image_window": true,
+//     "publish": { "host": "239.0.0.1", "port": 5020, "deadband": 8, "keyframe_ms": 1000, "ttl": 1 },
+//     "shift": { "outputs": 4, "inputs": 4, "sclk": 18, "mosi": 23, "miso": 19, "load": 5, "latch": 17, "clock_hz": 4000000 },
+//     "counters": [{ "mode": "up", "pulse": 4 }, { "mode": "quadrature", "pulse": 16, "ctrl": 17, "filter_ns": 1000 }]
 // }
 
-// generator checks for size constrains and pin assignment resolution while building config
-// resulting config as a whole is automatically checked with io_config_validate() after generation
-esp_err_t io_config_generate(char* io_json, io_config_t* io_config)
+// holding register output; mode string, or object with "mode" and mode parameters:
+// { "mode": "ramp", "slew": 50 }
+// { "mode": "table", "wave": "sine/triangle/saw/square", "freq_hz": 100, "amplitude": 100 }
+// { "mode": "cosine", "freq_hz": 1000, "scale": 1/2/4/8, "phase": 0/180 }
+// parses one field of an output object into output; unknown fields are ignored, "mode" is required
+esp_err_t dac_output_config_field(dac_output_config_t* output, bool* has_mode, json_stream_t* stream, json_stream_event_t event)
 {
-    bool has_err = false;
+    const char* key = json_stream_key(stream);
+    const int value = json_stream_int(stream);
 
-    IO_CONFIG_INIT(*io_config);
-    cJSON* root = cJSON_Parse(io_json);
-    if(!root)
+    if(strcmp("mode", key) == 0)
     {
-        printf("Could not parse IO config JSON!\n");
-        return ESP_FAIL;
+        if(event != JSON_STREAM_STRING || stream->value_truncated || dac_mode_parse(stream->value, &(output->mode))) { return ESP_ERR_INVALID_ARG; }
+        *has_mode = true;
     }
-    
-    // pull resistors
-    cJSON* pull = cJSON_GetObjectItem(root, "pull");
-    if(pull)
+    else if(strcmp("slew", key) == 0)
     {
-        if(strcmp("up", pull->valuestring) == 0)
+        if(event != JSON_STREAM_NUMBER || value < 1 || value > UINT16_MAX) { return ESP_ERR_INVALID_ARG; }
+        output->slew = value;
+    }
+    else if(strcmp("wave", key) == 0)
+    {
+        if(event != JSON_STREAM_STRING || stream->value_truncated || dac_wave_parse(stream->value, &(output->wave))) { return ESP_ERR_INVALID_ARG; }
+    }
+    else if(strcmp("amplitude", key) == 0)
+    {
+        if(event != JSON_STREAM_NUMBER || value < 0 || value > 255) { return ESP_ERR_INVALID_ARG; }
+        output->amplitude = value;
+    }
+    else if(strcmp("freq_hz", key) == 0)
+    {
+        if(event != JSON_STREAM_NUMBER || value < 0) { return ESP_ERR_INVALID_ARG; }
+        output->freq_hz = value;
+    }
+    else if(strcmp("scale", key) == 0)
+    {
+        if(event != JSON_STREAM_NUMBER || value < 0 || value > 255) { return ESP_ERR_INVALID_ARG; }
+        output->cw_scale = value;
+    }
+    else if(strcmp("phase", key) == 0)
+    {
+        if(event != JSON_STREAM_NUMBER || value < 0 || value > 360) { return ESP_ERR_INVALID_ARG; }
+        output->cw_phase = value;
+    }
+
+    return ESP_OK;
+}
+
+// top level keys of the IO configuration
+typedef enum {
+    IO_CONFIG_KEY_NONE,
+    IO_CONFIG_KEY_CYCLE_US,
+    IO_CONFIG_KEY_LATCH_US,
+    IO_CONFIG_KEY_PULL,
+    IO_CONFIG_KEY_DISCRETE_IN_EVENTS,
+    IO_CONFIG_KEY_IMAGE_WINDOW,
+    IO_CONFIG_KEY_COILS,
+    IO_CONFIG_KEY_DISCRETE_IN,
+    IO_CONFIG_KEY_HOLDING_REG,
+    IO_CONFIG_KEY_HOLDING_REG_MODE,
+    IO_CONFIG_KEY_DAC_RATE_HZ,
+    IO_CONFIG_KEY_INPUT_REG,
+    IO_CONFIG_KEY_INPUT_REG_MODE,
+    IO_CONFIG_KEY_INPUT_SCALE,
+    IO_CONFIG_KEY_CAPTURE,
+    IO_CONFIG_KEY_PUBLISH,
+    IO_CONFIG_KEY_SHIFT,
+    IO_CONFIG_KEY_COUNTERS,
+    IO_CONFIG_KEY_MAX
+} io_config_key_t;
+
+static const char* const io_config_keys[IO_CONFIG_KEY_MAX] = {
+    [IO_CONFIG_KEY_NONE] = "",
+    [IO_CONFIG_KEY_CYCLE_US] = "cycle_us",
+    [IO_CONFIG_KEY_LATCH_US] = "latch_us",
+    [IO_CONFIG_KEY_PULL] = "pull",
+    [IO_CONFIG_KEY_DISCRETE_IN_EVENTS] = "discrete_in_events",
+    [IO_CONFIG_KEY_IMAGE_WINDOW] = "image_window",
+    [IO_CONFIG_KEY_COILS] = "coils",
+    [IO_CONFIG_KEY_DISCRETE_IN] = "discrete_in",
+    [IO_CONFIG_KEY_HOLDING_REG] = "holding_reg",
+    [IO_CONFIG_KEY_HOLDING_REG_MODE] = "holding_reg_mode",
+    [IO_CONFIG_KEY_DAC_RATE_HZ] = "dac_rate_hz",
+    [IO_CONFIG_KEY_INPUT_REG] = "input_reg",
+    [IO_CONFIG_KEY_INPUT_REG_MODE] = "input_reg_mode",
+    [IO_CONFIG_KEY_INPUT_SCALE] = "input_scale",
+    [IO_CONFIG_KEY_CAPTURE] = "capture",
+    [IO_CONFIG_KEY_PUBLISH] = "publish",
+    [IO_CONFIG_KEY_SHIFT] = "shift",
+    [IO_CONFIG_KEY_COUNTERS] = "counters"
+};
+
+io_config_key_t io_config_key_lookup(json_stream_t* stream)
+{
+    const char* key = json_stream_key(stream);
+    if(!key || stream->level[stream->depth - 1].key_truncated) { return IO_CONFIG_KEY_NONE; }
+    for(int i = IO_CONFIG_KEY_NONE + 1; i < IO_CONFIG_KEY_MAX; i++)
+    {
+        if(strcmp(io_config_keys[i], key) == 0) { return (io_config_key_t) i; }
+    }
+    return IO_CONFIG_KEY_NONE;
+}
+
+// streaming parser state; builds the config while the JSON document is received, without a DOM or heap allocation
+// keys are handled in document order, checks across keys (mode arrays vs. pin arrays, required keys) are done at the end
+typedef struct io_config_parser_t {
+    json_stream_t stream;
+    io_config_t* io_config;
+    // top level key of the container being parsed
+    io_config_key_t section;
+    bool has_err;
+    bool has_pins;
+    bool has_pull;
+    bool has_host;
+    // stored pins per array
+    uint8_t coils;
+    uint8_t discrete_in;
+    uint8_t holding_reg;
+    uint8_t input_reg;
+    // entries of mode arrays; -1 for a single entry
+    int8_t holding_reg_modes;
+    int8_t input_reg_modes;
+    // holding register output object being parsed
+    dac_output_config_t output;
+    bool output_has_mode;
+    bool output_err;
+    // counter object being parsed
+    uint8_t counters;
+    io_counter_config_t counter;
+    bool counter_has_mode;
+    bool counter_err;
+} io_config_parser_t;
+
+static inline bool io_config_parser_is_value(json_stream_event_t event)
+{
+    return event != JSON_STREAM_OBJECT_END && event != JSON_STREAM_ARRAY_END;
+}
+
+// entry of a pin array; GPIO number or error; returns false if the entry is to be skipped
+// pins are stored as int8_t with GPIO_NUM_NC ending the array, so fractions, negative and large numbers are rejected here
+bool io_config_parse_pin(io_config_parser_t* parser, json_stream_event_t event, int max, const char* key, const char* name)
+{
+    json_stream_t* stream = &(parser->stream);
+    if(json_stream_index(stream) >= max)
+    {
+        if(json_stream_index(stream) == max)
         {
-            io_config->pull = UP;
+            printf("too many pins for %s!\n", name);
+            parser->has_err = true;
         }
-        else if(strcmp("down", pull->valuestring) == 0)
+        return false;
+    }
+    if(event != JSON_STREAM_NUMBER)
+    {
+        printf("skipping non-number entry in \"%s\"!\n", key);
+        parser->has_err = true;
+        return false;
+    }
+    const int value = json_stream_int(stream);
+    if(value < 0 || value >= GPIO_NUM_MAX || stream->number != (double)value)
+    {
+        printf("skipping entry %.*s in \"%s\": not a GPIO number!\n", stream->value_len, stream->value, key);
+        parser->has_err = true;
+        return false;
+    }
+    return true;
+}
+
+void io_config_parse_holding_reg_mode(io_config_parser_t* parser, json_stream_event_t event)
+{
+    json_stream_t* stream = &(parser->stream);
+    io_config_t* io_config = parser->io_config;
+
+    // fields of a single output object
+    if(parser->holding_reg_modes < 0)
+    {
+        if(stream->depth == 2 && io_config_parser_is_value(event))
         {
-            io_config->pull = DOWN;
+            parser->output_err |= dac_output_config_field(&(parser->output), &(parser->output_has_mode), stream, event) != ESP_OK;
         }
+        return;
     }
-    else
+
+    // fields of an output object in the array
+    if(stream->depth == 3)
     {
-        io_config->pull = OFF;
+        if(json_stream_key(stream) && io_config_parser_is_value(event))
+        {
+            parser->output_err |= dac_output_config_field(&(parser->output), &(parser->output_has_mode), stream, event) != ESP_OK;
+        }
+        return;
+    }
+    if(stream->depth != 2 || event == JSON_STREAM_ARRAY_END) { return; }
+
+    const int i = json_stream_index(stream);
+    if(event == JSON_STREAM_OBJECT_BEGIN)
+    {
+        parser->output = (dac_output_config_t)DAC_OUTPUT_CONFIG_DEFAULT();
+        parser->output_has_mode = false;
+        parser->output_err = false;
+        parser->holding_reg_modes++;
+        return;
+    }
+    if(event != JSON_STREAM_OBJECT_END)
+    {
+        parser->output = (dac_output_config_t)DAC_OUTPUT_CONFIG_DEFAULT();
+        parser->output_has_mode = event == JSON_STREAM_STRING && !stream->value_truncated && !dac_mode_parse(stream->value, &(parser->output.mode));
+        parser->output_err = false;
+        parser->holding_reg_modes++;
+    }
+    if(!parser->output_has_mode || parser->output_err)
+    {
+        printf("invalid entry in \"holding_reg_mode\"!\n");
+        parser->has_err = true;
+    }
+    else if(i < HOLDING_REG_MAX)
+    {
+        io_config->holding_reg_output[i] = parser->output;
     }
+}
 
-    // coils
-    cJSON* coils = cJSON_GetObjectItem(root, "coils");
-    if(coils && cJSON_IsArray(coils))
+// counter object; "mode" and "pulse" are required
+void io_config_parse_counters(io_config_parser_t* parser, json_stream_event_t event)
+{
+    json_stream_t* stream = &(parser->stream);
+    io_config_t* io_config = parser->io_config;
+    const int value = json_stream_int(stream);
+
+    // fields of a counter object
+    if(stream->depth == 3)
     {
-        if(cJSON_GetArraySize(coils) <= sizeof(io_config->coils))
+        const char* key = json_stream_key(stream);
+        if(!key || !io_config_parser_is_value(event)) { return; }
+        io_counter_config_t* counter = &(parser->counter);
+        if(strcmp("mode", key) == 0)
+        {
+            parser->counter_has_mode = event == JSON_STREAM_STRING && !stream->value_truncated && !io_counter_mode_parse(stream->value, &(counter->mode));
+            parser->counter_err |= !parser->counter_has_mode;
+        }
+        else if(strcmp("pulse", key) == 0 || strcmp("ctrl", key) == 0)
         {
-            int8_t* coil_store = io_config->coils;
-            cJSON* coil;
-            cJSON_ArrayForEach(coil, coils)
+            if(event == JSON_STREAM_NUMBER && value >= 0 && value < GPIO_NUM_MAX)
             {
-                if(cJSON_IsNumber(coil))
-                {
-                    *coil_store = coil->valueint;
-                    coil_store++;
-                    printf("added coil on GPIO %i\n", coil->valueint);
-                }
-                else
-                {
-                    printf("skipping non-number entry in \"coils\"!\n");
-                    has_err = true;
-                }
+                if(key[0] == 'p') { counter->pulse = value; }
+                else { counter->ctrl = value; }
+            }
+            else
+            {
+                printf("\"counters\": \"%s\" is not a GPIO number!\n", key);
+                parser->counter_err = true;
             }
         }
-        else
+        else if(strcmp("filter_ns", key) == 0)
         {
-            printf("too many pins for coils!\n");
-            has_err = true;
+            if(event == JSON_STREAM_NUMBER && value >= 0 && value <= IO_COUNTER_FILTER_NS_MAX)
+            {
+                counter->filter_ns = value;
+            }
+            else
+            {
+                printf("\"counters\": \"filter_ns\" out of range (0 - %u)!\n", IO_COUNTER_FILTER_NS_MAX);
+                parser->counter_err = true;
+            }
         }
+        return;
     }
+    if(stream->depth != 2 || event == JSON_STREAM_ARRAY_END) { return; }
 
-    // discrete ins
-    cJSON* discrete_ins = cJSON_GetObjectItem(root, "discrete_in");
-    if(discrete_ins && cJSON_IsArray(discrete_ins))
+    if(event == JSON_STREAM_OBJECT_BEGIN)
     {
-        if(cJSON_GetArraySize(discrete_ins) <= sizeof(io_config->discrete_in))
+        parser->counter = (io_counter_config_t)IO_COUNTER_CONFIG_DEFAULT();
+        parser->counter_has_mode = false;
+        parser->counter_err = false;
+        return;
+    }
+    if(event != JSON_STREAM_OBJECT_END || !parser->counter_has_mode || parser->counter.pulse == GPIO_NUM_NC || parser->counter_err)
+    {
+        printf("invalid entry in \"counters\"!\n");
+        parser->has_err = true;
+        return;
+    }
+    if(parser->counters >= IO_COUNTERS_MAX)
+    {
+        if(parser->counters++ == IO_COUNTERS_MAX) { printf("too many counters!\n"); }
+        parser->has_err = true;
+        return;
+    }
+    io_config->counters[parser->counters++] = parser->counter;
+    printf("added counter on GPIO %i\n", parser->counter.pulse);
+}
+
+#define HANDLE_CASE_ADC1_CHANNEL(n) \
+    case ADC1_CHANNEL_ ## n ## _GPIO_NUM: \
+        io_config->input_reg_adc_channel[parser->input_reg] = ADC1_CHANNEL_ ## n; \
+        printf("added input register in for ADC1 channel %i on GPIO %i\n",n , value); \
+        break
+
+// values inside top level arrays and objects
+void io_config_parse_section(io_config_parser_t* parser, json_stream_event_t event)
+{
+    json_stream_t* stream = &(parser->stream);
+    io_config_t* io_config = parser->io_config;
+    const int value = json_stream_int(stream);
+
+    if(parser->section == IO_CONFIG_KEY_HOLDING_REG_MODE)
+    {
+        io_config_parse_holding_reg_mode(parser, event);
+        return;
+    }
+    if(parser->section == IO_CONFIG_KEY_COUNTERS)
+    {
+        io_config_parse_counters(parser, event);
+        return;
+    }
+    // nested values are not expected below any other key
+    if(stream->depth != 2 || !io_config_parser_is_value(event)) { return; }
+
+    switch(parser->section)
+    {
+        case IO_CONFIG_KEY_COILS:
+            if(!io_config_parse_pin(parser, event, COILS_MAX, "coils", "coils")) { break; }
+            io_config->coils[parser->coils++] = value;
+            printf("added coil on GPIO %i\n", value);
+            break;
+
+        case IO_CONFIG_KEY_DISCRETE_IN:
+            if(!io_config_parse_pin(parser, event, DISCRETE_IN_MAX, "discrete_in", "discrete inputs")) { break; }
+            io_config->discrete_in[parser->discrete_in++] = value;
+            printf("added discrete in on GPIO %i\n", value);
+            break;
+
+        case IO_CONFIG_KEY_HOLDING_REG:
+            if(!io_config_parse_pin(parser, event, HOLDING_REG_MAX, "holding_reg", "holding registers")) { break; }
+            switch(value)
+            {
+                case DAC_CHANNEL_1_GPIO_NUM:
+                    io_config->holding_reg_dac_channel[parser->holding_reg] = DAC_CHANNEL_1;
+                    printf("added holding register out for DAC channel %i on GPIO %i\n", 1, value);
+                    break;
+                case DAC_CHANNEL_2_GPIO_NUM:
+                    io_config->holding_reg_dac_channel[parser->holding_reg] = DAC_CHANNEL_2;
+                    printf("added holding register out for DAC channel %i on GPIO %i\n", 2, value);
+                    break;
+                default:
+                    printf("GPIO %i not connected to a DAC channel as holding register!", value);
+                    parser->has_err = true;
+                    return;
+            }
+            io_config->holding_reg[parser->holding_reg++] = value;
+            break;
+
+        case IO_CONFIG_KEY_INPUT_REG:
+            if(!io_config_parse_pin(parser, event, INPUT_REG_MAX, "input_reg", "input registers")) { break; }
+            switch(value)
+            {
+                HANDLE_CASE_ADC1_CHANNEL(0);
+                HANDLE_CASE_ADC1_CHANNEL(1);
+                HANDLE_CASE_ADC1_CHANNEL(2);
+                HANDLE_CASE_ADC1_CHANNEL(3);
+                HANDLE_CASE_ADC1_CHANNEL(4);
+                HANDLE_CASE_ADC1_CHANNEL(5);
+                HANDLE_CASE_ADC1_CHANNEL(6);
+                HANDLE_CASE_ADC1_CHANNEL(7);
+                default:
+                    printf("GPIO %i not connected to a ADC1 channel as input register!", value);
+                    parser->has_err = true;
+                    return;
+            }
+            io_config->input_reg[parser->input_reg++] = value;
+            break;
+
+        case IO_CONFIG_KEY_INPUT_REG_MODE:
+        {
+            const int i = json_stream_index(stream);
+            parser->input_reg_modes++;
+            // oversized arrays are reported once all input registers are known
+            if(i >= INPUT_REG_MAX) { break; }
+            if(event != JSON_STREAM_STRING || stream->value_truncated || adc_reduce_mode_parse(stream->value, &(io_config->input_reg_mode[i]), &(io_config->input_reg_iir_shift[i])))
+            {
+                printf("invalid entry in \"input_reg_mode\"!\n");
+                parser->has_err = true;
+            }
+            break;
+        }
+
+        case IO_CONFIG_KEY_CAPTURE:
         {
-            int8_t* discrete_in_store = io_config->discrete_in;
-            cJSON* discrete_in;
-            cJSON_ArrayForEach(discrete_in, discrete_ins)
+            const char* key = json_stream_key(stream);
+            if(strcmp("pre", key) == 0)
             {
-                if(cJSON_IsNumber(discrete_in))
+                if(event == JSON_STREAM_NUMBER && value >= 0 && value <= ADC_CAPTURE_SAMPLES_MAX)
                 {
-                    *discrete_in_store = discrete_in->valueint;
-                    discrete_in_store++;
-                    printf("added discrete in on GPIO %i\n", discrete_in->valueint);
+                    io_config->capture_pre = value;
                 }
                 else
                 {
-                    printf("skipping non-number entry in \"discrete_in\"!\n");
-                    has_err = true;
+                    printf("\"capture\": \"pre\" is not a valid sample count!\n");
+                    parser->has_err = true;
                 }
             }
+            else if(strcmp("post", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 0 && value <= ADC_CAPTURE_SAMPLES_MAX)
+                {
+                    io_config->capture_post = value;
+                }
+                else
+                {
+                    printf("\"capture\": \"post\" is not a valid sample count!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("trigger", key) == 0)
+            {
+                if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "coil")) { io_config->capture_trigger = ADC_CAPTURE_TRIGGER_COIL; }
+                else if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "rising")) { io_config->capture_trigger = ADC_CAPTURE_TRIGGER_RISING; }
+                else if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "falling")) { io_config->capture_trigger = ADC_CAPTURE_TRIGGER_FALLING; }
+                else
+                {
+                    printf("\"capture\": unknown \"trigger\"!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("input", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER)
+                {
+                    io_config->capture_input = value;
+                }
+                else
+                {
+                    printf("\"capture\": \"input\" is not a number!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("level", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 0)
+                {
+                    io_config->capture_level = value;
+                }
+                else
+                {
+                    printf("\"capture\": \"level\" is not a positive number!\n");
+                    parser->has_err = true;
+                }
+            }
+            break;
         }
-        else
-        {
-            printf("too many pins for discrete inputs!\n");
-            has_err = true;
-        }
-    }
 
-    // holding registers
-    cJSON* holding_regs = cJSON_GetObjectItem(root, "holding_reg");
-    if(holding_regs && cJSON_IsArray(holding_regs))
-    {
-        if(cJSON_GetArraySize(holding_regs) <= sizeof(io_config->holding_reg))
+        case IO_CONFIG_KEY_PUBLISH:
         {
-            int8_t* holding_reg_store = io_config->holding_reg;
-            dac_channel_t* holding_reg_dac_channel_store = io_config->holding_reg_dac_channel;
-            cJSON* holding_reg;
-            cJSON_ArrayForEach(holding_reg, holding_regs)
+            const char* key = json_stream_key(stream);
+            if(strcmp("host", key) == 0)
             {
-                if(cJSON_IsNumber(holding_reg))
+                unsigned int ip[4];
+                char tail;
+                parser->has_host = true;
+                if(event == JSON_STREAM_STRING && !stream->value_truncated
+                    && sscanf(stream->value, "%u.%u.%u.%u%c", &ip[0], &ip[1], &ip[2], &ip[3], &tail) == 4
+                    && ip[0] <= 255 && ip[1] <= 255 && ip[2] <= 255 && ip[3] <= 255 && ip[0] != 0)
                 {
-                    switch(holding_reg->valueint)
-                    {
-                        case DAC_CHANNEL_1_GPIO_NUM:
-                            *holding_reg_dac_channel_store = DAC_CHANNEL_1;
-                            holding_reg_dac_channel_store++;
-                            printf("added holding register out for DAC channel %i on GPIO %i\n", 1, holding_reg->valueint);
-                            break;
-                        case DAC_CHANNEL_2_GPIO_NUM:
-                            *holding_reg_dac_channel_store = DAC_CHANNEL_2;
-                            holding_reg_dac_channel_store++;
-                            printf("added holding register out for DAC channel %i on GPIO %i\n", 2, holding_reg->valueint);
-                            break;
-                        default:
-                            printf("GPIO %i not connected to a DAC channel as holding register!", holding_reg->valueint);
-                            has_err = true;
-                            // CONTINUE LOOP WITH NEXT PIN
-                            continue;
-                    }
-                    
-                    *holding_reg_store = holding_reg->valueint;
-                    holding_reg_store++;
+                    for(int i = 0; i < 4; i++) { io_config->publish_ip[i] = ip[i]; }
+                    io_config->publish = true;
+                }
+                else
+                {
+                    printf("\"publish\": \"host\" is not an IPv4 address!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("port", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value > 0 && value <= UINT16_MAX)
+                {
+                    io_config->publish_port = value;
+                }
+                else
+                {
+                    printf("\"publish\": \"port\" is not a valid port!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("deadband", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 0 && value <= UINT16_MAX)
+                {
+                    io_config->publish_deadband = value;
+                }
+                else
+                {
+                    printf("\"publish\": \"deadband\" is not a positive number!\n");
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("keyframe_ms", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= IO_PUBLISH_KEYFRAME_MS_MIN && value <= IO_PUBLISH_KEYFRAME_MS_MAX)
+                {
+                    io_config->publish_keyframe_ms = value;
+                }
+                else
+                {
+                    printf("\"publish\": \"keyframe_ms\" out of range (%u - %u)!\n", IO_PUBLISH_KEYFRAME_MS_MIN, IO_PUBLISH_KEYFRAME_MS_MAX);
+                    parser->has_err = true;
+                }
+            }
+            else if(strcmp("ttl", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 1 && value <= 255)
+                {
+                    io_config->publish_ttl = value;
                 }
                 else
                 {
-                    printf("skipping non-number entry in \"holding_reg\"!\n");
-                    has_err = true;
+                    printf("\"publish\": \"ttl\" is not in 1 - 255!\n");
+                    parser->has_err = true;
                 }
             }
+            break;
         }
-        else
+
+        case IO_CONFIG_KEY_SHIFT:
         {
-            printf("too many pins for holding registers!\n");
-            has_err = true;
+            const char* key = json_stream_key(stream);
+            int8_t* pin = NULL;
+            uint8_t* chips = NULL;
+            if(strcmp("sclk", key) == 0) { pin = &(io_config->shift_sclk); }
+            else if(strcmp("mosi", key) == 0) { pin = &(io_config->shift_mosi); }
+            else if(strcmp("miso", key) == 0) { pin = &(io_config->shift_miso); }
+            else if(strcmp("load", key) == 0) { pin = &(io_config->shift_load); }
+            else if(strcmp("latch", key) == 0) { pin = &(io_config->shift_latch); }
+            else if(strcmp("outputs", key) == 0) { chips = &(io_config->shift_outputs); }
+            else if(strcmp("inputs", key) == 0) { chips = &(io_config->shift_inputs); }
+            else if(strcmp("clock_hz", key) == 0)
+            {
+                if(event == JSON_STREAM_NUMBER && value > 0)
+                {
+                    io_config->shift_clock_hz = value;
+                }
+                else
+                {
+                    printf("\"shift\": \"clock_hz\" is not a positive number!\n");
+                    parser->has_err = true;
+                }
+            }
+
+            if(pin)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 0 && value < GPIO_NUM_MAX)
+                {
+                    *pin = value;
+                }
+                else
+                {
+                    printf("\"shift\": \"%s\" is not a GPIO number!\n", key);
+                    parser->has_err = true;
+                }
+            }
+            if(chips)
+            {
+                if(event == JSON_STREAM_NUMBER && value >= 0 && value <= IO_SHIFT_CHIPS_MAX)
+                {
+                    *chips = value;
+                }
+                else
+                {
+                    printf("\"shift\": \"%s\" out of range (0 - %u chips)!\n", key, IO_SHIFT_CHIPS_MAX);
+                    parser->has_err = true;
+                }
+            }
+            break;
         }
+
+        default:
+            break;
     }
+}
 
-#define HANDLE_CASE_ADC1_CHANNEL(n) \
-    case ADC1_CHANNEL_ ## n ## _GPIO_NUM: \
-        *input_reg_adc_channel_store = ADC1_CHANNEL_ ## n; \
-        input_reg_adc_channel_store++; \
-        printf("added input register in for ADC1 channel %i on GPIO %i\n",n , input_reg->valueint); \
-        break
+// values of top level keys; containers open a section for their contents
+void io_config_parse_key(io_config_parser_t* parser, json_stream_event_t event)
+{
+    json_stream_t* stream = &(parser->stream);
+    io_config_t* io_config = parser->io_config;
+    const int value = json_stream_int(stream);
 
-    // input registers
-    cJSON* input_regs = cJSON_GetObjectItem(root, "input_reg");
-    if(input_regs && cJSON_IsArray(input_regs))
+    // end of section; single holding register output object applies to all
+    if(!io_config_parser_is_value(event))
     {
-        if(cJSON_GetArraySize(input_regs) <= sizeof(io_config->input_reg))
+        if(parser->section == IO_CONFIG_KEY_HOLDING_REG_MODE && parser->holding_reg_modes < 0)
         {
-            int8_t* input_reg_store = io_config->input_reg;
-            adc1_channel_t* input_reg_adc_channel_store = io_config->input_reg_adc_channel;
-            cJSON* input_reg;
-            cJSON_ArrayForEach(input_reg, input_regs)
+            if(parser->output_has_mode && !parser->output_err)
             {
-                if(cJSON_IsNumber(input_reg))
+                for(int i = 0; i < HOLDING_REG_MAX; i++)
                 {
-                    switch(input_reg->valueint)
+                    io_config->holding_reg_output[i] = parser->output;
+                }
+            }
+            else
+            {
+                printf("invalid \"holding_reg_mode\"!\n");
+                parser->has_err = true;
+            }
+        }
+        if(parser->section == IO_CONFIG_KEY_PUBLISH && !parser->has_host)
+        {
+            printf("\"publish\": \"host\" is not an IPv4 address!\n");
+            parser->has_err = true;
+        }
+        parser->section = IO_CONFIG_KEY_NONE;
+        return;
+    }
+
+    const io_config_key_t key = io_config_key_lookup(stream);
+    switch(key)
+    {
+        // cycle timing
+        case IO_CONFIG_KEY_CYCLE_US:
+            if(event == JSON_STREAM_NUMBER && value > 0)
+            {
+                io_config->cycle_us = value;
+            }
+            else
+            {
+                printf("\"cycle_us\" is not a positive number!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        case IO_CONFIG_KEY_LATCH_US:
+            if(event == JSON_STREAM_NUMBER && value >= 0)
+            {
+                io_config->latch_us = value;
+            }
+            else
+            {
+                printf("\"latch_us\" is not a number!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // pull resistors
+        case IO_CONFIG_KEY_PULL:
+            parser->has_pull = true;
+            if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "up"))
+            {
+                io_config->pull = UP;
+            }
+            else if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "down"))
+            {
+                io_config->pull = DOWN;
+            }
+            break;
+
+        // change-of-state events
+        case IO_CONFIG_KEY_DISCRETE_IN_EVENTS:
+            if(event == JSON_STREAM_BOOL)
+            {
+                io_config->discrete_in_events = stream->boolean;
+            }
+            else
+            {
+                printf("\"discrete_in_events\" is not a boolean!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // process image window
+        case IO_CONFIG_KEY_IMAGE_WINDOW:
+            if(event == JSON_STREAM_BOOL)
+            {
+                io_config->image_window = stream->boolean;
+            }
+            else
+            {
+                printf("\"image_window\" is not a boolean!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // pin arrays; other types are ignored
+        case IO_CONFIG_KEY_COILS:
+        case IO_CONFIG_KEY_DISCRETE_IN:
+        case IO_CONFIG_KEY_HOLDING_REG:
+        case IO_CONFIG_KEY_INPUT_REG:
+            parser->has_pins = true;
+            if(event == JSON_STREAM_ARRAY_BEGIN) { parser->section = key; }
+            break;
+
+        // holding register output modes; single entry for all, or array in order of holding_reg
+        case IO_CONFIG_KEY_HOLDING_REG_MODE:
+            parser->output = (dac_output_config_t)DAC_OUTPUT_CONFIG_DEFAULT();
+            parser->output_has_mode = false;
+            parser->output_err = false;
+            parser->holding_reg_modes = event == JSON_STREAM_ARRAY_BEGIN ? 0 : -1;
+            if(event == JSON_STREAM_ARRAY_BEGIN || event == JSON_STREAM_OBJECT_BEGIN)
+            {
+                parser->section = key;
+            }
+            else if(event == JSON_STREAM_STRING && !stream->value_truncated && !dac_mode_parse(stream->value, &(parser->output.mode)))
+            {
+                for(int i = 0; i < HOLDING_REG_MAX; i++)
+                {
+                    io_config->holding_reg_output[i] = parser->output;
+                }
+            }
+            else
+            {
+                printf("invalid \"holding_reg_mode\"!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        case IO_CONFIG_KEY_DAC_RATE_HZ:
+            if(event == JSON_STREAM_NUMBER && value > 0)
+            {
+                io_config->dac_rate_hz = value;
+            }
+            else
+            {
+                printf("\"dac_rate_hz\" is not a positive number!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // input register reduction modes; single string for all, or array in order of input_reg
+        case IO_CONFIG_KEY_INPUT_REG_MODE:
+            parser->input_reg_modes = -1;
+            if(event == JSON_STREAM_STRING)
+            {
+                adc_reduce_mode_t mode;
+                uint8_t iir_shift;
+                if(!stream->value_truncated && !adc_reduce_mode_parse(stream->value, &mode, &iir_shift))
+                {
+                    for(int i = 0; i < INPUT_REG_MAX; i++)
                     {
-                        HANDLE_CASE_ADC1_CHANNEL(0);
-                        HANDLE_CASE_ADC1_CHANNEL(1);
-                        HANDLE_CASE_ADC1_CHANNEL(2);
-                        HANDLE_CASE_ADC1_CHANNEL(3);
-                        HANDLE_CASE_ADC1_CHANNEL(4);
-                        HANDLE_CASE_ADC1_CHANNEL(5);
-                        HANDLE_CASE_ADC1_CHANNEL(6);
-                        HANDLE_CASE_ADC1_CHANNEL(7);
-                        default:
-                            printf("GPIO %i not connected to a ADC1 channel as input register!", input_reg->valueint);
-                            has_err = true;
-                            // CONTINUE LOOP WITH NEXT PIN
-                            continue;
+                        io_config->input_reg_mode[i] = mode;
+                        io_config->input_reg_iir_shift[i] = iir_shift;
                     }
-                    
-                    *input_reg_store = input_reg->valueint;
-                    input_reg_store++;
                 }
                 else
                 {
-                    printf("skipping non-number entry in \"input_reg\"!\n");
-                    has_err = true;
+                    printf("unknown input register mode \"%s\"!\n", stream->value);
+                    parser->has_err = true;
                 }
             }
-        }
-        else
-        {
-            printf("too many pins for input registers!\n");
-            has_err = true;
-        }
+            else if(event == JSON_STREAM_ARRAY_BEGIN)
+            {
+                parser->input_reg_modes = 0;
+                parser->section = key;
+            }
+            else
+            {
+                printf("\"input_reg_mode\" must be a string or an array of at most one entry per input register!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // input register scale
+        case IO_CONFIG_KEY_INPUT_SCALE:
+            if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "raw"))
+            {
+                io_config->input_scale = ADC_SCALE_RAW;
+            }
+            else if(json_stream_value_is(stream, event, JSON_STREAM_STRING, "mV"))
+            {
+                io_config->input_scale = ADC_SCALE_MV;
+            }
+            else
+            {
+                printf("\"input_scale\" must be \"raw\" or \"mV\"!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // waveform capture
+        case IO_CONFIG_KEY_CAPTURE:
+            if(event == JSON_STREAM_OBJECT_BEGIN)
+            {
+                parser->section = key;
+            }
+            else
+            {
+                printf("\"capture\" is not an object!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // report-by-exception publisher
+        case IO_CONFIG_KEY_PUBLISH:
+            if(event == JSON_STREAM_OBJECT_BEGIN)
+            {
+                parser->has_host = false;
+                parser->section = key;
+            }
+            else
+            {
+                printf("\"publish\" is not an object!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // shift register IO expansion; counts as IO on its own
+        case IO_CONFIG_KEY_SHIFT:
+            if(event == JSON_STREAM_OBJECT_BEGIN)
+            {
+                parser->has_pins = true;
+                parser->section = key;
+            }
+            else
+            {
+                printf("\"shift\" is not an object!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        // pulse counters and encoders; array of objects
+        case IO_CONFIG_KEY_COUNTERS:
+            if(event == JSON_STREAM_ARRAY_BEGIN)
+            {
+                parser->has_pins = true;
+                parser->section = key;
+            }
+            else
+            {
+                printf("\"counters\" is not an array!\n");
+                parser->has_err = true;
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+void io_config_parse_event(json_stream_t* stream, json_stream_event_t event, void* ctx)
+{
+    io_config_parser_t* parser = (io_config_parser_t*) ctx;
+
+    // values of the root object only; other documents have no suitable keys
+    if(stream->depth == 0 || !stream->level[0].object) { return; }
+
+    if(stream->depth == 1)
+    {
+        io_config_parse_key(parser, event);
+    }
+    else if(parser->section != IO_CONFIG_KEY_NONE)
+    {
+        io_config_parse_section(parser, event);
+    }
+}
+
+void io_config_parse_begin(io_config_parser_t* parser, io_config_t* io_config)
+{
+    memset((void*)parser, 0, sizeof(io_config_parser_t));
+    json_stream_init(&(parser->stream), io_config_parse_event, (void*)parser);
+    parser->io_config = io_config;
+    parser->section = IO_CONFIG_KEY_NONE;
+    parser->holding_reg_modes = -1;
+    parser->input_reg_modes = -1;
+    IO_CONFIG_INIT(*io_config);
+}
+
+// feed next chunk of the JSON document, e.g. as received
+esp_err_t io_config_parse_feed(io_config_parser_t* parser, const char* chunk, size_t len)
+{
+    if(parser->stream.state == JSON_STREAM_STATE_ERROR) { return ESP_FAIL; }
+    if(json_stream_feed(&(parser->stream), chunk, len))
+    {
+        printf("Could not parse IO config JSON!\n");
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// generator checks for size constrains and pin assignment resolution while building config
+// resulting config as a whole is automatically checked with io_config_validate() after the document ended
+esp_err_t io_config_parse_end(io_config_parser_t* parser)
+{
+    io_config_t* io_config = parser->io_config;
+
+    if(parser->stream.state == JSON_STREAM_STATE_ERROR) { return ESP_FAIL; }
+    if(json_stream_end(&(parser->stream)))
+    {
+        printf("Could not parse IO config JSON!\n");
+        return ESP_FAIL;
+    }
+
+    if(!parser->has_pull)
+    {
+        io_config->pull = OFF;
     }
 
-    if(!(coils || discrete_ins || holding_regs || input_regs))
+    if(parser->holding_reg_modes > count_holding_reg(io_config))
+    {
+        printf("\"holding_reg_mode\" must be a single entry or an array of at most one entry per holding register!\n");
+        parser->has_err = true;
+    }
+
+    if(parser->input_reg_modes > count_input_reg(io_config))
+    {
+        printf("\"input_reg_mode\" must be a string or an array of at most one entry per input register!\n");
+        parser->has_err = true;
+    }
+
+    if(!parser->has_pins)
     {
         printf("No suitable keys found in IO configuration!\n");
         return ESP_FAIL;
     }
 
-    if(has_err || io_config_validate(io_config))
+    if(parser->has_err || io_config_validate(io_config))
     {
         return ESP_FAIL;
     }
 
     return ESP_OK;
 }
+
+// complete JSON document in memory, e.g. from NVS
+esp_err_t io_config_generate(const char* io_json, size_t io_json_len, io_config_t* io_config)
+{
+    io_config_parser_t parser;
+    io_config_parse_begin(&parser, io_config);
+    io_config_parse_feed(&parser, io_json, io_json_len);
+    return io_config_parse_end(&parser);
+}
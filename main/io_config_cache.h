@@ -0,0 +1,53 @@
+#pragma once
+#include "esp32/rom/crc.h"
+#include "esp_ota_ops.h"
+#include "io_config.h"
+#include "io_setup_handler.h"
+
+
+// binary cache of the compiled IO configuration, persisted next to the JSON document it was built from
+// on boot it is copied in as a whole, so IO starts without parsing, validating and compiling; the JSON document stays
+// the source and is used whenever the cache was written by another firmware (magic, size, ELF SHA) or is corrupt (CRC)
+// keyed on the ELF SHA of the app, so any new firmware re-validates the stored JSON against its own rules and layout
+#define IO_CONFIG_CACHE_MAGIC 0x43434f49 // "IOCC"
+#define IO_CONFIG_CACHE_SHA_LEN 32
+
+typedef struct io_config_cache_t {
+    uint32_t magic;
+    uint16_t size; // sizeof(io_compiled_t)
+    uint16_t reserved;
+    uint8_t app_elf_sha256[IO_CONFIG_CACHE_SHA_LEN];
+    uint32_t crc; // CRC32 of compiled
+    io_compiled_t compiled;
+} io_config_cache_t;
+
+void io_config_cache_build(io_config_cache_t* cache, const io_compiled_t* compiled)
+{
+    memset((void*)cache, 0, sizeof(io_config_cache_t));
+    cache->magic = IO_CONFIG_CACHE_MAGIC;
+    memcpy((void*)cache->app_elf_sha256, (const void*)esp_ota_get_app_description()->app_elf_sha256, IO_CONFIG_CACHE_SHA_LEN);
+    cache->size = sizeof(io_compiled_t);
+    cache->compiled = *compiled;
+    cache->crc = crc32_le(0, (const uint8_t*)&(cache->compiled), sizeof(io_compiled_t));
+}
+
+// size: bytes read from storage
+esp_err_t io_config_cache_check(const io_config_cache_t* cache, size_t size)
+{
+    if(size != sizeof(io_config_cache_t) || cache->magic != IO_CONFIG_CACHE_MAGIC || cache->size != sizeof(io_compiled_t))
+    {
+        printf("IO config cache does not match this firmware\n");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if(memcmp(cache->app_elf_sha256, esp_ota_get_app_description()->app_elf_sha256, IO_CONFIG_CACHE_SHA_LEN))
+    {
+        printf("IO config cache was written by another firmware build\n");
+        return ESP_ERR_INVALID_VERSION;
+    }
+    if(cache->crc != crc32_le(0, (const uint8_t*)&(cache->compiled), sizeof(io_compiled_t)))
+    {
+        printf("IO config cache is corrupt!\n");
+        return ESP_ERR_INVALID_CRC;
+    }
+    return ESP_OK;
+}
@@ -0,0 +1,200 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "esp_system.h"
+#include "driver/gpio.h"
+#include "driver/pcnt.h"
+
+
+// hardware pulse counters and quadrature encoders on the PCNT units; counting needs no CPU time
+//   up: rising edges on pulse
+//   updown: rising edges on pulse; up while ctrl is high, down while low
+//   quadrature: all edges of pulse (A) and ctrl (B), 4 counts per encoder period; up while A leads B
+// the 16 bit unit counters are extended to 32 bits by the IO task: units reset to 0 at +-IO_COUNTER_LIMIT, so the unit
+// counter follows the true count modulo IO_COUNTER_LIMIT in both directions; the change per IO cycle is recovered
+// unambiguously as long as it stays below IO_COUNTER_LIMIT / 2 counts (1.6MHz at 10ms cycles), without interrupts
+// frequency and period are derived per IO cycle from the counts and the time since the last cycle with counts;
+// without counts, the period grows with the time since the last count and reads 0 after IO_COUNTER_TIMEOUT_US
+#define IO_COUNTERS_MAX 8 // PCNT units
+#define IO_COUNTER_LIMIT 32767
+#define IO_COUNTER_FILTER_NS_MAX 12787 // 1023 APB clock cycles
+#define IO_COUNTER_TIMEOUT_US 10000000
+
+typedef enum {
+    IO_COUNTER_UP = 0,
+    IO_COUNTER_UPDOWN,
+    IO_COUNTER_QUADRATURE
+} io_counter_mode_t;
+
+// pulse: counted input, encoder A; ctrl: direction input, encoder B; GPIO_NUM_NC if unused
+// filter_ns: pulses shorter than this are ignored; 0 disables the glitch filter
+typedef struct io_counter_config_t {
+    io_counter_mode_t mode;
+    int8_t pulse;
+    int8_t ctrl;
+    uint16_t filter_ns;
+} io_counter_config_t;
+
+#define IO_COUNTER_CONFIG_DEFAULT() { .mode = IO_COUNTER_UP, .pulse = GPIO_NUM_NC, .ctrl = GPIO_NUM_NC, .filter_ns = 0 }
+
+// input register layout per counter; 32 bit values as two registers, high word first
+// count (signed), frequency in mHz, period in us
+#define IO_COUNTER_REGS 6
+#define IO_COUNTER_REG_COUNT (IO_COUNTERS_MAX * IO_COUNTER_REGS)
+
+void print_io_counter_config(const io_counter_config_t* config)
+{
+    static const char* modes[] = { "up", "updown", "quadrature" };
+    printf("%s on GPIO %i", modes[config->mode], config->pulse);
+    if(config->ctrl != GPIO_NUM_NC) { printf(", ctrl GPIO %i", config->ctrl); }
+    if(config->filter_ns) { printf(", filter %uns", config->filter_ns); }
+}
+
+// parse "up", "updown" or "quadrature"
+esp_err_t io_counter_mode_parse(const char* str, io_counter_mode_t* mode)
+{
+    if(strcmp("up", str) == 0) { *mode = IO_COUNTER_UP; }
+    else if(strcmp("updown", str) == 0) { *mode = IO_COUNTER_UPDOWN; }
+    else if(strcmp("quadrature", str) == 0) { *mode = IO_COUNTER_QUADRATURE; }
+    else { return ESP_ERR_INVALID_ARG; }
+    return ESP_OK;
+}
+
+// IO task state per counter
+typedef struct io_counter_t {
+    int16_t raw; // unit counter at last update
+    int32_t count;
+    int64_t last_us; // cycle with the last counts; 0 before the first
+    uint32_t period_us;
+    uint32_t freq_mhz;
+} io_counter_t;
+
+typedef struct io_counters_t {
+    uint8_t count;
+    io_counter_t counters[IO_COUNTERS_MAX];
+} io_counters_t;
+static io_counters_t io_counters;
+
+static esp_err_t io_counter_unit_config(pcnt_unit_t unit, pcnt_channel_t channel, int8_t pulse, int8_t ctrl, pcnt_count_mode_t pos_mode, pcnt_count_mode_t neg_mode, pcnt_ctrl_mode_t lctrl_mode)
+{
+    pcnt_config_t config = {
+        .pulse_gpio_num = pulse,
+        .ctrl_gpio_num = ctrl == GPIO_NUM_NC ? PCNT_PIN_NOT_USED : ctrl,
+        .lctrl_mode = lctrl_mode,
+        .hctrl_mode = PCNT_MODE_KEEP,
+        .pos_mode = pos_mode,
+        .neg_mode = neg_mode,
+        .counter_h_lim = IO_COUNTER_LIMIT,
+        .counter_l_lim = -IO_COUNTER_LIMIT,
+        .unit = unit,
+        .channel = channel
+    };
+    return pcnt_unit_config(&config);
+}
+
+// configures one PCNT unit per counter, in order; counters start at 0
+esp_err_t io_counters_init(io_counters_t* counters, uint8_t count, const io_counter_config_t* configs)
+{
+    memset((void*)counters, 0, sizeof(io_counters_t));
+    counters->count = count;
+
+    for(int i = 0; i < count; i++)
+    {
+        const io_counter_config_t* config = &(configs[i]);
+        const pcnt_unit_t unit = (pcnt_unit_t) i;
+        printf("configuring counter %i: ", i);
+        print_io_counter_config(config);
+        printf("\n");
+
+        esp_err_t err = ESP_OK;
+        switch(config->mode)
+        {
+            case IO_COUNTER_UP:
+                err = io_counter_unit_config(unit, PCNT_CHANNEL_0, config->pulse, GPIO_NUM_NC, PCNT_COUNT_INC, PCNT_COUNT_DIS, PCNT_MODE_KEEP);
+                break;
+            case IO_COUNTER_UPDOWN:
+                err = io_counter_unit_config(unit, PCNT_CHANNEL_0, config->pulse, config->ctrl, PCNT_COUNT_INC, PCNT_COUNT_DIS, PCNT_MODE_REVERSE);
+                break;
+            case IO_COUNTER_QUADRATURE:
+                // both edges of both signals; direction from the level of the other signal
+                err = io_counter_unit_config(unit, PCNT_CHANNEL_0, config->pulse, config->ctrl, PCNT_COUNT_DEC, PCNT_COUNT_INC, PCNT_MODE_REVERSE);
+                if(!err) { err = io_counter_unit_config(unit, PCNT_CHANNEL_1, config->ctrl, config->pulse, PCNT_COUNT_INC, PCNT_COUNT_DEC, PCNT_MODE_REVERSE); }
+                break;
+            default:
+                err = ESP_ERR_INVALID_ARG;
+        }
+        if(err) { return err; }
+
+        // limits reset the unit counter; no interrupt is enabled
+        err = pcnt_event_enable(unit, PCNT_EVT_H_LIM);
+        if(!err) { err = pcnt_event_enable(unit, PCNT_EVT_L_LIM); }
+        if(!err && config->filter_ns)
+        {
+            err = pcnt_set_filter_value(unit, (uint32_t)config->filter_ns * 2 / 25);
+            if(!err) { err = pcnt_filter_enable(unit); }
+        }
+        else if(!err)
+        {
+            err = pcnt_filter_disable(unit);
+        }
+        if(!err) { err = pcnt_counter_pause(unit); }
+        if(!err) { err = pcnt_counter_clear(unit); }
+        if(!err) { err = pcnt_counter_resume(unit); }
+        if(err) { return err; }
+    }
+    return ESP_OK;
+}
+
+// IO task; extends unit counters and derives frequency and period at cycle time now_us
+// reset: bit per counter held at 0
+static inline void io_counters_update(io_counters_t* counters, int64_t now_us, uint8_t reset)
+{
+    for(int i = 0; i < counters->count; i++)
+    {
+        io_counter_t* counter = &(counters->counters[i]);
+        int16_t raw = 0;
+        pcnt_get_counter_value((pcnt_unit_t) i, &raw);
+
+        // change modulo IO_COUNTER_LIMIT, folded to the smallest magnitude
+        int32_t delta = ((int32_t)raw - counter->raw) % IO_COUNTER_LIMIT;
+        if(delta > IO_COUNTER_LIMIT / 2) { delta -= IO_COUNTER_LIMIT; }
+        else if(delta < -(IO_COUNTER_LIMIT / 2)) { delta += IO_COUNTER_LIMIT; }
+        counter->raw = raw;
+        counter->count = (reset >> i) & 0x01 ? 0 : (int32_t)((uint32_t)counter->count + (uint32_t)delta);
+
+        const uint32_t pulses = delta < 0 ? -delta : delta;
+        const int64_t elapsed_us = now_us - counter->last_us;
+        if(pulses)
+        {
+            if(counter->last_us && elapsed_us > 0)
+            {
+                counter->period_us = elapsed_us / pulses;
+                const uint64_t freq_mhz = (uint64_t)pulses * 1000000000 / elapsed_us;
+                counter->freq_mhz = freq_mhz > UINT32_MAX ? UINT32_MAX : freq_mhz;
+            }
+            counter->last_us = now_us;
+        }
+        else if(counter->period_us && elapsed_us > counter->period_us)
+        {
+            // slower than the last period, or stopped
+            const bool stopped = elapsed_us >= IO_COUNTER_TIMEOUT_US;
+            counter->period_us = stopped ? 0 : elapsed_us;
+            counter->freq_mhz = stopped ? 0 : 1000000000 / elapsed_us;
+        }
+    }
+}
+
+static inline void io_counters_export(const io_counters_t* counters, uint16_t* regs)
+{
+    for(int i = 0; i < counters->count; i++)
+    {
+        const io_counter_t* counter = &(counters->counters[i]);
+        uint16_t* counter_regs = regs + i * IO_COUNTER_REGS;
+        counter_regs[0] = (uint32_t)counter->count >> 16;
+        counter_regs[1] = (uint32_t)counter->count & 0xffff;
+        counter_regs[2] = counter->freq_mhz >> 16;
+        counter_regs[3] = counter->freq_mhz & 0xffff;
+        counter_regs[4] = counter->period_us >> 16;
+        counter_regs[5] = counter->period_us & 0xffff;
+    }
+}
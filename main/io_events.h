@@ -0,0 +1,176 @@
+#pragma once
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
+#include "io_config.h"
+
+
+// change-of-state capture for discrete inputs
+// edge interrupts of all discrete inputs push timestamped events into a single producer/single consumer ring;
+// producer: GPIO ISR (all handlers run from the ISR service on one core); consumer: modbus side
+// additionally, edges are accumulated per input and picked up by the IO task each cycle to latch "seen" bits
+// indices are positions in the discrete input list; each list swapped in by a reconfiguration starts a new generation,
+// events and edges of an earlier one are dropped instead of being served against the new list
+#define IO_EVENT_FIFO_LEN 256 // power of two
+
+// index: position in discrete input array (modbus address)
+// level: input level sampled in ISR
+// timestamp_us: lower 32 bits of esp_timer time; wraps after ~71 minutes
+// generation: of the discrete input list index refers to
+typedef struct io_event_t {
+    uint32_t timestamp_us;
+    uint8_t index;
+    uint8_t level;
+    uint8_t generation;
+} io_event_t;
+
+typedef struct io_events_t {
+    io_event_t fifo[IO_EVENT_FIFO_LEN];
+    volatile uint32_t head; // written by ISR only
+    volatile uint32_t tail; // written by consumer only
+    volatile uint32_t overflows;
+    volatile uint32_t edges[2]; // bit per discrete input with edges since last io_events_take_edges(); 32 bit words for atomics in ISR
+    int8_t pins[DISCRETE_IN_MAX];
+    volatile uint8_t generation; // of the discrete input list in use by the IO task; changed by the IO task only
+} io_events_t;
+static io_events_t io_events;
+
+// arg: generation << 8 | index
+static void IRAM_ATTR io_event_isr(void* arg)
+{
+    const uint8_t index = (uintptr_t) arg & 0xff;
+    const uint8_t generation = (uintptr_t) arg >> 8;
+    // handler of a replaced input list, not yet removed
+    if(generation != __atomic_load_n(&(io_events.generation), __ATOMIC_RELAXED)) { return; }
+    const int8_t pin = io_events.pins[index];
+    const uint32_t timestamp_us = (uint32_t) esp_timer_get_time();
+    const uint8_t level = pin < 32 ? (REG_READ(GPIO_IN_REG) >> pin) & 0x01 : (REG_READ(GPIO_IN1_REG) >> (pin - 32)) & 0x01;
+
+    __atomic_fetch_or(&(io_events.edges[index >> 5]), (uint32_t)0x01 << (index & 31), __ATOMIC_RELAXED);
+
+    const uint32_t head = io_events.head;
+    if(head - __atomic_load_n(&(io_events.tail), __ATOMIC_ACQUIRE) >= IO_EVENT_FIFO_LEN)
+    {
+        io_events.overflows++;
+        return;
+    }
+
+    io_event_t* event = &(io_events.fifo[head & (IO_EVENT_FIFO_LEN - 1)]);
+    event->timestamp_us = timestamp_us;
+    event->index = index;
+    event->level = level;
+    event->generation = generation;
+    __atomic_store_n(&(io_events.head), head + 1, __ATOMIC_RELEASE);
+}
+
+// attach edge interrupt handlers for all configured discrete inputs; GPIOs must be configured by setup_gpio_in() before
+esp_err_t setup_io_events(io_config_t* io_config)
+{
+    memset((void*)&io_events, 0, sizeof(io_events));
+    memcpy((void*)io_events.pins, (void*)io_config->discrete_in, sizeof(io_events.pins));
+
+    if(!io_config->discrete_in_events)
+    {
+        return ESP_OK;
+    }
+
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if(err) { return err; }
+
+    for(int i = 0; i < count_discrete_in(io_config); i++)
+    {
+        printf("enabling change-of-state events on GPIO %i\n", io_config->discrete_in[i]);
+        err = gpio_isr_handler_add(io_config->discrete_in[i], io_event_isr, (void*)(((uintptr_t)io_events.generation << 8) | i));
+        if(err) { return err; }
+    }
+
+    return ESP_OK;
+}
+
+// re-attach edge interrupt handlers after the new discrete input list was swapped in; until then, old handlers are
+// ignored by generation (see io_events_next_generation())
+esp_err_t io_events_reconfigure(io_config_t* old_config, io_config_t* io_config)
+{
+    if(old_config->discrete_in_events)
+    {
+        for(int i = 0; i < count_discrete_in(old_config); i++)
+        {
+            gpio_isr_handler_remove(old_config->discrete_in[i]);
+        }
+    }
+    memcpy((void*)io_events.pins, (void*)io_config->discrete_in, sizeof(io_events.pins));
+
+    if(!io_config->discrete_in_events)
+    {
+        return ESP_OK;
+    }
+
+    // service is installed once; kept if events were enabled before
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if(err && err != ESP_ERR_INVALID_STATE) { return err; }
+
+    for(int i = 0; i < count_discrete_in(io_config); i++)
+    {
+        printf("enabling change-of-state events on GPIO %i\n", io_config->discrete_in[i]);
+        err = gpio_isr_handler_add(io_config->discrete_in[i], io_event_isr, (void*)(((uintptr_t)io_events.generation << 8) | i));
+        if(err) { return err; }
+    }
+
+    return ESP_OK;
+}
+
+// single consumer; returns number of events copied to events, oldest first
+// events of an earlier discrete input list are removed without being copied
+size_t io_events_pop(io_event_t* events, size_t max)
+{
+    uint32_t tail = io_events.tail;
+    const uint32_t head = __atomic_load_n(&(io_events.head), __ATOMIC_ACQUIRE);
+    const uint8_t generation = __atomic_load_n(&(io_events.generation), __ATOMIC_RELAXED);
+    size_t count = 0;
+
+    for(; tail != head && count < max; tail++)
+    {
+        const io_event_t* event = &(io_events.fifo[tail & (IO_EVENT_FIFO_LEN - 1)]);
+        if(event->generation != generation) { continue; }
+        events[count++] = *event;
+    }
+    __atomic_store_n(&(io_events.tail), tail, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+size_t io_events_pending()
+{
+    return __atomic_load_n(&(io_events.head), __ATOMIC_ACQUIRE) - io_events.tail;
+}
+
+// IO task only; edges since last call
+static inline uint64_t io_events_take_edges()
+{
+    const uint64_t edges = __atomic_exchange_n(&(io_events.edges[0]), 0, __ATOMIC_RELAXED);
+    return edges | ((uint64_t)__atomic_exchange_n(&(io_events.edges[1]), 0, __ATOMIC_RELAXED) << 32);
+}
+
+// IO task only, at the swap to a new discrete input list; handlers, queued events and edges of the old list are
+// dropped from here on, handlers of the new list are attached by io_events_reconfigure()
+static inline void io_events_next_generation()
+{
+    __atomic_store_n(&(io_events.generation), (uint8_t)(io_events.generation + 1), __ATOMIC_RELAXED);
+    io_events_take_edges();
+}
+
+// latched "seen high"/"seen low" bits per discrete input
+// an edge implies both levels were present; the sampled level of the cycle is latched as well
+// latches are held until reset by the corresponding bit in reset; reset is applied before new data is latched
+typedef struct io_latch_t {
+    uint64_t seen_high;
+    uint64_t seen_low;
+} io_latch_t;
+
+static inline void io_latch_update(io_latch_t* latch, uint64_t level, uint64_t edges, uint64_t reset, uint64_t mask)
+{
+    latch->seen_high &= ~reset;
+    latch->seen_low &= ~reset;
+    latch->seen_high |= (edges | level) & mask;
+    latch->seen_low |= (edges | ~level) & mask;
+}
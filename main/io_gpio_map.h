@@ -0,0 +1,170 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "esp_system.h"
+
+
+// precompiled bit permutation between packed IO data and GPIO registers
+// built once at IO task setup from the configured pin arrays:
+//   runs: contiguous source bits mapping to contiguous destination bits; one shift-and-mask each
+//   luts: remaining scattered bits, grouped by source byte; one indexed load per source byte
+// cost per application depends on the number of runs and touched bytes, not on the number of points
+// at most 32 runs of two or more bits plus one single bit run per source byte
+#define GPIO_MAP_RUNS_MAX 40
+#define GPIO_MAP_LUTS_MAX 8 // bytes in 64 bit source word
+// minimum scattered bits sharing a source byte to justify a lookup table over single bit runs
+#define GPIO_MAP_LUT_MIN_BITS 2
+
+typedef struct gpio_map_run_t {
+    uint64_t mask; // run mask, aligned to bit 0
+    uint8_t src_shift;
+    uint8_t dst_shift;
+} gpio_map_run_t;
+
+typedef struct gpio_map_t {
+    uint8_t run_count;
+    uint8_t lut_count;
+    gpio_map_run_t runs[GPIO_MAP_RUNS_MAX];
+    uint8_t lut_shift[GPIO_MAP_LUTS_MAX]; // source bit offset of byte for each table
+    uint64_t (*lut)[256]; // lut_count tables of 256 entries; heap allocated
+} gpio_map_t;
+
+#define GPIO_MAP_DEFAULT() { .run_count = 0, .lut_count = 0, .lut = NULL }
+
+void gpio_map_free(gpio_map_t* map)
+{
+    free(map->lut);
+    map->lut = NULL;
+    map->lut_count = 0;
+    map->run_count = 0;
+}
+
+// src_bits[i] is mapped to dst_bits[i]; bit numbers must be < 64 and unique per side
+esp_err_t gpio_map_compile(gpio_map_t* map, const uint8_t* src_bits, const uint8_t* dst_bits, size_t count)
+{
+    gpio_map_free(map);
+
+    // collect runs; single bits are kept aside for lookup tables
+    uint64_t single_src = 0x00;
+    uint8_t single_dst[64];
+    for(size_t i = 0; i < count;)
+    {
+        size_t len = 1;
+        while(i + len < count
+            && src_bits[i + len] == src_bits[i] + len
+            && dst_bits[i + len] == dst_bits[i] + len)
+        {
+            len++;
+        }
+
+        if(len == 1)
+        {
+            single_src |= (uint64_t)0x01 << src_bits[i];
+            single_dst[src_bits[i]] = dst_bits[i];
+        }
+        else
+        {
+            gpio_map_run_t* run = &(map->runs[map->run_count++]);
+            run->mask = len == 64 ? ~(uint64_t)0x00 : ((uint64_t)0x01 << len) - 1;
+            run->src_shift = src_bits[i];
+            run->dst_shift = dst_bits[i];
+        }
+        i += len;
+    }
+
+    // count single bits per source byte
+    uint8_t lut_bytes[GPIO_MAP_LUTS_MAX];
+    for(int byte = 0; byte < GPIO_MAP_LUTS_MAX; byte++)
+    {
+        uint8_t bits = (single_src >> (byte * 8)) & 0xff;
+        if(__builtin_popcount(bits) >= GPIO_MAP_LUT_MIN_BITS)
+        {
+            lut_bytes[map->lut_count++] = byte;
+        }
+        else if(bits)
+        {
+            // not worth a table; map as single bit run
+            int bit = byte * 8 + __builtin_ctz(bits);
+            gpio_map_run_t* run = &(map->runs[map->run_count++]);
+            run->mask = 0x01;
+            run->src_shift = bit;
+            run->dst_shift = single_dst[bit];
+        }
+    }
+
+    if(!map->lut_count) { return ESP_OK; }
+
+    // build tables; each entry is the OR of destination bits set by the byte value
+    map->lut = malloc(sizeof(uint64_t[256]) * map->lut_count);
+    if(!map->lut)
+    {
+        map->lut_count = 0;
+        return ESP_ERR_NO_MEM;
+    }
+
+    for(int t = 0; t < map->lut_count; t++)
+    {
+        const int byte = lut_bytes[t];
+        const uint8_t bits = (single_src >> (byte * 8)) & 0xff;
+        map->lut_shift[t] = byte * 8;
+
+        for(int value = 0; value < 256; value++)
+        {
+            uint64_t dst = 0x00;
+            for(int bit = 0; bit < 8; bit++)
+            {
+                if(bits & value & (0x01 << bit))
+                {
+                    dst |= (uint64_t)0x01 << single_dst[byte * 8 + bit];
+                }
+            }
+            map->lut[t][value] = dst;
+        }
+    }
+
+    return ESP_OK;
+}
+
+static inline uint64_t gpio_map_apply(const gpio_map_t* map, uint64_t src)
+{
+    uint64_t dst = 0x00;
+
+    for(int i = 0; i < map->run_count; i++)
+    {
+        const gpio_map_run_t* run = &(map->runs[i]);
+        dst |= ((src >> run->src_shift) & run->mask) << run->dst_shift;
+    }
+
+    for(int i = 0; i < map->lut_count; i++)
+    {
+        dst |= map->lut[i][(uint8_t)(src >> map->lut_shift[i])];
+    }
+
+    return dst;
+}
+
+// GPIO register bits -> packed data bits (discrete inputs)
+esp_err_t gpio_map_compile_in(gpio_map_t* map, const int8_t* pins, size_t count)
+{
+    uint8_t src[64];
+    uint8_t dst[64];
+    for(size_t i = 0; i < count; i++)
+    {
+        src[i] = pins[i];
+        dst[i] = i;
+    }
+    return gpio_map_compile(map, src, dst, count);
+}
+
+// packed data bits -> GPIO register bits (coils)
+esp_err_t gpio_map_compile_out(gpio_map_t* map, const int8_t* pins, size_t count)
+{
+    uint8_t src[64];
+    uint8_t dst[64];
+    for(size_t i = 0; i < count; i++)
+    {
+        src[i] = i;
+        dst[i] = pins[i];
+    }
+    return gpio_map_compile(map, src, dst, count);
+}
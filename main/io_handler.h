@@ -1,96 +1,57 @@
 #pragma once
 #include "freertos/task.h"
 #include "driver/gpio.h"
+#include "driver/timer.h"
+#include "esp_timer.h"
 #include "driver/i2s.h"
 #include "driver/dac.h"
 #include "esp_adc_cal.h"
-#include "io_setup_handler.h" // for dma buffer size
-#include "modbus_server.h"
+#include "io_setup_handler.h" // for ADC mailbox
+#include "io_gpio_map.h"
+#include "process_image.h"
+#include "io_profile.h"
+#include "io_shift.h"
 
 
+// copy latest reduced readings from ADC mailbox; never blocks on DMA
 // data: pointer to array of sufficient size
-// channel_data_mapping: array, mapping channel numbers as array indices to positions/indices in data array; set unused channels to ADC_CHANNEL_MAX
-// channel_mask: bitmask, with bits at position of required channel set to 1
-// as_mv: output millivolts instead of raw readings
-esp_err_t read_adc(uint16_t* data, int8_t channel_data_mapping[8], uint8_t channel_mask)
+// count: number of input registers
+// layout: ADC layout of the input registers (see adc_mailbox_t); data is left untouched for readings of another one
+esp_err_t read_adc(uint16_t* data, size_t count, uint32_t layout)
 {
     // skip if no actual channels are requested
-    if(!channel_mask) { return ESP_OK; }
+    if(!count) { return ESP_OK; }
 
-    adc_digi_output_data_t adc_data[ADC_DMA_BUF_LEN];
-    size_t adc_data_size = 0;
-    i2s_read(I2S_NUM_0, adc_data, ADC_DMA_BUF_LEN * sizeof(adc_digi_output_data_t), &adc_data_size, portMAX_DELAY);
-
-    size_t adc_raw_count = adc_data_size/sizeof(adc_digi_output_data_t);
-    uint8_t read_channel_mask = 0;
-
-    // loop through raw readings from back(newest), until all are processed, or we found a match for all requested channels
-    for(int i = adc_raw_count - 1; i >= 0 && read_channel_mask != channel_mask; i--)
-    {
-        uint8_t reading_mask = 1 << adc_data[i].type1.channel;
-        // test if channel has already been read
-        if(!(reading_mask & read_channel_mask))
-        {
-            // add to read channels
-            read_channel_mask |= reading_mask;
-
-            // test if channel is actually to be sampled, or something went wrong
-            if(channel_data_mapping[adc_data[i].type1.channel] != ADC_CHANNEL_MAX)
-            {
-                // assign data to output data array
-                *(data + channel_data_mapping[adc_data[i].type1.channel]) = adc_data[i].type1.data;
-            }
-            else
-            {
-                // printf("got reading for non-requested ADC channel #%i\n", adc_data[i].type1.channel);
-            }
-        }
-    }
+    const uint8_t buf = triple_buffer_fetch(&(adc_mailbox.exchange));
+    if(adc_mailbox.layout[buf] != layout) { return ESP_ERR_INVALID_STATE; }
+    memcpy((void*)data, (void*)adc_mailbox.data[buf], count * sizeof(uint16_t));
 
     // return successful acquisition of all requested channels
-    return read_channel_mask == channel_mask ? ESP_OK : ESP_FAIL;
+    const uint8_t valid_mask = ((uint16_t)0x01 << count) - 1;
+    return (adc_mailbox.valid_mask[buf] & valid_mask) == valid_mask ? ESP_OK : ESP_FAIL;
 }
 
-void write_dac(uint16_t* data, int8_t data_channel_mapping[2])
+// apply holding registers per output mode; see dac_engine.h
+void write_dac(const uint16_t* data, dac_engine_t* engine)
 {
-    for(int i = 0; data_channel_mapping[i] != DAC_CHANNEL_MAX && i < 2; i++)
-    {
-        RTCIO.pad_dac[data_channel_mapping[i]].dac = (uint8_t)*(data + i);
-        // esp_err_t err = dac_output_voltage(data_channel_mapping[i], (uint8_t)*(data + i));
-        // if(err) { return err; };
-    }
-
-    // return ESP_OK;
+    dac_engine_write(engine, data);
 }
 
 // always read both GPIO registers
-void read_gpio_in(uint64_t* data, int8_t* pins, size_t count)
+// map: compiled with gpio_map_compile_in() from discrete input pins
+void read_gpio_in(uint64_t* data, const gpio_map_t* map)
 {
-    *data = 0x00;
     uint64_t gpio_in = 0x00;
     gpio_in |= ((uint64_t)REG_READ(GPIO_IN1_REG) << 32);
     gpio_in |= REG_READ(GPIO_IN_REG);
 
-    for(int i = 0; i < count; i++)
-    {
-        *data |= ((gpio_in >> *(pins + i)) & 0x01) << i;
-    }
+    *data = gpio_map_apply(map, gpio_in);
 }
 
-void gpio_out_build(uint64_t data, int8_t* pins, uint64_t mask, size_t count, uint64_t* mask_set, uint64_t* mask_clear)
+// map: compiled with gpio_map_compile_out() from coil pins
+void gpio_out_build(uint64_t data, const gpio_map_t* map, uint64_t mask, uint64_t* mask_set, uint64_t* mask_clear)
 {
-    *mask_set = 0x00;
-    *mask_clear = 0x00;
-
-    // shift data at end of each iteration
-    for(int i = 0; i < count; i++)
-    {
-        *mask_set |= (data & (uint64_t)0x01) << *(pins + i);
-
-        // shift
-        data >>= 1;
-    }
-
+    *mask_set = gpio_map_apply(map, data);
     *mask_clear = mask & ~*mask_set;
 
     // printf("GPIO SET: %lli; GPIO CLEAR: %lli\n", *mask_set, mask_clear);
@@ -106,67 +67,227 @@ void gpio_out_latch(uint64_t mask_set, uint64_t mask_clear)
 }
 
 // always write both GPIO registers
-void write_gpio_out(uint64_t data, int8_t* pins, uint64_t mask, size_t count)
+void write_gpio_out(uint64_t data, const gpio_map_t* map, uint64_t mask)
 {
     uint64_t mask_set, mask_clear;
-    gpio_out_build(data, pins, mask, count, &mask_set, &mask_clear);
+    gpio_out_build(data, map, mask, &mask_set, &mask_clear);
     gpio_out_latch(mask_set, mask_clear);
 }
 
+// cycle statistics; written by IO task only
+// missed_cycles: timer ticks elapsed while the previous cycle was still running
+// late_latches: cycles reaching the output latch after the configured latch offset
+// first_cycle_us: time of first IO cycle since boot
+// swaps: runtimes swapped in by hot reconfiguration; swap_ns: time the last swap took within its IO cycle
+// shift_errors: failed shift register transactions
+typedef struct io_cycle_stats_t {
+    uint32_t cycles;
+    uint32_t missed_cycles;
+    uint32_t late_latches;
+    int64_t first_cycle_us;
+    uint32_t swaps;
+    uint32_t swap_ns;
+    uint32_t shift_errors;
+} io_cycle_stats_t;
+
+// runtime of the IO task: compiled config and the tables built from it off the hot path
+// dac: DAC engine of the holding registers; see setup_dac()
+// adc_layout: ADC layout of the input registers; the one set up last when built
+typedef struct io_runtime_t {
+    io_compiled_t compiled;
+    size_t coils_count;
+    size_t discrete_in_count;
+    size_t input_reg_count;
+    size_t holding_reg_count;
+    uint64_t discrete_in_mask;
+    gpio_map_t coils_map;
+    gpio_map_t discrete_in_map;
+    dac_engine_t* dac;
+    uint32_t adc_layout;
+} io_runtime_t;
+
+// two runtimes; one in use by the IO task, the other one free for hot reconfiguration (see io_reconfig.h)
+static io_runtime_t io_runtimes[2] = {
+    { .coils_map = GPIO_MAP_DEFAULT(), .discrete_in_map = GPIO_MAP_DEFAULT() },
+    { .coils_map = GPIO_MAP_DEFAULT(), .discrete_in_map = GPIO_MAP_DEFAULT() }
+};
+
+esp_err_t io_runtime_build(io_runtime_t* runtime, const io_compiled_t* compiled, dac_engine_t* dac)
+{
+    memcpy((void*)&(runtime->compiled), (const void*)compiled, sizeof(io_compiled_t));
+    io_config_t* io_config = &(runtime->compiled.config);
+
+    runtime->coils_count = count_coils(io_config);
+    runtime->discrete_in_count = count_discrete_in(io_config);
+    runtime->input_reg_count = count_input_reg(io_config);
+    runtime->holding_reg_count = count_holding_reg(io_config);
+    runtime->discrete_in_mask = runtime->discrete_in_count == 64 ? ~(uint64_t)0x00 : ((uint64_t)0x01 << runtime->discrete_in_count) - 1;
+    runtime->dac = dac;
+    runtime->adc_layout = adc_layout;
+
+    esp_err_t err = gpio_map_compile_out(&(runtime->coils_map), io_config->coils, runtime->coils_count);
+    if(err) { return err; }
+    err = gpio_map_compile_in(&(runtime->discrete_in_map), io_config->discrete_in, runtime->discrete_in_count);
+    if(err) { return err; }
+    printf("IO pin maps: coils %i runs, %i tables; discrete inputs %i runs, %i tables\n",
+        runtime->coils_map.run_count, runtime->coils_map.lut_count, runtime->discrete_in_map.run_count, runtime->discrete_in_map.lut_count);
+
+    return ESP_OK;
+}
+
+void io_runtime_free(io_runtime_t* runtime)
+{
+    gpio_map_free(&(runtime->coils_map));
+    gpio_map_free(&(runtime->discrete_in_map));
+}
+
+// compiled: config to start with; runtime is built from it by the IO task
+// runtime: in use by the IO task; pending: runtime to be swapped in at the next cycle boundary
+// swap_waiter: task notified once pending has been swapped in
 typedef struct io_task_params_t {
-    io_config_t* io_config;
-    modbus_data_t* modbus_data;
+    io_compiled_t* compiled;
+    process_image_t* image;
+    io_cycle_stats_t cycle_stats;
+    io_runtime_t* runtime;
+    io_runtime_t* pending;
+    TaskHandle_t swap_waiter;
 } io_task_params_t;
 
-// uint32_t voltage = esp_adc_cal_raw_to_voltage(adc_data[i].type1.data, &adc_cal);
+// hardware timer ticking the IO cycle; notifies the IO task from ISR
+#define IO_TIMER_GROUP TIMER_GROUP_0
+#define IO_TIMER_IDX TIMER_0
+#define IO_TIMER_DIVIDER 80 // 80MHz APB clock -> 1MHz; timer counts microseconds
+// ISR is installed from the IO task, so tick_ccount is taken on the IO task core
+typedef struct io_cycle_timer_t {
+    TaskHandle_t task;
+    volatile int64_t tick_us; // esp_timer time of last tick
+    volatile uint32_t tick_ccount; // CPU cycle count of last tick
+} io_cycle_timer_t;
+static io_cycle_timer_t io_cycle_timer = { .task = NULL, .tick_us = 0, .tick_ccount = 0 };
+
+static bool IRAM_ATTR io_cycle_timer_isr(void* arg)
+{
+    io_cycle_timer_t* timer = (io_cycle_timer_t*) arg;
+    BaseType_t higher_prio_woken = pdFALSE;
+
+    timer->tick_ccount = io_profile_ccount();
+    timer->tick_us = esp_timer_get_time();
+    vTaskNotifyGiveFromISR(timer->task, &higher_prio_woken);
+
+    return higher_prio_woken == pdTRUE;
+}
+
+esp_err_t start_io_cycle_timer(uint32_t cycle_us, TaskHandle_t task)
+{
+    io_cycle_timer.task = task;
+
+    timer_config_t timer_config = {
+        .divider = IO_TIMER_DIVIDER,
+        .counter_dir = TIMER_COUNT_UP,
+        .counter_en = TIMER_PAUSE,
+        .alarm_en = TIMER_ALARM_EN,
+        .auto_reload = TIMER_AUTORELOAD_EN,
+        .intr_type = TIMER_INTR_LEVEL
+    };
+
+    esp_err_t err = timer_init(IO_TIMER_GROUP, IO_TIMER_IDX, &timer_config);
+    if(err) { return err; }
+    timer_set_counter_value(IO_TIMER_GROUP, IO_TIMER_IDX, 0);
+    timer_set_alarm_value(IO_TIMER_GROUP, IO_TIMER_IDX, cycle_us);
+    timer_enable_intr(IO_TIMER_GROUP, IO_TIMER_IDX);
+    err = timer_isr_callback_add(IO_TIMER_GROUP, IO_TIMER_IDX, io_cycle_timer_isr, (void*) &io_cycle_timer, ESP_INTR_FLAG_IRAM);
+    if(err) { return err; }
+
+    printf("starting IO cycle timer with %uus period\n", cycle_us);
+    return timer_start(IO_TIMER_GROUP, IO_TIMER_IDX);
+}
+
+// busy wait for the latch phase; returns false if the latch point has already passed
+static inline bool io_wait_latch(int64_t latch_us)
+{
+    if(esp_timer_get_time() > latch_us) { return false; }
+    while(esp_timer_get_time() < latch_us) { /*spin*/ }
+    return true;
+}
+
+// attempts to read a consistent output image per cycle, before falling back to the previous one
+#define IO_IMAGE_READ_RETRIES 2
+
 // TODO: mark regions as critical? prevents task preemption
-#define IO_TASK_RATE_MS 10
-void vIOTask(void* params) // io_config_t* params
+void vIOTask(void* params) // io_task_params_t* params
 {
     // get parameters
-    io_config_t* io_config = ((io_task_params_t*) params)->io_config;
-    modbus_data_t* modbus_data = ((io_task_params_t*) params)->modbus_data;
-    
-    // setup loop
-    const TickType_t xFrequency = IO_TASK_RATE_MS / portTICK_PERIOD_MS;
-    TickType_t xLastWakeTime = xTaskGetTickCount();
-
-    // setup IO data structures
-        // coils
-        const size_t coils_count = count_coils(io_config);
-        uint64_t coils_mask = 0x00;
-        for(int i = 0; i < coils_count; i++)
-        {
-            coils_mask |= (uint64_t) 0x01 << io_config->coils[i];
-        }
-        // uint64_t coils_data = 0;
+    io_task_params_t* task_params = (io_task_params_t*) params;
+    process_image_t* image = task_params->image;
+    io_cycle_stats_t* cycle_stats = &(task_params->cycle_stats);
+
+    // setup IO data structures; holding registers: DAC engine is set up by setup_dac()
+    io_runtime_t* runtime = &(io_runtimes[0]);
+    ESP_ERROR_CHECK(io_runtime_build(runtime, task_params->compiled, &dac_engine));
+    __atomic_store_n(&(task_params->runtime), runtime, __ATOMIC_RELEASE);
+    io_config_t* io_config = &(runtime->compiled.config);
+
+    // cycle profiling; exported to diagnostic registers once per window
+    io_profile_t profile;
+    io_profile_init(&profile, io_config->cycle_us);
+    process_image_diag_t image_diag;
+    memset((void*)&image_diag, 0, sizeof(image_diag));
+
+    // local images; outputs keep last consistent state if reading the shared image fails
+    process_image_in_t image_in;
+    process_image_out_t image_out;
+    memset((void*)&image_in, 0, sizeof(image_in));
+    memset((void*)&image_out, 0, sizeof(image_out));
+
+    // discrete inputs
+    io_latch_t discrete_in_latch = { .seen_high = 0x00, .seen_low = 0x00 };
+    // waveform capture control; requests on rising edges
+    uint16_t capture_control = 0x00;
+
+    // start ticking; timer interrupt is allocated on this core
+    ESP_ERROR_CHECK(start_io_cycle_timer(io_config->cycle_us, xTaskGetCurrentTaskHandle()));
 
-        // holding registers
-        const size_t holding_reg_count = count_holding_reg(io_config);
-        // uint16_t holding_reg_data[2] = {0, 0};
-        int8_t dac_data_channel_mapping[2] = {DAC_CHANNEL_MAX, DAC_CHANNEL_MAX};
-        for(int i = 0; i < holding_reg_count; i++)
+    while(true) {
+        // wait for timer tick; more than one pending notification means cycles were missed
+        uint32_t ticks = ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if(ticks > 1)
         {
-            dac_data_channel_mapping[i] = io_config->holding_reg_dac_channel[i];
+            cycle_stats->missed_cycles += ticks - 1;
         }
-
-        // discrete inputs
-        const size_t discrete_in_count = count_discrete_in(io_config);
-        // uint64_t discrete_in_data = 0;
-
-        // input registers - ADC
-        const size_t input_reg_count = count_input_reg(io_config);
-        // uint16_t* input_reg_data = malloc(sizeof(uint16_t) * input_reg_count);
-        int8_t adc_channel_data_mapping[8];
-        memset((void*)adc_channel_data_mapping, ADC_CHANNEL_MAX, 8);
-        uint8_t adc_channel_mask = 0;
-        for(int i = 0; i < input_reg_count; i++)
+        const int64_t tick_us = io_cycle_timer.tick_us;
+        const uint32_t tick_ccount = io_cycle_timer.tick_ccount;
+        uint32_t ccount = io_profile_phase(&profile, IO_PHASE_WAKE, tick_ccount);
+        cycle_stats->cycles++;
+        if(cycle_stats->cycles == 1) { cycle_stats->first_cycle_us = tick_us; }
+
+        // hot reconfiguration; new runtime is taken between two cycles, before any IO of this one
+        io_runtime_t* next = __atomic_exchange_n(&(task_params->pending), NULL, __ATOMIC_ACQUIRE);
+        if(next)
         {
-            adc_channel_mask |= (1 << io_config->input_reg_adc_channel[i]);
-            adc_channel_data_mapping[io_config->input_reg_adc_channel[i]] = i;
+            io_config_t* next_config = &(next->compiled.config);
+            if(next_config->cycle_us != io_config->cycle_us)
+            {
+                timer_set_alarm_value(IO_TIMER_GROUP, IO_TIMER_IDX, next_config->cycle_us);
+                io_profile_init(&profile, next_config->cycle_us);
+            }
+            // latches and registers of inputs not present anymore; coils are written from the output image
+            if(next->compiled.discrete_in_gpio != runtime->compiled.discrete_in_gpio || memcmp(next_config->discrete_in, io_config->discrete_in, sizeof(io_config->discrete_in)))
+            {
+                discrete_in_latch.seen_high = 0x00;
+                discrete_in_latch.seen_low = 0x00;
+                io_events_next_generation();
+            }
+            // registers hold their last reading until the ADC delivers the new layout; removed ones read 0
+            memset((void*)(image_in.input_reg + next->input_reg_count), 0, sizeof(image_in.input_reg) - next->input_reg_count * sizeof(uint16_t));
+
+            runtime = next;
+            io_config = next_config;
+            __atomic_store_n(&(task_params->runtime), next, __ATOMIC_RELEASE);
+            xTaskNotifyGive(task_params->swap_waiter);
+            cycle_stats->swaps++;
+            cycle_stats->swap_ns = io_profile_ns(io_profile_ccount() - ccount);
         }
 
-    while(true) {
         /* DO WORK */
         // PREPARE WRITE DATA (!!! MOCK !!!)
         // static int loop_counter = 0;
@@ -187,20 +308,64 @@ void vIOTask(void* params) // io_config_t* params
         // loop_counter++;
 
         // PREPARE
+            process_image_read_out(image, &image_out, IO_IMAGE_READ_RETRIES);
             uint64_t mask_set;
             uint64_t mask_clear;
-            gpio_out_build(/*coils_data*/ modbus_data->coils, io_config->coils, coils_mask, coils_count, &mask_set, &mask_clear);
+            ccount = io_profile_ccount();
+            gpio_out_build(/*coils_data*/ image_out.coils, &(runtime->coils_map), runtime->compiled.coils_gpio, &mask_set, &mask_clear);
+            ccount = io_profile_phase(&profile, IO_PHASE_OUT_BUILD, ccount);
         // READ DATA
             // discrete inputs
-            read_gpio_in(/*&discrete_in_data*/ &(modbus_data->discrete_in), io_config->discrete_in, discrete_in_count);
+            read_gpio_in(/*&discrete_in_data*/ &(image_in.discrete_in), &(runtime->discrete_in_map));
+            io_counters_update(&io_counters, tick_us, image_out.counter_reset);
+            io_profile_phase(&profile, IO_PHASE_GPIO_IN, ccount);
+            // shift registers; inputs loaded next to the GPIO inputs, DMA shifts while the ADC is read
+            if(io_shift.len && io_shift_start(&io_shift, image_out.shift_out))
+            {
+                cycle_stats->shift_errors++;
+            }
+            io_latch_update(&discrete_in_latch, image_in.discrete_in, io_events_take_edges(), image_out.discrete_in_latch_reset, runtime->discrete_in_mask);
+            image_in.discrete_in_seen_high = discrete_in_latch.seen_high;
+            image_in.discrete_in_seen_low = discrete_in_latch.seen_low;
             // input registers / ADC
             /*esp_err_t adc_read_err = */
-            read_adc(/*input_reg_data*/ modbus_data->input_reg, adc_channel_data_mapping, adc_channel_mask);
-
-        // WRITE DATA 
-            write_dac(/*holding_reg_data*/ modbus_data->holding_reg, dac_data_channel_mapping);
+            ccount = io_profile_ccount();
+            read_adc(/*input_reg_data*/ image_in.input_reg, runtime->input_reg_count, runtime->adc_layout);
+            ccount = io_profile_phase(&profile, IO_PHASE_ADC, ccount);
+            if(io_shift.len)
+            {
+                if(io_shift_end(&io_shift, image_in.shift_in)) { cycle_stats->shift_errors++; }
+                io_profile_phase(&profile, IO_PHASE_SHIFT, ccount);
+            }
+            // waveform capture; recording runs in ADC task
+            const uint16_t capture_requests = image_out.capture_control & ~capture_control;
+            capture_control = image_out.capture_control;
+            if(capture_requests)
+            {
+                adc_capture_request(&adc_capture, capture_requests & (ADC_CAPTURE_REQ_ARM | ADC_CAPTURE_REQ_TRIGGER));
+            }
+            adc_capture_status(&adc_capture, image_in.capture_reg);
+            io_counters_export(&io_counters, image_in.counter_reg);
+            image_in.tick_us = tick_us;
+            image_in.discrete_in_count = runtime->discrete_in_count;
+            image_in.coils_count = runtime->coils_count;
+            image_in.input_reg_count = runtime->input_reg_count;
+            image_in.holding_reg_count = runtime->holding_reg_count;
+            process_image_publish_in(image, &image_in);
+
+        // WRITE DATA; latch at fixed phase from tick
+            if(!io_wait_latch(tick_us + io_config->latch_us))
+            {
+                cycle_stats->late_latches++;
+            }
+            ccount = io_profile_ccount();
+            write_dac(/*holding_reg_data*/ image_out.holding_reg, runtime->dac);
+            ccount = io_profile_phase(&profile, IO_PHASE_DAC, ccount);
             gpio_out_latch(mask_set, mask_clear);
-            // write_gpio_out(coils_data, &(io_config->coils[0]), coils_mask, coils_count);
+            io_shift_latch(&io_shift);
+            ccount = io_profile_phase(&profile, IO_PHASE_LATCH, ccount);
+            io_profile_record(&profile, IO_PHASE_LATCH_OFFSET, ccount - tick_ccount);
+            // write_gpio_out(coils_data, &coils_map, coils_mask);
 
         // PRINT DATA
             // // discrete in
@@ -224,15 +389,28 @@ void vIOTask(void* params) // io_config_t* params
             //     printf("error reading ADC!\n");
             // }
 
-        vTaskDelayUntil(&xLastWakeTime, xFrequency);
+        // PROFILE
+            io_profile_phase(&profile, IO_PHASE_CYCLE, tick_ccount);
+            if(io_profile_cycle_end(&profile))
+            {
+                io_profile_export(&profile, cycle_stats->cycles, cycle_stats->missed_cycles, cycle_stats->late_latches, image_diag.profile_reg);
+                process_image_publish_diag(image, &image_diag);
+            }
+            // boot time; reported once, after the first latch
+            if(cycle_stats->cycles == 1)
+            {
+                printf("first IO cycle at %lluus after boot\n", (unsigned long long) cycle_stats->first_cycle_us);
+            }
     }
 }
 
-// TODO: adjust task priority
-#define IO_TASK_STACK_SIZE 2048
+// IO task runs on APP CPU, away from WiFi and network stack
+#define IO_TASK_STACK_SIZE 4096
+#define IO_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define IO_TASK_CORE 1
 void start_io_task(io_task_params_t* io_task_params)
 {
     TaskHandle_t xIOTask = NULL;
-    xTaskCreate(vIOTask, "io_task", IO_TASK_STACK_SIZE, (void*) io_task_params, tskIDLE_PRIORITY, &xIOTask);
+    xTaskCreatePinnedToCore(vIOTask, "io_task", IO_TASK_STACK_SIZE, (void*) io_task_params, IO_TASK_PRIORITY, &xIOTask, IO_TASK_CORE);
     configASSERT(xIOTask);
 }
\ No newline at end of file
@@ -0,0 +1,136 @@
+#pragma once
+#include "esp_system.h"
+#include "xtensa/hal.h" // xthal_get_ccount
+#include "sdkconfig.h"
+
+
+// per-phase timing of the IO cycle based on CPU cycle counter (CCOUNT) of the IO task core
+// statistics are collected over a window of IO_PROFILE_WINDOW_US and then converted to modbus registers
+#define IO_PROFILE_WINDOW_US 1000000
+#define IO_PROFILE_CPU_MHZ CONFIG_ESP32_DEFAULT_CPU_FREQ_MHZ
+
+typedef enum {
+    IO_PHASE_WAKE = 0,      // timer tick to IO task running
+    IO_PHASE_OUT_BUILD,     // gpio_out_build
+    IO_PHASE_GPIO_IN,       // read_gpio_in
+    IO_PHASE_ADC,           // read_adc
+    IO_PHASE_DAC,           // write_dac
+    IO_PHASE_LATCH,         // gpio_out_latch
+    IO_PHASE_LATCH_OFFSET,  // timer tick to output latch
+    IO_PHASE_CYCLE,         // timer tick to end of cycle
+    IO_PHASE_SHIFT,         // wait for shift register transaction after read_adc
+    IO_PHASE_MAX
+} io_phase_t;
+
+// histogram bucket upper bounds in ns; last bucket is unbounded
+#define IO_PROFILE_BUCKETS 8
+static const uint32_t io_profile_bucket_ns[IO_PROFILE_BUCKETS - 1] = { 500, 1000, 2000, 5000, 10000, 20000, 50000 };
+
+typedef struct io_phase_stats_t {
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint16_t hist[IO_PROFILE_BUCKETS];
+} io_phase_stats_t;
+
+typedef struct io_profile_t {
+    io_phase_stats_t phases[IO_PHASE_MAX];
+    uint32_t bucket_bounds[IO_PROFILE_BUCKETS - 1]; // in CPU cycles
+    uint32_t window_cycles; // IO cycles per window
+    uint32_t cycles; // IO cycles in current window
+} io_profile_t;
+
+// input register layout; 32 bit values as two registers, high word first
+// header: total IO cycles, missed cycles (overruns), late latches, IO cycles in window
+// per phase: min ns, max ns, mean ns, histogram counts per bucket
+#define IO_PROFILE_HEADER_REGS 8
+#define IO_PROFILE_PHASE_REGS (6 + IO_PROFILE_BUCKETS)
+#define IO_PROFILE_REG_COUNT (IO_PROFILE_HEADER_REGS + IO_PHASE_MAX * IO_PROFILE_PHASE_REGS)
+
+static inline uint32_t io_profile_ccount()
+{
+    return xthal_get_ccount();
+}
+
+static void io_profile_reset(io_profile_t* profile)
+{
+    for(int phase = 0; phase < IO_PHASE_MAX; phase++)
+    {
+        io_phase_stats_t* stats = &(profile->phases[phase]);
+        memset((void*)stats, 0, sizeof(io_phase_stats_t));
+        stats->min = UINT32_MAX;
+    }
+    profile->cycles = 0;
+}
+
+void io_profile_init(io_profile_t* profile, uint32_t cycle_us)
+{
+    for(int i = 0; i < IO_PROFILE_BUCKETS - 1; i++)
+    {
+        profile->bucket_bounds[i] = io_profile_bucket_ns[i] * IO_PROFILE_CPU_MHZ / 1000;
+    }
+    profile->window_cycles = IO_PROFILE_WINDOW_US / cycle_us;
+    if(!profile->window_cycles) { profile->window_cycles = 1; }
+    io_profile_reset(profile);
+}
+
+static inline void io_profile_record(io_profile_t* profile, io_phase_t phase, uint32_t ccount_delta)
+{
+    io_phase_stats_t* stats = &(profile->phases[phase]);
+    if(ccount_delta < stats->min) { stats->min = ccount_delta; }
+    if(ccount_delta > stats->max) { stats->max = ccount_delta; }
+    stats->sum += ccount_delta;
+
+    int bucket = 0;
+    while(bucket < IO_PROFILE_BUCKETS - 1 && ccount_delta >= profile->bucket_bounds[bucket]) { bucket++; }
+    stats->hist[bucket]++;
+}
+
+// record phase from start to now; returns now as start of next phase
+static inline uint32_t io_profile_phase(io_profile_t* profile, io_phase_t phase, uint32_t start)
+{
+    const uint32_t now = io_profile_ccount();
+    io_profile_record(profile, phase, now - start);
+    return now;
+}
+
+static inline void io_profile_put_u32(uint16_t* regs, uint32_t value)
+{
+    regs[0] = value >> 16;
+    regs[1] = value & 0xffff;
+}
+
+static inline uint32_t io_profile_ns(uint64_t ccount)
+{
+    const uint64_t ns = ccount * 1000 / IO_PROFILE_CPU_MHZ;
+    return ns > UINT32_MAX ? UINT32_MAX : ns;
+}
+
+// count finished cycle; returns true once a window is complete and should be exported by io_profile_export()
+static inline bool io_profile_cycle_end(io_profile_t* profile)
+{
+    return ++(profile->cycles) >= profile->window_cycles;
+}
+
+// convert window statistics to registers and start a new window
+void io_profile_export(io_profile_t* profile, uint32_t cycles, uint32_t missed_cycles, uint32_t late_latches, uint16_t* regs)
+{
+    io_profile_put_u32(regs + 0, cycles);
+    io_profile_put_u32(regs + 2, missed_cycles);
+    io_profile_put_u32(regs + 4, late_latches);
+    io_profile_put_u32(regs + 6, profile->cycles);
+
+    for(int phase = 0; phase < IO_PHASE_MAX; phase++)
+    {
+        const io_phase_stats_t* stats = &(profile->phases[phase]);
+        uint16_t* phase_regs = regs + IO_PROFILE_HEADER_REGS + phase * IO_PROFILE_PHASE_REGS;
+        const bool has_data = profile->cycles && stats->min != UINT32_MAX;
+
+        io_profile_put_u32(phase_regs + 0, has_data ? io_profile_ns(stats->min) : 0);
+        io_profile_put_u32(phase_regs + 2, has_data ? io_profile_ns(stats->max) : 0);
+        io_profile_put_u32(phase_regs + 4, has_data ? io_profile_ns(stats->sum / profile->cycles) : 0);
+        memcpy((void*)(phase_regs + 6), (void*)stats->hist, sizeof(stats->hist));
+    }
+
+    io_profile_reset(profile);
+}
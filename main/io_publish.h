@@ -0,0 +1,203 @@
+#pragma once
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+#include "io_config.h"
+#include "process_image.h"
+
+
+// report-by-exception publisher of the input image over UDP
+// a task subscribed to the process image wakes after each IO cycle, compares discrete inputs and input registers
+// with the last published state and sends changes only; input register changes within the deadband are held back
+// until they exceed it, relative to the last published value
+// a keyframe with the complete input image is sent every keyframe_ms, so subscribers recover from lost datagrams
+// without requests; cycles the task could not keep up with are coalesced into one datagram
+//
+// datagram, little endian:
+//   0   u8   version (IO_PUBLISH_VERSION)
+//   1   u8   flags: bit 0 keyframe, bit 1 discrete inputs included
+//   2   u16  sequence number; incremented per datagram, gaps indicate loss
+//   4   u32  time of input image (IO cycle tick); lower 32 bits of esp_timer in us
+//   8   u8   discrete input count
+//   9   u8   input register count
+//   10  u16  input registers included; bit per register
+//   12  discrete inputs, bit per input, (count + 7) / 8 bytes; if included
+//   ..  u16  included input registers in ascending order
+#define IO_PUBLISH_VERSION 1
+#define IO_PUBLISH_FLAG_KEYFRAME 0x01
+#define IO_PUBLISH_FLAG_DISCRETE_IN 0x02
+#define IO_PUBLISH_HEADER_LEN 12
+#define IO_PUBLISH_DATAGRAM_LEN_MAX (IO_PUBLISH_HEADER_LEN + (DISCRETE_IN_MAX + 7) / 8 + 2 * INPUT_REG_MAX)
+
+// settings written by the config task at a reconfiguration; read by the publish task once per wake
+typedef struct io_publish_settings_t {
+    uint16_t deadband;
+    int64_t keyframe_us;
+} io_publish_settings_t;
+
+typedef struct io_publish_t {
+    process_image_t* image;
+    int sock;
+    struct sockaddr_in target;
+    seqlock_t settings_lock;
+    io_publish_settings_t settings;
+    int64_t last_keyframe_us;
+    // last published state; point counts follow the input image
+    uint16_t sequence;
+    uint8_t discrete_in_count;
+    uint8_t input_reg_count;
+    uint64_t discrete_in;
+    uint16_t input_reg[INPUT_REG_MAX];
+    // statistics
+    uint32_t cycles;
+    uint32_t datagrams;
+    uint32_t keyframes;
+    uint32_t send_errors;
+} io_publish_t;
+static io_publish_t io_publish;
+
+// config task only; single writer of the settings
+void io_publish_configure(io_publish_t* pub, const io_config_t* io_config)
+{
+    seqlock_write_begin(&(pub->settings_lock));
+    pub->settings.deadband = io_config->publish_deadband;
+    pub->settings.keyframe_us = (int64_t)io_config->publish_keyframe_ms * 1000;
+    seqlock_write_end(&(pub->settings_lock));
+}
+
+static inline void io_publish_read_settings(const io_publish_t* pub, io_publish_settings_t* settings)
+{
+    uint32_t seq;
+    do
+    {
+        seq = seqlock_read_begin(&(pub->settings_lock));
+        *settings = pub->settings;
+    } while(seqlock_read_retry(&(pub->settings_lock), seq));
+}
+
+// builds datagram of changes against last published state and takes them as published
+// a change of the point counts in the image, i.e. a reconfiguration, forces a keyframe
+// returns datagram length; 0 if nothing changed and no keyframe is requested
+size_t io_publish_encode(io_publish_t* pub, const process_image_in_t* in, uint16_t deadband, bool keyframe, uint8_t* datagram)
+{
+    if(in->discrete_in_count != pub->discrete_in_count || in->input_reg_count != pub->input_reg_count)
+    {
+        pub->discrete_in_count = in->discrete_in_count;
+        pub->input_reg_count = in->input_reg_count;
+        keyframe = true;
+    }
+
+    const uint64_t discrete_in_mask = pub->discrete_in_count == 64 ? ~(uint64_t)0x00 : ((uint64_t)0x01 << pub->discrete_in_count) - 1;
+    const bool discrete_in_changed = ((in->discrete_in ^ pub->discrete_in) & discrete_in_mask) != 0;
+
+    uint16_t input_reg_changed = 0x00;
+    for(int i = 0; i < pub->input_reg_count; i++)
+    {
+        if(keyframe || abs((int32_t)in->input_reg[i] - (int32_t)pub->input_reg[i]) > deadband)
+        {
+            input_reg_changed |= (uint16_t)0x01 << i;
+        }
+    }
+
+    if(!keyframe && !discrete_in_changed && !input_reg_changed) { return 0; }
+
+    uint8_t flags = keyframe ? IO_PUBLISH_FLAG_KEYFRAME : 0x00;
+    if(keyframe || discrete_in_changed) { flags |= IO_PUBLISH_FLAG_DISCRETE_IN; }
+
+    uint8_t* pos = datagram;
+    *pos++ = IO_PUBLISH_VERSION;
+    *pos++ = flags;
+    pos = process_image_put_u16(pos, pub->sequence++);
+    pos = process_image_put_u32(pos, (uint32_t) in->tick_us);
+    *pos++ = pub->discrete_in_count;
+    *pos++ = pub->input_reg_count;
+    pos = process_image_put_u16(pos, input_reg_changed);
+
+    if(flags & IO_PUBLISH_FLAG_DISCRETE_IN)
+    {
+        pub->discrete_in = in->discrete_in & discrete_in_mask;
+        pos = process_image_put_bits(pos, pub->discrete_in, pub->discrete_in_count);
+    }
+
+    for(int i = 0; i < pub->input_reg_count; i++)
+    {
+        if(!((input_reg_changed >> i) & 0x01)) { continue; }
+        pub->input_reg[i] = in->input_reg[i];
+        pos = process_image_put_u16(pos, in->input_reg[i]);
+    }
+
+    pub->keyframes += keyframe;
+    return pos - datagram;
+}
+
+void vIoPublishTask(void* params)
+{
+    io_publish_t* pub = (io_publish_t*) params;
+    process_image_in_t in;
+    io_publish_settings_t settings;
+    uint8_t datagram[IO_PUBLISH_DATAGRAM_LEN_MAX];
+
+    while(true)
+    {
+        pub->cycles += ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        process_image_read_in(pub->image, &in);
+        io_publish_read_settings(pub, &settings);
+
+        const int64_t now_us = esp_timer_get_time();
+        const uint32_t keyframes = pub->keyframes;
+        const bool keyframe = !keyframes || now_us - pub->last_keyframe_us >= settings.keyframe_us;
+        const size_t len = io_publish_encode(pub, &in, settings.deadband, keyframe, datagram);
+        if(!len) { continue; }
+        if(pub->keyframes != keyframes) { pub->last_keyframe_us = now_us; }
+
+        if(sendto(pub->sock, datagram, len, MSG_DONTWAIT, (struct sockaddr*)&(pub->target), sizeof(pub->target)) < 0)
+        {
+            pub->send_errors++;
+        }
+        else
+        {
+            pub->datagrams++;
+        }
+    }
+}
+
+// publisher task runs on PRO CPU next to the network stack; above the Modbus server for low latency, below the ADC task
+// subscribes to the process image; may start after the IO task, e.g. once the network is up
+#define IO_PUBLISH_TASK_STACK_SIZE 3072
+#define IO_PUBLISH_TASK_PRIORITY 6
+#define IO_PUBLISH_TASK_CORE 0
+esp_err_t start_io_publish(io_config_t* io_config, process_image_t* image)
+{
+    if(!io_config->publish) { return ESP_OK; }
+
+    io_publish_t* pub = &io_publish;
+    memset((void*)pub, 0, sizeof(io_publish_t));
+    pub->image = image;
+    io_publish_configure(pub, io_config);
+    pub->target.sin_family = AF_INET;
+    pub->target.sin_port = htons(io_config->publish_port);
+    memcpy((void*)&(pub->target.sin_addr.s_addr), (const void*)io_config->publish_ip, 4); // network byte order
+
+    pub->sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if(pub->sock < 0)
+    {
+        printf("creating publisher socket failed!\n");
+        return ESP_FAIL;
+    }
+
+    // multicast: 224.0.0.0 - 239.255.255.255
+    if(io_config->publish_ip[0] >= 224 && io_config->publish_ip[0] <= 239)
+    {
+        const uint8_t ttl = io_config->publish_ttl;
+        setsockopt(pub->sock, IPPROTO_IP, IP_MULTICAST_TTL, &ttl, sizeof(ttl));
+    }
+
+    printf("publishing input changes to %u.%u.%u.%u:%u\n", io_config->publish_ip[0], io_config->publish_ip[1], io_config->publish_ip[2], io_config->publish_ip[3], io_config->publish_port);
+    TaskHandle_t xIoPublish = NULL;
+    xTaskCreatePinnedToCore(vIoPublishTask, "io_publish", IO_PUBLISH_TASK_STACK_SIZE, (void*) pub, IO_PUBLISH_TASK_PRIORITY, &xIoPublish, IO_PUBLISH_TASK_CORE);
+    configASSERT(xIoPublish);
+
+    return process_image_subscribe(image, xIoPublish);
+}
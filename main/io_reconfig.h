@@ -0,0 +1,285 @@
+#pragma once
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "io_config.h"
+#include "io_setup_handler.h"
+#include "io_handler.h"
+#include "io_events.h"
+#include "dac_engine.h"
+#include "modbus_pdu.h"
+#include "io_publish.h"
+
+
+// hot reconfiguration of the running IO task
+// the new runtime is built in the runtime slot not used by the IO task, off the hot path; the IO task takes it
+// at the next cycle boundary (RCU style: pointer exchange, the old runtime is released once the IO task
+// acknowledged the swap). peripherals are touched only where the configs differ:
+//   before the swap: added inputs, added outputs (driven off), inputs if pull or events changed, ADC and DAC
+//   at the swap, by the IO task: pin maps, masks, cycle period, latch offset, DAC engine
+//   after the swap: pins not used anymore are released, removed DAC channels disabled, events re-attached
+// coils in both configs are not reconfigured and hold their level; so do DAC channels in both configs
+// ADC and DAC are reconfigured as a whole if any of their settings changed; input registers hold their last
+// reading meanwhile: the old runtime ignores readings of the new ADC layout, and the swap waits for the first of them
+// (up to IO_RECONFIG_ADC_TIMEOUT_MS); a completed waveform capture is discarded
+// shift register chains and counters are not reconfigured; a config changing them is refused and applies on next boot
+// one reconfiguration at a time; call from a single task (the configuration server)
+#define IO_RECONFIG_SWAP_TIMEOUT_MS 1000
+#define IO_RECONFIG_ADC_TIMEOUT_MS 100 // first readings of a new ADC layout
+
+// peripherals touched by a reconfiguration
+#define IO_RECONFIG_GPIO_IN 0x01
+#define IO_RECONFIG_GPIO_OUT 0x02
+#define IO_RECONFIG_GPIO_RELEASE 0x04
+#define IO_RECONFIG_EVENTS 0x08
+#define IO_RECONFIG_ADC 0x10
+#define IO_RECONFIG_DAC 0x20
+
+// prepare_us: peripherals set up before the swap; wait_us: until the IO task reached the cycle boundary
+// swap_ns: swap within the IO cycle; release_us: peripherals released after the swap
+typedef struct io_reconfig_stats_t {
+    uint32_t prepare_us;
+    uint32_t wait_us;
+    uint32_t swap_ns;
+    uint32_t release_us;
+    uint32_t total_us;
+    uint8_t changed;
+} io_reconfig_stats_t;
+
+// DAC engine of the next runtime if the DAC config changes; alternates with dac_engine
+static dac_engine_t dac_engine_standby;
+
+static bool io_reconfig_adc_changed(const io_compiled_t* old, const io_compiled_t* compiled)
+{
+    const io_config_t* a = &(old->config);
+    const io_config_t* b = &(compiled->config);
+    const size_t count = compiled->adc_pattern_len;
+    return old->adc_pattern_len != count
+        || memcmp(old->adc_pattern, compiled->adc_pattern, sizeof(compiled->adc_pattern))
+        || old->adc_window_buffers != compiled->adc_window_buffers
+        || old->capture_slot != compiled->capture_slot
+        || memcmp(a->input_reg_mode, b->input_reg_mode, count * sizeof(adc_reduce_mode_t))
+        || memcmp(a->input_reg_iir_shift, b->input_reg_iir_shift, count * sizeof(uint8_t))
+        || a->input_scale != b->input_scale
+        || a->capture_pre != b->capture_pre
+        || a->capture_post != b->capture_post
+        || a->capture_trigger != b->capture_trigger
+        || a->capture_level != b->capture_level;
+}
+
+static bool io_reconfig_dac_changed(io_config_t* a, io_config_t* b)
+{
+    const size_t count = count_holding_reg(b);
+    return count_holding_reg(a) != count
+        || memcmp(a->holding_reg_dac_channel, b->holding_reg_dac_channel, count * sizeof(dac_channel_t))
+        || memcmp(a->holding_reg_output, b->holding_reg_output, count * sizeof(dac_output_config_t))
+        || a->dac_rate_hz != b->dac_rate_hz;
+}
+
+static bool io_reconfig_shift_changed(const io_config_t* a, const io_config_t* b)
+{
+    return a->shift_outputs != b->shift_outputs
+        || a->shift_inputs != b->shift_inputs
+        || a->shift_sclk != b->shift_sclk
+        || a->shift_mosi != b->shift_mosi
+        || a->shift_miso != b->shift_miso
+        || a->shift_load != b->shift_load
+        || a->shift_latch != b->shift_latch
+        || a->shift_clock_hz != b->shift_clock_hz;
+}
+
+// up to and including the first unused counter
+static bool io_reconfig_counters_changed(const io_config_t* a, const io_config_t* b)
+{
+    for(int i = 0; i < IO_COUNTERS_MAX; i++)
+    {
+        if(memcmp(&(a->counters[i]), &(b->counters[i]), sizeof(io_counter_config_t))) { return true; }
+        if(a->counters[i].pulse == GPIO_NUM_NC) { break; }
+    }
+    return false;
+}
+
+static inline uint64_t io_reconfig_gpio_bit(int8_t pin)
+{
+    return pin < 0 ? 0x00 : (uint64_t)0x01 << pin;
+}
+
+// every pin the config uses, in any function
+static uint64_t io_reconfig_used_gpio(io_compiled_t* compiled)
+{
+    io_config_t* io_config = &(compiled->config);
+    uint64_t mask = compiled->discrete_in_gpio | compiled->coils_gpio;
+    for(int i = 0; i < count_holding_reg(io_config); i++) { mask |= io_reconfig_gpio_bit(io_config->holding_reg[i]); }
+    for(int i = 0; i < count_input_reg(io_config); i++) { mask |= io_reconfig_gpio_bit(io_config->input_reg[i]); }
+    if(io_config->shift_outputs || io_config->shift_inputs)
+    {
+        mask |= io_reconfig_gpio_bit(io_config->shift_sclk) | io_reconfig_gpio_bit(io_config->shift_mosi) | io_reconfig_gpio_bit(io_config->shift_miso)
+            | io_reconfig_gpio_bit(io_config->shift_load) | io_reconfig_gpio_bit(io_config->shift_latch);
+    }
+    for(int i = 0; i < count_counters(io_config); i++)
+    {
+        mask |= io_reconfig_gpio_bit(io_config->counters[i].pulse) | io_reconfig_gpio_bit(io_config->counters[i].ctrl);
+    }
+    return mask;
+}
+
+static uint8_t io_reconfig_dac_channels(io_config_t* io_config, bool* cosine)
+{
+    uint8_t channels = 0x00;
+    for(int i = 0; i < count_holding_reg(io_config); i++)
+    {
+        channels |= 0x01 << io_config->holding_reg_dac_channel[i];
+        if(io_config->holding_reg_output[i].mode == DAC_MODE_COSINE) { *cosine = true; }
+    }
+    return channels;
+}
+
+// compiled must be validated and compiled with io_config_compile(); IO task must be running
+// ESP_ERR_NOT_SUPPORTED: nothing changed, config applies on next boot; any other error may leave ADC, DAC and pins
+// half way between both configs, e.g. the new DAC engine running next to a frozen old runtime: restart the coupler
+esp_err_t io_reconfig_apply(io_task_params_t* params, const io_compiled_t* compiled, io_reconfig_stats_t* stats)
+{
+    const int64_t start_us = esp_timer_get_time();
+    memset((void*)stats, 0, sizeof(io_reconfig_stats_t));
+
+    io_runtime_t* current = __atomic_load_n(&(params->runtime), __ATOMIC_ACQUIRE);
+    if(!current)
+    {
+        printf("IO task is not running; cannot reconfigure!\n");
+        return ESP_ERR_INVALID_STATE;
+    }
+    io_runtime_t* next = current == &(io_runtimes[0]) ? &(io_runtimes[1]) : &(io_runtimes[0]);
+    io_compiled_t* old = &(current->compiled);
+    io_config_t* old_config = &(old->config);
+
+    if(io_reconfig_shift_changed(old_config, &(compiled->config)))
+    {
+        printf("shift register config changed; applies on next boot\n");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    if(io_reconfig_counters_changed(old_config, &(compiled->config)))
+    {
+        printf("counter config changed; applies on next boot\n");
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+
+    esp_err_t err = io_runtime_build(next, compiled, current->dac);
+    if(err) { return err; }
+    io_config_t* io_config = &(next->compiled.config);
+
+    // DAC engine alternates only if the DAC config changes; the engine in use keeps running otherwise
+    const bool dac_changed = io_reconfig_dac_changed(old_config, io_config);
+    if(dac_changed) { next->dac = current->dac == &dac_engine ? &dac_engine_standby : &dac_engine; }
+
+    // changes
+    const bool in_all = old_config->pull != io_config->pull || old_config->discrete_in_events != io_config->discrete_in_events;
+    const uint64_t in_mask = in_all ? compiled->discrete_in_gpio : compiled->discrete_in_gpio & ~old->discrete_in_gpio;
+    const uint64_t out_mask = compiled->coils_gpio & ~old->coils_gpio;
+    // digital pins not used anymore; a pin taken over by an analog function keeps the pad setup of ADC or DAC
+    const uint64_t release_mask = (old->discrete_in_gpio | old->coils_gpio) & ~io_reconfig_used_gpio(&(next->compiled));
+    const bool events_changed = old_config->discrete_in_events != io_config->discrete_in_events
+        || (io_config->discrete_in_events && memcmp(old_config->discrete_in, io_config->discrete_in, sizeof(io_config->discrete_in)));
+    const bool adc_changed = io_reconfig_adc_changed(old, compiled);
+    stats->changed = (in_mask ? IO_RECONFIG_GPIO_IN : 0) | (out_mask ? IO_RECONFIG_GPIO_OUT : 0) | (release_mask ? IO_RECONFIG_GPIO_RELEASE : 0)
+        | (events_changed ? IO_RECONFIG_EVENTS : 0) | (adc_changed ? IO_RECONFIG_ADC : 0) | (dac_changed ? IO_RECONFIG_DAC : 0);
+
+    // before the swap; the IO task keeps running the old runtime
+    err = setup_gpio_in_mask(&(next->compiled), in_mask);
+    if(!err) { err = setup_gpio_out_mask(&(next->compiled), out_mask); }
+    if(!err && adc_changed)
+    {
+        err = teardown_adc();
+        if(!err) { err = setup_adc(&(next->compiled)); }
+        next->adc_layout = adc_layout;
+        const int64_t adc_start_us = esp_timer_get_time();
+        while(!err && next->compiled.adc_pattern_len && __atomic_load_n(&(adc_mailbox.published_layout), __ATOMIC_ACQUIRE) != adc_layout)
+        {
+            if(esp_timer_get_time() - adc_start_us > IO_RECONFIG_ADC_TIMEOUT_MS * 1000)
+            {
+                printf("no ADC readings of the new config yet; input registers hold until they arrive\n");
+                break;
+            }
+            vTaskDelay(1);
+        }
+    }
+    bool cosine_old = false;
+    bool cosine = false;
+    const uint8_t dac_channels_old = io_reconfig_dac_channels(old_config, &cosine_old);
+    const uint8_t dac_channels = io_reconfig_dac_channels(io_config, &cosine);
+    if(!err && dac_changed)
+    {
+        // added channels start at 0; ramps continue from the current level
+        for(int i = 0; i < count_holding_reg(io_config) && !err; i++)
+        {
+            const dac_channel_t channel = io_config->holding_reg_dac_channel[i];
+            if((dac_channels_old >> channel) & 0x01) { continue; }
+            printf("configuring GPIO %i as DAC channel %i output\n", io_config->holding_reg[i], channel + 1);
+            err = dac_output_enable(channel);
+            if(!err) { err = dac_output_voltage(channel, 0); }
+        }
+        dac_engine_stop(current->dac);
+        if(!err) { err = dac_engine_init(next->dac, count_holding_reg(io_config), io_config->holding_reg_dac_channel, io_config->holding_reg_output, io_config->dac_rate_hz); }
+    }
+    if(err)
+    {
+        // peripherals may be half way; see above
+        printf("preparing IO reconfiguration failed: %s\n", esp_err_to_name(err));
+        io_runtime_free(next);
+        return err;
+    }
+    const int64_t swap_us = esp_timer_get_time();
+    stats->prepare_us = swap_us - start_us;
+
+    // swap at the next cycle boundary
+    params->swap_waiter = xTaskGetCurrentTaskHandle();
+    __atomic_store_n(&(params->pending), next, __ATOMIC_RELEASE);
+    while(__atomic_load_n(&(params->runtime), __ATOMIC_ACQUIRE) != next)
+    {
+        if(!ulTaskNotifyTake(pdTRUE, IO_RECONFIG_SWAP_TIMEOUT_MS / portTICK_PERIOD_MS)
+            && __atomic_exchange_n(&(params->pending), NULL, __ATOMIC_ACQ_REL) == next)
+        {
+            printf("IO task did not take the new config!\n");
+            io_runtime_free(next);
+            return ESP_ERR_TIMEOUT;
+        }
+    }
+    const int64_t release_us = esp_timer_get_time();
+    stats->wait_us = release_us - swap_us;
+    stats->swap_ns = params->cycle_stats.swap_ns;
+
+    // after the swap; old runtime is not referenced by the IO task anymore
+    if(events_changed)
+    {
+        err = io_events_reconfigure(old_config, io_config);
+        if(err) { printf("re-attaching change-of-state events failed: %s\n", esp_err_to_name(err)); }
+    }
+    for(int pin = 0; pin < 64; pin++)
+    {
+        if(!((release_mask >> pin) & 0x01)) { continue; }
+        printf("releasing GPIO %i\n", pin);
+        gpio_reset_pin(pin);
+    }
+    for(int channel = 0; channel < DAC_CHANNEL_MAX; channel++)
+    {
+        if(((dac_channels_old & ~dac_channels) >> channel) & 0x01) { dac_output_disable(channel); }
+    }
+    if(cosine_old && !cosine) { dac_cw_generator_disable(); }
+    io_runtime_free(current);
+
+    // modbus and publisher follow the new config; publisher target and enabling apply on next boot
+    // point counts of publisher and stream follow the input image; see process_image_in_t
+    __atomic_store_n(&mb_image_window, io_config->image_window, __ATOMIC_RELAXED);
+    if(old_config->publish && io_config->publish)
+    {
+        io_publish_configure(&io_publish, io_config);
+    }
+
+    const int64_t end_us = esp_timer_get_time();
+    stats->release_us = end_us - release_us;
+    stats->total_us = end_us - start_us;
+    printf("IO config switched over in %uus: prepare %uus, cycle boundary %uus, swap %uns in cycle, release %uus\n",
+        stats->total_us, stats->prepare_us, stats->wait_us, stats->swap_ns, stats->release_us);
+    fflush(stdout);
+
+    return ESP_OK;
+}
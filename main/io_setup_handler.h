@@ -5,47 +5,124 @@
 #include "esp_adc_cal.h"
 #include "driver/gpio.h"
 #include "hal/gpio_types.h"
+#include "io_events.h"
+#include "process_image.h" // triple buffer
+#include "adc_reduce.h"
+#include "adc_capture.h"
+#include "dac_engine.h"
 
 
 #define ADC_SAMPLE_RATE 200000
 // using 16 sample buffer; should hold readings for all (max 8) channels
 #define ADC_DMA_BUF_LEN 16
+// DMA buffers bridge scheduling latency of the ADC task
+#define ADC_DMA_BUF_COUNT 4
 
 
-esp_err_t setup_gpio_in(io_config_t* io_config)
+// compiled IO configuration: validated config and the runtime data derived from it for setup and the IO task
+// plain data only, so it can be persisted and loaded as a whole (see io_config_cache.h); heap tables (GPIO maps,
+// ADC millivolt table) and peripheral state are still built at setup
+typedef struct io_compiled_t {
+    io_config_t config;
+    // GPIO masks for gpio_config() and the IO task
+    uint64_t discrete_in_gpio;
+    uint64_t coils_gpio;
+    // ADC1 pattern table; one entry per input register
+    uint8_t adc_pattern_len;
+    adc_digi_pattern_table_t adc_pattern[ADC_REDUCE_SLOTS_MAX];
+    // DMA buffers per reduction window of one IO cycle
+    uint32_t adc_window_buffers;
+    // input register recorded for threshold capture triggers; -1 if none
+    int8_t capture_slot;
+} io_compiled_t;
+
+// config must be validated, see io_config_generate()
+esp_err_t io_config_compile(const io_config_t* io_config, io_compiled_t* compiled)
 {
+    memset((void*)compiled, 0, sizeof(io_compiled_t));
+    compiled->config = *io_config;
+    io_config_t* config = &(compiled->config);
+
+    for(int i = 0; i < count_discrete_in(config); i++)
+    {
+        compiled->discrete_in_gpio |= (uint64_t)0x01 << config->discrete_in[i];
+    }
+    for(int i = 0; i < count_coils(config); i++)
+    {
+        compiled->coils_gpio |= (uint64_t)0x01 << config->coils[i];
+    }
+
+    const size_t count = count_input_reg(config);
+    if(count > ADC_REDUCE_SLOTS_MAX) { return ESP_ERR_INVALID_ARG; }
+    compiled->adc_pattern_len = count;
+    for(size_t i = 0; i < count; i++)
+    {
+        adc_digi_pattern_table_t* tbl = &(compiled->adc_pattern[i]);
+        tbl->atten = ADC_ATTEN_DB_11;
+        tbl->bit_width = ADC_WIDTH_BIT_12;
+        tbl->channel = config->input_reg_adc_channel[i];
+    }
+    compiled->adc_window_buffers = (uint64_t)config->cycle_us * ADC_SAMPLE_RATE / (1000000 * ADC_DMA_BUF_LEN);
+
+    compiled->capture_slot = -1;
+    for(size_t i = 0; i < count; i++)
+    {
+        if(config->input_reg[i] == config->capture_input) { compiled->capture_slot = i; }
+    }
+
+    return ESP_OK;
+}
+
+
+// mask: pins to configure; all discrete inputs on boot, added ones on reconfiguration
+esp_err_t setup_gpio_in_mask(io_compiled_t* compiled, uint64_t mask)
+{
+    io_config_t* io_config = &(compiled->config);
     const gpio_pullup_t pull_up = io_config->pull == UP ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE;
     const gpio_pulldown_t pull_down = io_config->pull == DOWN ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE;
     
-    uint64_t pinmask = 0;
+    mask &= compiled->discrete_in_gpio;
+    if(!mask) { return ESP_OK; }
     for(int i = 0; i < count_discrete_in(io_config); i++)
     {
+        if(!((mask >> io_config->discrete_in[i]) & 0x01)) { continue; }
         printf("configuring GPIO %i as input\n", io_config->discrete_in[i]);
-        pinmask |= (1 << io_config->discrete_in[i]);
     }
 
     gpio_config_t gpio_in_config = {
-        .pin_bit_mask = pinmask,
+        .pin_bit_mask = mask,
         .pull_up_en = pull_up,
         .pull_down_en = pull_down,
         .mode = GPIO_MODE_INPUT,
-        .intr_type = GPIO_INTR_DISABLE
+        .intr_type = io_config->discrete_in_events ? GPIO_INTR_ANYEDGE : GPIO_INTR_DISABLE
     };
     
     return gpio_config(&gpio_in_config);
 }
 
-esp_err_t setup_gpio_out(io_config_t* io_config)
+esp_err_t setup_gpio_in(io_compiled_t* compiled)
+{
+    return setup_gpio_in_mask(compiled, compiled->discrete_in_gpio);
+}
+
+// mask: pins to configure; all coils on boot, added ones on reconfiguration
+esp_err_t setup_gpio_out_mask(io_compiled_t* compiled, uint64_t mask)
 {
-    uint64_t pinmask = 0;
+    io_config_t* io_config = &(compiled->config);
+    mask &= compiled->coils_gpio;
+    if(!mask) { return ESP_OK; }
     for(int i = 0; i < count_coils(io_config); i++)
     {
+        if(!((mask >> io_config->coils[i]) & 0x01)) { continue; }
         printf("configuring GPIO %i as output\n", io_config->coils[i]);
-        pinmask |= (1 << io_config->coils[i]);
     }
 
+    // safe state; coils are driven off from the moment the outputs are enabled until a master writes them
+    REG_WRITE(GPIO_OUT1_W1TC_REG, (uint32_t) (mask >> 32));
+    REG_WRITE(GPIO_OUT_W1TC_REG, (uint32_t) mask);
+
     gpio_config_t gpio_out_config = {
-        .pin_bit_mask = pinmask,
+        .pin_bit_mask = mask,
         .pull_up_en = GPIO_PULLUP_DISABLE,
         .pull_down_en = GPIO_PULLDOWN_DISABLE,
         .mode = GPIO_MODE_OUTPUT,
@@ -55,6 +132,11 @@ esp_err_t setup_gpio_out(io_config_t* io_config)
     return gpio_config(&gpio_out_config);
 }
 
+esp_err_t setup_gpio_out(io_compiled_t* compiled)
+{
+    return setup_gpio_out_mask(compiled, compiled->coils_gpio);
+}
+
 esp_err_t setup_dac(io_config_t* io_config)
 {
     for(int i = 0; i < count_holding_reg(io_config); i++)
@@ -66,42 +148,160 @@ esp_err_t setup_dac(io_config_t* io_config)
         if(err_c || err_s) { return err_c ? err_c : err_s; }
     }
 
+    // ramp and table outputs are updated by the DAC timer on this core
+    return dac_engine_init(&dac_engine, count_holding_reg(io_config), io_config->holding_reg_dac_channel, io_config->holding_reg_output, io_config->dac_rate_hz);
+}
+
+// PCNT units of the counters; counter inputs follow pull like discrete inputs (PCNT setup enables pull-ups)
+esp_err_t setup_counters(io_config_t* io_config)
+{
+    const uint8_t count = count_counters(io_config);
+    esp_err_t err = io_counters_init(&io_counters, count, io_config->counters);
+    if(err || !count) { return err; }
+
+    uint64_t mask = 0x00;
+    for(int i = 0; i < count; i++)
+    {
+        mask |= (uint64_t)0x01 << io_config->counters[i].pulse;
+        if(io_config->counters[i].ctrl != GPIO_NUM_NC) { mask |= (uint64_t)0x01 << io_config->counters[i].ctrl; }
+    }
+    gpio_config_t gpio_counter_config = {
+        .pin_bit_mask = mask,
+        .pull_up_en = io_config->pull == UP ? GPIO_PULLUP_ENABLE : GPIO_PULLUP_DISABLE,
+        .pull_down_en = io_config->pull == DOWN ? GPIO_PULLDOWN_ENABLE : GPIO_PULLDOWN_DISABLE,
+        .mode = GPIO_MODE_INPUT,
+        .intr_type = GPIO_INTR_DISABLE
+    };
+    return gpio_config(&gpio_counter_config);
+}
+
+// latest reduced ADC1 reading per input register; written by ADC task, read by IO task without blocking
+// layout: setup_adc() call the readings were reduced with; readers of another layout ignore them, so the registers
+// of a runtime never mix with the order and count of another one across a reconfiguration
+typedef struct adc_mailbox_t {
+    triple_buffer_t exchange;
+    uint16_t data[3][ADC_REDUCE_SLOTS_MAX];
+    uint8_t valid_mask[3]; // input registers with at least one reading
+    uint32_t layout[3];
+    volatile uint32_t published_layout; // layout of the latest published buffer
+} adc_mailbox_t;
+static adc_mailbox_t adc_mailbox = { .exchange = TRIPLE_BUFFER_DEFAULT() };
+static uint32_t adc_layout = 0; // incremented by setup_adc()
+
+// ADC task drains every completed DMA buffer on each I2S RX event, reduces all samples per input register
+// and publishes the latest results; reduction windows span one IO cycle
+// if configured, samples are recorded to the waveform capture as well
+// runs on PRO CPU, so DMA handling never preempts the IO task; DMA buffers bridge its scheduling latency
+#define ADC_TASK_STACK_SIZE 2048
+#define ADC_TASK_PRIORITY (configMAX_PRIORITIES - 3)
+#define ADC_TASK_CORE 0
+#define ADC_EVENT_QUEUE_LEN 8
+// posted to the I2S event queue by teardown_adc(); the task stops between two DMA buffers, never inside the driver
+#define ADC_TASK_EVENT_STOP I2S_EVENT_MAX
+static QueueHandle_t i2s_event_queue;
+static adc_reduce_t adc_reduce;
+static TaskHandle_t adc_dma_task = NULL;
+static TaskHandle_t adc_dma_stopper = NULL;
+void vAdcDmaTask(void* params)
+{
+    printf("adc dma reader task running!\n");
+
+    while(true) {
+        i2s_event_t evt;
+        if(xQueueReceive(i2s_event_queue, &evt, portMAX_DELAY) == pdTRUE) {
+            switch(evt.type) {
+                case I2S_EVENT_RX_DONE:;
+                    adc_digi_output_data_t adc_data[ADC_DMA_BUF_LEN];
+                    size_t adc_data_size = 0;
+                    // drain all completed buffers without waiting
+                    while(i2s_read(I2S_NUM_0, adc_data, sizeof(adc_data), &adc_data_size, 0) == ESP_OK && adc_data_size)
+                    {
+                        adc_reduce_buffer(&adc_reduce, adc_data, adc_data_size / sizeof(adc_digi_output_data_t));
+                        adc_capture_buffer(&adc_capture, adc_data, adc_data_size / sizeof(adc_digi_output_data_t));
+                    }
+
+                    // publish
+                    const uint8_t buf = adc_mailbox.exchange.write;
+                    uint8_t valid_mask = 0;
+                    for(int i = 0; i < adc_reduce.slot_count; i++)
+                    {
+                        adc_mailbox.data[buf][i] = adc_reduce.slots[i].value;
+                        valid_mask |= adc_reduce.slots[i].valid << i;
+                    }
+                    adc_mailbox.valid_mask[buf] = valid_mask;
+                    adc_mailbox.layout[buf] = adc_layout;
+                    triple_buffer_publish(&(adc_mailbox.exchange));
+                    __atomic_store_n(&(adc_mailbox.published_layout), adc_layout, __ATOMIC_RELEASE);
+                    break;
+                case I2S_EVENT_DMA_ERROR:
+                    printf("i2s DMA error!\n");
+                    break;
+                case ADC_TASK_EVENT_STOP:
+                    printf("adc dma reader task stopping\n");
+                    xTaskNotifyGive(adc_dma_stopper);
+                    vTaskDelete(NULL);
+                    break;
+                default:
+                    printf("unknown i2s queue event\n");
+                    break;
+            }
+        }
+        else
+        {
+            printf("reading from adc dma event queue failed!\n");
+        }
+    }
+}
+
+#define DEFAULT_VREF 1100
+void get_adc_cal(esp_adc_cal_characteristics_t* adc_cal)
+{
+    // get adc calibration data
+    switch(
+        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, DEFAULT_VREF, adc_cal)
+    ){
+        case ESP_ADC_CAL_VAL_EFUSE_VREF:
+            printf("using ADC1 reference voltage calibration\n");
+            break;
+        case ESP_ADC_CAL_VAL_EFUSE_TP:
+            printf("using ADC1 two point calibration\n");
+            break;
+        case ESP_ADC_CAL_VAL_DEFAULT_VREF :
+            printf("using ADC1 default vref calibration\n");
+            break;
+        default:
+            printf("unknown calibration for ADC1\n");
+    }
+}
+
+// calibrated millivolts per raw ADC1 reading; built once, so samples are converted by a single table load
+// instead of evaluating the calibration curve per sample
+esp_err_t build_adc_mv_table(uint16_t** table)
+{
+    *table = malloc(sizeof(uint16_t) * ADC_SCALE_TABLE_LEN);
+    if(!*table)
+    {
+        printf("allocating ADC millivolt table failed!\n");
+        return ESP_ERR_NO_MEM;
+    }
+
+    esp_adc_cal_characteristics_t adc_cal;
+    get_adc_cal(&adc_cal);
+    const int64_t start_us = esp_timer_get_time();
+    for(uint32_t raw = 0; raw < ADC_SCALE_TABLE_LEN; raw++)
+    {
+        (*table)[raw] = esp_adc_cal_raw_to_voltage(raw, &adc_cal);
+    }
+    printf("built ADC1 millivolt table of %i bytes in %uus\n", (int)(sizeof(uint16_t) * ADC_SCALE_TABLE_LEN), (uint32_t)(esp_timer_get_time() - start_us));
+
     return ESP_OK;
 }
 
-// QueueHandle_t i2s_event_queue;
-// void vAdcDmaTask(void* params)
-// {
-//     printf("adc dma reader task running!\n");
-//     while(true) {
-//         i2s_event_t evt;
-//         if(xQueueReceive(i2s_event_queue, &evt, portMAX_DELAY) == pdTRUE) {
-//             switch(evt.type) {
-//                 case I2S_EVENT_RX_DONE:;
-//                     adc_digi_output_data_t adc_data[ADC_DMA_BUF_LEN];
-//                     size_t adc_data_size = 0;
-//                     i2s_read(I2S_NUM_0, adc_data, ADC_DMA_BUF_LEN * sizeof(adc_digi_output_data_t), &adc_data_size, portMAX_DELAY);
-//                     /* DO SOMETHING */
-//                     break;
-//                 case I2S_EVENT_DMA_ERROR:
-//                     printf("i2s DMA error!\n");
-//                     break;
-//                 default:
-//                     printf("unknown i2s queue event\n");
-//                     break;
-//             }
-//         }
-//         else
-//         {
-//             printf("reading from adc dma event queue failed!\n");
-//         }
-//     }
-// }
-
-esp_err_t setup_adc(io_config_t* io_config)
+esp_err_t setup_adc(io_compiled_t* compiled)
 {
+    io_config_t* io_config = &(compiled->config);
     // count adc channels
-    size_t count = count_input_reg(io_config);
+    size_t count = compiled->adc_pattern_len;
     // size_t count = 0;
     // for(int8_t* in_reg_ptr = &(io_config->input_reg[0]); *in_reg_ptr != GPIO_NUM_NC; in_reg_ptr++)
     // {
@@ -116,7 +316,6 @@ esp_err_t setup_adc(io_config_t* io_config)
     }
 
     // init i2c dma controller to read from adc1
-    // static QueueHandle_t i2s_event_queue;
 
     i2s_config_t i2s_config = {
         .mode = I2S_MODE_MASTER | I2S_MODE_RX | I2S_MODE_ADC_BUILT_IN,
@@ -126,25 +325,16 @@ esp_err_t setup_adc(io_config_t* io_config)
         .communication_format = I2S_COMM_FORMAT_STAND_I2S,
         .channel_format = I2S_CHANNEL_FMT_ONLY_RIGHT,
         .intr_alloc_flags = 0,
-        .dma_buf_count = 2,
+        .dma_buf_count = ADC_DMA_BUF_COUNT,
         .dma_buf_len = ADC_DMA_BUF_LEN // max 8 channels @ 16bits
     };
 
-    // i2s_event_queue = xQueueCreate(1, sizeof(adc_digi_output_data_t));
-    i2s_driver_install(I2S_NUM_0, &i2s_config, 0, NULL); //1, &i2s_event_queue);
+    i2s_driver_install(I2S_NUM_0, &i2s_config, ADC_EVENT_QUEUE_LEN, &i2s_event_queue);
 
-    // configure adc1 with multiplex pattern table
-    adc_digi_pattern_table_t* adc_pattern_tbl = malloc(sizeof(adc_digi_pattern_table_t) * count);
-    adc_digi_pattern_table_t tbl_base = {
-        .atten = ADC_ATTEN_DB_11,
-        .bit_width = ADC_WIDTH_BIT_12,
-    };
+    // configure adc1 with compiled multiplex pattern table
     for(size_t i = 0; i < count; i++)
     {
-        printf("building table and initializing ADC1 channel %i\n", io_config->input_reg_adc_channel[i]);
-        adc_digi_pattern_table_t* tbl = adc_pattern_tbl + i;
-        *tbl = tbl_base;
-        tbl->channel = io_config->input_reg_adc_channel[i];
+        printf("initializing ADC1 channel %i\n", io_config->input_reg_adc_channel[i]);
         adc_gpio_init(ADC_UNIT_1, io_config->input_reg_adc_channel[i]);
     }
 
@@ -157,7 +347,7 @@ esp_err_t setup_adc(io_config_t* io_config)
         .adc2_pattern = NULL
     };
     dig_cfg.adc1_pattern_len = count;
-    dig_cfg.adc1_pattern = adc_pattern_tbl;
+    dig_cfg.adc1_pattern = compiled->adc_pattern;
     // dig_cfg.conv_limit_num = count * 16;
 
     adc_power_acquire(); // possibly redundant
@@ -172,32 +362,51 @@ esp_err_t setup_adc(io_config_t* io_config)
     vTaskDelay(10/portTICK_RATE_MS);
     SYSCON.saradc_ctrl2.meas_num_limit = 0;
 
-    // start dma reader task
-    // TaskHandle_t xAdcDma = NULL;
-    // xTaskCreate(vAdcDmaTask, "adc_dma", 2048, NULL, tskIDLE_PRIORITY, &xAdcDma);
-    // configASSERT(xAdcDma);
+    // setup reduction; one window per IO cycle
+    // millivolt table is built once and kept across reconfiguration
+    static uint16_t* adc_mv_table = NULL;
+    uint16_t* scale = NULL;
+    if(io_config->input_scale == ADC_SCALE_MV)
+    {
+        if(!adc_mv_table)
+        {
+            esp_err_t err = build_adc_mv_table(&adc_mv_table);
+            if(err) { return err; }
+        }
+        scale = adc_mv_table;
+    }
+    adc_reduce_init(&adc_reduce, count, io_config->input_reg_adc_channel, io_config->input_reg_mode, io_config->input_reg_iir_shift, compiled->adc_window_buffers, scale);
+
+    // setup waveform capture; buffers are allocated once here
+    esp_err_t err = adc_capture_init(&adc_capture, count, io_config->input_reg_adc_channel, io_config->capture_pre, io_config->capture_post, io_config->capture_trigger, compiled->capture_slot, io_config->capture_level);
+    if(err) { return err; }
+
+    // start dma reader task; publishes the new layout from now on
+    adc_layout++;
+    xTaskCreatePinnedToCore(vAdcDmaTask, "adc_dma", ADC_TASK_STACK_SIZE, NULL, ADC_TASK_PRIORITY, &adc_dma_task, ADC_TASK_CORE);
+    configASSERT(adc_dma_task);
 
     // done
     return ESP_OK;
 }
 
-#define DEFAULT_VREF 1100
-void get_adc_cal(esp_adc_cal_characteristics_t* adc_cal)
+// stop ADC acquisition and release I2S, for setup_adc() with a new config; the IO task keeps reading the
+// last reduced values from the mailbox meanwhile
+esp_err_t teardown_adc()
 {
-    // get adc calibration data
-    switch(
-        esp_adc_cal_characterize(ADC_UNIT_1, ADC_ATTEN_DB_11, ADC_WIDTH_BIT_12, DEFAULT_VREF, adc_cal)
-    ){
-        case ESP_ADC_CAL_VAL_EFUSE_VREF:
-            printf("using ADC1 reference voltage calibration\n");
-            break;
-        case ESP_ADC_CAL_VAL_EFUSE_TP:
-            printf("using ADC1 two point calibration\n");
-            break;
-        case ESP_ADC_CAL_VAL_DEFAULT_VREF :
-            printf("using ADC1 default vref calibration\n");
-            break;
-        default:
-            printf("unknown calibration for ADC1\n");
+    if(!adc_dma_task) { return ESP_OK; }
+
+    // stop event is queued behind pending DMA events
+    i2s_event_t stop = { .type = ADC_TASK_EVENT_STOP };
+    adc_dma_stopper = xTaskGetCurrentTaskHandle();
+    if(xQueueSend(i2s_event_queue, &stop, portMAX_DELAY) != pdTRUE)
+    {
+        printf("stopping adc dma reader task failed!\n");
+        return ESP_FAIL;
     }
-}
\ No newline at end of file
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    adc_dma_task = NULL;
+
+    i2s_stop(I2S_NUM_0);
+    return i2s_driver_uninstall(I2S_NUM_0);
+}
@@ -0,0 +1,140 @@
+#pragma once
+#include "esp_system.h"
+#include "driver/gpio.h"
+#include "driver/spi_master.h"
+#include "io_config.h"
+
+
+// shift register IO expansion: 74HC595 output and 74HC165 input chains on one SPI bus (VSPI), with DMA
+// both chains are clocked in one transaction per IO cycle, started by the IO task after the GPIO inputs were read
+// and completed after the ADC read; the CPU is free while DMA shifts the bits
+//   load (165 SH/LD): pulsed low right after the GPIO inputs are read; chain inputs are sampled with them
+//   latch (595 RCLK): pulsed high right after the coils are latched; chain outputs switch with them
+// chips are counted from the ESP32: output chip 0 at MOSI, input chip 0 at MISO; byte per chip, bit 0 on pin A (QA)
+// the transaction is padded to whole words (no bounce buffer in the IO cycle); padding is sent first and falls off
+// the end of the output chain, trailing input bytes are dropped
+// SPI mode 0: 595 shifts and MISO is sampled on rising SCLK; 165 chain QH is valid after load, before the first clock
+#define IO_SHIFT_HOST SPI3_HOST
+
+typedef struct io_shift_t {
+    spi_device_handle_t device;
+    spi_transaction_t trans;
+    uint8_t len; // bytes per transaction
+    uint8_t outputs;
+    uint8_t inputs;
+    uint64_t load_mask; // GPIO bit of 165 SH/LD; 0 without inputs
+    uint64_t latch_mask; // GPIO bit of 595 RCLK; 0 without outputs
+} io_shift_t;
+static io_shift_t io_shift;
+
+static DMA_ATTR uint8_t io_shift_tx[IO_SHIFT_CHIPS_MAX];
+static DMA_ATTR uint8_t io_shift_rx[IO_SHIFT_CHIPS_MAX];
+
+// single pin of either GPIO register; no pin if mask is 0
+static inline void io_shift_pin_write(uint64_t mask, bool level)
+{
+    if((uint32_t) mask) { REG_WRITE(level ? GPIO_OUT_W1TS_REG : GPIO_OUT_W1TC_REG, (uint32_t) mask); }
+    else if(mask) { REG_WRITE(level ? GPIO_OUT1_W1TS_REG : GPIO_OUT1_W1TC_REG, (uint32_t) (mask >> 32)); }
+}
+
+// IO task; loads the input chain and starts shifting out; out: byte per output chip
+static inline esp_err_t io_shift_start(io_shift_t* shift, const uint8_t* out)
+{
+    // 165 loads while SH/LD is low; two register writes are longer than the minimum pulse width
+    io_shift_pin_write(shift->load_mask, false);
+    io_shift_pin_write(shift->load_mask, true);
+
+    // last byte sent ends up in chip 0
+    for(int i = 0; i < shift->outputs; i++)
+    {
+        io_shift_tx[shift->len - 1 - i] = out[i];
+    }
+    return spi_device_polling_start(shift->device, &(shift->trans), portMAX_DELAY);
+}
+
+// IO task; waits for the transaction started by io_shift_start(); in: byte per input chip
+static inline esp_err_t io_shift_end(io_shift_t* shift, uint8_t* in)
+{
+    esp_err_t err = spi_device_polling_end(shift->device, portMAX_DELAY);
+    memcpy((void*)in, (const void*)io_shift_rx, shift->inputs);
+    return err;
+}
+
+// IO task; outputs shifted by the last transaction appear on the 595 outputs
+static inline void io_shift_latch(io_shift_t* shift)
+{
+    io_shift_pin_write(shift->latch_mask, true);
+    io_shift_pin_write(shift->latch_mask, false);
+}
+
+// shift register chains; outputs are cleared before the IO task starts
+esp_err_t setup_shift(io_config_t* io_config)
+{
+    io_shift_t* shift = &io_shift;
+    memset((void*)shift, 0, sizeof(io_shift_t));
+    if(!io_config->shift_outputs && !io_config->shift_inputs)
+    {
+        printf("no shift registers configured; skipping SPI setup...\n");
+        return ESP_OK;
+    }
+
+    shift->outputs = io_config->shift_outputs;
+    shift->inputs = io_config->shift_inputs;
+    const uint8_t chips = shift->outputs > shift->inputs ? shift->outputs : shift->inputs;
+    shift->len = (chips + 3) & ~0x03;
+    if(shift->outputs) { shift->latch_mask = (uint64_t)0x01 << io_config->shift_latch; }
+    if(shift->inputs) { shift->load_mask = (uint64_t)0x01 << io_config->shift_load; }
+
+    // load idles high (shift), latch idles low
+    if(shift->load_mask | shift->latch_mask)
+    {
+        io_shift_pin_write(shift->load_mask, true);
+        io_shift_pin_write(shift->latch_mask, false);
+        gpio_config_t io_conf = {
+            .pin_bit_mask = shift->load_mask | shift->latch_mask,
+            .mode = GPIO_MODE_OUTPUT,
+            .pull_up_en = GPIO_PULLUP_DISABLE,
+            .pull_down_en = GPIO_PULLDOWN_DISABLE,
+            .intr_type = GPIO_INTR_DISABLE
+        };
+        esp_err_t err = gpio_config(&io_conf);
+        if(err) { return err; }
+    }
+
+    spi_bus_config_t bus_config = {
+        .mosi_io_num = shift->outputs ? io_config->shift_mosi : -1,
+        .miso_io_num = shift->inputs ? io_config->shift_miso : -1,
+        .sclk_io_num = io_config->shift_sclk,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        .max_transfer_sz = IO_SHIFT_CHIPS_MAX
+    };
+    esp_err_t err = spi_bus_initialize(IO_SHIFT_HOST, &bus_config, SPI_DMA_CH_AUTO);
+    if(err) { return err; }
+
+    spi_device_interface_config_t device_config = {
+        .mode = 0,
+        .clock_speed_hz = io_config->shift_clock_hz,
+        .spics_io_num = -1,
+        .queue_size = 1
+    };
+    err = spi_bus_add_device(IO_SHIFT_HOST, &device_config, &(shift->device));
+    if(err) { return err; }
+    // IO task is the only user of the bus
+    err = spi_device_acquire_bus(shift->device, portMAX_DELAY);
+    if(err) { return err; }
+
+    shift->trans.length = shift->len * 8;
+    shift->trans.tx_buffer = io_shift_tx;
+    shift->trans.rx_buffer = shift->inputs ? io_shift_rx : NULL;
+    memset((void*)io_shift_tx, 0, sizeof(io_shift_tx));
+    memset((void*)io_shift_rx, 0, sizeof(io_shift_rx));
+
+    printf("configuring shift registers: %u outputs, %u inputs; %u bytes per cycle at %uHz\n",
+        shift->outputs * 8, shift->inputs * 8, shift->len, io_config->shift_clock_hz);
+    uint8_t bytes[IO_SHIFT_CHIPS_MAX] = { 0 };
+    err = io_shift_start(shift, bytes);
+    if(!err) { err = io_shift_end(shift, bytes); }
+    io_shift_latch(shift);
+    return err;
+}
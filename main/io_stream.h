@@ -0,0 +1,269 @@
+#pragma once
+#include <stdlib.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_http_server.h"
+#include "io_config.h"
+#include "process_image.h"
+
+
+// live process image over WebSocket at ws://<ip>/stream; for HMIs and dashboards without polling
+// a task subscribed to the process image builds one frame per IO cycle while clients are connected; the frame is
+// shared by all clients and sent from the http server task (httpd_queue_work), so client table and sockets are
+// owned by the server task alone
+// per client decimation: every n-th IO cycle, from the query (/stream?every=10) or a text message "every=10";
+// default IO_STREAM_EVERY_DEFAULT, 1 streams at the cycle rate
+// cycles the server could not keep up with are skipped: the cycle number of a client's frames advances by
+// more than its decimation
+//
+// binary frame, little endian:
+//   0   u8   version (IO_STREAM_VERSION)
+//   1   u8   discrete input count
+//   2   u8   coil count
+//   3   u8   input register count
+//   4   u8   holding register count
+//   5   u8   reserved, 0
+//   6   u16  reserved, 0
+//   8   u32  cycle number; IO cycles seen by the stream task
+//   12  u32  time of input image (IO cycle tick); lower 32 bits of esp_timer in us
+//   16  discrete inputs, bit per input, (count + 7) / 8 bytes
+//   ..  coils, bit per coil, (count + 7) / 8 bytes; as last written by Modbus
+//   ..  u16  input registers
+//   ..  u16  holding registers; as last written by Modbus
+#define IO_STREAM_VERSION 1
+#define IO_STREAM_HEADER_LEN 16
+#define IO_STREAM_FRAME_LEN_MAX (IO_STREAM_HEADER_LEN + (DISCRETE_IN_MAX + 7) / 8 + (COILS_MAX + 7) / 8 + 2 * INPUT_REG_MAX + 2 * HOLDING_REG_MAX)
+#define IO_STREAM_CLIENTS_MAX 4
+#define IO_STREAM_EVERY_DEFAULT 10
+#define IO_STREAM_EVERY_MAX 60000
+
+typedef struct io_stream_client_t {
+    int fd; // -1 if unused
+    uint16_t every;
+    uint32_t next_cycle;
+} io_stream_client_t;
+
+typedef struct io_stream_t {
+    process_image_t* image;
+    httpd_handle_t server;
+    // server task only
+    io_stream_client_t clients[IO_STREAM_CLIENTS_MAX];
+    // shared frame; owned by the server task while in_flight
+    volatile uint8_t client_count;
+    volatile bool in_flight;
+    uint32_t cycle;
+    size_t frame_len;
+    uint8_t frame[IO_STREAM_FRAME_LEN_MAX];
+    process_image_out_t out;
+    // statistics
+    uint32_t frames;
+    uint32_t sent;
+    uint32_t skipped;
+    uint32_t send_errors;
+} io_stream_t;
+static io_stream_t io_stream;
+
+// returns frame length; point counts of the IO task runtime that built the input image
+size_t io_stream_encode(io_stream_t* stream, const process_image_in_t* in, const process_image_out_t* out, uint32_t cycle, uint8_t* frame)
+{
+    const uint8_t discrete_in_count = in->discrete_in_count;
+    const uint8_t coils_count = in->coils_count;
+    const uint8_t input_reg_count = in->input_reg_count;
+    const uint8_t holding_reg_count = in->holding_reg_count;
+
+    uint8_t* pos = frame;
+    *pos++ = IO_STREAM_VERSION;
+    *pos++ = discrete_in_count;
+    *pos++ = coils_count;
+    *pos++ = input_reg_count;
+    *pos++ = holding_reg_count;
+    *pos++ = 0x00;
+    pos = process_image_put_u16(pos, 0x0000);
+    pos = process_image_put_u32(pos, cycle);
+    pos = process_image_put_u32(pos, (uint32_t) in->tick_us);
+
+    pos = process_image_put_bits(pos, in->discrete_in, discrete_in_count);
+    pos = process_image_put_bits(pos, out->coils, coils_count);
+    for(int i = 0; i < input_reg_count; i++) { pos = process_image_put_u16(pos, in->input_reg[i]); }
+    for(int i = 0; i < holding_reg_count; i++) { pos = process_image_put_u16(pos, out->holding_reg[i]); }
+
+    return pos - frame;
+}
+
+static void io_stream_client_remove(io_stream_t* stream, io_stream_client_t* client)
+{
+    printf("stream client %i disconnected\n", client->fd);
+    client->fd = -1;
+    __atomic_store_n(&(stream->client_count), stream->client_count - 1, __ATOMIC_RELEASE);
+}
+
+// server task; sends the shared frame to all clients due in its cycle and releases it
+static void io_stream_send_work(void* arg)
+{
+    io_stream_t* stream = (io_stream_t*) arg;
+    httpd_ws_frame_t ws_frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_BINARY,
+        .payload = stream->frame,
+        .len = stream->frame_len
+    };
+
+    for(int i = 0; i < IO_STREAM_CLIENTS_MAX; i++)
+    {
+        io_stream_client_t* client = &(stream->clients[i]);
+        if(client->fd < 0 || (int32_t)(stream->cycle - client->next_cycle) < 0) { continue; }
+
+        // socket closed or taken over by a plain http request
+        if(httpd_ws_get_fd_info(stream->server, client->fd) != HTTPD_WS_CLIENT_WEBSOCKET)
+        {
+            io_stream_client_remove(stream, client);
+            continue;
+        }
+        if(httpd_ws_send_frame_async(stream->server, client->fd, &ws_frame) != ESP_OK)
+        {
+            stream->send_errors++;
+            io_stream_client_remove(stream, client);
+            continue;
+        }
+        stream->sent++;
+        client->next_cycle = stream->cycle + client->every;
+    }
+
+    __atomic_store_n(&(stream->in_flight), false, __ATOMIC_RELEASE);
+}
+
+void vIoStreamTask(void* params)
+{
+    io_stream_t* stream = (io_stream_t*) params;
+    process_image_in_t in;
+    uint32_t cycle = 0;
+
+    while(true)
+    {
+        cycle += ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if(!__atomic_load_n(&(stream->client_count), __ATOMIC_ACQUIRE)) { continue; }
+        if(__atomic_load_n(&(stream->in_flight), __ATOMIC_ACQUIRE))
+        {
+            stream->skipped++;
+            continue;
+        }
+
+        // outputs are kept from the last consistent read if Modbus is writing
+        process_image_read_in(stream->image, &in);
+        process_image_read_out(stream->image, &(stream->out), 3);
+        stream->cycle = cycle;
+        stream->frame_len = io_stream_encode(stream, &in, &(stream->out), cycle, stream->frame);
+        stream->frames++;
+
+        __atomic_store_n(&(stream->in_flight), true, __ATOMIC_RELEASE);
+        if(httpd_queue_work(stream->server, io_stream_send_work, (void*) stream) != ESP_OK)
+        {
+            stream->send_errors++;
+            __atomic_store_n(&(stream->in_flight), false, __ATOMIC_RELEASE);
+        }
+    }
+}
+
+// decimation from "every=<n>" in query or message; keeps every if not given or out of range
+static uint16_t io_stream_parse_every(const char* str, uint16_t every)
+{
+    char value[8];
+    if(httpd_query_key_value(str, "every", value, sizeof(value)) != ESP_OK) { return every; }
+    const long parsed = strtol(value, NULL, 10);
+    if(parsed < 1 || parsed > IO_STREAM_EVERY_MAX)
+    {
+        printf("stream decimation %s out of range; keeping %u\n", value, every);
+        return every;
+    }
+    return parsed;
+}
+
+// server task; handshake registers the client, text messages change its decimation
+static esp_err_t io_stream_ws_handler(httpd_req_t* req)
+{
+    io_stream_t* stream = (io_stream_t*) req->user_ctx;
+    const int fd = httpd_req_to_sockfd(req);
+
+    io_stream_client_t* client = NULL;
+    for(int i = 0; i < IO_STREAM_CLIENTS_MAX && !client; i++)
+    {
+        if(stream->clients[i].fd == fd) { client = &(stream->clients[i]); }
+    }
+
+    if(req->method == HTTP_GET)
+    {
+        // a new client on the socket of a closed one takes over its slot
+        if(!client)
+        {
+            for(int i = 0; i < IO_STREAM_CLIENTS_MAX && !client; i++)
+            {
+                if(stream->clients[i].fd < 0) { client = &(stream->clients[i]); }
+            }
+            if(!client)
+            {
+                printf("too many stream clients!\n");
+                return ESP_FAIL;
+            }
+            __atomic_store_n(&(stream->client_count), stream->client_count + 1, __ATOMIC_RELEASE);
+        }
+
+        char query[32] = "";
+        if(httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) { query[0] = '\0'; }
+        client->fd = fd;
+        client->every = io_stream_parse_every(query, IO_STREAM_EVERY_DEFAULT);
+        client->next_cycle = stream->cycle;
+        printf("stream client %i connected; every %u cycles\n", fd, client->every);
+        return ESP_OK;
+    }
+
+    char message[32];
+    httpd_ws_frame_t ws_frame = { .payload = (uint8_t*) message };
+    esp_err_t err = httpd_ws_recv_frame(req, &ws_frame, 0);
+    if(err) { return err; }
+    if(ws_frame.len >= sizeof(message))
+    {
+        printf("stream message too long!\n");
+        return ESP_ERR_INVALID_SIZE;
+    }
+    err = httpd_ws_recv_frame(req, &ws_frame, ws_frame.len);
+    if(err) { return err; }
+    message[ws_frame.len] = '\0';
+
+    if(client && ws_frame.type == HTTPD_WS_TYPE_TEXT)
+    {
+        client->every = io_stream_parse_every(message, client->every);
+        printf("stream client %i: every %u cycles\n", fd, client->every);
+    }
+    return ESP_OK;
+}
+
+// registers /stream with the http server; clients may connect before the stream task runs
+esp_err_t io_stream_register(httpd_handle_t server)
+{
+    io_stream.server = server;
+    for(int i = 0; i < IO_STREAM_CLIENTS_MAX; i++) { io_stream.clients[i].fd = -1; }
+
+    httpd_uri_t stream_uri = {
+        .uri = "/stream",
+        .method = HTTP_GET,
+        .handler = io_stream_ws_handler,
+        .user_ctx = (void*) &io_stream,
+        .is_websocket = true
+    };
+    return httpd_register_uri_handler(server, &stream_uri);
+}
+
+// stream task on PRO CPU below the Modbus server; frames are sent by the http server task
+// subscribes to the process image; may start after the IO task, e.g. once the network is up
+#define IO_STREAM_TASK_STACK_SIZE 3072
+#define IO_STREAM_TASK_PRIORITY 4
+#define IO_STREAM_TASK_CORE 0
+esp_err_t start_io_stream(io_config_t* io_config, process_image_t* image)
+{
+    io_stream.image = image;
+    TaskHandle_t xIoStream = NULL;
+    xTaskCreatePinnedToCore(vIoStreamTask, "io_stream", IO_STREAM_TASK_STACK_SIZE, (void*) &io_stream, IO_STREAM_TASK_PRIORITY, &xIoStream, IO_STREAM_TASK_CORE);
+    configASSERT(xIoStream);
+
+    return process_image_subscribe(image, xIoStream);
+}
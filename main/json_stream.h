@@ -0,0 +1,386 @@
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include "esp_system.h"
+
+
+// incremental SAX style JSON tokenizer; no allocation, no DOM
+// input is fed in chunks of any size, e.g. as received from a socket; tokens may span chunks
+// for each value and container boundary, the handler is called with the event; nesting is available from the stream:
+//   depth: containers open around the value; 0 for the root value
+//   level[depth - 1].key: key of the value in the enclosing object
+//   level[depth - 1].index: index of the value in the enclosing array
+// container begin events are raised before entering, end events after leaving the container,
+// so depth, key and index always refer to the container itself
+// string values longer than JSON_STREAM_VALUE_LEN and keys longer than JSON_STREAM_KEY_LEN are truncated and flagged
+#define JSON_STREAM_DEPTH_MAX 8
+#define JSON_STREAM_KEY_LEN 24
+#define JSON_STREAM_VALUE_LEN 32
+
+typedef enum {
+    JSON_STREAM_OBJECT_BEGIN,
+    JSON_STREAM_OBJECT_END,
+    JSON_STREAM_ARRAY_BEGIN,
+    JSON_STREAM_ARRAY_END,
+    JSON_STREAM_STRING,
+    JSON_STREAM_NUMBER,
+    JSON_STREAM_BOOL,
+    JSON_STREAM_NULL
+} json_stream_event_t;
+
+typedef enum {
+    JSON_STREAM_STATE_VALUE,
+    JSON_STREAM_STATE_VALUE_OR_END,
+    JSON_STREAM_STATE_KEY,
+    JSON_STREAM_STATE_KEY_OR_END,
+    JSON_STREAM_STATE_COLON,
+    JSON_STREAM_STATE_NEXT,
+    JSON_STREAM_STATE_STRING,
+    JSON_STREAM_STATE_ESCAPE,
+    JSON_STREAM_STATE_UNICODE,
+    JSON_STREAM_STATE_NUMBER,
+    JSON_STREAM_STATE_LITERAL,
+    JSON_STREAM_STATE_DONE,
+    JSON_STREAM_STATE_ERROR
+} json_stream_state_t;
+
+typedef struct json_stream_level_t {
+    bool object;
+    uint16_t index;
+    char key[JSON_STREAM_KEY_LEN + 1];
+    bool key_truncated;
+} json_stream_level_t;
+
+struct json_stream_t;
+typedef void (*json_stream_handler_t)(struct json_stream_t* stream, json_stream_event_t event, void* ctx);
+
+typedef struct json_stream_t {
+    json_stream_state_t state;
+    uint8_t depth;
+    json_stream_level_t level[JSON_STREAM_DEPTH_MAX];
+    // scalar of current event; strings unescaped, numbers and literals as in the document
+    char value[JSON_STREAM_VALUE_LEN + 1];
+    uint8_t value_len;
+    bool value_truncated;
+    bool is_key;
+    uint8_t unicode_digits;
+    uint16_t unicode;
+    // number and bool of current event
+    double number;
+    bool boolean;
+    uint32_t offset;
+    json_stream_handler_t handler;
+    void* ctx;
+} json_stream_t;
+
+void json_stream_init(json_stream_t* stream, json_stream_handler_t handler, void* ctx)
+{
+    memset((void*)stream, 0, sizeof(json_stream_t));
+    stream->state = JSON_STREAM_STATE_VALUE;
+    stream->handler = handler;
+    stream->ctx = ctx;
+}
+
+// key of the current value; NULL at root or in arrays
+static inline const char* json_stream_key(json_stream_t* stream)
+{
+    if(!stream->depth || !stream->level[stream->depth - 1].object) { return NULL; }
+    return stream->level[stream->depth - 1].key;
+}
+
+static inline uint16_t json_stream_index(json_stream_t* stream)
+{
+    return stream->depth ? stream->level[stream->depth - 1].index : 0;
+}
+
+// number as integer; truncated and saturated like cJSON valueint
+static inline int json_stream_int(json_stream_t* stream)
+{
+    if(stream->number >= INT32_MAX) { return INT32_MAX; }
+    if(stream->number <= INT32_MIN) { return INT32_MIN; }
+    return (int) stream->number;
+}
+
+static inline bool json_stream_value_is(json_stream_t* stream, json_stream_event_t event, json_stream_event_t expected, const char* str)
+{
+    return event == expected && !stream->value_truncated && strcmp(str, stream->value) == 0;
+}
+
+static inline void json_stream_value_put(json_stream_t* stream, char c)
+{
+    if(stream->value_len < JSON_STREAM_VALUE_LEN)
+    {
+        stream->value[stream->value_len++] = c;
+        stream->value[stream->value_len] = '\0';
+    }
+    else
+    {
+        stream->value_truncated = true;
+    }
+}
+
+static inline void json_stream_value_reset(json_stream_t* stream)
+{
+    stream->value[0] = '\0';
+    stream->value_len = 0;
+    stream->value_truncated = false;
+}
+
+static inline void json_stream_emit(json_stream_t* stream, json_stream_event_t event)
+{
+    stream->handler(stream, event, stream->ctx);
+}
+
+// value done; continue with separator, end of container or end of document
+static inline void json_stream_value_done(json_stream_t* stream)
+{
+    stream->state = stream->depth ? JSON_STREAM_STATE_NEXT : JSON_STREAM_STATE_DONE;
+}
+
+static inline bool json_stream_is_space(char c)
+{
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+static void json_stream_string_done(json_stream_t* stream)
+{
+    if(stream->is_key)
+    {
+        json_stream_level_t* level = &(stream->level[stream->depth - 1]);
+        size_t len = stream->value_len < JSON_STREAM_KEY_LEN ? stream->value_len : JSON_STREAM_KEY_LEN;
+        memcpy((void*)level->key, (const void*)stream->value, len);
+        level->key[len] = '\0';
+        level->key_truncated = stream->value_truncated || stream->value_len > JSON_STREAM_KEY_LEN;
+        stream->state = JSON_STREAM_STATE_COLON;
+    }
+    else
+    {
+        json_stream_emit(stream, JSON_STREAM_STRING);
+        json_stream_value_done(stream);
+    }
+}
+
+static bool json_stream_number_done(json_stream_t* stream)
+{
+    char* end;
+    stream->number = strtod(stream->value, &end);
+    // strtod accepts more than JSON; reject leading '+', '.', hex and missing digits
+    const char* digits = stream->value[0] == '-' ? stream->value + 1 : stream->value;
+    if(stream->value_truncated || *end != '\0' || !(digits[0] >= '0' && digits[0] <= '9')
+        || (digits[0] == '0' && digits[1] >= '0' && digits[1] <= '9'))
+    {
+        return false;
+    }
+    json_stream_emit(stream, JSON_STREAM_NUMBER);
+    json_stream_value_done(stream);
+    return true;
+}
+
+static bool json_stream_literal_done(json_stream_t* stream)
+{
+    if(strcmp("true", stream->value) == 0 || strcmp("false", stream->value) == 0)
+    {
+        stream->boolean = stream->value[0] == 't';
+        json_stream_emit(stream, JSON_STREAM_BOOL);
+    }
+    else if(strcmp("null", stream->value) == 0)
+    {
+        json_stream_emit(stream, JSON_STREAM_NULL);
+    }
+    else
+    {
+        return false;
+    }
+    json_stream_value_done(stream);
+    return true;
+}
+
+static bool json_stream_begin_value(json_stream_t* stream, char c)
+{
+    json_stream_value_reset(stream);
+    switch(c)
+    {
+        case '{':
+        case '[':
+            if(stream->depth == JSON_STREAM_DEPTH_MAX) { return false; }
+            json_stream_emit(stream, c == '{' ? JSON_STREAM_OBJECT_BEGIN : JSON_STREAM_ARRAY_BEGIN);
+            stream->level[stream->depth].object = c == '{';
+            stream->level[stream->depth].index = 0;
+            stream->level[stream->depth].key[0] = '\0';
+            stream->depth++;
+            stream->state = c == '{' ? JSON_STREAM_STATE_KEY_OR_END : JSON_STREAM_STATE_VALUE_OR_END;
+            return true;
+        case '"':
+            stream->is_key = false;
+            stream->state = JSON_STREAM_STATE_STRING;
+            return true;
+        case 't':
+        case 'f':
+        case 'n':
+            json_stream_value_put(stream, c);
+            stream->state = JSON_STREAM_STATE_LITERAL;
+            return true;
+        default:
+            if(c == '-' || (c >= '0' && c <= '9'))
+            {
+                json_stream_value_put(stream, c);
+                stream->state = JSON_STREAM_STATE_NUMBER;
+                return true;
+            }
+            return false;
+    }
+}
+
+static bool json_stream_end_container(json_stream_t* stream, char c)
+{
+    if(stream->level[stream->depth - 1].object != (c == '}')) { return false; }
+    stream->depth--;
+    json_stream_emit(stream, c == '}' ? JSON_STREAM_OBJECT_END : JSON_STREAM_ARRAY_END);
+    json_stream_value_done(stream);
+    return true;
+}
+
+static bool json_stream_put(json_stream_t* stream, char c)
+{
+    switch(stream->state)
+    {
+        case JSON_STREAM_STATE_VALUE:
+            if(json_stream_is_space(c)) { return true; }
+            return json_stream_begin_value(stream, c);
+
+        case JSON_STREAM_STATE_VALUE_OR_END:
+            if(json_stream_is_space(c)) { return true; }
+            if(c == ']') { return json_stream_end_container(stream, c); }
+            return json_stream_begin_value(stream, c);
+
+        case JSON_STREAM_STATE_KEY_OR_END:
+            if(c == '}') { return json_stream_end_container(stream, c); }
+            // fall through
+        case JSON_STREAM_STATE_KEY:
+            if(json_stream_is_space(c)) { return true; }
+            if(c != '"') { return false; }
+            json_stream_value_reset(stream);
+            stream->is_key = true;
+            stream->state = JSON_STREAM_STATE_STRING;
+            return true;
+
+        case JSON_STREAM_STATE_COLON:
+            if(json_stream_is_space(c)) { return true; }
+            if(c != ':') { return false; }
+            stream->state = JSON_STREAM_STATE_VALUE;
+            return true;
+
+        case JSON_STREAM_STATE_NEXT:
+            if(json_stream_is_space(c)) { return true; }
+            if(c == ',')
+            {
+                json_stream_level_t* level = &(stream->level[stream->depth - 1]);
+                if(level->object)
+                {
+                    stream->state = JSON_STREAM_STATE_KEY;
+                }
+                else
+                {
+                    level->index++;
+                    stream->state = JSON_STREAM_STATE_VALUE;
+                }
+                return true;
+            }
+            if(c == '}' || c == ']') { return json_stream_end_container(stream, c); }
+            return false;
+
+        case JSON_STREAM_STATE_STRING:
+            if(c == '"')
+            {
+                json_stream_string_done(stream);
+                return true;
+            }
+            if(c == '\\')
+            {
+                stream->state = JSON_STREAM_STATE_ESCAPE;
+                return true;
+            }
+            if((unsigned char)c < 0x20) { return false; }
+            json_stream_value_put(stream, c);
+            return true;
+
+        case JSON_STREAM_STATE_ESCAPE:
+            stream->state = JSON_STREAM_STATE_STRING;
+            switch(c)
+            {
+                case '"': case '\\': case '/': json_stream_value_put(stream, c); return true;
+                case 'b': json_stream_value_put(stream, '\b'); return true;
+                case 'f': json_stream_value_put(stream, '\f'); return true;
+                case 'n': json_stream_value_put(stream, '\n'); return true;
+                case 'r': json_stream_value_put(stream, '\r'); return true;
+                case 't': json_stream_value_put(stream, '\t'); return true;
+                case 'u':
+                    stream->unicode = 0;
+                    stream->unicode_digits = 0;
+                    stream->state = JSON_STREAM_STATE_UNICODE;
+                    return true;
+                default:
+                    return false;
+            }
+
+        case JSON_STREAM_STATE_UNICODE:
+            if(c >= '0' && c <= '9') { stream->unicode = (stream->unicode << 4) | (c - '0'); }
+            else if(c >= 'a' && c <= 'f') { stream->unicode = (stream->unicode << 4) | (c - 'a' + 10); }
+            else if(c >= 'A' && c <= 'F') { stream->unicode = (stream->unicode << 4) | (c - 'A' + 10); }
+            else { return false; }
+            if(++stream->unicode_digits == 4)
+            {
+                // no config key or value uses non ASCII characters; keep ASCII, mark others
+                json_stream_value_put(stream, stream->unicode < 0x80 ? (char) stream->unicode : '?');
+                stream->state = JSON_STREAM_STATE_STRING;
+            }
+            return true;
+
+        case JSON_STREAM_STATE_NUMBER:
+            if((c >= '0' && c <= '9') || c == '.' || c == 'e' || c == 'E' || c == '+' || c == '-')
+            {
+                json_stream_value_put(stream, c);
+                return true;
+            }
+            // terminated by the next token; process it after the number
+            return json_stream_number_done(stream) && json_stream_put(stream, c);
+
+        case JSON_STREAM_STATE_LITERAL:
+            if(c >= 'a' && c <= 'z')
+            {
+                json_stream_value_put(stream, c);
+                return true;
+            }
+            return json_stream_literal_done(stream) && json_stream_put(stream, c);
+
+        case JSON_STREAM_STATE_DONE:
+            return json_stream_is_space(c);
+
+        default:
+            return false;
+    }
+}
+
+// feed next chunk of the document; returns ESP_FAIL on syntax errors, further input is rejected then
+esp_err_t json_stream_feed(json_stream_t* stream, const char* chunk, size_t len)
+{
+    for(size_t i = 0; i < len; i++)
+    {
+        if(stream->state == JSON_STREAM_STATE_ERROR) { return ESP_FAIL; }
+        if(!json_stream_put(stream, chunk[i]))
+        {
+            stream->state = JSON_STREAM_STATE_ERROR;
+            return ESP_FAIL;
+        }
+        stream->offset++;
+    }
+    return stream->state == JSON_STREAM_STATE_ERROR ? ESP_FAIL : ESP_OK;
+}
+
+// end of document; completes a trailing root number and checks the document is complete
+esp_err_t json_stream_end(json_stream_t* stream)
+{
+    if(stream->state == JSON_STREAM_STATE_NUMBER && !json_stream_number_done(stream)) { return ESP_FAIL; }
+    if(stream->state == JSON_STREAM_STATE_LITERAL && !json_stream_literal_done(stream)) { return ESP_FAIL; }
+    return stream->state == JSON_STREAM_STATE_DONE ? ESP_OK : ESP_FAIL;
+}
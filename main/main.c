@@ -17,60 +17,141 @@
 #include "io_config.h"
 #include "io_setup_handler.h"
 #include "io_handler.h"
+#include "process_image.h"
+#include "modbus_server.h"
+#include "io_publish.h"
+#include "io_stream.h"
+#include "boot_phase.h"
 
 
 
-#define WIFI_SSID_LEN 33
-#define WIFI_PASS_LEN 65
+// setup IO and start IO task; outputs in safe state (coils off, DAC at 0) until a Modbus master writes them
+void start_io(io_task_params_t* io_task_params)
+{
+    io_compiled_t* io_compiled = io_task_params->compiled;
+    io_config_t* io_config = &(io_compiled->config);
+
+    ESP_ERROR_CHECK(setup_gpio_in(io_compiled));
+    ESP_ERROR_CHECK(setup_io_events(io_config));
+    ESP_ERROR_CHECK(setup_gpio_out(io_compiled));
+    ESP_ERROR_CHECK(setup_adc(io_compiled));
+    ESP_ERROR_CHECK(setup_dac(io_config));
+    ESP_ERROR_CHECK(setup_shift(io_config));
+    ESP_ERROR_CHECK(setup_counters(io_config));
+
+    start_io_task(io_task_params);
+}
+
+// modbus server and publisher; sockets are bound to any address, so both may start before WiFi is connected
+void start_io_network(io_task_params_t* io_task_params)
+{
+    io_config_t* io_config = &(io_task_params->compiled->config);
+
+    ESP_ERROR_CHECK(start_modbus_slave(io_config, io_task_params->image));
+
+    // start report-by-exception publisher; subscribes to input images of the IO task
+    ESP_ERROR_CHECK(start_io_publish(io_config, io_task_params->image));
+
+    // start WebSocket process image stream; served by the configuration server once it runs
+    ESP_ERROR_CHECK(start_io_stream(io_config, io_task_params->image));
+}
+
 void app_main(void)
 {
     printf("HTTP server example booting...\n");
+    boot_phase("app_main");
 
-    // init subsystems
     ESP_ERROR_CHECK(nvs_flash_init());
+    const bool config_strap = config_strap_requested();
+
+    // init process image shared by IO task and modbus slave
+    static process_image_t process_image;
+    process_image_init(&process_image);
+    static io_compiled_t io_compiled;
+    static io_task_params_t io_task_params = {
+        .compiled = &io_compiled,
+        .image = &process_image
+    };
+
+    // IO first, from stored config; compiled config from cache if valid
+    const bool io_running = !io_user_config_load(&io_compiled);
+    if(io_running)
+    {
+        start_io(&io_task_params);
+        boot_phase("IO task started");
+    }
+
+    // single window for all configuration; IO keeps running meanwhile
+    const config_req_t config_req = config_user_request(config_strap);
+    if(config_req.clear)
+    {
+        clear_user_config();
+        printf("Rebooting!\n");
+        esp_restart();
+    }
+
+    // network comes up in the background of the running IO
     ESP_ERROR_CHECK(esp_netif_init());
     ESP_ERROR_CHECK(esp_event_loop_create_default());
     esp_netif_t* app_netif = wifi_init_sta();
-    
-    // allow user to clear config
-    clear_user_config_handler();
+    if(io_running)
+    {
+        start_io_network(&io_task_params);
+        boot_phase("modbus server started");
+    }
 
     // configure, setup and connect wifi
     char wifi_ssid[WIFI_SSID_LEN] = "";
     char wifi_pass[WIFI_PASS_LEN] = "";
-    if(wifi_user_config_handler(wifi_ssid, WIFI_SSID_LEN, wifi_pass, WIFI_PASS_LEN))
+    if(wifi_user_config_handler(wifi_ssid, WIFI_SSID_LEN, wifi_pass, WIFI_PASS_LEN, config_req.wifi))
     {
-        printf("Error configuring WiFi! Rebooting!\n");
-        esp_restart();
+        if(!io_running)
+        {
+            printf("Error configuring WiFi! Rebooting!\n");
+            esp_restart();
+        }
+        // nothing to connect to; reconfigure in the console window of the next boot
+        printf("Error configuring WiFi! IO keeps running without network\n");
+        return;
     }
     printf("Connecting to '%s'\n", wifi_ssid);
     
-    if(wifi_connect_sta(wifi_ssid, wifi_pass))
+    const bool wifi_connected = !wifi_connect_sta(wifi_ssid, wifi_pass);
+    if(!wifi_connected)
     {
-        printf("WiFi connection failed! Rebooting!\n");
-        esp_restart();
+        if(!io_running)
+        {
+            printf("WiFi connection failed! Rebooting!\n");
+            esp_restart();
+        }
+        // servers are bound to any address and become reachable once connected
+        printf("WiFi connection failed! IO keeps running; retrying in the background\n");
     }
+    else
+    {
+        boot_phase("WiFi connected");
+    }
+    // later disconnects are retried in the background as well
+    ESP_ERROR_CHECK(wifi_keep_connected(wifi_ssid, wifi_pass, wifi_connected));
 
-    // get and build io configuration
-    static io_config_t io_config = IO_CONFIG_DEFAULT();
-    io_user_config_handler(&io_config);
-
-    // setup and init IO
-    ESP_ERROR_CHECK(setup_gpio_in(&io_config));
-    ESP_ERROR_CHECK(setup_gpio_out(&io_config));
-    ESP_ERROR_CHECK(setup_adc(&io_config));
-    ESP_ERROR_CHECK(setup_dac(&io_config));
-
-    // init modbus slave
-    static modbus_data_t modbus_data;
-    start_modbus_slave(&io_config, &modbus_data, app_netif);
-
-    // start IO acquisition task
-    static io_task_params_t io_task_params = {
-        .io_config = &io_config,
-        .modbus_data = &modbus_data
-    };
-    start_io_task(&io_task_params);
+    // configuration server stays up; configs POSTed to /config switch the running IO task over without reboot
+    if(!io_running)
+    {
+        // no stored io configuration; wait for the first one
+        if(io_user_config_receive(&io_compiled))
+        {
+            printf("Error configuring IO! Rebooting!\n");
+            esp_restart();
+        }
+        start_io(&io_task_params);
+        start_io_network(&io_task_params);
+        boot_phase("IO task started");
+    }
+    else if(io_user_config_server())
+    {
+        printf("IO reconfiguration is not available!\n");
+    }
+    io_user_config_attach(&io_task_params);
 
     // ready; do work async
     printf("up and running!\n");
@@ -0,0 +1,683 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include "esp_system.h"
+#include "io_config.h"
+#include "process_image.h"
+#include "io_events.h"
+#include "adc_capture.h"
+#include "modbus_stats.h"
+
+
+// modbus PDU processing directly on the process image
+// inputs and diagnostics are encoded into the response under their seqlock; reads are retried while the IO task publishes
+// outputs are owned by the modbus side: read without locking, written in place under the output seqlock
+// all functions expect to be called from a single task (the modbus server)
+
+typedef enum {
+    MB_EX_NONE = 0x00,
+    MB_EX_ILLEGAL_FUNCTION = 0x01,
+    MB_EX_ILLEGAL_DATA_ADDRESS = 0x02,
+    MB_EX_ILLEGAL_DATA_VALUE = 0x03,
+    MB_EX_SLAVE_BUSY = 0x06
+} mb_exception_t;
+
+#define MB_FUNC_READ_COILS 1
+#define MB_FUNC_READ_DISCRETE_INPUTS 2
+#define MB_FUNC_READ_HOLDING_REGISTERS 3
+#define MB_FUNC_READ_INPUT_REGISTERS 4
+#define MB_FUNC_WRITE_SINGLE_COIL 5
+#define MB_FUNC_WRITE_SINGLE_REGISTER 6
+#define MB_FUNC_DIAGNOSTICS 8
+#define MB_FUNC_WRITE_MULTIPLE_COILS 15
+#define MB_FUNC_WRITE_MULTIPLE_REGISTERS 16
+#define MB_FUNC_READ_FILE_RECORD 20
+#define MB_FUNC_READ_WRITE_MULTIPLE_REGISTERS 23
+#define MB_FUNC_READ_FIFO_QUEUE 24
+
+#define MB_PDU_SIZE_MAX 253
+#define MB_READ_BITS_MAX 2000
+#define MB_READ_REGS_MAX 125
+#define MB_WRITE_BITS_MAX 1968
+#define MB_WRITE_REGS_MAX 123
+#define MB_READ_WRITE_READ_REGS_MAX 125
+#define MB_READ_WRITE_WRITE_REGS_MAX 121
+
+// additional areas; bit addresses for coils and discrete inputs
+#define MB_DISCRETE_IN_LATCH_RESET_START 64
+#define MB_DISCRETE_IN_SEEN_HIGH_START 64
+#define MB_DISCRETE_IN_SEEN_LOW_START 128
+// input register window of IO cycle profile; see io_profile.h for layout
+#define MB_IO_PROFILE_START 1000
+// waveform capture arm/trigger coils and status input registers; see adc_capture.h for layout
+#define MB_CAPTURE_CONTROL_START 128
+#define MB_CAPTURE_STATUS_START 2000
+// shift register chains as coils and discrete inputs; see io_shift.h
+#define MB_SHIFT_START 1000
+// counter reset coils and counter input registers; see io_counter.h for layout
+#define MB_COUNTER_START 1500
+// input register window of server statistics; see modbus_stats.h for layout
+#define MB_SERVER_STATS_START 3000
+
+// address map; each area maps a range of bits or registers onto a field of the process image
+// bit areas are little endian bit strings; register areas are uint16_t arrays
+// a request must not span more than one area
+typedef enum {
+    MB_IMAGE_IN = 0,
+    MB_IMAGE_OUT,
+    MB_IMAGE_DIAG,
+    MB_SERVER_STATS // not part of process image; exported from mb_stats on access
+} mb_image_part_t;
+
+typedef struct mb_area_t {
+    uint16_t start;
+    uint16_t count;
+    mb_image_part_t part;
+    uint16_t offset; // byte offset of field in image part
+} mb_area_t;
+
+static const mb_area_t mb_coil_areas[] = {
+    { 0, 64, MB_IMAGE_OUT, offsetof(process_image_out_t, coils) },
+    { MB_DISCRETE_IN_LATCH_RESET_START, 64, MB_IMAGE_OUT, offsetof(process_image_out_t, discrete_in_latch_reset) },
+    { MB_CAPTURE_CONTROL_START, 16, MB_IMAGE_OUT, offsetof(process_image_out_t, capture_control) },
+    { MB_SHIFT_START, IO_SHIFT_CHIPS_MAX * 8, MB_IMAGE_OUT, offsetof(process_image_out_t, shift_out) },
+    { MB_COUNTER_START, IO_COUNTERS_MAX, MB_IMAGE_OUT, offsetof(process_image_out_t, counter_reset) }
+};
+
+static const mb_area_t mb_discrete_in_areas[] = {
+    { 0, 64, MB_IMAGE_IN, offsetof(process_image_in_t, discrete_in) },
+    { MB_DISCRETE_IN_SEEN_HIGH_START, 64, MB_IMAGE_IN, offsetof(process_image_in_t, discrete_in_seen_high) },
+    { MB_DISCRETE_IN_SEEN_LOW_START, 64, MB_IMAGE_IN, offsetof(process_image_in_t, discrete_in_seen_low) },
+    { MB_SHIFT_START, IO_SHIFT_CHIPS_MAX * 8, MB_IMAGE_IN, offsetof(process_image_in_t, shift_in) }
+};
+
+static const mb_area_t mb_holding_reg_areas[] = {
+    { 0, HOLDING_REG_MAX, MB_IMAGE_OUT, offsetof(process_image_out_t, holding_reg) }
+};
+
+static const mb_area_t mb_input_reg_areas[] = {
+    { 0, INPUT_REG_MAX, MB_IMAGE_IN, offsetof(process_image_in_t, input_reg) },
+    { MB_IO_PROFILE_START, IO_PROFILE_REG_COUNT, MB_IMAGE_DIAG, offsetof(process_image_diag_t, profile_reg) },
+    { MB_COUNTER_START, IO_COUNTER_REG_COUNT, MB_IMAGE_IN, offsetof(process_image_in_t, counter_reg) },
+    { MB_CAPTURE_STATUS_START, ADC_CAPTURE_STATUS_REGS, MB_IMAGE_IN, offsetof(process_image_in_t, capture_reg) },
+    { MB_SERVER_STATS_START, MB_STATS_REG_COUNT, MB_SERVER_STATS, 0 }
+};
+
+// process image window; optional mirror of all IO in holding registers (io_config.image_window)
+// outputs first, then inputs: a master exchanges all IO of a scan with a single FC23 request,
+// writing [MB_IMAGE_WINDOW_START, + MB_IMAGE_WINDOW_OUT_LEN) and reading the whole window
+// 64 bit fields are mapped in host (little endian) order: register n holds bits 16n to 16n + 15
+// the input part is read under one seqlock, so discrete inputs and input registers are from the same IO cycle
+#define MB_IMAGE_WINDOW_START 4096
+#define MB_IMAGE_WINDOW_HOLDING_REG MB_IMAGE_WINDOW_START
+#define MB_IMAGE_WINDOW_COILS (MB_IMAGE_WINDOW_HOLDING_REG + HOLDING_REG_MAX)
+#define MB_IMAGE_WINDOW_DISCRETE_IN (MB_IMAGE_WINDOW_COILS + 4)
+#define MB_IMAGE_WINDOW_INPUT_REG (MB_IMAGE_WINDOW_DISCRETE_IN + 4)
+#define MB_IMAGE_WINDOW_OUT_LEN (MB_IMAGE_WINDOW_DISCRETE_IN - MB_IMAGE_WINDOW_START)
+#define MB_IMAGE_WINDOW_LEN (MB_IMAGE_WINDOW_INPUT_REG + INPUT_REG_MAX - MB_IMAGE_WINDOW_START)
+
+static const mb_area_t mb_image_window_areas[] = {
+    { MB_IMAGE_WINDOW_HOLDING_REG, HOLDING_REG_MAX, MB_IMAGE_OUT, offsetof(process_image_out_t, holding_reg) },
+    { MB_IMAGE_WINDOW_COILS, 4, MB_IMAGE_OUT, offsetof(process_image_out_t, coils) },
+    { MB_IMAGE_WINDOW_DISCRETE_IN, 4, MB_IMAGE_IN, offsetof(process_image_in_t, discrete_in) },
+    { MB_IMAGE_WINDOW_INPUT_REG, INPUT_REG_MAX, MB_IMAGE_IN, offsetof(process_image_in_t, input_reg) }
+};
+
+// set by start_modbus_slave() and io_reconfig_apply(); read by the server task
+static bool mb_image_window = false;
+
+#define MB_AREAS(areas) (areas), (sizeof(areas) / sizeof(mb_area_t))
+
+// area holding [address, address + count); NULL if there is none
+static const mb_area_t* mb_area_find(const mb_area_t* areas, size_t area_count, uint16_t address, uint16_t count)
+{
+    for(size_t i = 0; i < area_count; i++)
+    {
+        if(address >= areas[i].start && (uint32_t)address + count <= (uint32_t)areas[i].start + areas[i].count)
+        {
+            return &(areas[i]);
+        }
+    }
+    return NULL;
+}
+
+static uint16_t mb_stats_reg[MB_STATS_REG_COUNT];
+
+static inline uint8_t* mb_area_data(process_image_t* image, const mb_area_t* area)
+{
+    switch(area->part)
+    {
+        case MB_SERVER_STATS:
+            mb_stats_export(&mb_stats, mb_stats_reg);
+            return (uint8_t*)mb_stats_reg + area->offset;
+        case MB_IMAGE_IN:
+            return (uint8_t*)&(image->in) + area->offset;
+        case MB_IMAGE_DIAG:
+            return (uint8_t*)&(image->diag) + area->offset;
+        case MB_IMAGE_OUT:
+        default:
+            return (uint8_t*)&(image->out) + area->offset;
+    }
+}
+
+// NULL for outputs and statistics, which are written by this task only
+static inline const seqlock_t* mb_area_lock(process_image_t* image, const mb_area_t* area)
+{
+    switch(area->part)
+    {
+        case MB_IMAGE_IN:
+            return &(image->in_lock);
+        case MB_IMAGE_DIAG:
+            return &(image->diag_lock);
+        case MB_IMAGE_OUT:
+        default:
+            return NULL;
+    }
+}
+
+static inline uint16_t mb_get_u16(const uint8_t* data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static inline void mb_put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = value >> 8;
+    data[1] = value & 0xff;
+}
+
+// pack bits [first, first + count) of area into data, LSB first
+static void mb_encode_bits(process_image_t* image, const mb_area_t* area, uint16_t first, uint16_t count, uint8_t* data)
+{
+    const uint8_t* bits = mb_area_data(image, area);
+    const seqlock_t* lock = mb_area_lock(image, area);
+    const uint16_t bytes = (count + 7) / 8;
+    uint32_t seq = 0;
+    do
+    {
+        if(lock) { seq = seqlock_read_begin(lock); }
+        if(!(first & 0x07))
+        {
+            // byte aligned; copy and mask trailing bits
+            memcpy((void*)data, (const void*)(bits + first / 8), bytes);
+        }
+        else
+        {
+            memset((void*)data, 0, bytes);
+            for(uint16_t i = 0; i < count; i++)
+            {
+                const uint16_t bit = first + i;
+                data[i / 8] |= ((bits[bit / 8] >> (bit & 0x07)) & 0x01) << (i & 0x07);
+            }
+        }
+    } while(lock && seqlock_read_retry(lock, seq));
+
+    if(count & 0x07)
+    {
+        data[bytes - 1] &= (0x01 << (count & 0x07)) - 1;
+    }
+}
+
+// registers [first, first + count) of area into data, big endian
+static void mb_encode_regs(process_image_t* image, const mb_area_t* area, uint16_t first, uint16_t count, uint8_t* data)
+{
+    const uint16_t* regs = (const uint16_t*)mb_area_data(image, area) + first;
+    const seqlock_t* lock = mb_area_lock(image, area);
+    uint32_t seq = 0;
+    do
+    {
+        if(lock) { seq = seqlock_read_begin(lock); }
+        for(uint16_t i = 0; i < count; i++)
+        {
+            mb_put_u16(data + i * 2, regs[i]);
+        }
+    } while(lock && seqlock_read_retry(lock, seq));
+}
+
+// true if [address, address + count) lies within the first len registers of the image window
+static inline bool mb_image_window_contains(uint16_t address, uint16_t count, uint16_t len)
+{
+    return __atomic_load_n(&mb_image_window, __ATOMIC_RELAXED) && address >= MB_IMAGE_WINDOW_START && (uint32_t)address + count <= MB_IMAGE_WINDOW_START + len;
+}
+
+// part of area within [address, address + count); returns number of registers, 0 if disjoint
+static inline uint16_t mb_area_overlap(const mb_area_t* area, uint16_t address, uint16_t count, uint16_t* first)
+{
+    const uint32_t from = address > area->start ? address : area->start;
+    const uint32_t to = (uint32_t)address + count < (uint32_t)area->start + area->count ? (uint32_t)address + count : (uint32_t)area->start + area->count;
+    *first = from;
+    return to > from ? to - from : 0;
+}
+
+// registers [address, address + count) of image window into data, big endian
+static void mb_encode_image_window(process_image_t* image, uint16_t address, uint16_t count, uint8_t* data)
+{
+    uint32_t seq;
+    do
+    {
+        seq = seqlock_read_begin(&(image->in_lock));
+        for(size_t i = 0; i < sizeof(mb_image_window_areas) / sizeof(mb_area_t); i++)
+        {
+            const mb_area_t* area = &(mb_image_window_areas[i]);
+            uint16_t first;
+            const uint16_t len = mb_area_overlap(area, address, count, &first);
+            if(!len) { continue; }
+            const uint16_t* regs = (const uint16_t*)mb_area_data(image, area) + (first - area->start);
+            uint8_t* dst = data + (first - address) * 2;
+            for(uint16_t j = 0; j < len; j++)
+            {
+                mb_put_u16(dst + j * 2, regs[j]);
+            }
+        }
+    } while(seqlock_read_retry(&(image->in_lock), seq));
+}
+
+// holding registers [address, address + count) into data, including the image window
+static mb_exception_t mb_encode_holding_regs(process_image_t* image, uint16_t address, uint16_t count, uint8_t* data)
+{
+    const mb_area_t* area = mb_area_find(MB_AREAS(mb_holding_reg_areas), address, count);
+    if(area)
+    {
+        mb_encode_regs(image, area, address - area->start, count, data);
+        return MB_EX_NONE;
+    }
+    if(mb_image_window_contains(address, count, MB_IMAGE_WINDOW_LEN))
+    {
+        mb_encode_image_window(image, address, count, data);
+        return MB_EX_NONE;
+    }
+    return MB_EX_ILLEGAL_DATA_ADDRESS;
+}
+
+// FC01/FC02
+static mb_exception_t mb_read_bits(process_image_t* image, const mb_area_t* areas, size_t area_count, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 5) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t address = mb_get_u16(req + 1);
+    const uint16_t count = mb_get_u16(req + 3);
+    if(!count || count > MB_READ_BITS_MAX) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    const mb_area_t* area = mb_area_find(areas, area_count, address, count);
+    if(!area) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+    resp[1] = (count + 7) / 8;
+    mb_encode_bits(image, area, address - area->start, count, resp + 2);
+    *resp_len = 2 + resp[1];
+    return MB_EX_NONE;
+}
+
+// FC04
+static mb_exception_t mb_read_regs(process_image_t* image, const mb_area_t* areas, size_t area_count, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 5) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t address = mb_get_u16(req + 1);
+    const uint16_t count = mb_get_u16(req + 3);
+    if(!count || count > MB_READ_REGS_MAX) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    const mb_area_t* area = mb_area_find(areas, area_count, address, count);
+    if(!area) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+    resp[1] = count * 2;
+    mb_encode_regs(image, area, address - area->start, count, resp + 2);
+    *resp_len = 2 + resp[1];
+    return MB_EX_NONE;
+}
+
+// FC03
+static mb_exception_t mb_read_holding_regs(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 5) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t count = mb_get_u16(req + 3);
+    if(!count || count > MB_READ_REGS_MAX) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    mb_exception_t ex = mb_encode_holding_regs(image, mb_get_u16(req + 1), count, resp + 2);
+    if(ex) { return ex; }
+
+    resp[1] = count * 2;
+    *resp_len = 2 + resp[1];
+    return MB_EX_NONE;
+}
+
+// FC05/FC15; values: packed bits, LSB first
+static mb_exception_t mb_write_bits(process_image_t* image, uint16_t address, uint16_t count, const uint8_t* values)
+{
+    const mb_area_t* area = mb_area_find(MB_AREAS(mb_coil_areas), address, count);
+    if(!area) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+    process_image_write_out_begin(image);
+    uint8_t* bits = mb_area_data(image, area);
+    const uint16_t first = address - area->start;
+    for(uint16_t i = 0; i < count; i++)
+    {
+        const uint16_t bit = first + i;
+        const uint8_t mask = 0x01 << (bit & 0x07);
+        if((values[i / 8] >> (i & 0x07)) & 0x01) { bits[bit / 8] |= mask; }
+        else { bits[bit / 8] &= ~mask; }
+    }
+    process_image_write_out_end(image);
+    return MB_EX_NONE;
+}
+
+// FC06/FC16/FC23; values: big endian registers
+// writes to the image window are limited to its output part
+static mb_exception_t mb_write_regs(process_image_t* image, uint16_t address, uint16_t count, const uint8_t* values)
+{
+    const mb_area_t* areas;
+    size_t area_count;
+    if(mb_area_find(MB_AREAS(mb_holding_reg_areas), address, count))
+    {
+        areas = mb_holding_reg_areas;
+        area_count = sizeof(mb_holding_reg_areas) / sizeof(mb_area_t);
+    }
+    else if(mb_image_window_contains(address, count, MB_IMAGE_WINDOW_OUT_LEN))
+    {
+        areas = mb_image_window_areas;
+        area_count = sizeof(mb_image_window_areas) / sizeof(mb_area_t);
+    }
+    else
+    {
+        return MB_EX_ILLEGAL_DATA_ADDRESS;
+    }
+
+    process_image_write_out_begin(image);
+    for(size_t i = 0; i < area_count; i++)
+    {
+        uint16_t first;
+        const uint16_t len = mb_area_overlap(&(areas[i]), address, count, &first);
+        if(!len) { continue; }
+        uint16_t* regs = (uint16_t*)mb_area_data(image, &(areas[i])) + (first - areas[i].start);
+        const uint8_t* src = values + (first - address) * 2;
+        for(uint16_t j = 0; j < len; j++)
+        {
+            regs[j] = mb_get_u16(src + j * 2);
+        }
+    }
+    process_image_write_out_end(image);
+    return MB_EX_NONE;
+}
+
+static mb_exception_t mb_write_single_coil(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 5) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t value = mb_get_u16(req + 3);
+    if(value != 0xff00 && value != 0x0000) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    const uint8_t bit = value ? 0x01 : 0x00;
+    mb_exception_t ex = mb_write_bits(image, mb_get_u16(req + 1), 1, &bit);
+    if(ex) { return ex; }
+
+    memcpy((void*)(resp + 1), (const void*)(req + 1), 4);
+    *resp_len = 5;
+    return MB_EX_NONE;
+}
+
+static mb_exception_t mb_write_single_reg(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 5) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    mb_exception_t ex = mb_write_regs(image, mb_get_u16(req + 1), 1, req + 3);
+    if(ex) { return ex; }
+
+    memcpy((void*)(resp + 1), (const void*)(req + 1), 4);
+    *resp_len = 5;
+    return MB_EX_NONE;
+}
+
+static mb_exception_t mb_write_multiple_coils(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len < 6) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t count = mb_get_u16(req + 3);
+    if(!count || count > MB_WRITE_BITS_MAX || req[5] != (count + 7) / 8 || req_len != 6 + req[5]) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    mb_exception_t ex = mb_write_bits(image, mb_get_u16(req + 1), count, req + 6);
+    if(ex) { return ex; }
+
+    memcpy((void*)(resp + 1), (const void*)(req + 1), 4);
+    *resp_len = 5;
+    return MB_EX_NONE;
+}
+
+static mb_exception_t mb_write_multiple_regs(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len < 6) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t count = mb_get_u16(req + 3);
+    if(!count || count > MB_WRITE_REGS_MAX || req[5] != count * 2 || req_len != 6 + req[5]) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    mb_exception_t ex = mb_write_regs(image, mb_get_u16(req + 1), count, req + 6);
+    if(ex) { return ex; }
+
+    memcpy((void*)(resp + 1), (const void*)(req + 1), 4);
+    *resp_len = 5;
+    return MB_EX_NONE;
+}
+
+// FC23; write is applied before read, so written registers read back their new values
+static mb_exception_t mb_read_write_multiple_regs(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len < 10) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t read_address = mb_get_u16(req + 1);
+    const uint16_t read_count = mb_get_u16(req + 3);
+    const uint16_t write_count = mb_get_u16(req + 7);
+    if(!read_count || read_count > MB_READ_WRITE_READ_REGS_MAX || !write_count || write_count > MB_READ_WRITE_WRITE_REGS_MAX
+        || req[9] != write_count * 2 || req_len != 10 + req[9])
+    {
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+
+    // validate read range before writing
+    if(!mb_area_find(MB_AREAS(mb_holding_reg_areas), read_address, read_count) && !mb_image_window_contains(read_address, read_count, MB_IMAGE_WINDOW_LEN))
+    {
+        return MB_EX_ILLEGAL_DATA_ADDRESS;
+    }
+
+    mb_exception_t ex = mb_write_regs(image, mb_get_u16(req + 5), write_count, req + 10);
+    if(ex) { return ex; }
+
+    mb_encode_holding_regs(image, read_address, read_count, resp + 2);
+    resp[1] = read_count * 2;
+    *resp_len = 2 + resp[1];
+    return MB_EX_NONE;
+}
+
+// FC08 diagnostics; serial line counters are mapped to server statistics
+// 0x00 return query data, 0x0A clear counters (all server statistics)
+// 0x0B bus message count and 0x0E server message count: requests
+// 0x0C bus communication error count: framing errors; 0x0D bus exception error count: exceptions
+// 0x0F server no response count: ignored frames; 0x11 server busy count: SLAVE_BUSY exceptions
+#define MB_DIAG_RETURN_QUERY_DATA 0x00
+#define MB_DIAG_CLEAR_COUNTERS 0x0a
+#define MB_DIAG_BUS_MESSAGE_COUNT 0x0b
+#define MB_DIAG_BUS_COMM_ERROR_COUNT 0x0c
+#define MB_DIAG_BUS_EXCEPTION_COUNT 0x0d
+#define MB_DIAG_SERVER_MESSAGE_COUNT 0x0e
+#define MB_DIAG_SERVER_NO_RESPONSE_COUNT 0x0f
+#define MB_DIAG_SERVER_BUSY_COUNT 0x11
+static mb_exception_t mb_diagnostics(const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len < 3) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    const uint16_t sub_function = mb_get_u16(req + 1);
+
+    if(sub_function == MB_DIAG_RETURN_QUERY_DATA)
+    {
+        memcpy((void*)(resp + 1), (const void*)(req + 1), req_len - 1);
+        *resp_len = req_len;
+        return MB_EX_NONE;
+    }
+
+    if(req_len != 5 || mb_get_u16(req + 3) != 0) { return MB_EX_ILLEGAL_DATA_VALUE; }
+
+    uint32_t value;
+    switch(sub_function)
+    {
+        case MB_DIAG_CLEAR_COUNTERS:
+            mb_stats_clear(&mb_stats);
+            value = 0;
+            break;
+        case MB_DIAG_BUS_MESSAGE_COUNT:
+        case MB_DIAG_SERVER_MESSAGE_COUNT:
+            value = mb_stats.requests;
+            break;
+        case MB_DIAG_BUS_COMM_ERROR_COUNT:
+            value = mb_stats.framing_errors;
+            break;
+        case MB_DIAG_BUS_EXCEPTION_COUNT:
+            value = mb_stats.exceptions;
+            break;
+        case MB_DIAG_SERVER_NO_RESPONSE_COUNT:
+            value = mb_stats.ignored;
+            break;
+        case MB_DIAG_SERVER_BUSY_COUNT:
+            value = mb_stats.busy;
+            break;
+        default:
+            return MB_EX_ILLEGAL_FUNCTION;
+    }
+
+    // counters wrap at 16 bit; the full values are available as input registers
+    mb_put_u16(resp + 1, sub_function);
+    mb_put_u16(resp + 3, value & 0xffff);
+    *resp_len = 5;
+    return MB_EX_NONE;
+}
+
+// FC20 read file record of completed waveform capture
+// file number: input register (ADC channel) + 1; record number: sample index from start of capture, oldest first
+// response is limited to one PDU; longer captures are read with consecutive requests
+// SLAVE_BUSY while no capture is completed; compare capture sequence before and after download to detect re-arming
+#define MB_FILE_RECORD_REF_TYPE 6
+#define MB_FILE_RECORD_SUB_REQ_LEN 7
+#define MB_FILE_RECORD_REGS_MAX ((MB_PDU_SIZE_MAX - 4) / 2)
+static mb_exception_t mb_read_file_record(const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    const uint8_t request_len = req[1];
+    if(req_len < 2 || request_len != req_len - 2 || request_len < MB_FILE_RECORD_SUB_REQ_LEN || request_len % MB_FILE_RECORD_SUB_REQ_LEN)
+    {
+        return MB_EX_ILLEGAL_DATA_VALUE;
+    }
+
+    uint8_t* data = resp + 2;
+    uint16_t samples[MB_FILE_RECORD_REGS_MAX];
+    for(int i = 0; i < request_len / MB_FILE_RECORD_SUB_REQ_LEN; i++)
+    {
+        const uint8_t* sub = req + 2 + i * MB_FILE_RECORD_SUB_REQ_LEN;
+        const uint16_t file = mb_get_u16(sub + 1);
+        const uint16_t record = mb_get_u16(sub + 3);
+        const uint16_t count = mb_get_u16(sub + 5);
+
+        if(sub[0] != MB_FILE_RECORD_REF_TYPE || count > MB_FILE_RECORD_REGS_MAX || data + 2 + count * 2 > resp + MB_PDU_SIZE_MAX)
+        {
+            return MB_EX_ILLEGAL_DATA_VALUE;
+        }
+        if(!file) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+        esp_err_t err = adc_capture_read(&adc_capture, file - 1, record, count, samples);
+        if(err == ESP_ERR_INVALID_STATE) { return MB_EX_SLAVE_BUSY; }
+        if(err) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+        *data++ = 1 + count * 2;
+        *data++ = MB_FILE_RECORD_REF_TYPE;
+        for(uint16_t j = 0; j < count; j++)
+        {
+            mb_put_u16(data, samples[j]);
+            data += 2;
+        }
+    }
+    resp[1] = data - resp - 2;
+    *resp_len = data - resp;
+
+    return MB_EX_NONE;
+}
+
+// FC24 read FIFO queue of discrete input change-of-state events
+// request: FIFO pointer address (MB_EVENT_FIFO_ADDRESS)
+// response: up to MB_EVENT_FIFO_BATCH events, 3 registers each: (input index << 8 | level), timestamp us high, low
+// events are removed from the queue when read
+#define MB_EVENT_FIFO_ADDRESS 0
+#define MB_EVENT_FIFO_EVENT_REGS 3
+#define MB_EVENT_FIFO_BATCH (31 / MB_EVENT_FIFO_EVENT_REGS)
+static mb_exception_t mb_read_fifo_queue(const uint8_t* req, uint16_t req_len, uint8_t* resp, uint16_t* resp_len)
+{
+    if(req_len != 3) { return MB_EX_ILLEGAL_DATA_VALUE; }
+    if(mb_get_u16(req + 1) != MB_EVENT_FIFO_ADDRESS) { return MB_EX_ILLEGAL_DATA_ADDRESS; }
+
+    io_event_t events[MB_EVENT_FIFO_BATCH];
+    const size_t count = io_events_pop(events, MB_EVENT_FIFO_BATCH);
+    const uint16_t regs = count * MB_EVENT_FIFO_EVENT_REGS;
+
+    mb_put_u16(resp + 1, 2 + regs * 2);
+    mb_put_u16(resp + 3, regs);
+    uint8_t* data = resp + 5;
+    for(size_t i = 0; i < count; i++)
+    {
+        *data++ = events[i].index;
+        *data++ = events[i].level;
+        mb_put_u16(data, events[i].timestamp_us >> 16);
+        mb_put_u16(data + 2, events[i].timestamp_us & 0xffff);
+        data += 4;
+    }
+    *resp_len = data - resp;
+
+    return MB_EX_NONE;
+}
+
+// process one request PDU into resp (MB_PDU_SIZE_MAX bytes); returns response length, including exception responses
+uint16_t mb_pdu_process(process_image_t* image, const uint8_t* req, uint16_t req_len, uint8_t* resp)
+{
+    if(!req_len) { return 0; }
+
+    const uint8_t function = req[0];
+    uint16_t resp_len = 0;
+    mb_exception_t ex;
+
+    resp[0] = function;
+    switch(function)
+    {
+        case MB_FUNC_READ_COILS:
+            ex = mb_read_bits(image, MB_AREAS(mb_coil_areas), req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_DISCRETE_INPUTS:
+            ex = mb_read_bits(image, MB_AREAS(mb_discrete_in_areas), req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_HOLDING_REGISTERS:
+            ex = mb_read_holding_regs(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_INPUT_REGISTERS:
+            ex = mb_read_regs(image, MB_AREAS(mb_input_reg_areas), req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_WRITE_SINGLE_COIL:
+            ex = mb_write_single_coil(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_WRITE_SINGLE_REGISTER:
+            ex = mb_write_single_reg(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_DIAGNOSTICS:
+            ex = mb_diagnostics(req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_WRITE_MULTIPLE_COILS:
+            ex = mb_write_multiple_coils(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_WRITE_MULTIPLE_REGISTERS:
+            ex = mb_write_multiple_regs(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_FILE_RECORD:
+            ex = mb_read_file_record(req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_WRITE_MULTIPLE_REGISTERS:
+            ex = mb_read_write_multiple_regs(image, req, req_len, resp, &resp_len);
+            break;
+        case MB_FUNC_READ_FIFO_QUEUE:
+            ex = mb_read_fifo_queue(req, req_len, resp, &resp_len);
+            break;
+        default:
+            ex = MB_EX_ILLEGAL_FUNCTION;
+            break;
+    }
+
+    if(ex)
+    {
+        resp[0] = function | 0x80;
+        resp[1] = ex;
+        resp_len = 2;
+    }
+    return resp_len;
+}
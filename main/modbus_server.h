@@ -1,76 +1,327 @@
 #pragma once
+#include <errno.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
 #include "io_config.h"
-#include "esp_modbus_slave.h"
-
-// copy max sizes from io config data
-typedef struct modbus_data_t {
-    // int8_t coils[sizeof(io_config_t::coils) / 8 + 1];
-    // int8_t discrete_in[sizeof(io_config_t::discrete_in) / 8 + 1];
-    uint64_t coils;
-    uint64_t discrete_in;
-    uint16_t holding_reg[HOLDING_REG_MAX];
-    uint16_t input_reg[INPUT_REG_MAX];
-} modbus_data_t;
+#include "process_image.h"
+#include "modbus_pdu.h"
+#include "modbus_stats.h"
 
+
+// Modbus/TCP server on lwIP sockets
+// a single task serves all connections with select(); requests are processed in order of arrival and answered
+// directly from the process image (see modbus_pdu.h), so a client may pipeline several transactions per connection
+// responses of all complete requests in the receive buffer are collected and sent at once; TCP_NODELAY avoids
+// delaying them for coalescing
+// if all connections are in use, the least recently active one is closed for a new client
+// any unit id is accepted and echoed
+// statistics of transactions and connections are recorded in mb_stats (see modbus_stats.h)
+#ifndef MB_TCP_PORT_NUMBER
 #define MB_TCP_PORT_NUMBER 502
-esp_err_t start_modbus_slave(io_config_t* io_config, modbus_data_t* modbus_data, esp_netif_t* modbus_netif)
+#endif
+#define MB_CONNECTIONS_MAX MB_STATS_CONNECTIONS
+#define MB_MBAP_HEADER_LEN 7
+#define MB_ADU_LEN_MAX (MB_MBAP_HEADER_LEN - 1 + MB_PDU_SIZE_MAX)
+// buffers hold several ADUs for pipelined requests
+#define MB_RX_BUFFER_LEN (4 * MB_ADU_LEN_MAX)
+#define MB_TX_BUFFER_LEN (4 * MB_ADU_LEN_MAX)
+// receive times of the data in the receive buffer, one span per recv(); latency of a request is measured from the
+// span holding its last byte; if more recv() calls are pending than spans, the last span grows and keeps its time
+#define MB_RX_SPANS 8
+
+typedef struct mb_rx_span_t {
+    uint16_t end; // offset in rx after the last byte of the span
+    int64_t time_us;
+} mb_rx_span_t;
+
+typedef struct mb_connection_t {
+    int sock; // -1 if unused
+    int64_t active_us; // time of last received data
+    uint16_t rx_len;
+    uint8_t rx_span_count;
+    mb_rx_span_t rx_spans[MB_RX_SPANS];
+    uint16_t tx_len;
+    uint16_t tx_sent;
+    uint8_t rx[MB_RX_BUFFER_LEN];
+    uint8_t tx[MB_TX_BUFFER_LEN];
+} mb_connection_t;
+
+typedef struct mb_server_t {
+    process_image_t* image;
+    int listen_sock;
+    mb_connection_t connections[MB_CONNECTIONS_MAX];
+} mb_server_t;
+
+static inline uint8_t mb_connection_slot(const mb_server_t* server, const mb_connection_t* conn)
+{
+    return conn - server->connections;
+}
+
+static void mb_connection_close(mb_server_t* server, mb_connection_t* conn)
+{
+    if(conn->sock < 0) { return; }
+    mb_stats_close(&mb_stats, mb_connection_slot(server, conn));
+    close(conn->sock);
+    conn->sock = -1;
+    conn->rx_len = 0;
+    conn->rx_span_count = 0;
+    conn->tx_len = 0;
+    conn->tx_sent = 0;
+}
+
+static void mb_connection_rx_append(mb_connection_t* conn, uint16_t received, int64_t now_us)
+{
+    conn->rx_len += received;
+    if(conn->rx_span_count < MB_RX_SPANS)
+    {
+        conn->rx_spans[conn->rx_span_count].time_us = now_us;
+        conn->rx_span_count++;
+    }
+    conn->rx_spans[conn->rx_span_count - 1].end = conn->rx_len;
+}
+
+// receive time of the byte before offset end
+static inline int64_t mb_connection_rx_time(const mb_connection_t* conn, uint16_t end)
+{
+    for(int i = 0; i < conn->rx_span_count; i++)
+    {
+        if(conn->rx_spans[i].end >= end) { return conn->rx_spans[i].time_us; }
+    }
+    return conn->active_us;
+}
+
+// drop len processed bytes from the front of the receive buffer
+static void mb_connection_rx_consume(mb_connection_t* conn, uint16_t len)
+{
+    memmove((void*)conn->rx, (const void*)(conn->rx + len), conn->rx_len - len);
+    conn->rx_len -= len;
+
+    uint8_t count = 0;
+    for(int i = 0; i < conn->rx_span_count; i++)
+    {
+        if(conn->rx_spans[i].end <= len) { continue; }
+        conn->rx_spans[count].end = conn->rx_spans[i].end - len;
+        conn->rx_spans[count].time_us = conn->rx_spans[i].time_us;
+        count++;
+    }
+    conn->rx_span_count = count;
+}
+
+// process complete requests in receive buffer while the transmit buffer can take a response
+// returns false if framing is lost and the connection must be closed
+static bool mb_connection_process(mb_server_t* server, mb_connection_t* conn)
+{
+    const uint8_t slot = mb_connection_slot(server, conn);
+    uint16_t pos = 0;
+    while(conn->rx_len - pos >= MB_MBAP_HEADER_LEN && MB_TX_BUFFER_LEN - conn->tx_len >= MB_ADU_LEN_MAX)
+    {
+        const uint8_t* adu = conn->rx + pos;
+        const uint16_t protocol = mb_get_u16(adu + 2);
+        const uint16_t length = mb_get_u16(adu + 4); // unit id and PDU
+        if(length < 2 || length > MB_PDU_SIZE_MAX + 1)
+        {
+            mb_stats.framing_errors++;
+            return false;
+        }
+        const uint16_t adu_len = MB_MBAP_HEADER_LEN - 1 + length;
+        if(conn->rx_len - pos < adu_len) { break; }
+
+        if(protocol == 0)
+        {
+            uint8_t* resp = conn->tx + conn->tx_len;
+            const uint16_t pdu_len = mb_pdu_process(server->image, adu + MB_MBAP_HEADER_LEN, length - 1, resp + MB_MBAP_HEADER_LEN);
+            memcpy((void*)resp, (const void*)adu, 4); // transaction and protocol id
+            mb_put_u16(resp + 4, pdu_len + 1);
+            resp[6] = adu[6]; // unit id
+            conn->tx_len += MB_MBAP_HEADER_LEN + pdu_len;
+
+            const uint8_t* pdu = resp + MB_MBAP_HEADER_LEN;
+            mb_stats_request(&mb_stats, slot, adu[6], adu[7], (pdu[0] & 0x80) ? pdu[1] : 0, esp_timer_get_time() - mb_connection_rx_time(conn, pos + adu_len));
+        }
+        else
+        {
+            mb_stats.ignored++;
+        }
+        pos += adu_len;
+    }
+
+    if(pos) { mb_connection_rx_consume(conn, pos); }
+    return true;
+}
+
+// returns false on socket error
+static bool mb_connection_flush(mb_server_t* server, mb_connection_t* conn)
 {
-    // init and configure slave, and start modbus slave stack
-    void* mbc_slave_handler = NULL;
-    ESP_ERROR_CHECK(mbc_slave_init_tcp(&mbc_slave_handler));
-    
-    mb_communication_info_t comm_info = { 0 };
-    comm_info.ip_port = MB_TCP_PORT_NUMBER;
-    comm_info.ip_addr_type = MB_IPV4;
-    comm_info.ip_mode = MB_MODE_TCP;
-    comm_info.ip_addr = NULL;
-    comm_info.ip_netif_ptr = (void*)modbus_netif;
-    ESP_ERROR_CHECK(mbc_slave_setup((void*)&comm_info));
-    
-    // setup slave data descriptors
-        // COILS
-        mb_register_area_descriptor_t mb_coils_reg;
-        mb_coils_reg.type = MB_PARAM_COIL;
-        mb_coils_reg.start_offset = 0;
-        mb_coils_reg.address = (void*)&(modbus_data->coils);
-        mb_coils_reg.size = sizeof(modbus_data->coils);
-
-        // DISCRETE IN
-        mb_register_area_descriptor_t mb_discrete_in_reg;
-        mb_discrete_in_reg.type = MB_PARAM_DISCRETE;
-        mb_discrete_in_reg.start_offset = 0;
-        mb_discrete_in_reg.address = (void*)&(modbus_data->discrete_in);
-        mb_discrete_in_reg.size = sizeof(modbus_data->discrete_in);
-
-        // HOLDING REGISTERS
-        mb_register_area_descriptor_t mb_holding_reg;
-        mb_holding_reg.type = MB_PARAM_HOLDING;
-        mb_holding_reg.start_offset = 0;
-        mb_holding_reg.address = (void*)modbus_data->holding_reg;
-        mb_holding_reg.size = sizeof(modbus_data->holding_reg);
-
-        // INPUT REGISTERS
-        mb_register_area_descriptor_t mb_input_reg;
-        mb_input_reg.type = MB_PARAM_INPUT;
-        mb_input_reg.start_offset = 0;
-        mb_input_reg.address = (void*)modbus_data->input_reg;
-        mb_input_reg.size = sizeof(modbus_data->input_reg);
-
-    // zero data
-    memset((void*)&(modbus_data->coils), 0, sizeof(modbus_data->coils));
-    memset((void*)&(modbus_data->discrete_in), 0, sizeof(modbus_data->discrete_in));
-    memset((void*)modbus_data->holding_reg, 0, sizeof(modbus_data->holding_reg));
-    memset((void*)modbus_data->input_reg, 0, sizeof(modbus_data->input_reg));
-
-    // setup slave data
-    ESP_ERROR_CHECK(mbc_slave_set_descriptor(mb_coils_reg));
-    ESP_ERROR_CHECK(mbc_slave_set_descriptor(mb_discrete_in_reg));
-    ESP_ERROR_CHECK(mbc_slave_set_descriptor(mb_holding_reg));
-    ESP_ERROR_CHECK(mbc_slave_set_descriptor(mb_input_reg));
-
-    // start slave
-    printf("starting modbus slave...\n");
-    ESP_ERROR_CHECK(mbc_slave_start());
+    while(conn->tx_sent < conn->tx_len)
+    {
+        const int sent = send(conn->sock, conn->tx + conn->tx_sent, conn->tx_len - conn->tx_sent, MSG_DONTWAIT);
+        if(sent < 0)
+        {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        conn->tx_sent += sent;
+        mb_stats_bytes_out(&mb_stats, mb_connection_slot(server, conn), sent);
+    }
+    conn->tx_len = 0;
+    conn->tx_sent = 0;
+    return true;
+}
+
+static void mb_server_accept(mb_server_t* server)
+{
+    struct sockaddr_in addr;
+    socklen_t addr_len = sizeof(addr);
+    const int sock = accept(server->listen_sock, (struct sockaddr*)&addr, &addr_len);
+    if(sock < 0) { return; }
+
+    // free slot, or least recently active connection
+    mb_connection_t* conn = &(server->connections[0]);
+    for(int i = 0; i < MB_CONNECTIONS_MAX && conn->sock >= 0; i++)
+    {
+        mb_connection_t* candidate = &(server->connections[i]);
+        if(candidate->sock < 0 || candidate->active_us < conn->active_us) { conn = candidate; }
+    }
+    const bool evict = conn->sock >= 0;
+    if(evict)
+    {
+        printf("modbus connection limit reached; closing least recently active connection\n");
+        mb_connection_close(server, conn);
+    }
+    mb_stats_accept(&mb_stats, mb_connection_slot(server, conn), evict);
+
+    const int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    fcntl(sock, F_SETFL, fcntl(sock, F_GETFL, 0) | O_NONBLOCK);
+
+    conn->sock = sock;
+    conn->active_us = esp_timer_get_time();
+    conn->rx_len = 0;
+    conn->rx_span_count = 0;
+    conn->tx_len = 0;
+    conn->tx_sent = 0;
+}
+
+// receive, process and answer; returns false if the connection was closed
+static bool mb_connection_service(mb_server_t* server, mb_connection_t* conn, bool readable, bool writable)
+{
+    if(writable && !mb_connection_flush(server, conn)) { return false; }
+
+    if(readable)
+    {
+        const int received = recv(conn->sock, conn->rx + conn->rx_len, MB_RX_BUFFER_LEN - conn->rx_len, MSG_DONTWAIT);
+        if(received == 0) { return false; }
+        if(received < 0 && errno != EAGAIN && errno != EWOULDBLOCK) { return false; }
+        if(received > 0)
+        {
+            conn->active_us = esp_timer_get_time();
+            mb_connection_rx_append(conn, received, conn->active_us);
+            mb_stats_bytes_in(&mb_stats, mb_connection_slot(server, conn), received);
+        }
+    }
+
+    // responses are sent before more requests are taken from the buffer
+    while(!conn->tx_len)
+    {
+        const uint16_t rx_len = conn->rx_len;
+        if(!mb_connection_process(server, conn)) { return false; }
+        if(!mb_connection_flush(server, conn)) { return false; }
+        if(conn->rx_len == rx_len) { break; }
+    }
+    return true;
+}
+
+void vModbusServerTask(void* params)
+{
+    mb_server_t* server = (mb_server_t*) params;
+
+    while(true)
+    {
+        fd_set read_fds;
+        fd_set write_fds;
+        FD_ZERO(&read_fds);
+        FD_ZERO(&write_fds);
+        FD_SET(server->listen_sock, &read_fds);
+        int max_fd = server->listen_sock;
+
+        for(int i = 0; i < MB_CONNECTIONS_MAX; i++)
+        {
+            const mb_connection_t* conn = &(server->connections[i]);
+            if(conn->sock < 0) { continue; }
+            // stop reading while responses are pending; keeps request order and bounds buffering
+            if(conn->tx_len) { FD_SET(conn->sock, &write_fds); }
+            else if(conn->rx_len < MB_RX_BUFFER_LEN) { FD_SET(conn->sock, &read_fds); }
+            if(conn->sock > max_fd) { max_fd = conn->sock; }
+        }
+
+        if(select(max_fd + 1, &read_fds, &write_fds, NULL, NULL) < 0)
+        {
+            printf("modbus server select failed!\n");
+            vTaskDelay(10 / portTICK_PERIOD_MS);
+            continue;
+        }
+
+        for(int i = 0; i < MB_CONNECTIONS_MAX; i++)
+        {
+            mb_connection_t* conn = &(server->connections[i]);
+            if(conn->sock < 0) { continue; }
+            const bool readable = FD_ISSET(conn->sock, &read_fds);
+            const bool writable = FD_ISSET(conn->sock, &write_fds);
+            if((readable || writable) && !mb_connection_service(server, conn, readable, writable))
+            {
+                mb_connection_close(server, conn);
+            }
+        }
+
+        if(FD_ISSET(server->listen_sock, &read_fds))
+        {
+            mb_server_accept(server);
+        }
+    }
+}
+
+// server task runs on PRO CPU, next to the network stack and away from the IO task
+#define MB_SERVER_TASK_STACK_SIZE 4096
+#define MB_SERVER_TASK_PRIORITY 5
+#define MB_SERVER_TASK_CORE 0
+esp_err_t start_modbus_slave(io_config_t* io_config, process_image_t* image)
+{
+    static mb_server_t server;
+    memset((void*)&server, 0, sizeof(server));
+    server.image = image;
+    __atomic_store_n(&mb_image_window, io_config->image_window, __ATOMIC_RELAXED);
+    for(int i = 0; i < MB_CONNECTIONS_MAX; i++)
+    {
+        server.connections[i].sock = -1;
+    }
+
+    server.listen_sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if(server.listen_sock < 0)
+    {
+        printf("creating modbus server socket failed!\n");
+        return ESP_FAIL;
+    }
+
+    const int reuse = 1;
+    setsockopt(server.listen_sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(MB_TCP_PORT_NUMBER),
+        .sin_addr.s_addr = htonl(INADDR_ANY)
+    };
+    if(bind(server.listen_sock, (struct sockaddr*)&addr, sizeof(addr)) || listen(server.listen_sock, MB_CONNECTIONS_MAX))
+    {
+        printf("binding modbus server to port %i failed!\n", MB_TCP_PORT_NUMBER);
+        close(server.listen_sock);
+        return ESP_FAIL;
+    }
+
+    printf("starting modbus server on port %i...\n", MB_TCP_PORT_NUMBER);
+    TaskHandle_t xModbusServer = NULL;
+    xTaskCreatePinnedToCore(vModbusServerTask, "mb_server", MB_SERVER_TASK_STACK_SIZE, (void*) &server, MB_SERVER_TASK_PRIORITY, &xModbusServer, MB_SERVER_TASK_CORE);
+    configASSERT(xModbusServer);
 
     return ESP_OK;
 }
@@ -0,0 +1,214 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "esp_system.h"
+
+
+// Modbus server statistics; cumulative since boot or last clear (FC08 sub-function 0x0A)
+// recorded and read by the server task only, so no locking is required
+// latency: time from reception of a request to its response being ready to send, in us; includes waiting in the
+// receive buffer behind pipelined requests, but not the network; the round trip time seen by a master minus
+// this latency is spent in the network and the TCP/IP stack
+#define MB_STATS_CONNECTIONS 8
+#define MB_STATS_UNITS_MAX 8
+#define MB_STATS_BUCKETS 8
+// histogram bucket upper bounds in us; last bucket is unbounded
+static const uint32_t mb_stats_bucket_us[MB_STATS_BUCKETS - 1] = { 50, 100, 200, 500, 1000, 2000, 5000 };
+
+// function codes with individual statistics, in register layout order (see modbus_pdu.h)
+// requests with any other function code are collected in one additional entry
+static const uint8_t mb_stats_functions[] = { 1, 2, 3, 4, 5, 6, 8, 15, 16, 20, 23, 24 };
+#define MB_STATS_FUNCTIONS (sizeof(mb_stats_functions) + 1)
+
+typedef struct mb_function_stats_t {
+    uint32_t requests;
+    uint32_t exceptions;
+    uint32_t max_us;
+    uint64_t sum_us;
+    uint32_t hist[MB_STATS_BUCKETS];
+} mb_function_stats_t;
+
+typedef struct mb_connection_stats_t {
+    bool open;
+    uint32_t requests;
+    uint32_t exceptions;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+} mb_connection_stats_t;
+
+typedef struct mb_unit_stats_t {
+    uint8_t unit;
+    uint32_t requests;
+    uint32_t exceptions;
+} mb_unit_stats_t;
+
+// framing_errors: connections closed for invalid MBAP length; ignored: frames with protocol id other than 0
+// busy: SLAVE_BUSY exceptions
+typedef struct mb_stats_t {
+    uint32_t accepts;
+    uint32_t closes;
+    uint32_t evictions;
+    uint32_t framing_errors;
+    uint32_t ignored;
+    uint32_t requests;
+    uint32_t exceptions;
+    uint32_t busy;
+    uint32_t bytes_in;
+    uint32_t bytes_out;
+    mb_function_stats_t functions[MB_STATS_FUNCTIONS];
+    mb_connection_stats_t connections[MB_STATS_CONNECTIONS];
+    mb_unit_stats_t units[MB_STATS_UNITS_MAX]; // in order of first request
+    uint8_t unit_count;
+} mb_stats_t;
+static mb_stats_t mb_stats;
+
+// reset all counters; open connections are kept
+void mb_stats_clear(mb_stats_t* stats)
+{
+    bool open[MB_STATS_CONNECTIONS];
+    for(int i = 0; i < MB_STATS_CONNECTIONS; i++) { open[i] = stats->connections[i].open; }
+    memset((void*)stats, 0, sizeof(mb_stats_t));
+    for(int i = 0; i < MB_STATS_CONNECTIONS; i++) { stats->connections[i].open = open[i]; }
+}
+
+static inline void mb_stats_accept(mb_stats_t* stats, uint8_t slot, bool evicted)
+{
+    stats->accepts++;
+    if(evicted) { stats->evictions++; }
+    memset((void*)&(stats->connections[slot]), 0, sizeof(mb_connection_stats_t));
+    stats->connections[slot].open = true;
+}
+
+static inline void mb_stats_close(mb_stats_t* stats, uint8_t slot)
+{
+    stats->closes++;
+    stats->connections[slot].open = false;
+}
+
+static inline void mb_stats_bytes_in(mb_stats_t* stats, uint8_t slot, uint32_t bytes)
+{
+    stats->bytes_in += bytes;
+    stats->connections[slot].bytes_in += bytes;
+}
+
+static inline void mb_stats_bytes_out(mb_stats_t* stats, uint8_t slot, uint32_t bytes)
+{
+    stats->bytes_out += bytes;
+    stats->connections[slot].bytes_out += bytes;
+}
+
+static mb_function_stats_t* mb_stats_function(mb_stats_t* stats, uint8_t function)
+{
+    for(int i = 0; i < sizeof(mb_stats_functions); i++)
+    {
+        if(mb_stats_functions[i] == function) { return &(stats->functions[i]); }
+    }
+    return &(stats->functions[MB_STATS_FUNCTIONS - 1]);
+}
+
+// NULL if unit table is full
+static mb_unit_stats_t* mb_stats_unit(mb_stats_t* stats, uint8_t unit)
+{
+    for(int i = 0; i < stats->unit_count; i++)
+    {
+        if(stats->units[i].unit == unit) { return &(stats->units[i]); }
+    }
+    if(stats->unit_count >= MB_STATS_UNITS_MAX) { return NULL; }
+
+    mb_unit_stats_t* unit_stats = &(stats->units[stats->unit_count++]);
+    unit_stats->unit = unit;
+    return unit_stats;
+}
+
+// exception: exception code of response; 0 for a regular response
+void mb_stats_request(mb_stats_t* stats, uint8_t slot, uint8_t unit, uint8_t function, uint8_t exception, uint32_t latency_us)
+{
+    const bool is_exception = exception != 0;
+    stats->requests++;
+    stats->exceptions += is_exception;
+    if(exception == 0x06) { stats->busy++; }
+
+    stats->connections[slot].requests++;
+    stats->connections[slot].exceptions += is_exception;
+
+    mb_unit_stats_t* unit_stats = mb_stats_unit(stats, unit);
+    if(unit_stats)
+    {
+        unit_stats->requests++;
+        unit_stats->exceptions += is_exception;
+    }
+
+    mb_function_stats_t* function_stats = mb_stats_function(stats, function);
+    function_stats->requests++;
+    function_stats->exceptions += is_exception;
+    if(latency_us > function_stats->max_us) { function_stats->max_us = latency_us; }
+    function_stats->sum_us += latency_us;
+
+    int bucket = 0;
+    while(bucket < MB_STATS_BUCKETS - 1 && latency_us >= mb_stats_bucket_us[bucket]) { bucket++; }
+    function_stats->hist[bucket]++;
+}
+
+// input register layout; all values 32 bit as two registers, high word first
+// header: accepts, closes, evictions, framing errors, ignored frames, requests, exceptions, busy, bytes in, bytes out
+// per function code (mb_stats_functions, then all others): requests, exceptions, mean us, max us, histogram counts per bucket
+// per connection slot: open, requests, exceptions, bytes in, bytes out
+// per unit id (in order of first request, unused entries 0): unit id, requests, exceptions
+#define MB_STATS_HEADER_REGS 20
+#define MB_STATS_FUNCTION_REGS (8 + 2 * MB_STATS_BUCKETS)
+#define MB_STATS_CONNECTION_REGS 10
+#define MB_STATS_UNIT_REGS 6
+#define MB_STATS_REG_COUNT (MB_STATS_HEADER_REGS + MB_STATS_FUNCTIONS * MB_STATS_FUNCTION_REGS + MB_STATS_CONNECTIONS * MB_STATS_CONNECTION_REGS + MB_STATS_UNITS_MAX * MB_STATS_UNIT_REGS)
+
+static inline uint16_t* mb_stats_put_u32(uint16_t* regs, uint32_t value)
+{
+    regs[0] = value >> 16;
+    regs[1] = value & 0xffff;
+    return regs + 2;
+}
+
+void mb_stats_export(const mb_stats_t* stats, uint16_t* regs)
+{
+    regs = mb_stats_put_u32(regs, stats->accepts);
+    regs = mb_stats_put_u32(regs, stats->closes);
+    regs = mb_stats_put_u32(regs, stats->evictions);
+    regs = mb_stats_put_u32(regs, stats->framing_errors);
+    regs = mb_stats_put_u32(regs, stats->ignored);
+    regs = mb_stats_put_u32(regs, stats->requests);
+    regs = mb_stats_put_u32(regs, stats->exceptions);
+    regs = mb_stats_put_u32(regs, stats->busy);
+    regs = mb_stats_put_u32(regs, stats->bytes_in);
+    regs = mb_stats_put_u32(regs, stats->bytes_out);
+
+    for(int i = 0; i < MB_STATS_FUNCTIONS; i++)
+    {
+        const mb_function_stats_t* function_stats = &(stats->functions[i]);
+        regs = mb_stats_put_u32(regs, function_stats->requests);
+        regs = mb_stats_put_u32(regs, function_stats->exceptions);
+        regs = mb_stats_put_u32(regs, function_stats->requests ? function_stats->sum_us / function_stats->requests : 0);
+        regs = mb_stats_put_u32(regs, function_stats->max_us);
+        for(int bucket = 0; bucket < MB_STATS_BUCKETS; bucket++)
+        {
+            regs = mb_stats_put_u32(regs, function_stats->hist[bucket]);
+        }
+    }
+
+    for(int i = 0; i < MB_STATS_CONNECTIONS; i++)
+    {
+        const mb_connection_stats_t* connection_stats = &(stats->connections[i]);
+        regs = mb_stats_put_u32(regs, connection_stats->open);
+        regs = mb_stats_put_u32(regs, connection_stats->requests);
+        regs = mb_stats_put_u32(regs, connection_stats->exceptions);
+        regs = mb_stats_put_u32(regs, connection_stats->bytes_in);
+        regs = mb_stats_put_u32(regs, connection_stats->bytes_out);
+    }
+
+    for(int i = 0; i < MB_STATS_UNITS_MAX; i++)
+    {
+        const mb_unit_stats_t* unit_stats = &(stats->units[i]);
+        const bool used = i < stats->unit_count;
+        regs = mb_stats_put_u32(regs, used ? unit_stats->unit : 0);
+        regs = mb_stats_put_u32(regs, used ? unit_stats->requests : 0);
+        regs = mb_stats_put_u32(regs, used ? unit_stats->exceptions : 0);
+    }
+}
@@ -0,0 +1,257 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "io_config.h"
+#include "io_profile.h"
+
+
+// sequence lock: single writer, any number of readers
+// writer never waits; readers retry if a write was in progress or happened while reading
+// sequence is odd while a write is in progress
+typedef struct seqlock_t {
+    volatile uint32_t seq;
+} seqlock_t;
+
+static inline void seqlock_write_begin(seqlock_t* lock)
+{
+    __atomic_store_n(&(lock->seq), lock->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void seqlock_write_end(seqlock_t* lock)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    __atomic_store_n(&(lock->seq), lock->seq + 1, __ATOMIC_RELAXED);
+}
+
+static inline uint32_t seqlock_read_begin(const seqlock_t* lock)
+{
+    uint32_t seq = __atomic_load_n(&(lock->seq), __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return seq;
+}
+
+// true if data read since seqlock_read_begin() is inconsistent
+static inline bool seqlock_read_retry(const seqlock_t* lock, uint32_t seq)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    return (seq & 0x01) || __atomic_load_n(&(lock->seq), __ATOMIC_RELAXED) != seq;
+}
+
+
+// triple buffer index exchange: single writer, single reader; neither side ever waits or retries
+// writer fills buffer[write] and publishes it; reader fetches the latest published buffer into buffer[read]
+// state holds the index of the shared middle buffer and a flag marking it as unread
+#define TRIPLE_BUFFER_FRESH 0x04
+typedef struct triple_buffer_t {
+    volatile uint32_t state;
+    uint8_t write; // owned by writer
+    uint8_t read; // owned by reader
+} triple_buffer_t;
+
+#define TRIPLE_BUFFER_DEFAULT() { .state = 1, .write = 0, .read = 2 }
+
+// returns index of the next buffer to write
+static inline uint8_t triple_buffer_publish(triple_buffer_t* buffer)
+{
+    const uint32_t prev = __atomic_exchange_n(&(buffer->state), buffer->write | TRIPLE_BUFFER_FRESH, __ATOMIC_ACQ_REL);
+    buffer->write = prev & 0x03;
+    return buffer->write;
+}
+
+// returns index of the latest published buffer; unchanged if nothing new was published
+static inline uint8_t triple_buffer_fetch(triple_buffer_t* buffer)
+{
+    if(__atomic_load_n(&(buffer->state), __ATOMIC_RELAXED) & TRIPLE_BUFFER_FRESH)
+    {
+        const uint32_t prev = __atomic_exchange_n(&(buffer->state), buffer->read, __ATOMIC_ACQ_REL);
+        buffer->read = prev & 0x03;
+    }
+    return buffer->read;
+}
+
+
+// process image shared between IO task and Modbus side
+// in: written once per cycle by IO task; out: written by Modbus side, read once per cycle by IO task
+// discrete_in_seen_high/low: latched levels per discrete input, held until reset by discrete_in_latch_reset
+// capture_reg: waveform capture status; capture_control: arm (bit 0) and trigger (bit 1), acting on rising edges
+// shift_in/shift_out: shift register chains, byte per chip counted from the ESP32, bit per chip input/output A - H
+// counter_reg: count, frequency and period per counter (see io_counter.h); counter_reset: bit per counter, held at 0
+// tick_us: esp_timer time of the IO cycle tick the inputs were read in
+// *_count: points configured in the runtime of the IO task that built the image; frame encoders follow these, so they
+// change with the image at a reconfiguration
+typedef struct process_image_in_t {
+    int64_t tick_us;
+    uint8_t discrete_in_count;
+    uint8_t coils_count;
+    uint8_t input_reg_count;
+    uint8_t holding_reg_count;
+    uint64_t discrete_in;
+    uint64_t discrete_in_seen_high;
+    uint64_t discrete_in_seen_low;
+    uint16_t input_reg[INPUT_REG_MAX];
+    uint16_t capture_reg[ADC_CAPTURE_STATUS_REGS];
+    uint8_t shift_in[IO_SHIFT_CHIPS_MAX];
+    uint16_t counter_reg[IO_COUNTER_REG_COUNT];
+} process_image_in_t;
+
+typedef struct process_image_out_t {
+    uint64_t coils;
+    uint64_t discrete_in_latch_reset;
+    uint16_t holding_reg[HOLDING_REG_MAX];
+    uint16_t capture_control;
+    uint8_t shift_out[IO_SHIFT_CHIPS_MAX];
+    uint8_t counter_reset;
+} process_image_out_t;
+
+// diagnostic registers; published by IO task once per profiling window
+typedef struct process_image_diag_t {
+    uint16_t profile_reg[IO_PROFILE_REG_COUNT];
+} process_image_diag_t;
+
+// little endian encoding of image data into frames sent to clients (see io_publish.h, io_stream.h)
+static inline uint8_t* process_image_put_u16(uint8_t* buf, uint16_t value)
+{
+    buf[0] = value & 0xff;
+    buf[1] = value >> 8;
+    return buf + 2;
+}
+
+static inline uint8_t* process_image_put_u32(uint8_t* buf, uint32_t value)
+{
+    buf = process_image_put_u16(buf, value & 0xffff);
+    return process_image_put_u16(buf, value >> 16);
+}
+
+// bit per point, (count + 7) / 8 bytes
+static inline uint8_t* process_image_put_bits(uint8_t* buf, uint64_t bits, uint8_t count)
+{
+    for(int byte = 0; byte < (count + 7) / 8; byte++)
+    {
+        *buf++ = (bits >> (byte * 8)) & 0xff;
+    }
+    return buf;
+}
+
+// tasks notified (xTaskNotifyGive) after each published input image
+#define PROCESS_IMAGE_SUBSCRIBERS_MAX 4
+
+typedef struct process_image_t {
+    seqlock_t in_lock;
+    process_image_in_t in;
+    seqlock_t out_lock;
+    process_image_out_t out;
+    seqlock_t diag_lock;
+    process_image_diag_t diag;
+    TaskHandle_t subscribers[PROCESS_IMAGE_SUBSCRIBERS_MAX];
+    uint8_t subscriber_count;
+} process_image_t;
+
+void process_image_init(process_image_t* image)
+{
+    memset((void*)image, 0, sizeof(process_image_t));
+}
+
+// register task for notification on new input image; may be called while the IO task runs,
+// from one registering task at a time: the slot is filled before the count is released to the IO task
+esp_err_t process_image_subscribe(process_image_t* image, TaskHandle_t task)
+{
+    const uint8_t count = image->subscriber_count;
+    if(count >= PROCESS_IMAGE_SUBSCRIBERS_MAX)
+    {
+        printf("too many process image subscribers!\n");
+        return ESP_ERR_NO_MEM;
+    }
+    image->subscribers[count] = task;
+    __atomic_store_n(&(image->subscriber_count), count + 1, __ATOMIC_RELEASE);
+    return ESP_OK;
+}
+
+// IO task only
+void process_image_publish_in(process_image_t* image, const process_image_in_t* in)
+{
+    seqlock_write_begin(&(image->in_lock));
+    memcpy((void*)&(image->in), (const void*)in, sizeof(process_image_in_t));
+    seqlock_write_end(&(image->in_lock));
+
+    const uint8_t subscriber_count = __atomic_load_n(&(image->subscriber_count), __ATOMIC_ACQUIRE);
+    for(int i = 0; i < subscriber_count; i++)
+    {
+        xTaskNotifyGive(image->subscribers[i]);
+    }
+}
+
+// returns latest complete input image; retries while IO task is publishing
+void process_image_read_in(const process_image_t* image, process_image_in_t* in)
+{
+    uint32_t seq;
+    do
+    {
+        seq = seqlock_read_begin(&(image->in_lock));
+        memcpy((void*)in, (const void*)&(image->in), sizeof(process_image_in_t));
+    } while(seqlock_read_retry(&(image->in_lock), seq));
+}
+
+// single writer on Modbus side only
+void process_image_publish_out(process_image_t* image, const process_image_out_t* out)
+{
+    seqlock_write_begin(&(image->out_lock));
+    memcpy((void*)&(image->out), (const void*)out, sizeof(process_image_out_t));
+    seqlock_write_end(&(image->out_lock));
+}
+
+// single writer on Modbus side only; modify image->out in place between begin and end
+// the writer may read image->out at any time without locking
+static inline process_image_out_t* process_image_write_out_begin(process_image_t* image)
+{
+    seqlock_write_begin(&(image->out_lock));
+    return &(image->out);
+}
+
+static inline void process_image_write_out_end(process_image_t* image)
+{
+    seqlock_write_end(&(image->out_lock));
+}
+
+// IO task only
+void process_image_publish_diag(process_image_t* image, const process_image_diag_t* diag)
+{
+    seqlock_write_begin(&(image->diag_lock));
+    memcpy((void*)&(image->diag), (const void*)diag, sizeof(process_image_diag_t));
+    seqlock_write_end(&(image->diag_lock));
+}
+
+// reads diagnostics if they changed since *seq; updates *seq and returns true if diag was read
+bool process_image_read_diag(const process_image_t* image, process_image_diag_t* diag, uint32_t* seq)
+{
+    uint32_t read_seq;
+    do
+    {
+        read_seq = seqlock_read_begin(&(image->diag_lock));
+        if(read_seq == *seq) { return false; }
+        memcpy((void*)diag, (const void*)&(image->diag), sizeof(process_image_diag_t));
+    } while(seqlock_read_retry(&(image->diag_lock), read_seq));
+
+    *seq = read_seq;
+    return true;
+}
+
+// bounded read for IO task; out is left untouched if no consistent image could be read within retries
+bool process_image_read_out(const process_image_t* image, process_image_out_t* out, int retries)
+{
+    process_image_out_t read;
+    do
+    {
+        uint32_t seq = seqlock_read_begin(&(image->out_lock));
+        memcpy((void*)&read, (const void*)&(image->out), sizeof(process_image_out_t));
+        if(!seqlock_read_retry(&(image->out_lock), seq))
+        {
+            memcpy((void*)out, (const void*)&read, sizeof(process_image_out_t));
+            return true;
+        }
+    } while(retries-- > 0);
+
+    return false;
+}
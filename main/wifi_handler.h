@@ -6,6 +6,9 @@
 #include "esp_wifi.h"
 
 
+#define WIFI_SSID_LEN 33
+#define WIFI_PASS_LEN 65
+
 esp_netif_t* wifi_init_sta()
 {
     esp_netif_t* sta_netif = esp_netif_create_default_wifi_sta();
@@ -57,6 +60,7 @@ int wifi_connect_sta(char* wifi_ssid, char* wifi_pass)
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
 
     s_wifi_event_group = xEventGroupCreate();
+    wifi_retry = 0;
 
     esp_event_handler_instance_t instance_any_id;
     esp_event_handler_instance_t instance_got_ip;
@@ -97,6 +101,73 @@ int wifi_connect_sta(char* wifi_ssid, char* wifi_pass)
     return EXIT_SUCCESS;
 }
 
+// keeps the station connected for running IO, which must not be rebooted: wifi_connect_sta() is retried in the
+// background until connected, both after a failed connect at boot and after any later disconnect
+#define WIFI_RECONNECT_DELAY_MS 10000
+#define WIFI_RECONNECT_TASK_STACK_SIZE 4096
+#define WIFI_RECONNECT_TASK_PRIORITY (tskIDLE_PRIORITY + 1)
+#define WIFI_RECONNECT_TASK_CORE 0
+
+typedef struct wifi_reconnect_t {
+    char ssid[WIFI_SSID_LEN];
+    char pass[WIFI_PASS_LEN];
+    // set once connected; cleared by the first disconnect, which starts the reconnect task
+    bool connected;
+} wifi_reconnect_t;
+static wifi_reconnect_t wifi_reconnect;
+
+static void vWifiReconnectTask(void* params)
+{
+    wifi_reconnect_t* reconnect = (wifi_reconnect_t*) params;
+    while(wifi_connect_sta(reconnect->ssid, reconnect->pass))
+    {
+        vTaskDelay(WIFI_RECONNECT_DELAY_MS / portTICK_PERIOD_MS);
+        printf("retrying WiFi connection to '%s'\n", reconnect->ssid);
+    }
+    __atomic_store_n(&(reconnect->connected), true, __ATOMIC_RELEASE);
+
+    vTaskDelete(NULL);
+}
+
+static esp_err_t wifi_reconnect_start(wifi_reconnect_t* reconnect)
+{
+    TaskHandle_t xWifiReconnect = NULL;
+    xTaskCreatePinnedToCore(vWifiReconnectTask, "wifi_reconnect", WIFI_RECONNECT_TASK_STACK_SIZE, (void*) reconnect, WIFI_RECONNECT_TASK_PRIORITY, &xWifiReconnect, WIFI_RECONNECT_TASK_CORE);
+    return xWifiReconnect ? ESP_OK : ESP_FAIL;
+}
+
+// disconnects while connecting are handled by wifi_connect_sta()
+static void wifi_disconnect_handler(void* arg, esp_event_base_t event_base, int32_t event_id, void* event_data)
+{
+    wifi_reconnect_t* reconnect = (wifi_reconnect_t*) arg;
+    if(!__atomic_exchange_n(&(reconnect->connected), false, __ATOMIC_ACQ_REL)) { return; }
+    printf("WiFi disconnected; reconnecting in the background\n");
+    if(wifi_reconnect_start(reconnect)) { printf("starting WiFi reconnect failed!\n"); }
+}
+
+// connected: result of wifi_connect_sta(); reconnects right away if not
+esp_err_t wifi_keep_connected(const char* wifi_ssid, const char* wifi_pass, bool connected)
+{
+    wifi_reconnect_t* reconnect = &wifi_reconnect;
+    strncpy(reconnect->ssid, wifi_ssid, WIFI_SSID_LEN - 1);
+    strncpy(reconnect->pass, wifi_pass, WIFI_PASS_LEN - 1);
+
+    esp_event_handler_instance_t instance_disconnected;
+    esp_err_t err = esp_event_handler_instance_register(WIFI_EVENT,
+                                                        WIFI_EVENT_STA_DISCONNECTED,
+                                                        &wifi_disconnect_handler,
+                                                        (void*) reconnect,
+                                                        &instance_disconnected);
+    if(err) { return err; }
+
+    if(connected)
+    {
+        __atomic_store_n(&(reconnect->connected), true, __ATOMIC_RELEASE);
+        return ESP_OK;
+    }
+    return wifi_reconnect_start(reconnect);
+}
+
 #define WIFI_SCAN_LIST_SIZE 15
 void wifi_scan(uint16_t* num, wifi_ap_record_t* wifi_list)
 {
@@ -0,0 +1,694 @@
+// Modbus/TCP load generator and latency benchmark
+// drives a configurable mix of function codes against the coupler register map over many concurrent connections,
+// closed loop (a fixed number of requests in flight per connection) or open loop (fixed request rate)
+// open loop latency is measured from the scheduled send time, so a stalled server is not hidden by a stalled client
+// --serve starts a minimal stand-in server on localhost to run without hardware
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+// coupler register map (main/modbus_pdu.h)
+#define MB_COILS 64
+#define MB_DISCRETE_IN 64
+#define MB_HOLDING_REG 16
+#define MB_INPUT_REG 16
+
+#define MB_MBAP_HEADER_LEN 7
+#define MB_PDU_SIZE_MAX 253
+#define MB_ADU_LEN_MAX (MB_MBAP_HEADER_LEN - 1 + MB_PDU_SIZE_MAX)
+
+typedef std::chrono::steady_clock bench_clock;
+
+static uint16_t get_u16(const uint8_t* data)
+{
+    return (data[0] << 8) | data[1];
+}
+
+static void put_u16(uint8_t* data, uint16_t value)
+{
+    data[0] = value >> 8;
+    data[1] = value & 0xff;
+}
+
+static int64_t now_us()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(bench_clock::now().time_since_epoch()).count();
+}
+
+
+// request mix
+
+struct bench_op_t {
+    uint8_t function;
+    uint16_t address;
+    uint16_t count;
+    unsigned weight;
+};
+
+// default request per function code: whole area of the coupler map
+static bool bench_op_default(uint8_t function, bench_op_t* op)
+{
+    op->function = function;
+    op->address = 0;
+    switch(function)
+    {
+        case 1: op->count = MB_COILS; break;
+        case 2: op->count = MB_DISCRETE_IN; break;
+        case 3: op->count = MB_HOLDING_REG; break;
+        case 4: op->count = MB_INPUT_REG; break;
+        case 5: op->count = 1; break;
+        case 6: op->count = 1; break;
+        case 15: op->count = MB_COILS; break;
+        case 16: op->count = MB_HOLDING_REG; break;
+        default: return false;
+    }
+    return true;
+}
+
+// protocol limit of the quantity per function code; requests must fit one PDU
+static uint16_t bench_op_count_max(uint8_t function)
+{
+    switch(function)
+    {
+        case 1:
+        case 2: return 2000;
+        case 3:
+        case 4: return 125;
+        case 15: return 1968;
+        case 16: return 123;
+        default: return 1;
+    }
+}
+
+// "<fc>[@<address>[+<count>]][:<weight>],..." e.g. "3:4,4:4,16:1,1@0+8"
+static bool bench_mix_parse(const std::string& str, std::vector<bench_op_t>* mix)
+{
+    size_t pos = 0;
+    while(pos < str.size())
+    {
+        size_t end = str.find(',', pos);
+        if(end == std::string::npos) { end = str.size(); }
+        const std::string item = str.substr(pos, end - pos);
+        pos = end + 1;
+
+        char* next = nullptr;
+        bench_op_t op;
+        if(!bench_op_default(strtoul(item.c_str(), &next, 10), &op)) { return false; }
+        op.weight = 1;
+        if(*next == '@') { op.address = strtoul(next + 1, &next, 10); }
+        unsigned long count = op.count;
+        if(*next == '+') { count = strtoul(next + 1, &next, 10); }
+        if(*next == ':') { op.weight = strtoul(next + 1, &next, 10); }
+        if(*next != '\0' || !count || !op.weight) { return false; }
+        if(count > bench_op_count_max(op.function))
+        {
+            fprintf(stderr, "count %lu of FC%02u exceeds the protocol limit of %u\n", count, op.function, bench_op_count_max(op.function));
+            return false;
+        }
+        op.count = count;
+        mix->push_back(op);
+    }
+    return !mix->empty();
+}
+
+// encode request PDU; written values change with tid
+static uint16_t bench_op_encode(const bench_op_t& op, uint16_t tid, uint8_t* pdu)
+{
+    pdu[0] = op.function;
+    put_u16(pdu + 1, op.address);
+    switch(op.function)
+    {
+        case 5:
+            put_u16(pdu + 3, (tid & 0x01) ? 0xff00 : 0x0000);
+            return 5;
+        case 6:
+            put_u16(pdu + 3, tid);
+            return 5;
+        case 15:
+        {
+            const uint8_t bytes = (op.count + 7) / 8;
+            put_u16(pdu + 3, op.count);
+            pdu[5] = bytes;
+            for(int i = 0; i < bytes; i++) { pdu[6 + i] = tid + i; }
+            return 6 + bytes;
+        }
+        case 16:
+            put_u16(pdu + 3, op.count);
+            pdu[5] = op.count * 2;
+            for(int i = 0; i < op.count; i++) { put_u16(pdu + 6 + i * 2, tid + i); }
+            return 6 + op.count * 2;
+        default:
+            put_u16(pdu + 3, op.count);
+            return 5;
+    }
+}
+
+
+// benchmark configuration and results
+
+struct bench_config_t {
+    std::string host = "127.0.0.1";
+    uint16_t port = 502;
+    uint8_t unit = 1;
+    int connections = 1;
+    int pipeline = 1; // requests in flight per connection
+    double rate = 0; // total requests/s; 0: closed loop
+    double duration_s = 10;
+    double warmup_s = 1;
+    std::vector<bench_op_t> mix;
+    std::string json_path;
+    bool serve = false;
+};
+
+struct bench_sample_t {
+    uint8_t function;
+    uint32_t latency_us;
+};
+
+struct bench_worker_t {
+    std::vector<bench_sample_t> samples;
+    uint64_t exceptions = 0;
+    uint64_t timeouts = 0;
+    uint64_t bytes_in = 0;
+    uint64_t bytes_out = 0;
+    std::string error;
+};
+
+static int bench_connect(const bench_config_t& config, std::string* error)
+{
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo* addr = nullptr;
+    const std::string port = std::to_string(config.port);
+    if(getaddrinfo(config.host.c_str(), port.c_str(), &hints, &addr) || !addr)
+    {
+        *error = "resolving " + config.host + " failed";
+        return -1;
+    }
+
+    const int sock = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+    if(sock < 0 || connect(sock, addr->ai_addr, addr->ai_addrlen))
+    {
+        *error = std::string("connecting failed: ") + strerror(errno);
+        freeaddrinfo(addr);
+        if(sock >= 0) { close(sock); }
+        return -1;
+    }
+    freeaddrinfo(addr);
+
+    const int nodelay = 1;
+    setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    return sock;
+}
+
+// one connection; requests in flight are tracked by transaction id
+static void bench_worker_run(const bench_config_t& config, int index, int64_t start_us, bench_worker_t* result)
+{
+    const int sock = bench_connect(config, &result->error);
+    if(sock < 0) { return; }
+
+    std::mt19937 rng(index + 1);
+    unsigned total_weight = 0;
+    for(const bench_op_t& op : config.mix) { total_weight += op.weight; }
+
+    struct in_flight_t {
+        bool active;
+        uint8_t function;
+        int64_t sent_us;
+    };
+    std::vector<in_flight_t> in_flight(65536);
+    int in_flight_count = 0;
+    uint16_t tid = 0;
+
+    // open loop: connections are staggered over one interval
+    const double interval_us = config.rate > 0 ? 1e6 * config.connections / config.rate : 0;
+    int64_t next_us = start_us + (int64_t)(interval_us * index / config.connections);
+    uint64_t scheduled = 0;
+
+    const int64_t measure_us = start_us + (int64_t)(config.warmup_s * 1e6);
+    const int64_t end_us = measure_us + (int64_t)(config.duration_s * 1e6);
+    const int64_t drain_us = end_us + 1000000;
+
+    std::vector<uint8_t> tx;
+    std::vector<uint8_t> rx(64 * MB_ADU_LEN_MAX);
+    size_t rx_len = 0;
+
+    while(true)
+    {
+        int64_t now = now_us();
+        if(now >= drain_us || (now >= end_us && !in_flight_count)) { break; }
+
+        // send
+        tx.clear();
+        while(now < end_us && in_flight_count < config.pipeline && (!interval_us || now >= next_us))
+        {
+            unsigned pick = std::uniform_int_distribution<unsigned>(0, total_weight - 1)(rng);
+            const bench_op_t* op = &config.mix[0];
+            for(const bench_op_t& candidate : config.mix)
+            {
+                if(pick < candidate.weight) { op = &candidate; break; }
+                pick -= candidate.weight;
+            }
+
+            tid++;
+            uint8_t adu[MB_ADU_LEN_MAX];
+            const uint16_t pdu_len = bench_op_encode(*op, tid, adu + MB_MBAP_HEADER_LEN);
+            put_u16(adu, tid);
+            put_u16(adu + 2, 0);
+            put_u16(adu + 4, pdu_len + 1);
+            adu[6] = config.unit;
+            tx.insert(tx.end(), adu, adu + MB_MBAP_HEADER_LEN + pdu_len);
+
+            in_flight[tid] = { true, op->function, interval_us ? next_us : now };
+            in_flight_count++;
+            if(interval_us) { next_us = start_us + (int64_t)(interval_us * (++scheduled + (double)index / config.connections)); }
+        }
+        if(!tx.empty())
+        {
+            size_t sent = 0;
+            while(sent < tx.size())
+            {
+                const ssize_t n = send(sock, tx.data() + sent, tx.size() - sent, MSG_NOSIGNAL);
+                if(n <= 0)
+                {
+                    result->error = std::string("send failed: ") + strerror(errno);
+                    close(sock);
+                    return;
+                }
+                sent += n;
+            }
+            result->bytes_out += sent;
+        }
+
+        // receive until next send is due
+        int64_t timeout_us = 100000;
+        // at least a few us; waiting with a zero timeout would spin
+        if(interval_us && in_flight_count < config.pipeline && now < end_us) { timeout_us = std::max<int64_t>(10, next_us - now); }
+        const timespec timeout = { (time_t)(timeout_us / 1000000), (long)(timeout_us % 1000000) * 1000 };
+        pollfd pfd = { sock, POLLIN, 0 };
+        if(ppoll(&pfd, 1, &timeout, nullptr) <= 0) { continue; }
+
+        const ssize_t n = recv(sock, rx.data() + rx_len, rx.size() - rx_len, 0);
+        if(n <= 0)
+        {
+            result->error = n ? std::string("recv failed: ") + strerror(errno) : "connection closed by server";
+            close(sock);
+            return;
+        }
+        result->bytes_in += n;
+        rx_len += n;
+        now = now_us();
+
+        size_t pos = 0;
+        while(rx_len - pos >= MB_MBAP_HEADER_LEN)
+        {
+            const uint8_t* adu = rx.data() + pos;
+            const uint16_t length = get_u16(adu + 4);
+            if(length < 2 || length > MB_PDU_SIZE_MAX + 1)
+            {
+                result->error = "invalid response length";
+                close(sock);
+                return;
+            }
+            if(rx_len - pos < (size_t)MB_MBAP_HEADER_LEN - 1 + length) { break; }
+            pos += MB_MBAP_HEADER_LEN - 1 + length;
+
+            in_flight_t* request = &in_flight[get_u16(adu)];
+            if(!request->active) { continue; }
+            request->active = false;
+            in_flight_count--;
+
+            if(adu[MB_MBAP_HEADER_LEN] & 0x80) { result->exceptions++; }
+            if(request->sent_us >= measure_us && request->sent_us < end_us)
+            {
+                result->samples.push_back({ request->function, (uint32_t)(now - request->sent_us) });
+            }
+        }
+        memmove(rx.data(), rx.data() + pos, rx_len - pos);
+        rx_len -= pos;
+    }
+
+    result->timeouts = in_flight_count;
+    close(sock);
+}
+
+
+// statistics
+
+struct bench_summary_t {
+    uint64_t count = 0;
+    double mean_us = 0;
+    uint32_t p50_us = 0;
+    uint32_t p99_us = 0;
+    uint32_t p999_us = 0;
+    uint32_t max_us = 0;
+};
+
+static bench_summary_t bench_summarize(std::vector<uint32_t>& latencies)
+{
+    bench_summary_t summary;
+    summary.count = latencies.size();
+    if(latencies.empty()) { return summary; }
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&](double p) { return latencies[std::min(latencies.size() - 1, (size_t)(p * latencies.size()))]; };
+    uint64_t sum = 0;
+    for(uint32_t latency : latencies) { sum += latency; }
+    summary.mean_us = (double)sum / latencies.size();
+    summary.p50_us = percentile(0.50);
+    summary.p99_us = percentile(0.99);
+    summary.p999_us = percentile(0.999);
+    summary.max_us = latencies.back();
+    return summary;
+}
+
+static void print_summary(const char* name, const bench_summary_t& summary, double duration_s)
+{
+    printf("%-6s %10llu %10.1f %9.1f %8u %8u %8u %8u\n", name, (unsigned long long)summary.count, summary.count / duration_s,
+        summary.mean_us, summary.p50_us, summary.p99_us, summary.p999_us, summary.max_us);
+}
+
+static void json_summary(FILE* file, const bench_summary_t& summary, double duration_s)
+{
+    fprintf(file, "{ \"requests\": %llu, \"throughput\": %.1f, \"mean_us\": %.1f, \"p50_us\": %u, \"p99_us\": %u, \"p999_us\": %u, \"max_us\": %u }",
+        (unsigned long long)summary.count, summary.count / duration_s, summary.mean_us, summary.p50_us, summary.p99_us, summary.p999_us, summary.max_us);
+}
+
+
+// stand-in server: coupler register map on plain arrays, one thread per connection
+
+struct stand_in_t {
+    std::atomic<uint64_t> coils{0};
+    std::atomic<uint64_t> discrete_in{0};
+    std::atomic<uint16_t> holding_reg[MB_HOLDING_REG];
+    std::atomic<uint16_t> input_reg[MB_INPUT_REG];
+};
+static stand_in_t stand_in;
+
+static uint16_t stand_in_process(const uint8_t* req, uint16_t req_len, uint8_t* resp)
+{
+    const uint8_t function = req[0];
+    const uint16_t address = req_len >= 3 ? get_u16(req + 1) : 0;
+    const uint16_t count = req_len >= 5 ? get_u16(req + 3) : 0;
+    uint8_t ex = 0;
+    uint16_t len = 0;
+
+    resp[0] = function;
+    switch(function)
+    {
+        case 1:
+        case 2:
+        {
+            const uint64_t bits = function == 1 ? stand_in.coils.load() : stand_in.discrete_in.load();
+            if(!count || address + count > 64) { ex = 2; break; }
+            resp[1] = (count + 7) / 8;
+            memset(resp + 2, 0, resp[1]);
+            for(int i = 0; i < count; i++) { resp[2 + i / 8] |= ((bits >> (address + i)) & 0x01) << (i & 0x07); }
+            len = 2 + resp[1];
+            break;
+        }
+        case 3:
+        case 4:
+        {
+            std::atomic<uint16_t>* regs = function == 3 ? stand_in.holding_reg : stand_in.input_reg;
+            if(!count || address + count > (function == 3 ? MB_HOLDING_REG : MB_INPUT_REG)) { ex = 2; break; }
+            resp[1] = count * 2;
+            for(int i = 0; i < count; i++) { put_u16(resp + 2 + i * 2, regs[address + i]); }
+            len = 2 + resp[1];
+            break;
+        }
+        case 5:
+            if(address >= 64) { ex = 2; break; }
+            if(count == 0xff00) { stand_in.coils |= (uint64_t)1 << address; }
+            else { stand_in.coils &= ~((uint64_t)1 << address); }
+            memcpy(resp + 1, req + 1, 4);
+            len = 5;
+            break;
+        case 6:
+            if(address >= MB_HOLDING_REG) { ex = 2; break; }
+            stand_in.holding_reg[address] = count;
+            memcpy(resp + 1, req + 1, 4);
+            len = 5;
+            break;
+        case 15:
+        {
+            if(!count || address + count > 64 || req_len < 6 + (count + 7) / 8) { ex = 2; break; }
+            uint64_t coils = stand_in.coils;
+            for(int i = 0; i < count; i++)
+            {
+                const uint64_t mask = (uint64_t)1 << (address + i);
+                coils = ((req[6 + i / 8] >> (i & 0x07)) & 0x01) ? coils | mask : coils & ~mask;
+            }
+            stand_in.coils = coils;
+            memcpy(resp + 1, req + 1, 4);
+            len = 5;
+            break;
+        }
+        case 16:
+            if(!count || address + count > MB_HOLDING_REG || req_len < 6 + count * 2) { ex = 2; break; }
+            for(int i = 0; i < count; i++) { stand_in.holding_reg[address + i] = get_u16(req + 6 + i * 2); }
+            memcpy(resp + 1, req + 1, 4);
+            len = 5;
+            break;
+        default:
+            ex = 1;
+            break;
+    }
+
+    if(ex)
+    {
+        resp[0] = function | 0x80;
+        resp[1] = ex;
+        len = 2;
+    }
+    return len;
+}
+
+static void stand_in_connection(int sock)
+{
+    std::vector<uint8_t> rx(16 * MB_ADU_LEN_MAX);
+    std::vector<uint8_t> tx(16 * MB_ADU_LEN_MAX);
+    size_t rx_len = 0;
+    while(true)
+    {
+        const ssize_t n = recv(sock, rx.data() + rx_len, rx.size() - rx_len, 0);
+        if(n <= 0) { break; }
+        rx_len += n;
+
+        size_t pos = 0;
+        size_t tx_len = 0;
+        while(rx_len - pos >= MB_MBAP_HEADER_LEN && tx.size() - tx_len >= MB_ADU_LEN_MAX)
+        {
+            const uint8_t* adu = rx.data() + pos;
+            const uint16_t length = get_u16(adu + 4);
+            if(length < 2 || length > MB_PDU_SIZE_MAX + 1) { close(sock); return; }
+            if(rx_len - pos < (size_t)MB_MBAP_HEADER_LEN - 1 + length) { break; }
+
+            uint8_t* resp = tx.data() + tx_len;
+            const uint16_t pdu_len = stand_in_process(adu + MB_MBAP_HEADER_LEN, length - 1, resp + MB_MBAP_HEADER_LEN);
+            memcpy(resp, adu, 4);
+            put_u16(resp + 4, pdu_len + 1);
+            resp[6] = adu[6];
+            tx_len += MB_MBAP_HEADER_LEN + pdu_len;
+            pos += MB_MBAP_HEADER_LEN - 1 + length;
+        }
+        memmove(rx.data(), rx.data() + pos, rx_len - pos);
+        rx_len -= pos;
+
+        if(tx_len && send(sock, tx.data(), tx_len, MSG_NOSIGNAL) != (ssize_t)tx_len) { break; }
+    }
+    close(sock);
+}
+
+static bool stand_in_start(uint16_t port)
+{
+    for(int i = 0; i < MB_INPUT_REG; i++) { stand_in.input_reg[i] = i * 100; }
+    for(int i = 0; i < MB_HOLDING_REG; i++) { stand_in.holding_reg[i] = 0; }
+    stand_in.discrete_in = 0xa5a5a5a5a5a5a5a5ull;
+
+    const int sock = socket(AF_INET, SOCK_STREAM, 0);
+    const int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if(sock < 0 || bind(sock, (sockaddr*)&addr, sizeof(addr)) || listen(sock, 64))
+    {
+        fprintf(stderr, "starting stand-in server on port %u failed: %s\n", port, strerror(errno));
+        return false;
+    }
+
+    std::thread([sock]() {
+        while(true)
+        {
+            const int client = accept(sock, nullptr, nullptr);
+            if(client < 0) { continue; }
+            const int nodelay = 1;
+            setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+            std::thread(stand_in_connection, client).detach();
+        }
+    }).detach();
+    printf("stand-in server on 127.0.0.1:%u\n", port);
+    return true;
+}
+
+
+static void usage(const char* name)
+{
+    fprintf(stderr,
+        "usage: %s [options]\n"
+        "  --host <host>          coupler address (default 127.0.0.1)\n"
+        "  --port <port>          Modbus/TCP port (default 502, 1502 with --serve)\n"
+        "  --unit <id>            unit id (default 1)\n"
+        "  --connections <n>      concurrent connections (default 1)\n"
+        "  --pipeline <n>         requests in flight per connection (default 1)\n"
+        "  --rate <req/s>         total request rate; 0 runs closed loop (default 0)\n"
+        "  --duration <s>         measurement duration (default 10)\n"
+        "  --warmup <s>           warm-up before measurement (default 1)\n"
+        "  --mix <ops>            request mix \"<fc>[@<address>[+<count>]][:<weight>],...\" of FC01, 02, 03, 04, 05, 06, 15, 16\n"
+        "                         (default \"1,2,3,4\", whole areas of the coupler map)\n"
+        "  --json <file>          write results as JSON\n"
+        "  --serve                run against a stand-in server on localhost\n",
+        name);
+}
+
+int main(int argc, char** argv)
+{
+    bench_config_t config;
+    bool port_set = false;
+    std::string mix = "1,2,3,4";
+
+    for(int i = 1; i < argc; i++)
+    {
+        const std::string arg = argv[i];
+        const bool has_value = i + 1 < argc;
+        if(arg == "--serve") { config.serve = true; }
+        else if(arg == "--host" && has_value) { config.host = argv[++i]; }
+        else if(arg == "--port" && has_value) { config.port = atoi(argv[++i]); port_set = true; }
+        else if(arg == "--unit" && has_value) { config.unit = atoi(argv[++i]); }
+        else if(arg == "--connections" && has_value) { config.connections = atoi(argv[++i]); }
+        else if(arg == "--pipeline" && has_value) { config.pipeline = atoi(argv[++i]); }
+        else if(arg == "--rate" && has_value) { config.rate = atof(argv[++i]); }
+        else if(arg == "--duration" && has_value) { config.duration_s = atof(argv[++i]); }
+        else if(arg == "--warmup" && has_value) { config.warmup_s = atof(argv[++i]); }
+        else if(arg == "--mix" && has_value) { mix = argv[++i]; }
+        else if(arg == "--json" && has_value) { config.json_path = argv[++i]; }
+        else { usage(argv[0]); return 2; }
+    }
+
+    if(!bench_mix_parse(mix, &config.mix))
+    {
+        fprintf(stderr, "invalid request mix \"%s\"\n", mix.c_str());
+        return 2;
+    }
+    if(config.connections < 1 || config.pipeline < 1 || config.pipeline > 32768 || config.rate < 0 || config.duration_s <= 0 || config.warmup_s < 0)
+    {
+        usage(argv[0]);
+        return 2;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    if(config.serve)
+    {
+        if(!port_set) { config.port = 1502; }
+        config.host = "127.0.0.1";
+        if(!stand_in_start(config.port)) { return 1; }
+    }
+
+    printf("%s:%u, %i connections, pipeline %i, %s, mix %s, %.1fs + %.1fs warm-up\n", config.host.c_str(), config.port,
+        config.connections, config.pipeline, config.rate > 0 ? (std::to_string((int)config.rate) + " req/s").c_str() : "closed loop",
+        mix.c_str(), config.duration_s, config.warmup_s);
+
+    std::vector<bench_worker_t> workers(config.connections);
+    std::vector<std::thread> threads;
+    const int64_t start_us = now_us() + 100000;
+    for(int i = 0; i < config.connections; i++)
+    {
+        threads.emplace_back(bench_worker_run, std::cref(config), i, start_us, &workers[i]);
+    }
+    for(std::thread& thread : threads) { thread.join(); }
+
+    // merge
+    std::vector<uint32_t> all;
+    std::vector<std::vector<uint32_t>> per_function(256);
+    uint64_t exceptions = 0, timeouts = 0, bytes_in = 0, bytes_out = 0;
+    int failed = 0;
+    for(const bench_worker_t& worker : workers)
+    {
+        if(!worker.error.empty())
+        {
+            fprintf(stderr, "connection failed: %s\n", worker.error.c_str());
+            failed++;
+        }
+        for(const bench_sample_t& sample : worker.samples)
+        {
+            all.push_back(sample.latency_us);
+            per_function[sample.function].push_back(sample.latency_us);
+        }
+        exceptions += worker.exceptions;
+        timeouts += worker.timeouts;
+        bytes_in += worker.bytes_in;
+        bytes_out += worker.bytes_out;
+    }
+
+    printf("%-6s %10s %10s %9s %8s %8s %8s %8s\n", "fc", "requests", "req/s", "mean us", "p50 us", "p99 us", "p999 us", "max us");
+    std::vector<std::pair<int, bench_summary_t>> function_summaries;
+    for(int function = 0; function < 256; function++)
+    {
+        if(per_function[function].empty()) { continue; }
+        function_summaries.push_back({ function, bench_summarize(per_function[function]) });
+        print_summary(("FC" + std::to_string(function)).c_str(), function_summaries.back().second, config.duration_s);
+    }
+    const bench_summary_t total = bench_summarize(all);
+    print_summary("total", total, config.duration_s);
+    printf("exceptions: %llu, unanswered: %llu, failed connections: %i, bytes out/in: %llu/%llu\n", (unsigned long long)exceptions,
+        (unsigned long long)timeouts, failed, (unsigned long long)bytes_out, (unsigned long long)bytes_in);
+
+    if(!config.json_path.empty())
+    {
+        FILE* file = fopen(config.json_path.c_str(), "w");
+        if(!file)
+        {
+            fprintf(stderr, "writing %s failed\n", config.json_path.c_str());
+            return 1;
+        }
+        fprintf(file, "{\n  \"host\": \"%s\", \"port\": %u, \"connections\": %i, \"pipeline\": %i, \"rate\": %.1f, \"duration_s\": %.1f, \"mix\": \"%s\",\n",
+            config.host.c_str(), config.port, config.connections, config.pipeline, config.rate, config.duration_s, mix.c_str());
+        fprintf(file, "  \"exceptions\": %llu, \"unanswered\": %llu, \"failed_connections\": %i, \"bytes_out\": %llu, \"bytes_in\": %llu,\n",
+            (unsigned long long)exceptions, (unsigned long long)timeouts, failed, (unsigned long long)bytes_out, (unsigned long long)bytes_in);
+        fprintf(file, "  \"total\": ");
+        json_summary(file, total, config.duration_s);
+        fprintf(file, ",\n  \"functions\": {");
+        for(size_t i = 0; i < function_summaries.size(); i++)
+        {
+            fprintf(file, "%s\n    \"%i\": ", i ? "," : "", function_summaries[i].first);
+            json_summary(file, function_summaries[i].second, config.duration_s);
+        }
+        fprintf(file, "\n  }\n}\n");
+        fclose(file);
+    }
+
+    return failed || timeouts ? 1 : 0;
+}